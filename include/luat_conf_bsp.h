@@ -213,7 +213,8 @@
 
 
 // 注意这里是 LUAT_USE_WINDOWS
-#ifdef _WIN32
+// Linux下默认只用libuv适配器, 编译时设置环境变量LUAT_USE_LWIP=y才带上lwip, NO_SYS模式由libuv的事件循环驱动
+#if defined(_WIN32) || defined(LUAT_USE_LWIP_LINUX)
 #define LUAT_USE_LWIP 1
 #define LUAT_USE_ULWIP 1
 #define LUAT_USE_DNS 1
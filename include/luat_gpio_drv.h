@@ -1,8 +1,9 @@
-#ifndef LUAT_UART_DRV_H
-#define LUAT_UART_DRV_H
+#ifndef LUAT_GPIO_DRV_H
+#define LUAT_GPIO_DRV_H
 
 #include "luat_base.h"
 #include "luat_gpio.h"
+#include "luat_hist_pc.h"
 
 typedef int (*gpio_setup)(void* userdata, luat_gpio_t* uart);
 typedef int (*gpio_write)(void* userdata, int pin, int level);
@@ -17,5 +18,37 @@ typedef struct luat_gpio_drv_opts
     gpio_close close;
 }luat_gpio_drv_opts_t;
 
-#endif
+// 注入输入脚的电平, 中断脚按触发方式产生中断, 经过msgbus回到lua
+// ts_ns是边沿发生的时间(uv_hrtime), 0表示现在, 用于统计从边沿到lua回调的延迟
+int luat_gpio_pc_inject(int pin, int level, uint64_t ts_ns);
+
+// 在输入脚上按每秒hz个脉冲产生count个脉冲(一个上升沿+一个下降沿), hz为0时立即全部注入, count为0时停止
+// 每个边沿的时间戳是它按频率应该出现的时间, 事件循环赶不上时延迟会体现在统计里
+int luat_gpio_pc_pulse(int pin, uint32_t count, uint32_t hz);
+// 还没产生的脉冲数
+uint32_t luat_gpio_pc_pulse_left(int pin);
+
+typedef struct luat_gpio_irq_stat
+{
+    uint64_t edges;         // 注入的电平变化次数
+    uint64_t fired;         // 产生的中断数
+    uint64_t handled;       // lua回调已经执行的中断数
+    uint64_t lost;          // 排队的中断超过上限(或者msgbus放不下)丢弃的中断数
+    uint32_t pending;       // 已经放进msgbus, 还没执行回调的中断数
+    uint32_t pending_max;   // pending的最大值
+    uint32_t depth;         // 排队上限, 0表示不限制
+    luat_hist_t latency_ns; // 边沿到lua回调开始执行的延迟, 纳秒
+    luat_hist_t cb_ns;      // lua回调本身的耗时, 纳秒
+}luat_gpio_irq_stat_t;
 
+const luat_gpio_irq_stat_t* luat_gpio_irq_stat(void);
+void luat_gpio_irq_stat_reset(void);
+// 排队的中断数上限, 模拟真实模组上有限的消息队列, 超过之后的边沿算作丢失
+void luat_gpio_irq_depth(uint32_t depth);
+
+// UDP驱动, 监听127.0.0.1:port接收"pin,level"文本, 输出脚的电平变化发往port+10000
+int luat_gpio_udp_init(int port);
+
+int luaopen_pcgpio(lua_State *L);
+
+#endif
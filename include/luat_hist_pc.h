@@ -0,0 +1,59 @@
+#ifndef LUAT_HIST_PC_H
+#define LUAT_HIST_PC_H
+
+#include "luat_base.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// 对数-线性分桶的直方图(HDR Histogram的简化版)
+// 每个2的幂区间再等分成(1 << LUAT_HIST_SUB_BITS)个桶, 相对误差不超过12.5%
+// 记录一次只需要几条整数指令, 可以常开
+
+#define LUAT_HIST_SUB_BITS 3
+#define LUAT_HIST_SUB_COUNT (1 << LUAT_HIST_SUB_BITS)
+#define LUAT_HIST_BUCKETS ((32 - LUAT_HIST_SUB_BITS + 1) * LUAT_HIST_SUB_COUNT)
+
+typedef struct luat_hist
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t buckets[LUAT_HIST_BUCKETS];
+}luat_hist_t;
+
+static inline uint32_t luat_hist_index(uint32_t value) {
+    if (value < LUAT_HIST_SUB_COUNT)
+        return value;
+#ifdef _MSC_VER
+    unsigned long msb;
+    _BitScanReverse(&msb, value);
+#else
+    uint32_t msb = 31 - __builtin_clz(value);
+#endif
+    uint32_t sub = (value >> (msb - LUAT_HIST_SUB_BITS)) & (LUAT_HIST_SUB_COUNT - 1);
+    return (msb - LUAT_HIST_SUB_BITS + 1) * LUAT_HIST_SUB_COUNT + sub;
+}
+
+static inline void luat_hist_record(luat_hist_t* h, uint32_t value) {
+    if (h->count == 0 || value < h->min)
+        h->min = value;
+    if (value > h->max)
+        h->max = value;
+    h->count++;
+    h->sum += value;
+    h->buckets[luat_hist_index(value)]++;
+}
+
+void luat_hist_reset(luat_hist_t* h);
+// 百分位数, p取值0~100, 返回所在桶的上界
+uint32_t luat_hist_percentile(const luat_hist_t* h, double p);
+void luat_hist_merge(luat_hist_t* dst, const luat_hist_t* src);
+// 压入一个table, 包括count/min/max/avg/p50/p90/p99/p999
+void luat_hist_push(lua_State* L, const luat_hist_t* h);
+// 格式化为"count/avg/p50/p99/max"形式的简短文本, 用于日志
+int luat_hist_sprint(char* buf, size_t len, const luat_hist_t* h);
+
+#endif
@@ -10,7 +10,7 @@ typedef struct luat_mock_ctx
     char key[128];
     char* req_data;
     size_t req_len;
-    char* resp_data;
+    char* resp_data; // 由mock层管理, 不需要释放, 下一次luat_mock_call之前有效
     size_t resp_len;
     int resp_type;
     int resp_code;
@@ -18,4 +18,8 @@ typedef struct luat_mock_ctx
 
 int luat_mock_call(luat_mock_ctx_t* ctx);
 
+// 声明式的mock表, 常量/序列/范围/波形直接在C里应答, 没有匹配的key返回MOCK_DISABLED
+int luat_mock_table_load(const char* path);
+int luat_mock_table_call(luat_mock_ctx_t* ctx);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,377 @@
+#ifndef LUAT_NETWORK_PC_H
+#define LUAT_NETWORK_PC_H
+
+#include "luat_base.h"
+#include "luat_hist_pc.h"
+
+// PC端网络适配相关的内部接口, 供libuv适配器与pcnet库共用
+
+//---------------------------------------
+// DNS缓存
+//---------------------------------------
+
+// 单个域名最多缓存的IP数量
+#define LUAT_DNS_CACHE_MAX_ADDR 8
+// 最多缓存的域名数量
+#define LUAT_DNS_CACHE_SIZE     64
+
+typedef struct luat_dns_addr
+{
+    int family;         // AF_INET 或 AF_INET6
+    uint8_t addr[16];   // 网络字节序, IPv4只用前4字节
+}luat_dns_addr_t;
+
+typedef struct luat_dns_cache_stat
+{
+    uint32_t lookups;   // 总查询次数
+    uint32_t hits;      // 命中正缓存
+    uint32_t neg_hits;  // 命中负缓存(解析失败的记录)
+    uint32_t misses;    // 未命中, 需要发起解析
+    uint32_t coalesced; // 已有相同查询进行中, 合并等待
+    uint32_t resolves;  // 实际发起的uv_getaddrinfo次数
+    uint32_t failures;  // 解析失败次数
+    uint32_t evictions; // 因缓存满而淘汰的记录数
+    uint32_t entries;   // 当前缓存的域名数量
+}luat_dns_cache_stat_t;
+
+// 解析结果回调, count为0代表解析失败, ttl为剩余有效期(秒)
+typedef void (*luat_dns_cache_cb)(const luat_dns_addr_t* addrs, size_t count, uint32_t ttl, void* userdata);
+
+int luat_dns_cache_query(const char* domain, size_t len, int family, luat_dns_cache_cb cb, void* userdata);
+void luat_dns_cache_clear(void);
+void luat_dns_cache_set_ttl(uint32_t ttl, uint32_t neg_ttl);
+void luat_dns_cache_get_stat(luat_dns_cache_stat_t* stat);
+// 查找与addr同属一个域名的, 指定地址族的缓存地址, 供Happy Eyeballs竞速使用
+size_t luat_dns_cache_peers(const luat_dns_addr_t* addr, int family, luat_dns_addr_t* out, size_t max);
+
+//---------------------------------------
+// libuv适配器的socket信息
+//---------------------------------------
+
+typedef struct luat_libuv_conn_info
+{
+    int state;
+    int is_tcp;
+    int family;          // 实际建立连接所用的地址族
+    uint32_t attempts;   // 本次连接尝试过的地址数量
+    uint64_t connect_ns; // 从发起连接到连接成功的耗时, 纳秒, 0代表尚未连接成功
+}luat_libuv_conn_info_t;
+
+int luat_libuv_conn_info(int socket_id, luat_libuv_conn_info_t* info);
+
+// socket选项, 取值-1代表使用系统默认值
+enum
+{
+    LUAT_SOCKOPT_NODELAY,   // TCP_NODELAY, 0/1
+    LUAT_SOCKOPT_KEEPALIVE, // SO_KEEPALIVE, 0/1
+    LUAT_SOCKOPT_KEEPIDLE,  // 空闲多久开始发探测包, 秒
+    LUAT_SOCKOPT_KEEPINTVL, // 探测包间隔, 秒
+    LUAT_SOCKOPT_KEEPCNT,   // 探测包个数
+    LUAT_SOCKOPT_SNDBUF,    // SO_SNDBUF, 字节
+    LUAT_SOCKOPT_RCVBUF,    // SO_RCVBUF, 字节
+    LUAT_SOCKOPT_QTY
+};
+
+// socket_id为-1时设置/读取的是新建socket的默认值
+int luat_libuv_sockopt_set(int socket_id, int opt, int value);
+// 已经有fd时读取的是系统里实际生效的值, 否则是设置的值
+int luat_libuv_sockopt_get(int socket_id, int opt, int* value);
+// Happy Eyeballs(RFC 8305)配置, delay_ms为相邻两次连接尝试的间隔
+void luat_libuv_he_config(int enable, uint32_t delay_ms);
+
+// socket统计信息, 创建socket时清零
+#define LUAT_SOCK_TIMELINE_SIZE 8
+
+typedef struct luat_libuv_sock_stat
+{
+    uint64_t tx_bytes;      // on_sent确认的字节数
+    uint64_t rx_bytes;
+    uint32_t tx_count;
+    uint32_t rx_count;
+    uint32_t tx_err;
+    uint32_t queued_bytes;  // 已提交uv_write但还没有on_sent的字节数
+    uint32_t transitions;   // 状态变化次数
+    struct {
+        uint8_t state;
+        uint32_t ms;        // 距离创建socket的时间
+    }timeline[LUAT_SOCK_TIMELINE_SIZE]; // 最近的状态变化, 环形记录
+    luat_hist_t connect_us; // 连接耗时, 微秒
+    luat_hist_t dns_us;     // 域名解析耗时, 微秒
+    luat_hist_t write_us;   // uv_write到on_sent的耗时, 微秒
+    luat_hist_t rx_chunk;   // 每次收到的数据长度, 字节
+    luat_hist_t queued;     // 每次提交发送后的排队字节数
+}luat_libuv_sock_stat_t;
+
+// socket_id为-1时返回的是全部socket的累计值
+const luat_libuv_sock_stat_t* luat_libuv_sock_stat(int socket_id);
+void luat_libuv_sock_stat_reset(int socket_id);
+const char* luat_libuv_state_name(int state);
+void luat_libuv_stat_dump(void);
+// 周期性打印统计信息, 0为关闭
+void luat_libuv_stat_dump_interval(uint32_t ms);
+
+//---------------------------------------
+// 进程内虚拟网络(vnet)
+//---------------------------------------
+
+// vnet注册在USB网卡的位置上, socket.create时传入这个适配器编号即可使用
+#define LUAT_VNET_ADAPTER_INDEX NW_ADAPTER_INDEX_USB
+
+enum
+{
+    LUAT_VNET_ECHO,     // 原样返回收到的数据
+    LUAT_VNET_DISCARD,  // 丢弃收到的数据
+    LUAT_VNET_SOURCE,   // 连接建立后持续发送数据
+    LUAT_VNET_CUSTOM,   // 自定义处理函数
+};
+
+enum
+{
+    LUAT_VNET_EV_CONNECT,
+    LUAT_VNET_EV_DATA,
+    LUAT_VNET_EV_CLOSE,
+};
+
+typedef struct luat_vnet_link
+{
+    uint32_t latency_ms;    // 单向延时
+    uint32_t bandwidth;     // 单向带宽, 字节/秒, 0为不限速
+    uint32_t loss;          // 丢包率, 万分比
+}luat_vnet_link_t;
+
+typedef struct luat_vnet_endpoint_stat
+{
+    uint32_t conns;
+    uint64_t rx_bytes;      // 端点收到的字节数
+    uint64_t tx_bytes;      // 端点发出的字节数
+    uint32_t rx_pkts;
+    uint32_t lost;          // 丢包次数
+    uint32_t retrans;       // TCP重传次数
+}luat_vnet_endpoint_stat_t;
+
+// conn是连接编号, 也就是vnet里的socket id
+typedef void (*luat_vnet_handler)(uint16_t port, int conn, int event, const uint8_t* data, size_t len, void* userdata);
+
+void luat_vnet_init(void);
+int luat_vnet_listen(uint16_t port, int kind, const luat_vnet_link_t* link, uint64_t source_size, luat_vnet_handler handler, void* userdata);
+int luat_vnet_unlisten(uint16_t port, void** userdata);
+// 端点向客户端发送数据
+int luat_vnet_send(int conn, const uint8_t* data, size_t len);
+// 端点主动断开连接
+int luat_vnet_disconnect(int conn);
+int luat_vnet_endpoint_stat(uint16_t port, luat_vnet_endpoint_stat_t* stat);
+
+//---------------------------------------
+// lwip虚拟网卡, 需要LUAT_USE_LWIP
+//---------------------------------------
+
+typedef struct luat_lwip_vnetif_stat
+{
+    uint64_t tx_bytes;
+    uint64_t rx_bytes;
+    uint32_t tx_frames;
+    uint32_t rx_frames;
+    uint32_t drops;         // 对端接收缓冲区满或者发送失败而丢弃的帧
+    uint32_t no_pbuf;       // pbuf池耗尽而丢弃的帧
+}luat_lwip_vnetif_stat_t;
+
+// 地址参数都是网络字节序
+// 两块lwip网卡首尾相连, 各自注册到对应的适配器编号上
+int luat_lwip_vnetif_pair(uint8_t index_a, uint8_t index_b, uint32_t ip_a, uint32_t ip_b, uint32_t mask);
+// 通过本机UDP与另一个进程里的虚拟网卡相连, 每个UDP报文是一个以太网帧
+int luat_lwip_vnetif_udp(uint8_t adapter_index, uint32_t ip, uint32_t mask, uint32_t gw, uint16_t local_port, const char* peer_host, uint16_t peer_port);
+int luat_lwip_vnetif_stat(uint8_t adapter_index, luat_lwip_vnetif_stat_t* stat);
+
+// 零拷贝把一帧数据交给适配器对应的lwip网卡, data在回调之前必须保持有效且不被修改
+// 返回0为零拷贝, 返回1为描述符不够退回到了复制(不会回调), 负数为失败
+typedef void (*luat_lwip_ref_free_cb)(void* owner, int tag);
+int luat_lwip_input_ref(uint8_t adapter_index, const uint8_t* data, size_t len, void* owner, int tag, luat_lwip_ref_free_cb cb);
+// owner还有多少帧在lwip里没有释放
+size_t luat_lwip_input_ref_count(const void* owner);
+
+// lwip内存池与TCP参数的profile, 启动时用--lwip_profile=选择, 默认mcu
+typedef struct luat_lwip_profile
+{
+    const char* name;
+    size_t mem_size;            // 堆(PBUF_RAM等)的上限, 字节, 不含内存池
+    uint16_t pool_scale;        // 其余内存池的上限是MEMP_NUM_xxx的倍数
+    uint16_t pbuf_pool_size;
+    uint16_t udp_pcb;
+    uint16_t tcp_pcb;
+    uint16_t tcp_pcb_listen;
+    uint16_t tcp_seg;
+    uint16_t tcp_mss;
+    uint8_t tcp_rcv_scale;      // 窗口扩大因子, 0~14
+    uint32_t tcp_wnd;
+    uint32_t tcp_snd_buf;
+    uint16_t tcp_snd_queuelen;  // 0为按4*tcp_snd_buf/tcp_mss计算
+    uint16_t arp_table_size;    // ARP表的表项数, 最大ARP_TABLE_SIZE, 修改时会清空ARP表
+}luat_lwip_profile_t;
+
+const luat_lwip_profile_t* luat_lwip_profile_find(const char* name);
+const luat_lwip_profile_t* luat_lwip_profile_get(void);
+// 参数不合法或者还有TCP连接(TIME_WAIT的会被释放)时返回-1
+int luat_lwip_profile_set(const luat_lwip_profile_t* profile);
+int luat_lwip_profile_select(const char* name);
+
+typedef struct luat_lwip_pool_stat
+{
+    const char* name;
+    size_t elem_size;   // 每个元素的字节数, 堆为0
+    size_t cap;         // profile设置的上限, 堆为字节数
+    size_t used;
+    size_t max;
+    uint32_t err;       // 超出上限或分配失败的次数
+}luat_lwip_pool_stat_t;
+
+// index为0是堆, 之后依次是各个内存池, 越界返回-1
+int luat_lwip_pool_stat(int index, luat_lwip_pool_stat_t* stat);
+// 峰值重置为当前值, 失败次数清零
+void luat_lwip_pool_stat_reset(void);
+
+// lwip校验和的实现, 默认按CPU自动选择
+enum
+{
+    LUAT_CHKSUM_IMPL_LWIP,  // lwip自带的lwip_standard_chksum
+    LUAT_CHKSUM_IMPL_C64,   // 64位累加的通用实现
+    LUAT_CHKSUM_IMPL_SSE2,
+    LUAT_CHKSUM_IMPL_AVX2,
+    LUAT_CHKSUM_IMPL_QTY
+};
+
+int luat_lwip_chksum_supported(int impl);
+const char* luat_lwip_chksum_impl_name(int impl);
+// impl为-1时自动选择, CPU不支持返回-1
+int luat_lwip_chksum_set_impl(int impl);
+int luat_lwip_chksum_impl(void);
+// 用指定的实现计算iters次校验和, 返回总耗时, 纳秒
+uint64_t luat_lwip_chksum_bench(int impl, int copy, const uint8_t* src, uint8_t* dst, size_t len, uint32_t iters);
+// 用指定的实现与lwip_standard_chksum对比, 返回不一致的次数, 实现不可用返回-1
+int luat_lwip_chksum_verify(int impl);
+
+// PPPoS的HDLC转义与FCS, 实现的编号同校验和, lwip为pppos.c原来的逐字节处理
+int luat_lwip_hdlc_set_impl(int impl);
+int luat_lwip_hdlc_impl(void);
+// accm是32字节的转义位图, 编码一个完整的帧(首尾0x7E), dst至少要len*2+8字节
+size_t luat_lwip_hdlc_encode(const uint8_t* accm, const uint8_t* src, size_t len, uint8_t* dst);
+// 解码一个完整的帧, 返回去掉FCS之后的长度, FCS错误返回-1
+int luat_lwip_hdlc_decode(const uint8_t* accm, const uint8_t* src, size_t len, uint8_t* dst);
+// 用指定的实现编码/解码iters次, 返回总耗时, 纳秒
+uint64_t luat_lwip_hdlc_bench(int impl, int decode, const uint8_t* accm, const uint8_t* src, size_t len, uint8_t* dst, uint32_t iters);
+
+//---------------------------------------
+// lwip的PPPoS网卡, 需要LUAT_USE_LWIP
+//---------------------------------------
+
+// 与lwip的PPP_PHASE_RUNNING相同
+#define LUAT_LWIP_PPP_PHASE_RUNNING 10
+
+typedef struct luat_lwip_ppp_opts
+{
+    uint8_t server;         // 服务端给对端分配peer_ip, 不要求认证
+    const char* user;       // 客户端的PAP/CHAP用户名, NULL不认证
+    const char* passwd;
+    uint32_t local_ip;      // 服务端的地址, 网络字节序
+    uint32_t peer_ip;
+}luat_lwip_ppp_opts_t;
+
+typedef struct luat_lwip_ppp_stat
+{
+    uint8_t phase;          // PPP_PHASE_xxx
+    uint8_t err;            // 最后一次状态回调的PPPERR_xxx
+    uint64_t tx_wire;       // 线路上的字节数, 包括HDLC转义/FCS/帧标志
+    uint64_t rx_wire;
+    uint64_t tx_payload;    // PPP帧的载荷字节数, 包括LCP/IPCP等控制帧
+    uint64_t rx_payload;
+    uint32_t tx_frames;
+    uint32_t rx_frames;
+    uint64_t tx_ns;         // 发送路径(HDLC编码+写线路)的累计耗时
+    uint64_t rx_ns;         // 接收路径(HDLC解码+协议栈处理)的累计耗时
+}luat_lwip_ppp_stat_t;
+
+// 在串口上跑PPPoS, 串口需要先uart.setup, 之后串口的接收数据全部交给PPP
+int luat_lwip_ppp_uart(uint8_t adapter_index, int uart_id, const luat_lwip_ppp_opts_t* opts);
+// 两个PPPoS首尾相连, index_b作为服务端, 地址网络字节序
+int luat_lwip_ppp_pair(uint8_t index_a, uint8_t index_b, uint32_t ip_a, uint32_t ip_b);
+// pair模式会同时关闭两端
+int luat_lwip_ppp_close(uint8_t adapter_index);
+int luat_lwip_ppp_stat(uint8_t adapter_index, luat_lwip_ppp_stat_t* stat);
+
+//---------------------------------------
+// 大规模局域网的ARP表/网桥转发表性能测试, 需要LUAT_USE_LWIP
+//---------------------------------------
+
+typedef struct luat_lwip_lan_bench
+{
+    uint32_t hosts;             // 模拟的主机数, 每台主机一个MAC地址
+    uint32_t rounds;            // 查表阶段轮询所有主机的次数
+    uint32_t arp_entries;       // 学习阶段结束时ARP表里的表项数
+    uint64_t arp_learn_ns;      // 处理hosts个ARP请求的总耗时
+    uint64_t arp_output_ns;     // 轮流向每台主机发送rounds*hosts个IP包的总耗时
+    uint32_t arp_misses;        // 发送时没有命中ARP表而重新发出的ARP请求数
+    uint32_t fdb_size;          // 网桥动态转发表的表项数
+    uint64_t fdb_learn_ns;      // 两侧端口各hosts台主机首次发帧的总耗时
+    uint64_t fdb_forward_ns;    // 转发rounds*hosts*2个帧的总耗时
+    uint32_t fdb_floods;        // 转发阶段因为查不到目的MAC而广播的帧数
+}luat_lwip_lan_bench_t;
+
+// 在临时创建的网卡和网桥上注入来自hosts个MAC地址的帧, 结束后删除网卡, ARP表里对应的表项也一并清除
+int luat_lwip_lan_bench(uint32_t hosts, uint32_t rounds, uint32_t fdb_size, luat_lwip_lan_bench_t* result);
+
+//---------------------------------------
+// iperf2兼容的吞吐量测试
+//---------------------------------------
+
+#define LUAT_IPERF_MAX_SESSION  8
+#define LUAT_IPERF_PORT_DEFAULT 5001
+// 每次提交发送的最大字节数
+#define LUAT_IPERF_MAX_BLOCK    (128 * 1024)
+
+enum
+{
+    LUAT_IPERF_LWIP,    // 进程内的lwip协议栈, 需要LUAT_USE_LWIP
+    LUAT_IPERF_LIBUV,   // 系统协议栈
+};
+
+enum
+{
+    LUAT_IPERF_DONE,
+    LUAT_IPERF_ABORTED_LOCAL,
+    LUAT_IPERF_ABORTED_REMOTE,
+};
+
+typedef struct luat_iperf_opts
+{
+    uint8_t backend;
+    uint8_t adapter;        // lwip后端绑定的网卡对应的适配器编号
+    uint8_t copy;           // lwip后端tcp_write是否复制数据, 0则直接引用发送缓冲区
+    const char* host;       // 客户端为服务器地址, 服务端为绑定的地址(只对libuv有效)
+    uint16_t port;          // 0为5001
+    uint32_t duration_ms;   // 客户端发送的时长, 与amount都为0时为10秒
+    uint64_t amount;        // 客户端发送的字节数, 不为0时优先于duration_ms
+    uint32_t block;         // 每次提交发送的字节数, 0为LUAT_IPERF_MAX_BLOCK
+}luat_iperf_opts_t;
+
+typedef struct luat_iperf_report
+{
+    uint8_t is_server;
+    uint8_t backend;
+    uint8_t result;
+    char remote[48];        // 对端的ip:port
+    uint64_t bytes;         // 服务端为收到的字节数, 客户端为已确认的字节数(libuv为已写入系统的字节数)
+    uint32_t ms;
+    uint64_t kbps;          // 有效吞吐量, kbit/s
+    int64_t retrans;        // 重传的报文段数, -1为无法获取
+    uint64_t cpu_us;        // 测试期间整个进程消耗的CPU时间(用户态+内核态)
+}luat_iperf_report_t;
+
+// 每条连接结束时回调一次, 在事件循环里调用
+typedef void (*luat_iperf_report_cb)(int id, const luat_iperf_report_t* report, void* userdata);
+// 成功返回会话id, 失败返回-1
+int luat_iperf_server(const luat_iperf_opts_t* opts, luat_iperf_report_cb cb, void* userdata);
+int luat_iperf_client(const luat_iperf_opts_t* opts, luat_iperf_report_cb cb, void* userdata);
+int luat_iperf_stop(int id);
+
+int luaopen_pcnet(lua_State *L);
+
+#endif
@@ -17,5 +17,89 @@ typedef struct luat_uart_drv_opts
     uart_close close;
 }luat_uart_drv_opts_t;
 
+// 串口的接收数据可以由C模块(例如PPP)接管, 接管之后不再缓存, 也不再通知Lua
+// data为NULL表示驱动只知道有len字节可读, 需要调用luat_uart_read读取
+typedef void (*luat_uart_rx_hook_t)(int uart_id, const uint8_t* data, size_t len, void* userdata);
+// hook为NULL时取消接管
+int luat_uart_set_rx_hook(int uart_id, luat_uart_rx_hook_t hook, void* userdata);
+int luat_uart_is_hooked(int uart_id);
+// 驱动收到数据时调用, 已被接管返回1; data为NULL时经过msgbus转发到事件循环, 可以在驱动的读线程里调用
+int luat_uart_rx_hook_input(int uart_id, const uint8_t* data, size_t len);
+
+// 驱动共用的接收环形缓冲区, 大小与uart.setup的bufsz一致, 满了之后丢弃新数据并计数, 相当于硬件FIFO溢出
+typedef struct luat_uart_rx_stat
+{
+    size_t size;            // 缓冲区大小, 0表示没有打开
+    size_t used;            // 还没读走的字节数
+    uint64_t rx_bytes;      // 存进缓冲区的总字节数
+    uint64_t overflow_bytes;// 缓冲区满了丢弃的字节数
+    uint32_t overflow_count;// 发生丢弃的次数
+    uint32_t events;        // 发给Lua的receive事件数
+}luat_uart_rx_stat_t;
+
+int luat_uart_rx_open(int uart_id, size_t size);
+void luat_uart_rx_close(int uart_id);
+// 收到的数据先交给接管者, 没有接管则存进缓冲区并通知Lua, 返回存进缓冲区的字节数
+size_t luat_uart_rx_input(int uart_id, const uint8_t* data, size_t len);
+// 缓冲区里一段连续的空闲空间, 驱动可以直接读进去, 再用luat_uart_rx_commit提交
+uint8_t* luat_uart_rx_reserve(int uart_id, size_t* len);
+void luat_uart_rx_commit(int uart_id, size_t len);
+int luat_uart_rx_read(int uart_id, void* buffer, size_t len);
+int luat_uart_rx_stat(int uart_id, luat_uart_rx_stat_t* stat);
+// 按波特率限速时的统计, 速率都是最近1秒的实际值, 不限速时也统计
+typedef struct luat_uart_pace_stat
+{
+    uint8_t paced;          // 是否开启了限速
+    uint32_t byte_rate;     // 按波特率和帧格式算出的字节速率
+    uint32_t tx_rate;       // 实际发送的字节速率
+    uint32_t rx_rate;       // 实际收到的字节速率
+    uint64_t tx_bytes;      // 发出去的总字节数
+    size_t tx_queued;       // 还在发送缓冲区里排队的字节数
+    size_t rx_held;         // 已经收到, 但按波特率还没到达的字节数
+}luat_uart_pace_stat_t;
+
+// 按luat_uart_t里的波特率/数据位/校验位/停止位限制收发速度, 可以在uart.setup之前设置
+int luat_uart_pace(int uart_id, int enable);
+int luat_uart_pace_stat(int uart_id, luat_uart_pace_stat_t* stat);
+// 驱动把写入的数据都发出去之后调用, 由它通知Lua的sent事件
+void luat_uart_tx_done(int uart_id);
+
+// 接收事件合并, 攒够threshold字节或者线路空闲idle_ms之后才通知一次, 都为0时每段数据都通知, 可以在uart.setup之前设置
+int luat_uart_rx_coalesce(int uart_id, uint32_t threshold, uint32_t idle_ms);
+
+// 按url给串口选择驱动, 在uart.setup之前调用, 命令行参数--uart=id,url
+// udp 默认的UDP虚拟串口
+// tcp://ip:port tcp-listen://ip:port unix://path unix-listen://path 字节流虚拟串口
+// tty:///dev/ttyUSB0 真实串口, pty或pty:///tmp/ttyV1 伪终端, 仅linux/macos
+// replay:///tmp/gnss.cap 回放录制的数据
+int luat_uart_drv_config(int uart_id, const char* url);
+int luat_uart_stream_config(int uart_id, const char* url);
+int luat_uart_tty_config(int uart_id, const char* url);
+// 已打开的tty串口的设备路径, pty为从设备的路径, 其他驱动返回NULL
+const char* luat_uart_tty_name(int uart_id);
+
+// 录制串口数据, 收到和写入的数据都带时间戳写进同一个文件, 用replay://回放
+int luat_uart_capture_start(const char* path);
+int luat_uart_capture_enable(int uart_id, int enable);
+// 返回录制的字节数
+uint64_t luat_uart_capture_stop(void);
+// 共用层调用, 没有开始录制或者串口没有启用录制时直接返回
+void luat_uart_capture(int uart_id, int tx, const void* data, size_t len);
+
+// 回放, replay://path?speed=2&id=1&loop=3, speed=max为最快速度
+typedef struct luat_uart_replay_stat
+{
+    uint8_t done;           // 已经回放完
+    uint32_t loops;         // 已经完成的遍数
+    uint32_t records;       // 送出的记录数
+    uint64_t bytes;         // 送出的字节数
+    uint64_t elapsed_ms;    // 从开始到现在或者到回放完的时间
+}luat_uart_replay_stat_t;
+
+int luat_uart_replay_config(int uart_id, const char* url);
+int luat_uart_replay_stat(int uart_id, luat_uart_replay_stat_t* stat);
+
+int luaopen_pcuart(lua_State *L);
+
 #endif
 
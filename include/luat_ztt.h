@@ -3,18 +3,113 @@
 
 #include "stdint.h"
 #include "inttypes.h"
+#include "stddef.h"
 
-typedef struct luat_ztt
+// 外设事件追踪, 驱动把每次操作写成定长的二进制记录放进预先分配好的环形缓冲区,
+// 由外部的设备模拟器读取. 没有开启的驱动只多一次位判断, 不产生任何开销
+// 模拟器也可以反过来写记录给设备, 注入GPIO电平(有中断时触发中断)和ADC的值
+
+// 事件来源, 每个驱动可以单独开关
+enum {
+    LUAT_ZTT_GPIO = 0,
+    LUAT_ZTT_UART,
+    LUAT_ZTT_ADC,
+    LUAT_ZTT_PWM,
+    LUAT_ZTT_DRV_MAX,
+};
+
+// 操作, id为pin/通道/串口id, 后面是args的含义
+enum {
+    LUAT_ZTT_SETUP = 1,     // gpio: mode, pull, irq; uart: baud, data_bits, parity, stop_bits; pwm: period, pulse, pnum
+    LUAT_ZTT_CLOSE,
+    LUAT_ZTT_SET,           // gpio: level; uart写入: 请求的字节数, 实际写入的字节数; pwm: period, pulse, pnum
+    LUAT_ZTT_GET,           // gpio: level; uart读取: 请求的字节数, 实际读到的字节数; adc: val, val2
+};
+
+// 模拟器发给设备的记录使用同样的格式:
+// gpio SET: level, 输入脚的电平变了就按中断配置触发中断
+// adc  SET: val, val2, 之后adc读取都返回这两个值; adc CLOSE: 取消注入
+
+typedef struct luat_ztt_rec
+{
+    uint64_t ts_ns;         // uv_hrtime
+    uint32_t seq;           // 写入顺序, 用于发现丢失的记录
+    uint8_t  drv;
+    uint8_t  action;
+    uint16_t id;            // pin/通道/串口id
+    int32_t  args[4];
+}luat_ztt_rec_t;
+
+// 共享内存的布局, 外部程序映射同一个文件即可读写, 见test/068.ztt_shm/ztt_sim.c
+// 每个环形缓冲区是一个有界的无锁队列, 槽位序号等于写位置时可写, 等于写位置+1时可读,
+// 读完之后加上容量留给下一圈. 写入方可以有多个(用CAS争用head), 读取方只能有一个
+#define LUAT_ZTT_MAGIC      (0x54545A4C) // "LZTT"
+#define LUAT_ZTT_VERSION    (1)
+
+typedef struct luat_ztt_slot
+{
+    volatile uint64_t state;
+    luat_ztt_rec_t rec;
+}luat_ztt_slot_t;
+
+typedef struct luat_ztt_ring
+{
+    uint32_t capacity;          // 槽位数, 2的幂
+    uint32_t reserved;
+    uint8_t pad[56];
+    volatile uint64_t head;     // 写入方争用
+    uint8_t pad0[56];
+    volatile uint64_t tail;     // 只有读取方修改
+    uint8_t pad1[56];
+    volatile uint64_t dropped;  // 满了丢掉的记录数
+    uint8_t pad2[56];
+}luat_ztt_ring_t;
+
+// 槽位紧跟在ring头后面
+#define LUAT_ZTT_SLOTS(ring) ((luat_ztt_slot_t*)((luat_ztt_ring_t*)(ring) + 1))
+
+typedef struct luat_ztt_shm
 {
-    char *key;
-    size_t value_len;
-    char *value;
-    void* next;
-}luat_ztt_t;
-
-luat_ztt_t* ztt_create(const char* type);
-luat_ztt_t* ztt_addf(luat_ztt_t* ztt_head, const char* key, const char* fmt, ...);
-luat_ztt_t* ztt_add(luat_ztt_t* ztt, const char* key, const char* value, size_t value_len);
-int ztt_commit(luat_ztt_t* ztt);
+    uint32_t magic;
+    uint32_t version;
+    uint32_t rec_size;
+    uint32_t slot_size;
+    uint64_t size;              // 整个区域的大小
+    uint64_t tx_offset;         // 设备 -> 模拟器
+    uint64_t rx_offset;         // 模拟器 -> 设备
+    uint8_t pad[24];
+}luat_ztt_shm_t;
+
+typedef struct luat_ztt_stat
+{
+    size_t capacity;
+    size_t used;
+    uint64_t written;
+    uint64_t dropped;       // 缓冲区满了丢掉的记录数
+}luat_ztt_stat_t;
+
+extern volatile uint32_t luat_ztt_mask;
+
+#define LUAT_ZTT_ON(drv) (luat_ztt_mask & (1u << (drv)))
+
+// 热路径只判断开关, 参数在开启之后才求值
+#define LUAT_ZTT(drv, action, id, a0, a1, a2, a3) do { \
+    if (LUAT_ZTT_ON(drv)) \
+        luat_ztt_emit((drv), (action), (id), (a0), (a1), (a2), (a3)); \
+} while (0)
+
+int luat_ztt_init(size_t capacity);
+int luat_ztt_enable(int drv, int enable);
+int luat_ztt_enable_names(const char* names);
+void luat_ztt_emit(uint8_t drv, uint8_t action, uint16_t id, int32_t a0, int32_t a1, int32_t a2, int32_t a3);
+int luat_ztt_read(luat_ztt_rec_t* recs, int max);
+int luat_ztt_stat(luat_ztt_stat_t* stat);
+
+// 传输方式, 二选一. 共享内存: 映射path文件; UDP: 记录发往127.0.0.1:port, 在port+1接收注入
+int luat_ztt_shm_open(const char* path, size_t capacity);
+int luat_ztt_udp_open(int port);
+
+// 注入, 由驱动实现, GPIO的注入见luat_gpio_drv.h
+int luat_adc_pc_inject(int ch, int enable, int val, int val2);
 
 #endif
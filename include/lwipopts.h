@@ -56,7 +56,8 @@
 #define LWIP_DNS                   0
 #define LWIP_MDNS_RESPONDER        0
 
-#define LWIP_NUM_NETIF_CLIENT_DATA (LWIP_MDNS_RESPONDER)
+/* bridgeif用一个client data保存端口信息 */
+#define LWIP_NUM_NETIF_CLIENT_DATA (LWIP_MDNS_RESPONDER + 1)
 
 #define LWIP_HAVE_LOOPIF           0
 #define LWIP_NETIF_LOOPBACK        0
@@ -74,6 +75,47 @@
 #define LWIP_NETIF_STATUS_CALLBACK      1
 #define LWIP_NETIF_EXT_STATUS_CALLBACK  1
 
+/* 虚拟网卡和PPP的pair模式需要按源地址选路, 见port/network/luat_lwip_vnetif.c和luat_lwip_ppp.c */
+struct netif;
+struct ip4_addr;
+struct netif *luat_lwip_route4(const struct ip4_addr *src, const struct ip4_addr *dest);
+#define LWIP_HOOK_IP4_ROUTE_SRC(src, dest) luat_lwip_route4(src, dest)
+
+/* lwip的定时器由libuv按最近的超时时间唤醒, 新增了更早的超时要重新设置, 见port/network/luat_lwip_port.c */
+void luat_lwip_timer_kick(void);
+#define LWIP_HOOK_TIMEOUTS_HEAD_CHANGED() luat_lwip_timer_kick()
+
+/* 校验和按CPU选择SIMD实现, 并且在复制数据时顺便计算, 见port/network/luat_lwip_chksum.c
+   LWIP_CHKSUM_ALGORITHM仍然编译lwip自带的实现, 用于对比 */
+unsigned short luat_lwip_chksum(const void *dataptr, int len);
+unsigned short luat_lwip_chksum_copy(void *dst, const void *src, unsigned short len);
+#define LWIP_CHKSUM                     luat_lwip_chksum
+#define LWIP_CHKSUM_ALGORITHM           2
+#define LWIP_CHECKSUM_ON_COPY           1
+#define LWIP_CHKSUM_COPY(dst, src, len) luat_lwip_chksum_copy(dst, src, len)
+
+/* PPPoS的HDLC转义与FCS走批量实现, 见port/network/luat_lwip_hdlc.c
+   PPPOS_HDLC_SCAN返回开头连续不需要转义的字节数, PPPOS_FCS_BLOCK按块更新FCS */
+unsigned int luat_lwip_hdlc_scan(const unsigned char *accm, const unsigned char *data, unsigned int len);
+unsigned short luat_lwip_hdlc_fcs(unsigned short fcs, const unsigned char *data, unsigned int len);
+#define PPPOS_HDLC_SCAN(accm, data, len)    luat_lwip_hdlc_scan(accm, data, len)
+#define PPPOS_FCS_BLOCK(fcs, data, len)     luat_lwip_hdlc_fcs(fcs, data, len)
+
+/* 内存池和TCP参数由启动时选择的profile决定, 见port/network/luat_lwip_profile.c
+   内存池元素改为从堆里分配, 由LWIP_HOOK_MEMP_LIMIT按profile限制每个池的数量,
+   下面的MEMP_NUM_xxx/PBUF_POOL_SIZE/MEM_SIZE是mcu profile的取值 */
+#include <stddef.h>
+void *luat_lwip_mem_malloc(size_t size);
+void *luat_lwip_mem_calloc(size_t count, size_t size);
+void luat_lwip_mem_free(void *mem);
+int luat_lwip_memp_limit(int type);
+#define MEMP_MEM_MALLOC                 1
+#define MEM_CUSTOM_ALLOCATOR            1
+#define MEM_CUSTOM_MALLOC               luat_lwip_mem_malloc
+#define MEM_CUSTOM_CALLOC               luat_lwip_mem_calloc
+#define MEM_CUSTOM_FREE                 luat_lwip_mem_free
+#define LWIP_HOOK_MEMP_LIMIT(type)      luat_lwip_memp_limit(type)
+
 // #define LWIP_DEBUG                 1
 
 #ifdef LWIP_DEBUG
@@ -144,7 +186,7 @@ a lot of data that needs to be copied, this should be set high. */
 #define MEMP_NUM_TCP_SEG        16
 /* MEMP_NUM_SYS_TIMEOUT: the number of simultaneously active
    timeouts. */
-#define MEMP_NUM_SYS_TIMEOUT    17
+#define MEMP_NUM_SYS_TIMEOUT    (17 + PPP_NUM_TIMEOUTS)
 
 /* The following four are used only with the sequential API and can be
    set to 0 if the application only will use the raw API. */
@@ -164,7 +206,11 @@ a lot of data that needs to be copied, this should be set high. */
 #define PBUF_POOL_SIZE          120
 
 /* PBUF_POOL_BUFSIZE: the size of each pbuf in the pbuf pool. */
-#define PBUF_POOL_BUFSIZE       256
+/* PC上内存充足, 一个pool pbuf就能放下完整的以太网帧, 收包时不再拆成多段链表 */
+#define PBUF_POOL_BUFSIZE       1536
+
+/* 允许用PBUF_REF引用外部内存(zbuff)做零拷贝输入, 见luat_lwip_input_ref */
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
 
 /** SYS_LIGHTWEIGHT_PROT
  * define SYS_LIGHTWEIGHT_PROT in lwipopts.h if you want inter-task protection
@@ -190,14 +236,32 @@ a lot of data that needs to be copied, this should be set high. */
 #define TCP_QUEUE_OOSEQ         1
 
 /* TCP Maximum segment size. */
-#define TCP_MSS                 1024
+/* Linux的netinet/tcp.h里TCP_MSS是socket选项, 和lwip的同名配置冲突, 以lwip的为准 */
+#ifdef TCP_MSS
+#undef TCP_MSS
+#endif
+/* TCP_MSS/TCP_SND_BUF/TCP_SND_QUEUELEN/TCP_WND/TCP_RCV_SCALE是运行时变量,
+   取值和检查见port/network/luat_lwip_profile.c, init.c里对应的编译期检查跳过 */
+extern unsigned short luat_lwip_tcp_mss;
+extern unsigned int luat_lwip_tcp_snd_buf;
+extern unsigned short luat_lwip_tcp_snd_queuelen;
+extern unsigned int luat_lwip_tcp_wnd;
+extern unsigned char luat_lwip_tcp_rcv_scale;
+#define LWIP_TCP_RUNTIME_CONFIG 1
+#define LWIP_DISABLE_TCP_SANITY_CHECKS 1
+/* 每个pcb统计自己重传的报文段数(含超时重传), iperf按连接报告重传次数 */
+#define LWIP_TCP_REXMIT_COUNT   1
+#define TCP_MSS                 luat_lwip_tcp_mss
+/* opt.h里TCP_OVERSIZE默认是TCP_MSS, 变量在#if里会被当成0, 把oversize整个关掉.
+   这里用常量, 不小于所有profile的tcp_mss, luat_lwip_profile.c里检查 */
+#define TCP_OVERSIZE            1460
 
 /* TCP sender buffer space (bytes). */
-#define TCP_SND_BUF             2048
+#define TCP_SND_BUF             luat_lwip_tcp_snd_buf
 
 /* TCP sender buffer space (pbufs). This must be at least = 2 *
    TCP_SND_BUF/TCP_MSS for things to work. */
-#define TCP_SND_QUEUELEN       (4 * TCP_SND_BUF/TCP_MSS)
+#define TCP_SND_QUEUELEN        luat_lwip_tcp_snd_queuelen
 
 /* TCP writable space (bytes). This must be less than or equal
    to TCP_SND_BUF. It is the amount of space which must be
@@ -205,7 +269,9 @@ a lot of data that needs to be copied, this should be set high. */
 #define TCP_SNDLOWAT           (TCP_SND_BUF/2)
 
 /* TCP receive window. */
-#define TCP_WND                 (20 * 1024)
+#define TCP_WND                 luat_lwip_tcp_wnd
+#define LWIP_WND_SCALE          1
+#define TCP_RCV_SCALE           luat_lwip_tcp_rcv_scale
 
 /* Maximum number of retransmissions of data segments. */
 #define TCP_MAXRTX              12
@@ -216,8 +282,19 @@ a lot of data that needs to be copied, this should be set high. */
 
 /* ---------- ARP options ---------- */
 #define LWIP_ARP                1
-#define ARP_TABLE_SIZE          10
+/* ARP表从堆里分配并按IP地址做哈希索引, 模拟几百上千台主机的局域网时查表不再线性扫描,
+   ARP_TABLE_SIZE只是上限, 实际的表项数由profile的arp_table_size决定 */
+#define ARP_TABLE_SIZE          4096
+#define ETHARP_TABLE_HASH       1
+extern unsigned short luat_lwip_arp_table_size;
+#define ETHARP_TABLE_CAPACITY   luat_lwip_arp_table_size
 #define ARP_QUEUEING            1
+/* 地址解析完成之前每个目的地址缓存的包, 默认只有3个, 同时发起大量连接时SYN会被丢掉等3秒重传,
+   这里放开, 实际数量由profile里ARP_QUEUE内存池的上限决定 */
+#define ARP_QUEUE_LEN           1024
+
+/* bridgeif的动态转发表按MAC地址做哈希索引, 容量由bridgeif_initdata_t.max_fdb_dynamic_entries决定 */
+#define BRIDGEIF_FDB_HASH       1
 
 
 /* ---------- IP options ---------- */
@@ -229,7 +306,8 @@ a lot of data that needs to be copied, this should be set high. */
 /* IP reassembly and segmentation.These are orthogonal even
  * if they both deal with IP fragments */
 #define IP_REASSEMBLY           1
-#define IP_REASS_MAX_PBUFS      (10 * ((1500 + PBUF_POOL_BUFSIZE - 1) / PBUF_POOL_BUFSIZE))
+/* 一个pool pbuf放得下一个分片, 64个分片能重组出接近64K的UDP报文 */
+#define IP_REASS_MAX_PBUFS      64
 #define MEMP_NUM_REASSDATA      IP_REASS_MAX_PBUFS
 #define IP_FRAG                 1
 #define IPV6_FRAG_COPYHEADER    1
@@ -287,18 +365,21 @@ a lot of data that needs to be copied, this should be set high. */
 
 /* ---------- PPP options ---------- */
 
-#define PPP_SUPPORT             0      /* Set > 0 for PPP */
+#define PPP_SUPPORT             1      /* Set > 0 for PPP */
 
 #if PPP_SUPPORT
 
 #define NUM_PPP                 1      /* Max PPP sessions. */
+/* 一条串口链路加上pppPair的两端, 见port/network/luat_lwip_ppp.c */
+#define MEMP_NUM_PPP_PCB        4
+#define PPP_SERVER              1
 
 
 /* Select modules to enable.  Ideally these would be set in the makefile but
  * we're limited by the command line length so you need to modify the settings
  * in this file.
  */
-#define PPPOE_SUPPORT           1
+#define PPPOE_SUPPORT           0
 #define PPPOS_SUPPORT           1
 
 #define PAP_SUPPORT             1      /* Set > 0 for PAP. */
@@ -306,7 +387,7 @@ a lot of data that needs to be copied, this should be set high. */
 #define MSCHAP_SUPPORT          0      /* Set > 0 for MSCHAP */
 #define CBCP_SUPPORT            0      /* Set > 0 for CBCP (NOT FUNCTIONAL!) */
 #define CCP_SUPPORT             0      /* Set > 0 for CCP */
-#define VJ_SUPPORT              0      /* Set > 0 for VJ header compression. */
+#define VJ_SUPPORT              1      /* Set > 0 for VJ header compression. */
 #define MD5_SUPPORT             1      /* Set > 0 for MD5 (see also CHAP) */
 
 #endif /* PPP_SUPPORT */
@@ -101,9 +101,28 @@ struct etharp_entry {
   struct eth_addr ethaddr;
   u16_t ctime;
   u8_t state;
+#if ETHARP_TABLE_HASH
+  /** Next entry in the same hash bucket, or in the free list if unused. */
+  s16_t next;
+#endif /* ETHARP_TABLE_HASH */
 };
 
+#if ETHARP_TABLE_HASH
+/* The table is allocated on first use with ETHARP_TABLE_CAPACITY entries.
+ * Every entry that is not EMPTY is linked into the bucket of its IP address,
+ * EMPTY entries are kept on a free list, so looking up an address or
+ * creating a new entry does not sweep the table. Only recycling an entry
+ * when the table is full still does, to keep the original heuristic. */
+static struct etharp_entry *arp_table;
+static s16_t *arp_hash;
+static u16_t arp_table_size;
+static u8_t arp_hash_shift;
+static s16_t arp_free = -1;
+#define ETHARP_TABLE_SIZE arp_table_size
+#else /* ETHARP_TABLE_HASH */
 static struct etharp_entry arp_table[ARP_TABLE_SIZE];
+#define ETHARP_TABLE_SIZE ARP_TABLE_SIZE
+#endif /* ETHARP_TABLE_HASH */
 
 #if !LWIP_NETIF_HWADDRHINT
 static netif_addr_idx_t etharp_cached_entry;
@@ -164,10 +183,83 @@ free_etharp_q(struct etharp_q_entry *q)
 
 #endif /* ARP_QUEUEING */
 
+#if ETHARP_TABLE_HASH
+/** Bucket of an IP address (multiplicative hashing, hosts on one subnet
+ * only differ in the low bits) */
+static u32_t
+etharp_hash(const ip4_addr_t *ipaddr)
+{
+  return (u32_t)(ip4_addr_get_u32(ipaddr) * 0x9E3779B1UL) >> arp_hash_shift;
+}
+
+/** Allocate the table and the buckets, all entries start on the free list */
+static err_t
+etharp_table_alloc(void)
+{
+  u16_t size = ETHARP_TABLE_CAPACITY;
+  u32_t buckets = 2;
+  u8_t bits = 1;
+  s16_t i;
+
+  if (size == 0 || size > ARP_TABLE_SIZE) {
+    size = ARP_TABLE_SIZE;
+  }
+  while (buckets < size) {
+    buckets <<= 1;
+    bits++;
+  }
+  arp_table = (struct etharp_entry *)mem_calloc(size, sizeof(struct etharp_entry));
+  arp_hash = (s16_t *)mem_malloc((mem_size_t)(buckets * sizeof(s16_t)));
+  if (arp_table == NULL || arp_hash == NULL) {
+    if (arp_table != NULL) {
+      mem_free(arp_table);
+      arp_table = NULL;
+    }
+    if (arp_hash != NULL) {
+      mem_free(arp_hash);
+      arp_hash = NULL;
+    }
+    return ERR_MEM;
+  }
+  for (i = 0; i < (s16_t)buckets; i++) {
+    arp_hash[i] = -1;
+  }
+  for (i = 0; i < (s16_t)size; i++) {
+    arp_table[i].next = (s16_t)(i + 1 < size ? i + 1 : -1);
+  }
+  arp_free = 0;
+  arp_hash_shift = (u8_t)(32 - bits);
+  arp_table_size = size;
+  LWIP_DEBUGF(ETHARP_DEBUG, ("etharp_table_alloc: %"U16_F" entries, %"U32_F" buckets\n", size, buckets));
+  return ERR_OK;
+}
+
+/** Unlink a used entry from its bucket */
+static void
+etharp_hash_remove(s16_t i)
+{
+  s16_t *pp = &arp_hash[etharp_hash(&arp_table[i].ipaddr)];
+  while (*pp >= 0) {
+    if (*pp == i) {
+      *pp = arp_table[i].next;
+      return;
+    }
+    pp = &arp_table[*pp].next;
+  }
+  LWIP_ASSERT("entry not in its bucket", 0);
+}
+#endif /* ETHARP_TABLE_HASH */
+
 /** Clean up ARP table entries */
 static void
 etharp_free_entry(int i)
 {
+#if ETHARP_TABLE_HASH
+  u8_t used = (arp_table[i].state != ETHARP_STATE_EMPTY);
+  if (used) {
+    etharp_hash_remove((s16_t)i);
+  }
+#endif /* ETHARP_TABLE_HASH */
   /* remove from SNMP ARP index tree */
   mib2_remove_arp_entry(arp_table[i].netif, &arp_table[i].ipaddr);
   /* and empty packet queue */
@@ -186,6 +278,12 @@ etharp_free_entry(int i)
   ip4_addr_set_zero(&arp_table[i].ipaddr);
   arp_table[i].ethaddr = ethzero;
 #endif /* LWIP_DEBUG */
+#if ETHARP_TABLE_HASH
+  if (used) {
+    arp_table[i].next = arp_free;
+    arp_free = (s16_t)i;
+  }
+#endif /* ETHARP_TABLE_HASH */
 }
 
 /**
@@ -201,7 +299,7 @@ etharp_tmr(void)
 
   LWIP_DEBUGF(ETHARP_DEBUG, ("etharp_timer\n"));
   /* remove expired entries from the ARP table */
-  for (i = 0; i < ARP_TABLE_SIZE; ++i) {
+  for (i = 0; i < ETHARP_TABLE_SIZE; ++i) {
     u8_t state = arp_table[i].state;
     if (state != ETHARP_STATE_EMPTY
 #if ETHARP_SUPPORT_STATIC_ENTRIES
@@ -256,16 +354,37 @@ etharp_tmr(void)
 static s16_t
 etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif *netif)
 {
-  s16_t old_pending = ARP_TABLE_SIZE, old_stable = ARP_TABLE_SIZE;
-  s16_t empty = ARP_TABLE_SIZE;
+  s16_t old_pending = ETHARP_TABLE_SIZE, old_stable = ETHARP_TABLE_SIZE;
+  s16_t empty = ETHARP_TABLE_SIZE;
   s16_t i = 0;
   /* oldest entry with packets on queue */
-  s16_t old_queue = ARP_TABLE_SIZE;
+  s16_t old_queue = ETHARP_TABLE_SIZE;
   /* its age */
   u16_t age_queue = 0, age_pending = 0, age_stable = 0;
 
   LWIP_UNUSED_ARG(netif);
 
+#if ETHARP_TABLE_HASH
+  if ((arp_table == NULL) && (etharp_table_alloc() != ERR_OK)) {
+    return (s16_t)ERR_MEM;
+  }
+  if (ipaddr != NULL) {
+    for (i = arp_hash[etharp_hash(ipaddr)]; i >= 0; i = arp_table[i].next) {
+      if ((arp_table[i].state != ETHARP_STATE_EMPTY) && ip4_addr_eq(ipaddr, &arp_table[i].ipaddr)
+#if ETHARP_TABLE_MATCH_NETIF
+          && ((netif == NULL) || (netif == arp_table[i].netif))
+#endif /* ETHARP_TABLE_MATCH_NETIF */
+         ) {
+        LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: found matching entry %d\n", (int)i));
+        return i;
+      }
+    }
+  }
+  if ((flags & ETHARP_FLAG_FIND_ONLY) != 0) {
+    return (s16_t)ERR_MEM;
+  }
+#endif /* ETHARP_TABLE_HASH */
+
   /**
    * a) do a search through the cache, remember candidates
    * b) select candidate entry
@@ -281,10 +400,17 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif *netif)
    *    until 5 matches, or all entries are searched for.
    */
 
-  for (i = 0; i < ARP_TABLE_SIZE; ++i) {
+#if ETHARP_TABLE_HASH
+  /* no match; the free list holds all empty entries, so only sweep the
+     table for recycling candidates if it is empty */
+  if (arp_free >= 0) {
+    empty = arp_free;
+  } else
+#endif /* ETHARP_TABLE_HASH */
+  for (i = 0; i < ETHARP_TABLE_SIZE; ++i) {
     u8_t state = arp_table[i].state;
     /* no empty entry found yet and now we do find one? */
-    if ((empty == ARP_TABLE_SIZE) && (state == ETHARP_STATE_EMPTY)) {
+    if ((empty == ETHARP_TABLE_SIZE) && (state == ETHARP_STATE_EMPTY)) {
       LWIP_DEBUGF(ETHARP_DEBUG, ("etharp_find_entry: found empty entry %d\n", (int)i));
       /* remember first empty entry */
       empty = i;
@@ -338,7 +464,7 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif *netif)
   /* don't create new entry, only search? */
   if (((flags & ETHARP_FLAG_FIND_ONLY) != 0) ||
       /* or no empty entry found and not allowed to recycle? */
-      ((empty == ARP_TABLE_SIZE) && ((flags & ETHARP_FLAG_TRY_HARD) == 0))) {
+      ((empty == ETHARP_TABLE_SIZE) && ((flags & ETHARP_FLAG_TRY_HARD) == 0))) {
     LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: no empty entry found and not allowed to recycle\n"));
     return (s16_t)ERR_MEM;
   }
@@ -353,24 +479,24 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif *netif)
    */
 
   /* 1) empty entry available? */
-  if (empty < ARP_TABLE_SIZE) {
+  if (empty < ETHARP_TABLE_SIZE) {
     i = empty;
     LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: selecting empty entry %d\n", (int)i));
   } else {
     /* 2) found recyclable stable entry? */
-    if (old_stable < ARP_TABLE_SIZE) {
+    if (old_stable < ETHARP_TABLE_SIZE) {
       /* recycle oldest stable*/
       i = old_stable;
       LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: selecting oldest stable entry %d\n", (int)i));
       /* no queued packets should exist on stable entries */
       LWIP_ASSERT("arp_table[i].q == NULL", arp_table[i].q == NULL);
       /* 3) found recyclable pending entry without queued packets? */
-    } else if (old_pending < ARP_TABLE_SIZE) {
+    } else if (old_pending < ETHARP_TABLE_SIZE) {
       /* recycle oldest pending */
       i = old_pending;
       LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: selecting oldest pending entry %d (without queue)\n", (int)i));
       /* 4) found recyclable pending entry with queued packets? */
-    } else if (old_queue < ARP_TABLE_SIZE) {
+    } else if (old_queue < ETHARP_TABLE_SIZE) {
       /* recycle oldest pending (queued packets are free in etharp_free_entry) */
       i = old_queue;
       LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: selecting oldest pending entry %d, freeing packet queue %p\n", (int)i, (void *)(arp_table[i].q)));
@@ -381,19 +507,34 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif *netif)
     }
 
     /* { empty or recyclable entry found } */
-    LWIP_ASSERT("i < ARP_TABLE_SIZE", i < ARP_TABLE_SIZE);
+    LWIP_ASSERT("i < ARP_TABLE_SIZE", i < ETHARP_TABLE_SIZE);
     etharp_free_entry(i);
   }
 
-  LWIP_ASSERT("i < ARP_TABLE_SIZE", i < ARP_TABLE_SIZE);
+  LWIP_ASSERT("i < ARP_TABLE_SIZE", i < ETHARP_TABLE_SIZE);
   LWIP_ASSERT("arp_table[i].state == ETHARP_STATE_EMPTY",
               arp_table[i].state == ETHARP_STATE_EMPTY);
+#if ETHARP_TABLE_HASH
+  /* an empty entry, or the one just recycled, is the head of the free list */
+  LWIP_ASSERT("i == arp_free", i == arp_free);
+  arp_free = arp_table[i].next;
+#endif /* ETHARP_TABLE_HASH */
 
   /* IP address given? */
   if (ipaddr != NULL) {
     /* set IP address */
     ip4_addr_copy(arp_table[i].ipaddr, *ipaddr);
   }
+#if ETHARP_TABLE_HASH
+  else {
+    ip4_addr_set_zero(&arp_table[i].ipaddr);
+  }
+  {
+    s16_t *head = &arp_hash[etharp_hash(&arp_table[i].ipaddr)];
+    arp_table[i].next = *head;
+    *head = i;
+  }
+#endif /* ETHARP_TABLE_HASH */
   arp_table[i].ctime = 0;
 #if ETHARP_TABLE_MATCH_NETIF
   arp_table[i].netif = netif;
@@ -561,7 +702,7 @@ etharp_cleanup_netif(struct netif *netif)
 {
   int i;
 
-  for (i = 0; i < ARP_TABLE_SIZE; ++i) {
+  for (i = 0; i < ETHARP_TABLE_SIZE; ++i) {
     u8_t state = arp_table[i].state;
     if ((state != ETHARP_STATE_EMPTY) && (arp_table[i].netif == netif)) {
       etharp_free_entry(i);
@@ -569,6 +710,35 @@ etharp_cleanup_netif(struct netif *netif)
   }
 }
 
+#if ETHARP_TABLE_HASH
+/**
+ * Remove all ARP table entries and free the table. It is allocated again,
+ * with the then current ETHARP_TABLE_CAPACITY, when the next entry is created.
+ */
+void
+etharp_table_reset(void)
+{
+  int i;
+
+  for (i = 0; i < ETHARP_TABLE_SIZE; ++i) {
+    if (arp_table[i].state != ETHARP_STATE_EMPTY) {
+      etharp_free_entry(i);
+    }
+  }
+  if (arp_table != NULL) {
+    mem_free(arp_table);
+    mem_free(arp_hash);
+    arp_table = NULL;
+    arp_hash = NULL;
+  }
+  arp_table_size = 0;
+  arp_free = -1;
+#if !LWIP_NETIF_HWADDRHINT
+  etharp_cached_entry = 0;
+#endif /* !LWIP_NETIF_HWADDRHINT */
+}
+#endif /* ETHARP_TABLE_HASH */
+
 /**
  * Finds (stable) ethernet/IP address pair from ARP table
  * using interface and IP address index.
@@ -616,7 +786,7 @@ etharp_get_entry(size_t i, ip4_addr_t **ipaddr, struct netif **netif, struct eth
   LWIP_ASSERT("netif != NULL", netif != NULL);
   LWIP_ASSERT("eth_ret != NULL", eth_ret != NULL);
 
-  if ((i < ARP_TABLE_SIZE) && (arp_table[i].state >= ETHARP_STATE_STABLE)) {
+  if ((i < ETHARP_TABLE_SIZE) && (arp_table[i].state >= ETHARP_STATE_STABLE)) {
     *ipaddr  = &arp_table[i].ipaddr;
     *netif   = arp_table[i].netif;
     *eth_ret = &arp_table[i].ethaddr;
@@ -821,6 +991,9 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
     /* unicast destination IP address? */
   } else {
     netif_addr_idx_t i;
+#if ETHARP_TABLE_HASH
+    s16_t h;
+#endif /* ETHARP_TABLE_HASH */
     /* outside local network? if so, this can neither be a global broadcast nor
        a subnet broadcast. */
     if (!ip4_addr_net_eq(ipaddr, netif_ip4_addr(netif), netif_ip4_netmask(netif)) &&
@@ -857,7 +1030,11 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
     if (netif->hints != NULL) {
       /* per-pcb cached entry was given */
       netif_addr_idx_t etharp_cached_entry = netif->hints->addr_hint;
-      if (etharp_cached_entry < ARP_TABLE_SIZE) {
+      if (etharp_cached_entry < ETHARP_TABLE_SIZE) {
+#elif ETHARP_TABLE_HASH
+    {
+      /* the table may not be allocated yet */
+      if (etharp_cached_entry < ETHARP_TABLE_SIZE) {
 #endif /* LWIP_NETIF_HWADDRHINT */
         if ((arp_table[etharp_cached_entry].state >= ETHARP_STATE_STABLE) &&
 #if ETHARP_TABLE_MATCH_NETIF
@@ -868,14 +1045,19 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
           ETHARP_STATS_INC(etharp.cachehit);
           return etharp_output_to_arp_index(netif, q, etharp_cached_entry);
         }
-#if LWIP_NETIF_HWADDRHINT
+#if LWIP_NETIF_HWADDRHINT || ETHARP_TABLE_HASH
       }
     }
-#endif /* LWIP_NETIF_HWADDRHINT */
+#endif /* LWIP_NETIF_HWADDRHINT || ETHARP_TABLE_HASH */
 
     /* find stable entry: do this here since this is a critical path for
        throughput and etharp_find_entry() is kind of slow */
+#if ETHARP_TABLE_HASH
+    for (h = (arp_table != NULL) ? arp_hash[etharp_hash(dst_addr)] : -1; h >= 0; h = arp_table[h].next) {
+      i = (netif_addr_idx_t)h;
+#else /* ETHARP_TABLE_HASH */
     for (i = 0; i < ARP_TABLE_SIZE; i++) {
+#endif /* ETHARP_TABLE_HASH */
       if ((arp_table[i].state >= ETHARP_STATE_STABLE) &&
 #if ETHARP_TABLE_MATCH_NETIF
           (arp_table[i].netif == netif) &&
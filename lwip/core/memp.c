@@ -346,6 +346,16 @@ memp_malloc_fn(memp_t type, const char *file, const int line)
   memp_overflow_check_all();
 #endif /* MEMP_OVERFLOW_CHECK >= 2 */
 
+#ifdef LWIP_HOOK_MEMP_LIMIT
+  /* pools allocated from the heap have no fixed element count: let the port cap them */
+  if (LWIP_HOOK_MEMP_LIMIT(type)) {
+#if MEMP_STATS
+    memp_pools[type]->stats->err++;
+#endif /* MEMP_STATS */
+    return NULL;
+  }
+#endif /* LWIP_HOOK_MEMP_LIMIT */
+
 #if !MEMP_OVERFLOW_CHECK
   memp = do_memp_malloc_pool(memp_pools[type]);
 #else
@@ -135,7 +135,10 @@
 #endif /* LWIP_TCP_KEEPALIVE */
 
 /* As initial send MSS, we use TCP_MSS but limit it to 536. */
-#if TCP_MSS > 536
+#if defined(LWIP_TCP_RUNTIME_CONFIG) && LWIP_TCP_RUNTIME_CONFIG
+/* TCP_MSS is a runtime variable, the preprocessor can't compare it */
+#define INITIAL_MSS LWIP_MIN(TCP_MSS, 536)
+#elif TCP_MSS > 536
 #define INITIAL_MSS 536
 #else
 #define INITIAL_MSS TCP_MSS
@@ -1367,6 +1367,13 @@ tcp_output(struct tcp_pcb *pcb)
       tcp_set_flags(pcb, TF_NAGLEMEMERR);
       return err;
     }
+#if defined(LWIP_TCP_REXMIT_COUNT) && LWIP_TCP_REXMIT_COUNT
+    /* tcp_rexmit only counts fast retransmits in MIB2, count every
+       segment starting below snd_nxt so that RTO is included */
+    if (TCP_SEQ_LT(lwip_ntohl(seg->tcphdr->seqno), pcb->snd_nxt)) {
+      pcb->rexmit_segs++;
+    }
+#endif
 #if TCP_OVERSIZE_DBGCHECK
     seg->oversize_left = 0;
 #endif /* TCP_OVERSIZE_DBGCHECK */
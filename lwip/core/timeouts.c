@@ -72,6 +72,12 @@
 /* Check if timer's expiry time is greater than time and care about u32_t wraparounds */
 #define TIME_LESS_THAN(t, compare_to) ( (((u32_t)((t)-(compare_to))) > LWIP_MAX_TIMEOUT) ? 1 : 0 )
 
+/** Called whenever a new timeout becomes the earliest pending one, so that a
+ * tickless port can re-arm its wakeup to sys_timeouts_sleeptime() */
+#ifndef LWIP_HOOK_TIMEOUTS_HEAD_CHANGED
+#define LWIP_HOOK_TIMEOUTS_HEAD_CHANGED()
+#endif
+
 /** This array contains all stack-internal cyclic timers. To get the number of
  * timers, use LWIP_ARRAYSIZE() */
 const struct lwip_cyclic_timer lwip_cyclic_timers[] = {
@@ -204,11 +210,13 @@ sys_timeout_abs(u32_t abs_time, sys_timeout_handler handler, void *arg)
 
   if (next_timeout == NULL) {
     next_timeout = timeout;
+    LWIP_HOOK_TIMEOUTS_HEAD_CHANGED();
     return;
   }
   if (TIME_LESS_THAN(timeout->time, next_timeout->time)) {
     timeout->next = next_timeout;
     next_timeout = timeout;
+    LWIP_HOOK_TIMEOUTS_HEAD_CHANGED();
   } else {
     for (t = next_timeout; t != NULL; t = t->next) {
       if ((t->next == NULL) || TIME_LESS_THAN(timeout->time, t->next->time)) {
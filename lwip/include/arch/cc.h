@@ -34,8 +34,10 @@
 
 #define LWIP_TIMEVAL_PRIVATE 1
 #define LWIP_ERRNO_STDINCLUDE	1
+#ifdef _MSC_VER
 #define LWIP_NO_LIMITS_H 1
 #define LWIP_NO_UNISTD_H 1
+#endif
 #define LWIP_SOCKET_EXTERNAL_HEADERS 1
 #define LWIP_SOCKET_EXTERNAL_HEADER_INET_H "inaddr.h"
 
@@ -112,6 +114,4 @@ typedef int sys_prot_t;
 extern unsigned int lwip_port_rand(void);
 #define LWIP_RAND() ((uint32_t)lwip_port_rand())
 
-#define PPP_INCLUDE_SETTINGS_HEADER
-
 #endif /* LWIP_ARCH_CC_H */
@@ -87,6 +87,9 @@ err_t etharp_request(struct netif *netif, const ip4_addr_t *ipaddr);
  *  From RFC 3220 "IP Mobility Support for IPv4" section 4.6. */
 #define etharp_gratuitous(netif) etharp_request((netif), netif_ip4_addr(netif))
 void etharp_cleanup_netif(struct netif *netif);
+#if ETHARP_TABLE_HASH
+void etharp_table_reset(void);
+#endif /* ETHARP_TABLE_HASH */
 
 #if LWIP_ACD
 err_t etharp_acd_probe(struct netif *netif, const ip4_addr_t *ipaddr);
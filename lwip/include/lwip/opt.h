@@ -731,6 +731,22 @@
 #if !defined ETHARP_TABLE_MATCH_NETIF || defined __DOXYGEN__
 #define ETHARP_TABLE_MATCH_NETIF        !LWIP_SINGLE_NETIF
 #endif
+
+/** ETHARP_TABLE_HASH==1: allocate the ARP table from the heap and index it
+ * by a hash of the IP address, so lookups stay O(1) with thousands of
+ * entries. ARP_TABLE_SIZE then is the upper limit only, the actual number
+ * of entries is read from ETHARP_TABLE_CAPACITY when the table is created.
+ */
+#if !defined ETHARP_TABLE_HASH || defined __DOXYGEN__
+#define ETHARP_TABLE_HASH               0
+#endif
+
+/** ETHARP_TABLE_CAPACITY: number of ARP entries when ETHARP_TABLE_HASH==1.
+ * May expand to a variable, see etharp_table_reset().
+ */
+#if !defined ETHARP_TABLE_CAPACITY || defined __DOXYGEN__
+#define ETHARP_TABLE_CAPACITY           ARP_TABLE_SIZE
+#endif
 /**
  * @}
  */
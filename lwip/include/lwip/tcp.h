@@ -317,6 +317,10 @@ struct tcp_pcb {
 
   /* sender variables */
   u32_t snd_nxt;   /* next new seqno to be sent */
+#if defined(LWIP_TCP_REXMIT_COUNT) && LWIP_TCP_REXMIT_COUNT
+  /* segments sent again below snd_nxt, both fast retransmit and RTO */
+  u32_t rexmit_segs;
+#endif
   u32_t snd_wl1, snd_wl2; /* Sequence and acknowledgement numbers of last
                              window update. */
   u32_t snd_lbb;       /* Sequence number of next byte to be buffered. */
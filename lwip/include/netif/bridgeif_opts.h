@@ -68,6 +68,13 @@
 #define BRIDGEIF_MAX_PORTS                  7
 #endif
 
+/** BRIDGEIF_FDB_HASH==1: index the dynamic FDB in bridgeif_fdb.c by a hash
+ * of the MAC address instead of scanning all entries for every frame.
+ */
+#ifndef BRIDGEIF_FDB_HASH
+#define BRIDGEIF_FDB_HASH                   0
+#endif
+
 /** BRIDGEIF_DEBUG: Enable generic debugging in bridgeif.c. */
 #ifndef BRIDGEIF_DEBUG
 #define BRIDGEIF_DEBUG                      LWIP_DBG_OFF
@@ -560,4 +560,28 @@ bridgeif_add_port(struct netif *bridgeif, struct netif *portif)
   return ERR_OK;
 }
 
+/**
+ * @ingroup bridgeif
+ * Free the private data of a bridge. Call this after the bridge and its
+ * ports have been removed with @ref netif_remove.
+ */
+void
+bridgeif_deinit(struct netif *bridgeif)
+{
+  bridgeif_private_t *br;
+  u8_t i;
+
+  LWIP_ASSERT("bridgeif != NULL", bridgeif != NULL);
+  br = (bridgeif_private_t *)bridgeif->state;
+  if (br == NULL) {
+    return;
+  }
+  for (i = 0; i < br->num_ports; i++) {
+    netif_set_client_data(br->ports[i].port_netif, bridgeif_netif_client_id, NULL);
+  }
+  bridgeif_fdb_deinit(br->fdbd);
+  mem_free(br);
+  bridgeif->state = NULL;
+}
+
 #endif /* LWIP_NUM_NETIF_CLIENT_DATA */
@@ -56,13 +56,152 @@ typedef struct bridgeif_dfdb_entry_s {
   u8_t port;
   u32_t ts;
   struct eth_addr addr;
+#if BRIDGEIF_FDB_HASH
+  /** next entry in the same hash bucket, or in the free list if unused */
+  u16_t next;
+#endif /* BRIDGEIF_FDB_HASH */
 } bridgeif_dfdb_entry_t;
 
 typedef struct bridgeif_dfdb_s {
   u16_t max_fdb_entries;
   bridgeif_dfdb_entry_t *fdb;
+#if BRIDGEIF_FDB_HASH
+  u16_t *hash;
+  u16_t free;
+  u8_t hash_shift;
+#endif /* BRIDGEIF_FDB_HASH */
 } bridgeif_dfdb_t;
 
+#if BRIDGEIF_FDB_HASH
+#define BR_FDB_NONE 0xFFFF
+
+/* Hash-indexed variant: every used entry is linked into the bucket of its
+ * MAC address, unused entries are kept on a free list, so learning and
+ * looking up an address does not scan the table. Only aging still walks all
+ * entries, once per second. */
+
+static u32_t
+bridgeif_fdb_hash(const bridgeif_dfdb_t *fdb, const struct eth_addr *addr)
+{
+  u32_t h = ((u32_t)addr->addr[2] << 24) | ((u32_t)addr->addr[3] << 16) |
+            ((u32_t)addr->addr[4] << 8) | addr->addr[5];
+  h ^= ((u32_t)addr->addr[0] << 8) | addr->addr[1];
+  return (u32_t)(h * 0x9E3779B1UL) >> fdb->hash_shift;
+}
+
+static bridgeif_dfdb_entry_t *
+bridgeif_fdb_lookup(bridgeif_dfdb_t *fdb, const struct eth_addr *addr)
+{
+  u16_t i;
+  for (i = fdb->hash[bridgeif_fdb_hash(fdb, addr)]; i != BR_FDB_NONE; i = fdb->fdb[i].next) {
+    if (!memcmp(&fdb->fdb[i].addr, addr, sizeof(struct eth_addr))) {
+      return &fdb->fdb[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @ingroup bridgeif_fdb
+ * Remember the port a src mac address was seen on, or refresh its timeout
+ */
+void
+bridgeif_fdb_update_src(void *fdb_ptr, struct eth_addr *src_addr, u8_t port_idx)
+{
+  u16_t i;
+  u16_t *head;
+  bridgeif_dfdb_entry_t *e;
+  bridgeif_dfdb_t *fdb = (bridgeif_dfdb_t *)fdb_ptr;
+  BRIDGEIF_DECL_PROTECT(lev);
+  BRIDGEIF_READ_PROTECT(lev);
+  e = bridgeif_fdb_lookup(fdb, src_addr);
+  if (e != NULL) {
+    BRIDGEIF_WRITE_PROTECT(lev);
+    e->ts = BR_FDB_TIMEOUT_SEC;
+    e->port = port_idx;
+    BRIDGEIF_WRITE_UNPROTECT(lev);
+    BRIDGEIF_READ_UNPROTECT(lev);
+    return;
+  }
+  if (fdb->free == BR_FDB_NONE) {
+    /* not found, no free entry -> flood */
+    BRIDGEIF_READ_UNPROTECT(lev);
+    return;
+  }
+  BRIDGEIF_WRITE_PROTECT(lev);
+  i = fdb->free;
+  e = &fdb->fdb[i];
+  fdb->free = e->next;
+  LWIP_DEBUGF(BRIDGEIF_FDB_DEBUG, ("br: create src %02x:%02x:%02x:%02x:%02x:%02x (from %d) @ idx %d\n",
+                                   src_addr->addr[0], src_addr->addr[1], src_addr->addr[2], src_addr->addr[3], src_addr->addr[4], src_addr->addr[5],
+                                   port_idx, i));
+  memcpy(&e->addr, src_addr, sizeof(struct eth_addr));
+  e->ts = BR_FDB_TIMEOUT_SEC;
+  e->port = port_idx;
+  e->used = 1;
+  head = &fdb->hash[bridgeif_fdb_hash(fdb, src_addr)];
+  e->next = *head;
+  *head = i;
+  BRIDGEIF_WRITE_UNPROTECT(lev);
+  BRIDGEIF_READ_UNPROTECT(lev);
+}
+
+/**
+ * @ingroup bridgeif_fdb
+ * Look up the port of a dst mac address, return BR_FLOOD if unknown
+ */
+bridgeif_portmask_t
+bridgeif_fdb_get_dst_ports(void *fdb_ptr, struct eth_addr *dst_addr)
+{
+  bridgeif_portmask_t ret = BR_FLOOD;
+  bridgeif_dfdb_entry_t *e;
+  bridgeif_dfdb_t *fdb = (bridgeif_dfdb_t *)fdb_ptr;
+  BRIDGEIF_DECL_PROTECT(lev);
+  BRIDGEIF_READ_PROTECT(lev);
+  e = bridgeif_fdb_lookup(fdb, dst_addr);
+  if (e != NULL) {
+    ret = (bridgeif_portmask_t)(1 << e->port);
+  }
+  BRIDGEIF_READ_UNPROTECT(lev);
+  return ret;
+}
+
+/**
+ * @ingroup bridgeif_fdb
+ * Aging implementation of the hashed fdb, expired entries go back to the free list
+ */
+static void
+bridgeif_fdb_age_one_second(void *fdb_ptr)
+{
+  u16_t i;
+  bridgeif_dfdb_t *fdb;
+  BRIDGEIF_DECL_PROTECT(lev);
+
+  fdb = (bridgeif_dfdb_t *)fdb_ptr;
+  BRIDGEIF_READ_PROTECT(lev);
+
+  for (i = 0; i < fdb->max_fdb_entries; i++) {
+    bridgeif_dfdb_entry_t *e = &fdb->fdb[i];
+    if (e->used) {
+      BRIDGEIF_WRITE_PROTECT(lev);
+      if (e->used && --e->ts == 0) {
+        u16_t *pp = &fdb->hash[bridgeif_fdb_hash(fdb, &e->addr)];
+        while (*pp != i) {
+          pp = &fdb->fdb[*pp].next;
+        }
+        *pp = e->next;
+        e->used = 0;
+        e->next = fdb->free;
+        fdb->free = i;
+      }
+      BRIDGEIF_WRITE_UNPROTECT(lev);
+    }
+  }
+  BRIDGEIF_READ_UNPROTECT(lev);
+}
+
+#else /* BRIDGEIF_FDB_HASH */
+
 /**
  * @ingroup bridgeif_fdb
  * A real simple and slow implementation of an auto-learning forwarding database that
@@ -175,6 +314,8 @@ bridgeif_fdb_age_one_second(void *fdb_ptr)
   BRIDGEIF_READ_UNPROTECT(lev);
 }
 
+#endif /* BRIDGEIF_FDB_HASH */
+
 /** Timer callback for fdb aging, called once per second */
 static void
 bridgeif_age_tmr(void *arg)
@@ -196,7 +337,22 @@ bridgeif_fdb_init(u16_t max_fdb_entries)
 {
   bridgeif_dfdb_t *fdb;
   size_t alloc_len_sizet = sizeof(bridgeif_dfdb_t) + (max_fdb_entries * sizeof(bridgeif_dfdb_entry_t));
-  mem_size_t alloc_len = (mem_size_t)alloc_len_sizet;
+  mem_size_t alloc_len;
+#if BRIDGEIF_FDB_HASH
+  u32_t i, buckets = 2;
+  u8_t bits = 1;
+  if (max_fdb_entries == BR_FDB_NONE) {
+    /* BR_FDB_NONE marks the end of a list */
+    max_fdb_entries--;
+    alloc_len_sizet -= sizeof(bridgeif_dfdb_entry_t);
+  }
+  while (buckets < max_fdb_entries) {
+    buckets <<= 1;
+    bits++;
+  }
+  alloc_len_sizet += buckets * sizeof(u16_t);
+#endif /* BRIDGEIF_FDB_HASH */
+  alloc_len = (mem_size_t)alloc_len_sizet;
   LWIP_ASSERT("alloc_len == alloc_len_sizet", alloc_len == alloc_len_sizet);
   LWIP_DEBUGF(BRIDGEIF_DEBUG, ("bridgeif_fdb_init: allocating %d bytes for private FDB data\n", (int)alloc_len));
   fdb = (bridgeif_dfdb_t *)mem_calloc(1, alloc_len);
@@ -205,8 +361,30 @@ bridgeif_fdb_init(u16_t max_fdb_entries)
   }
   fdb->max_fdb_entries = max_fdb_entries;
   fdb->fdb = (bridgeif_dfdb_entry_t *)(fdb + 1);
+#if BRIDGEIF_FDB_HASH
+  fdb->hash = (u16_t *)(fdb->fdb + max_fdb_entries);
+  fdb->hash_shift = (u8_t)(32 - bits);
+  for (i = 0; i < buckets; i++) {
+    fdb->hash[i] = BR_FDB_NONE;
+  }
+  for (i = 0; i < max_fdb_entries; i++) {
+    fdb->fdb[i].next = (u16_t)(i + 1 < max_fdb_entries ? i + 1 : BR_FDB_NONE);
+  }
+  fdb->free = max_fdb_entries ? 0 : BR_FDB_NONE;
+#endif /* BRIDGEIF_FDB_HASH */
 
   sys_timeout(BRIDGEIF_AGE_TIMER_MS, bridgeif_age_tmr, fdb);
 
   return fdb;
 }
+
+/**
+ * @ingroup bridgeif_fdb
+ * Stop aging and free an fdb created by bridgeif_fdb_init
+ */
+void
+bridgeif_fdb_deinit(void *fdb_ptr)
+{
+  sys_untimeout(bridgeif_age_tmr, fdb_ptr);
+  mem_free(fdb_ptr);
+}
@@ -74,6 +74,7 @@ static void pppos_input_free_current_packet(pppos_pcb *pppos);
 static void pppos_input_drop(pppos_pcb *pppos);
 static err_t pppos_output_append(pppos_pcb *pppos, err_t err, struct pbuf *nb, u8_t c, u8_t accm, u16_t *fcs);
 static err_t pppos_output_last(pppos_pcb *pppos, err_t err, struct pbuf *nb, u16_t *fcs);
+static err_t pppos_output_append_buf(pppos_pcb *pppos, err_t err, struct pbuf *nb, const u8_t *s, u16_t n, u16_t *fcs);
 
 /* Callbacks structure for PPP core */
 static const struct link_callbacks pppos_callbacks = {
@@ -235,9 +236,7 @@ pppos_write(ppp_pcb *ppp, void *ctx, struct pbuf *p)
   fcs_out = PPP_INITFCS;
   s = (u8_t*)p->payload;
   n = p->len;
-  while (n-- > 0) {
-    err = pppos_output_append(pppos, err,  nb, *s++, 1, &fcs_out);
-  }
+  err = pppos_output_append_buf(pppos, err, nb, s, n, &fcs_out);
 
   err = pppos_output_last(pppos, err, nb, &fcs_out);
   if (err == ERR_OK) {
@@ -294,12 +293,7 @@ pppos_netif_output(ppp_pcb *ppp, void *ctx, struct pbuf *pb, u16_t protocol)
 
   /* Load packet. */
   for(p = pb; p; p = p->next) {
-    u16_t n = p->len;
-    u8_t *s = (u8_t*)p->payload;
-
-    while (n-- > 0) {
-      err = pppos_output_append(pppos, err,  nb, *s++, 1, &fcs_out);
-    }
+    err = pppos_output_append_buf(pppos, err, nb, (const u8_t*)p->payload, p->len, &fcs_out);
   }
 
   err = pppos_output_last(pppos, err, nb, &fcs_out);
@@ -500,7 +494,25 @@ pppos_input(ppp_pcb *ppp, const void *s, int l)
   PPPOS_UNPROTECT(lev);
 
   PPPDEBUG(LOG_DEBUG, ("pppos_input[%d]: got %d bytes\n", ppp->netif->num, l));
-  while (l-- > 0) {
+  while (l > 0) {
+#ifdef PPPOS_HDLC_SCAN
+    /* Fast path: inside the data field, copy a whole run of characters
+     * that are neither escaped nor special straight into the current pbuf. */
+    if (pppos->in_state == PDDATA && !pppos->in_escaped && pppos->in_tail != NULL
+        && pppos->in_tail->len < PBUF_POOL_BUFSIZE) {
+      int run = (int)PPPOS_HDLC_SCAN(pppos->in_accm, s_u8,
+                                     LWIP_MIN(l, PBUF_POOL_BUFSIZE - pppos->in_tail->len));
+      if (run > 0) {
+        MEMCPY((u8_t*)pppos->in_tail->payload + pppos->in_tail->len, s_u8, run);
+        pppos->in_tail->len += run;
+        pppos->in_fcs = PPPOS_FCS_BLOCK(pppos->in_fcs, s_u8, run);
+        s_u8 += run;
+        l -= run;
+        continue;
+      }
+    }
+#endif /* PPPOS_HDLC_SCAN */
+    l--;
     cur_char = *s_u8++;
 
     PPPOS_PROTECT(lev);
@@ -898,6 +910,37 @@ pppos_output_append(pppos_pcb *pppos, err_t err, struct pbuf *nb, u8_t c, u8_t a
   return ERR_OK;
 }
 
+/*
+ * pppos_output_append_buf - append a buffer, escaping and updating the FCS.
+ * With PPPOS_HDLC_SCAN, runs of characters that need no escaping are copied
+ * in one go; the remaining ones go through pppos_output_append().
+ */
+static err_t
+pppos_output_append_buf(pppos_pcb *pppos, err_t err, struct pbuf *nb, const u8_t *s, u16_t n, u16_t *fcs)
+{
+#ifdef PPPOS_HDLC_SCAN
+  while (err == ERR_OK && n > 0) {
+    u16_t run = (u16_t)PPPOS_HDLC_SCAN(pppos->out_accm, s, LWIP_MIN(n, PBUF_POOL_BUFSIZE - nb->len));
+    if (run > 0) {
+      MEMCPY((u8_t*)nb->payload + nb->len, s, run);
+      nb->len += run;
+      *fcs = PPPOS_FCS_BLOCK(*fcs, s, run);
+      s += run;
+      n -= run;
+    } else {
+      /* Special character or full buffer, pppos_output_append() flushes. */
+      err = pppos_output_append(pppos, err, nb, *s++, 1, fcs);
+      n--;
+    }
+  }
+#else /* PPPOS_HDLC_SCAN */
+  while (n-- > 0) {
+    err = pppos_output_append(pppos, err, nb, *s++, 1, fcs);
+  }
+#endif /* PPPOS_HDLC_SCAN */
+  return err;
+}
+
 static err_t
 pppos_output_last(pppos_pcb *pppos, err_t err, struct pbuf *nb, u16_t *fcs)
 {
@@ -35,6 +35,7 @@
 #include "netif/ppp/pppdebug.h"
 
 #include "netif/ppp/vj.h"
+#include "lwip/inet_chksum.h"
 
 #include <string.h>
 
@@ -499,7 +500,6 @@ vj_uncompress_tcp(struct pbuf **nb, struct vjcompress *comp)
   u8_t *cp;
   struct tcp_hdr *th;
   struct cstate *cs;
-  struct vj_u16_t *bp;
   struct pbuf *n0 = *nb;
   u32_t tmp;
   u32_t vjlen, hlen, changes;
@@ -608,15 +608,11 @@ vj_uncompress_tcp(struct pbuf **nb, struct vjcompress *comp)
   IPH_LEN_SET(&cs->cs_ip, lwip_htons(n0->tot_len - vjlen + cs->cs_hlen));
 #endif
 
-  /* recompute the ip header checksum */
-  bp = (struct vj_u16_t*) &cs->cs_ip;
+  /* recompute the ip header checksum; summing the header through a
+   * struct vj_u16_t pointer broke strict aliasing, so at -O2 and above the
+   * old checksum could be read back after IPH_CHKSUM_SET cleared it */
   IPH_CHKSUM_SET(&cs->cs_ip, 0);
-  for (tmp = 0; hlen > 0; hlen -= 2) {
-    tmp += (*bp++).v;
-  }
-  tmp = (tmp & 0xffff) + (tmp >> 16);
-  tmp = (tmp & 0xffff) + (tmp >> 16);
-  IPH_CHKSUM_SET(&cs->cs_ip,  (u16_t)(~tmp));
+  IPH_CHKSUM_SET(&cs->cs_ip, inet_chksum(&cs->cs_ip, (u16_t)hlen));
 
   /* Remove the compressed header and prepend the uncompressed header. */
   if (pbuf_remove_header(n0, vjlen)) {
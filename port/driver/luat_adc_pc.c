@@ -6,9 +6,28 @@
 #include <stdlib.h>
 #include "luat_mock.h"
 #include "luat_adc.h"
+#include "luat_ztt.h"
+
+// 外部模拟器注入的ADC值, 下标是通道号+2, 包含CPU(-1)和VBAT(-2)
+#define ADC_INJECT_MAX (32)
+static struct {
+    uint8_t enable;
+    int val;
+    int val2;
+}adc_injects[ADC_INJECT_MAX];
+
+int luat_adc_pc_inject(int ch, int enable, int val, int val2) {
+    if (ch + 2 < 0 || ch + 2 >= ADC_INJECT_MAX)
+        return -1;
+    adc_injects[ch + 2].enable = enable ? 1 : 0;
+    adc_injects[ch + 2].val = val;
+    adc_injects[ch + 2].val2 = val2;
+    return 0;
+}
 
 int luat_adc_open(int pin, void* args) {
     (void)args;
+    LUAT_ZTT(LUAT_ZTT_ADC, LUAT_ZTT_SETUP, pin, 0, 0, 0, 0);
     #ifdef LUAT_USE_MOCKAPI
     int ret = 0;
     luat_mock_ctx_t ctx = {0};
@@ -25,6 +44,12 @@ int luat_adc_open(int pin, void* args) {
 }
 
 int luat_adc_read(int pin, int* val, int* val2) {
+    if (pin + 2 >= 0 && pin + 2 < ADC_INJECT_MAX && adc_injects[pin + 2].enable) {
+      *val = adc_injects[pin + 2].val;
+      *val2 = adc_injects[pin + 2].val2;
+      LUAT_ZTT(LUAT_ZTT_ADC, LUAT_ZTT_GET, pin, *val, *val2, 0, 0);
+      return 0;
+    }
     #ifdef LUAT_USE_MOCKAPI
     int ret = 0;
     luat_mock_ctx_t ctx = {0};
@@ -32,9 +57,22 @@ int luat_adc_read(int pin, int* val, int* val2) {
     ctx.req_data = (char*)&pin;
     memcpy(ctx.key, "adc.read", strlen("adc.read"));
     ret = luat_mock_call(&ctx);
+    if (ret == 0 && ctx.resp_type == LUA_TNUMBER && ctx.resp_len == sizeof(lua_Integer)) {
+      // 单个数字(mock脚本返回数字, 或者mock表里的常量/seq元素)是lua_Integer, 原始值和电压值相同
+      lua_Integer v;
+      memcpy(&v, ctx.resp_data, sizeof(lua_Integer));
+      *val = *val2 = (int)v;
+      LUAT_ZTT(LUAT_ZTT_ADC, LUAT_ZTT_GET, pin, *val, *val2, 0, 0);
+      return 0;
+    }
     if (ret == 0 && ctx.resp_len >= sizeof(int)) {
       memcpy(val, ctx.resp_data, sizeof(int));
-      memcpy(val2, ctx.resp_data + sizeof(int), sizeof(int));
+      // 只给了一个int(例如mock表的range)时, 原始值和电压值相同
+      if (ctx.resp_len >= 2 * sizeof(int))
+        memcpy(val2, ctx.resp_data + sizeof(int), sizeof(int));
+      else
+        *val2 = *val;
+      LUAT_ZTT(LUAT_ZTT_ADC, LUAT_ZTT_GET, pin, *val, *val2, 0, 0);
       return 0;
     }
     #endif
@@ -50,9 +88,11 @@ int luat_adc_read(int pin, int* val, int* val2) {
       *val = -1;
       *val2 = -1;
     }
+    LUAT_ZTT(LUAT_ZTT_ADC, LUAT_ZTT_GET, pin, *val, *val2, 0, 0);
     return 0;
 }
 int luat_adc_close(int pin) {
+    LUAT_ZTT(LUAT_ZTT_ADC, LUAT_ZTT_CLOSE, pin, 0, 0, 0, 0);
     #ifdef LUAT_USE_MOCKAPI
     int ret = 0;
     luat_mock_ctx_t ctx = {0};
@@ -1,15 +1,22 @@
+#include "uv.h"
+
 #include "luat_base.h"
 #include "luat_malloc.h"
 #include "luat_msgbus.h"
 #include "luat_timer.h"
 #include "luat_gpio.h"
 #include "luat_irq.h"
-#include "luat_gpio.h"
 #include "luat_gpio_drv.h"
 
 #include "luat_ztt.h"
+#include "luat_pcconf.h"
+
+#define LUAT_LOG_TAG "gpio"
+#include "luat_log.h"
 
-luat_gpio_drv_opts_t* gpio_drvs[128];
+extern uv_loop_t *main_loop;
+
+const luat_gpio_drv_opts_t* gpio_drvs[128];
 
 luat_gpio_t gpio_confs[128];
 uint8_t gpio_levels[128];
@@ -19,13 +26,7 @@ int luat_gpio_setup(luat_gpio_t *gpio){
         return -1;
     memcpy(&gpio_confs[gpio->pin], gpio, sizeof(luat_gpio_t));
 
-    luat_ztt_t* ztt = ztt_create("gpio");
-    ztt_add(ztt, "action", "setup", strlen("setup"));
-    ztt_addf(ztt, "pin", "%d", gpio->pin);
-    ztt_addf(ztt, "mode", "%d", gpio->mode);
-    ztt_addf(ztt, "pull", "%d", gpio->pull);
-    ztt_addf(ztt, "irq", "%d", gpio->irq);
-    ztt_commit(ztt);
+    LUAT_ZTT(LUAT_ZTT_GPIO, LUAT_ZTT_SETUP, gpio->pin, gpio->mode, gpio->pull, gpio->irq, 0);
 
     if (gpio_drvs[gpio->pin]) {
         return gpio_drvs[gpio->pin]->setup(NULL, gpio);
@@ -39,11 +40,7 @@ int luat_gpio_set(int pin, int level)
         return -1;
     gpio_levels[pin] = level == 0 ? 0 : 1;
 
-    luat_ztt_t* ztt = ztt_create("gpio");
-    ztt_add(ztt, "action", "set", strlen("set"));
-    ztt_addf(ztt, "pin", "%d", pin);
-    ztt_addf(ztt, "level", "%d", level);
-    ztt_commit(ztt);
+    LUAT_ZTT(LUAT_ZTT_GPIO, LUAT_ZTT_SET, pin, gpio_levels[pin], 0, 0, 0);
 
     if (gpio_drvs[pin]) {
         return gpio_drvs[pin]->write(NULL, pin, level);
@@ -66,18 +63,15 @@ int luat_gpio_get(int pin)
     if (pin < 0 || pin >= 128)
         return -1;
 
-    luat_ztt_t* ztt = ztt_create("gpio");
-    ztt_add(ztt, "action", "get", strlen("get"));
-    ztt_addf(ztt, "pin", "%d", pin);
-    ztt_commit(ztt);
-
+    int level = 0;
     if (gpio_drvs[pin]) {
-        return gpio_drvs[pin]->read(NULL, pin);
+        level = gpio_drvs[pin]->read(NULL, pin);
     }
-    if (gpio_confs[pin].mode == LUAT_GPIO_INPUT || gpio_confs[pin].mode == LUAT_GPIO_IRQ) {
-        return gpio_levels[pin];
+    else if (gpio_confs[pin].mode == LUAT_GPIO_INPUT || gpio_confs[pin].mode == LUAT_GPIO_IRQ) {
+        level = gpio_levels[pin];
     }
-    return 0;
+    LUAT_ZTT(LUAT_ZTT_GPIO, LUAT_ZTT_GET, pin, level, 0, 0, 0);
+    return level;
 }
 
 void luat_gpio_close(int pin)
@@ -85,10 +79,7 @@ void luat_gpio_close(int pin)
     if (pin < 0 || pin >= 128)
         return;
 
-    luat_ztt_t* ztt = ztt_create("gpio");
-    ztt_add(ztt, "action", "close", strlen("close"));
-    ztt_addf(ztt, "pin", "%d", pin);
-    ztt_commit(ztt);
+    LUAT_ZTT(LUAT_ZTT_GPIO, LUAT_ZTT_CLOSE, pin, 0, 0, 0, 0);
 
     memset(&gpio_confs[pin], 0, sizeof(luat_gpio_t));
     gpio_confs[pin].mode = LUAT_GPIO_INPUT;
@@ -97,3 +88,249 @@ void luat_gpio_close(int pin)
     }
 }
 
+
+//-------------------------------------------------------------
+// 输入脚注入与中断统计
+
+static luat_gpio_irq_stat_t irq_stat;
+
+// 已经放进msgbus的中断的边沿时间, 与消息的顺序一致, 处理函数执行时取出
+// 积压多少就存多少, 满了翻倍, 不让时间戳和消息对不上
+static uint64_t* irq_ts;
+static uint32_t irq_ts_size;
+static uint32_t irq_ts_head;
+static uint32_t irq_ts_tail;
+
+static int irq_ts_push(uint64_t ts) {
+    if (irq_ts_head - irq_ts_tail == irq_ts_size) {
+        uint32_t size = irq_ts_size ? irq_ts_size * 2 : 1024;
+        uint64_t* tmp = luat_heap_malloc(sizeof(uint64_t) * size);
+        if (tmp == NULL)
+            return -1;
+        for (uint32_t i = 0; i < irq_ts_size; i++)
+            tmp[i] = irq_ts[(irq_ts_tail + i) & (irq_ts_size - 1)];
+        if (irq_ts)
+            luat_heap_free(irq_ts);
+        irq_ts = tmp;
+        irq_ts_tail = 0;
+        irq_ts_head = irq_ts_size;
+        irq_ts_size = size;
+    }
+    irq_ts[irq_ts_head++ & (irq_ts_size - 1)] = ts;
+    return 0;
+}
+
+static uint32_t ns_clamp(uint64_t ns) {
+    return ns > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)ns;
+}
+
+static int pulse_active;
+static void pulse_run_all(void);
+
+static int l_gpio_irq_pc_handler(lua_State *L, void* ptr) {
+    uint64_t start = uv_hrtime();
+    if (irq_ts_head != irq_ts_tail) {
+        uint64_t ts = irq_ts[irq_ts_tail++ & (irq_ts_size - 1)];
+        luat_hist_record(&irq_stat.latency_ns, ns_clamp(start > ts ? start - ts : 0));
+    }
+    if (irq_stat.pending)
+        irq_stat.pending--;
+    irq_stat.handled++;
+    // 消息仍在栈顶, 交给gpio库原来的处理函数
+    int ret = l_gpio_handler(L, ptr);
+    luat_hist_record(&irq_stat.cb_ns, ns_clamp(uv_hrtime() - start));
+    if (pulse_active)
+        pulse_run_all();
+    return ret;
+}
+
+// 与luat_irq_gpio_cb放进msgbus的消息相同, 只是换成带时间戳的处理函数.
+// 注入都在事件循环里进行, 统计和时间戳不需要加锁
+static int irq_post(int pin, int level, uint64_t ts) {
+    if (irq_stat.depth && irq_stat.pending >= irq_stat.depth) {
+        irq_stat.lost++;
+        return 0;
+    }
+    if (irq_ts_push(ts)) {
+        irq_stat.lost++;
+        return 0;
+    }
+    rtos_msg_t msg = {
+        .handler = l_gpio_irq_pc_handler,
+        .ptr = NULL,
+        .arg1 = pin,
+        .arg2 = level
+    };
+    if (luat_msgbus_put(&msg, 0)) {
+        // 时间戳与消息一一对应, 放不进去就撤回
+        irq_ts_head--;
+        irq_stat.lost++;
+        return 0;
+    }
+    irq_stat.pending++;
+    if (irq_stat.pending > irq_stat.pending_max)
+        irq_stat.pending_max = irq_stat.pending;
+    return 1;
+}
+
+const luat_gpio_irq_stat_t* luat_gpio_irq_stat(void) {
+    return &irq_stat;
+}
+
+void luat_gpio_irq_stat_reset(void) {
+    // 排队中的中断与上限保留
+    uint32_t pending = irq_stat.pending;
+    uint32_t depth = irq_stat.depth;
+    memset(&irq_stat, 0, sizeof(irq_stat));
+    irq_stat.pending = pending;
+    irq_stat.pending_max = pending;
+    irq_stat.depth = depth;
+}
+
+void luat_gpio_irq_depth(uint32_t depth) {
+    irq_stat.depth = depth;
+}
+
+// 外部模拟器注入输入脚的电平, 中断脚按触发方式产生中断, 与真实硬件一样经过msgbus回到lua
+int luat_gpio_pc_inject(int pin, int level, uint64_t ts_ns)
+{
+    if (pin < 0 || pin >= 128)
+        return -1;
+    level = level ? 1 : 0;
+    int old = gpio_levels[pin];
+    gpio_levels[pin] = level;
+    if (old != level)
+        irq_stat.edges++;
+    luat_gpio_t* conf = &gpio_confs[pin];
+    if (conf->mode != LUAT_GPIO_IRQ)
+        return 0;
+    int fire = 0;
+    switch (conf->irq)
+    {
+    case LUAT_GPIO_RISING:
+        fire = !old && level;
+        break;
+    case LUAT_GPIO_FALLING:
+        fire = old && !level;
+        break;
+    case LUAT_GPIO_BOTH:
+        fire = old != level;
+        break;
+    case LUAT_GPIO_HIGH_IRQ:
+        fire = level;
+        break;
+    case LUAT_GPIO_LOW_IRQ:
+        fire = !level;
+        break;
+    default:
+        break;
+    }
+    if (!fire)
+        return 0;
+    irq_stat.fired++;
+    // C模块注册的回调直接调用, lua回调的中断由这里放进msgbus, 以便统计延迟
+    if (conf->irq_cb && conf->irq_cb != luat_irq_gpio_cb)
+        conf->irq_cb(pin, conf->irq_args);
+    else
+        irq_post(pin, level, ts_ns ? ts_ns : uv_hrtime());
+    return 1;
+}
+
+//-------------------------------------------------------------
+// 脉冲发生器, 边沿时间按频率推算, 到期就注入
+// 事件循环空闲时由idle句柄注入, lua回调忙的时候每个中断处理完也补上到期的边沿,
+// 与真实硬件一样, 回调再慢边沿也按时出现
+
+// 每次最多注入的边沿数, 频率再高也要让出事件循环
+#define GPIO_PULSE_RUN_MAX (10000)
+
+typedef struct gpio_pulse
+{
+    uv_idle_t idle;
+    int pin;
+    uint32_t hz;
+    uint64_t start_ns;
+    uint64_t edges;     // 一共要产生的边沿数, 脉冲数的两倍
+    uint64_t done;
+}gpio_pulse_t;
+
+static gpio_pulse_t* pulses[128];
+
+static void pulse_stop(int pin) {
+    if (pulses[pin] == NULL)
+        return;
+    uv_idle_stop(&pulses[pin]->idle);
+    free_uv_handle(&pulses[pin]->idle);
+    pulses[pin] = NULL;
+    pulse_active--;
+}
+
+// 第k个边沿的时间, 上升沿在整周期, 下降沿在半周期
+static uint64_t pulse_edge_ns(gpio_pulse_t* p, uint64_t k) {
+    return p->start_ns + k * 500000000ull / p->hz;
+}
+
+static void pulse_run(gpio_pulse_t* p, uint64_t now) {
+    uint32_t n = 0;
+    while (p->done < p->edges && n < GPIO_PULSE_RUN_MAX) {
+        uint64_t ts = pulse_edge_ns(p, p->done);
+        if (ts > now)
+            break;
+        luat_gpio_pc_inject(p->pin, (p->done & 1) == 0, ts);
+        p->done++;
+        n++;
+    }
+    if (p->done >= p->edges)
+        pulse_stop(p->pin);
+}
+
+static void pulse_run_all(void) {
+    uint64_t now = uv_hrtime();
+    for (size_t i = 0; i < 128 && pulse_active; i++) {
+        if (pulses[i])
+            pulse_run(pulses[i], now);
+    }
+}
+
+static void pulse_idle_cb(uv_idle_t* handle) {
+    pulse_run((gpio_pulse_t*)handle->data, uv_hrtime());
+}
+
+int luat_gpio_pc_pulse(int pin, uint32_t count, uint32_t hz)
+{
+    if (pin < 0 || pin >= 128)
+        return -1;
+    pulse_stop(pin);
+    if (count == 0)
+        return 0;
+    // 从低电平开始, 第一个边沿是上升沿
+    gpio_levels[pin] = 0;
+    if (hz == 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            luat_gpio_pc_inject(pin, 1, 0);
+            luat_gpio_pc_inject(pin, 0, 0);
+        }
+        return 0;
+    }
+    gpio_pulse_t* p = luat_heap_malloc(sizeof(gpio_pulse_t));
+    if (p == NULL)
+        return -1;
+    memset(p, 0, sizeof(gpio_pulse_t));
+    p->pin = pin;
+    p->hz = hz;
+    p->edges = (uint64_t)count * 2;
+    p->start_ns = uv_hrtime();
+    uv_idle_init(main_loop, &p->idle);
+    p->idle.data = p;
+    uv_idle_start(&p->idle, pulse_idle_cb);
+    pulses[pin] = p;
+    pulse_active++;
+    return 0;
+}
+
+uint32_t luat_gpio_pc_pulse_left(int pin)
+{
+    if (pin < 0 || pin >= 128 || pulses[pin] == NULL)
+        return 0;
+    return (uint32_t)((pulses[pin]->edges - pulses[pin]->done + 1) / 2);
+}
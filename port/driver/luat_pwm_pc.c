@@ -6,8 +6,10 @@
 #include <stdlib.h>
 #include "luat_mock.h"
 #include "luat_pwm.h"
+#include "luat_ztt.h"
 
 int luat_pwm_open(int channel, size_t period, size_t pulse, int pnum) {
+    LUAT_ZTT(LUAT_ZTT_PWM, LUAT_ZTT_SETUP, channel, (int32_t)period, (int32_t)pulse, pnum, 0);
     #ifdef LUAT_USE_MOCKAPI
     int ret = 0;
     luat_mock_ctx_t ctx = {0};
@@ -30,6 +32,7 @@ int luat_pwm_open(int channel, size_t period, size_t pulse, int pnum) {
 }
 
 int luat_pwm_setup(luat_pwm_conf_t* conf) {
+    LUAT_ZTT(LUAT_ZTT_PWM, LUAT_ZTT_SETUP, conf->channel, (int32_t)conf->period, (int32_t)conf->pulse, (int32_t)conf->pnum, 0);
 
     #ifdef LUAT_USE_MOCKAPI
     int ret = 0;
@@ -51,6 +54,7 @@ int luat_pwm_capture(int channel,int freq) {
 }
 
 int luat_pwm_close(int channel) {
+    LUAT_ZTT(LUAT_ZTT_PWM, LUAT_ZTT_CLOSE, channel, 0, 0, 0, 0);
 
     #ifdef LUAT_USE_MOCKAPI
     int ret = 0;
@@ -68,6 +72,7 @@ int luat_pwm_close(int channel) {
 }
 
 int luat_pwm_update_dutycycle(int channel, size_t pulse) {
+    LUAT_ZTT(LUAT_ZTT_PWM, LUAT_ZTT_SET, channel, 0, (int32_t)pulse, 0, 0);
     #ifdef LUAT_USE_MOCKAPI
     int ret = 0;
     luat_mock_ctx_t ctx = {0};
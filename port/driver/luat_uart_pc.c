@@ -1,3 +1,4 @@
+#include "uv.h"
 #include <stdlib.h>
 #include <string.h>//add for memset
 #include "luat_base.h"
@@ -5,28 +6,157 @@
 #include "luat_uart.h"
 
 #include "luat_uart_drv.h"
+#include "luat_msgbus.h"
+#include "luat_pcconf.h"
+#include "luat_ztt.h"
 
 #define LUAT_LOG_TAG "uart"
 #include "luat_log.h"
 
 const luat_uart_drv_opts_t* uart_drvs[128];
 
+typedef struct uart_rx_hook
+{
+    luat_uart_rx_hook_t hook;
+    void* userdata;
+}uart_rx_hook_t;
+
+static uart_rx_hook_t rx_hooks[128];
+
+// 接收事件合并, 与硬件串口的FIFO阈值中断和接收超时中断类似:
+// 攒够threshold字节, 或者超过idle_ms没有新数据时, 才给Lua发一次receive事件, 两者都为0时每收到一段数据就通知
+typedef struct uart_rx_coalesce
+{
+    uint32_t threshold;
+    uint32_t idle_ms;
+}uart_rx_coalesce_t;
+
+static uart_rx_coalesce_t rx_coalesce[128];
+
+typedef struct uart_rx_ring
+{
+    int id;
+    uint8_t* buff;
+    size_t size;
+    size_t head;            // 下一个写入的位置
+    size_t used;
+    uint64_t rx_bytes;
+    uint64_t overflow_bytes;
+    uint32_t overflow_count;
+    uint8_t overflowed;     // 上次读取之后已经告警过
+    uint32_t events;        // 发给Lua的receive事件数
+    size_t pending;         // 还没通知的字节数
+    size_t held;            // 限速模式下已经存进来, 但按波特率还没"到达"的字节数, 在缓冲区的最后
+    uv_timer_t* idle_timer;
+}uart_rx_ring_t;
+
+static uart_rx_ring_t* rx_rings[128];
+extern uv_loop_t *main_loop;
+
+// 按波特率限速, 模拟真实串口的线路速度:
+// 发送的数据先进发送缓冲区, 接收的数据先按held留在接收缓冲区里, 定时器按令牌桶放行,
+// 一个字符在线路上的时间是(起始位+数据位+校验位+停止位)/波特率
+#define UART_PACE_BURST_NS      (10 * 1000 * 1000)
+#define UART_PACE_TX_MIN        4096
+#define UART_METER_WINDOW_NS    (1000 * 1000 * 1000ull)
+
+typedef struct uart_pace
+{
+    int id;
+    uint64_t byte_ns;       // 一个字符在线路上占用的时间
+    uint64_t last_ns;
+    uint64_t tx_credit_ns;
+    uint64_t rx_credit_ns;
+    uint8_t* tx_buff;
+    size_t tx_size;
+    size_t tx_pos;          // 下一个要发出的字节
+    size_t tx_len;
+    uint8_t tx_full;
+    uint8_t tx_writing;     // 正在调用驱动的write
+    uint8_t tx_drv_done;    // 驱动在write里就同步发完了
+    uv_timer_t* timer;
+}uart_pace_t;
+
+// 统计最近1秒的实际速率
+typedef struct uart_meter
+{
+    uint64_t bytes;
+    uint64_t win_start;
+    uint64_t win_bytes;
+    uint32_t rate;
+}uart_meter_t;
+
+typedef struct uart_line
+{
+    uint32_t baud_rate;
+    uint8_t frame_bits;
+    uint8_t opened;
+    uint8_t pace_enable;    // 在uart.setup之前设置也有效, uart.close之后保留
+    size_t bufsz;
+    uart_pace_t* pace;
+    uart_meter_t tx;
+    uart_meter_t rx;
+}uart_line_t;
+
+static uart_line_t lines[128];
+
+static int pace_write(uart_pace_t* p, const void* data, size_t len);
+static void pace_open(int uart_id);
+static void pace_close(int uart_id, int flush);
+static void meter_add(uart_meter_t* m, size_t len);
+static void pace_kick(uart_pace_t* p);
+
 int luat_uart_setup(luat_uart_t* uart) {
     if (!luat_uart_exist(uart->id))
         return -1;
-    return uart_drvs[uart->id]->setup(NULL, uart);
+    LUAT_ZTT(LUAT_ZTT_UART, LUAT_ZTT_SETUP, uart->id, uart->baud_rate, uart->data_bits, uart->parity, uart->stop_bits);
+    int ret = uart_drvs[uart->id]->setup(NULL, uart);
+    if (ret)
+        return ret;
+    uart_line_t* line = &lines[uart->id];
+    uint8_t bits = 1 + (uart->data_bits ? uart->data_bits : 8) + (uart->parity != LUAT_PARITY_NONE) + (uart->stop_bits > 1 ? 2 : 1);
+    if (!line->opened || line->baud_rate != uart->baud_rate || line->frame_bits != bits) {
+        line->baud_rate = uart->baud_rate;
+        line->frame_bits = bits;
+        line->bufsz = uart->bufsz;
+        if (!line->opened) {
+            memset(&line->tx, 0, sizeof(uart_meter_t));
+            memset(&line->rx, 0, sizeof(uart_meter_t));
+            line->tx.win_start = line->rx.win_start = uv_hrtime();
+        }
+        line->opened = 1;
+        // 波特率变了, 重新计算字符时间
+        pace_close(uart->id, 1);
+        if (line->pace_enable)
+            pace_open(uart->id);
+    }
+    return 0;
 }
 
 int luat_uart_write(int uart_id, void* buffer, size_t length) {
     if (!luat_uart_exist(uart_id))
         return -1;
-    return uart_drvs[uart_id]->write(NULL, uart_id, buffer, length);
+    int ret;
+    if (lines[uart_id].pace) {
+        ret = pace_write(lines[uart_id].pace, buffer, length);
+    }
+    else {
+        ret = uart_drvs[uart_id]->write(NULL, uart_id, buffer, length);
+        if (ret > 0)
+            meter_add(&lines[uart_id].tx, ret);
+    }
+    if (ret > 0)
+        luat_uart_capture(uart_id, 1, buffer, ret);
+    LUAT_ZTT(LUAT_ZTT_UART, LUAT_ZTT_SET, uart_id, (int32_t)length, ret, 0, 0);
+    return ret;
 }
 
 int luat_uart_read(int uart_id, void* buffer, size_t length) {
     if (!luat_uart_exist(uart_id))
         return -1;
-    return uart_drvs[uart_id]->read(NULL, uart_id, buffer, length);
+    int ret = uart_drvs[uart_id]->read(NULL, uart_id, buffer, length);
+    LUAT_ZTT(LUAT_ZTT_UART, LUAT_ZTT_GET, uart_id, (int32_t)length, ret, 0, 0);
+    return ret;
 }
 
 // void luat_uart_clear_rx_cache(int uart_id) {
@@ -36,6 +166,10 @@ int luat_uart_read(int uart_id, void* buffer, size_t length) {
 int luat_uart_close(int uart_id) {
     if (!luat_uart_exist(uart_id))
         return 0;
+    // 与硬件一样, 关闭时没发完的数据直接丢弃
+    pace_close(uart_id, 0);
+    lines[uart_id].opened = 0;
+    LUAT_ZTT(LUAT_ZTT_UART, LUAT_ZTT_CLOSE, uart_id, 0, 0, 0, 0);
     return uart_drvs[uart_id]->close(NULL, uart_id);
 }
 
@@ -49,6 +183,533 @@ int luat_uart_exist(int uart_id) {
     return 0;
 }
 
+extern const luat_uart_drv_opts_t uart_udp;
+
+int luat_uart_drv_config(int uart_id, const char* url) {
+    if (!luat_uart_exist(uart_id))
+        return -1;
+    if (!strcmp(url, "udp")) {
+        uart_drvs[uart_id] = &uart_udp;
+        return 0;
+    }
+    if (luat_uart_stream_config(uart_id, url) == 0)
+        return 0;
+    if (luat_uart_tty_config(uart_id, url) == 0)
+        return 0;
+    if (luat_uart_replay_config(uart_id, url) == 0)
+        return 0;
+    LLOGE("uart %d 无法识别的配置 %s", uart_id, url);
+    return -1;
+}
+
 int luat_setup_cb(int uartid, int received, int sent) {
     return 0;
 }
+
+int luat_uart_set_rx_hook(int uart_id, luat_uart_rx_hook_t hook, void* userdata) {
+    if (!luat_uart_exist(uart_id))
+        return -1;
+    if (hook && rx_hooks[uart_id].hook && rx_hooks[uart_id].hook != hook) {
+        LLOGE("uart %d 已经被接管", uart_id);
+        return -1;
+    }
+    rx_hooks[uart_id].hook = hook;
+    rx_hooks[uart_id].userdata = hook ? userdata : NULL;
+    return 0;
+}
+
+int luat_uart_is_hooked(int uart_id) {
+    if (uart_id < 0 || uart_id >= 128)
+        return 0;
+    return rx_hooks[uart_id].hook != NULL;
+}
+
+static int l_uart_rx_hook_handler(lua_State *L, void* ptr) {
+    (void)ptr;
+    rtos_msg_t* msg = (rtos_msg_t*)lua_topointer(L, -1);
+    int uart_id = msg->arg1;
+    if (uart_id < 0 || uart_id >= 128)
+        return 0;
+    // 转发的途中可能已经取消了接管, 数据留在驱动里
+    if (rx_hooks[uart_id].hook)
+        rx_hooks[uart_id].hook(uart_id, NULL, msg->arg2, rx_hooks[uart_id].userdata);
+    return 0;
+}
+
+static int rx_hook_deliver(int uart_id, const uint8_t* data, size_t len) {
+    if (!luat_uart_is_hooked(uart_id))
+        return 0;
+    if (data) {
+        // 限速模式下数据先进接收缓冲区, 按波特率放行时再交给接管者
+        if (lines[uart_id].pace && rx_rings[uart_id])
+            return 0;
+        meter_add(&lines[uart_id].rx, len);
+        rx_hooks[uart_id].hook(uart_id, data, len, rx_hooks[uart_id].userdata);
+        return 1;
+    }
+    rtos_msg_t msg = {
+        .handler = l_uart_rx_hook_handler,
+        .arg1 = uart_id,
+        .arg2 = (int)len
+    };
+    luat_msgbus_put(&msg, 1);
+    return 1;
+}
+
+int luat_uart_rx_hook_input(int uart_id, const uint8_t* data, size_t len) {
+    if (!rx_hook_deliver(uart_id, data, len))
+        return 0;
+    if (data)
+        luat_uart_capture(uart_id, 0, data, len);
+    return 1;
+}
+
+static uart_rx_ring_t* rx_ring_get(int uart_id) {
+    if (uart_id < 0 || uart_id >= 128)
+        return NULL;
+    return rx_rings[uart_id];
+}
+
+int luat_uart_rx_open(int uart_id, size_t size) {
+    if (uart_id < 0 || uart_id >= 128 || size == 0)
+        return -1;
+    uart_rx_ring_t* r = rx_rings[uart_id];
+    if (r && r->size == size)
+        return 0;
+    luat_uart_rx_close(uart_id);
+    r = luat_heap_malloc(sizeof(uart_rx_ring_t) + size);
+    if (r == NULL) {
+        LLOGE("uart %d 接收缓冲区分配失败 %d", uart_id, (int)size);
+        return -1;
+    }
+    memset(r, 0, sizeof(uart_rx_ring_t));
+    r->id = uart_id;
+    r->buff = (uint8_t*)(r + 1);
+    r->size = size;
+    rx_rings[uart_id] = r;
+    return 0;
+}
+
+void luat_uart_rx_close(int uart_id) {
+    uart_rx_ring_t* r = rx_ring_get(uart_id);
+    if (r == NULL)
+        return;
+    rx_rings[uart_id] = NULL;
+    if (r->idle_timer)
+        free_uv_handle(r->idle_timer);
+    luat_heap_free(r);
+}
+
+static void rx_ring_post(uart_rx_ring_t* r) {
+    if (r->idle_timer)
+        uv_timer_stop(r->idle_timer);
+    if (r->pending == 0)
+        return;
+    rtos_msg_t msg = {
+        .handler = l_uart_handler,
+        .arg1 = r->id,
+        .arg2 = (int)r->pending
+    };
+    r->pending = 0;
+    r->events++;
+    luat_msgbus_put(&msg, 0);
+}
+
+static void on_rx_idle(uv_timer_t* t) {
+    rx_ring_post((uart_rx_ring_t*)t->data);
+}
+
+static void rx_ring_notify(uart_rx_ring_t* r, size_t len) {
+    const uart_rx_coalesce_t* c = &rx_coalesce[r->id];
+    r->pending += len;
+    if (c->threshold == 0 && c->idle_ms == 0) {
+        rx_ring_post(r);
+        return;
+    }
+    // 攒够阈值, 或者缓冲区已经满了不会再有新数据
+    if ((c->threshold && r->pending >= c->threshold) || r->used == r->size) {
+        rx_ring_post(r);
+        return;
+    }
+    // 只设置了阈值, 不够的时候一直等
+    if (c->idle_ms == 0)
+        return;
+    if (r->idle_timer == NULL) {
+        r->idle_timer = luat_heap_malloc(sizeof(uv_timer_t));
+        if (r->idle_timer == NULL) {
+            rx_ring_post(r);
+            return;
+        }
+        uv_timer_init(main_loop, r->idle_timer);
+        r->idle_timer->data = r;
+    }
+    // 每次收到数据都重新计时, 线路空闲idle_ms之后才通知
+    uv_timer_start(r->idle_timer, on_rx_idle, c->idle_ms, 0);
+}
+
+// 数据到达线路, 不限速时存进缓冲区就算到达, 限速时由定时器放行
+static void rx_ring_arrive(uart_rx_ring_t* r, size_t len) {
+    meter_add(&lines[r->id].rx, len);
+    if (!luat_uart_is_hooked(r->id)) {
+        rx_ring_notify(r, len);
+        return;
+    }
+    // 被接管的串口, 经过驱动的read读出来交给接管者, 驱动借此恢复暂停的接收
+    uint8_t tmp[1024];
+    int id = r->id;
+    while (len > 0 && rx_rings[id] && rx_hooks[id].hook) {
+        int n = uart_drvs[id]->read(NULL, id, tmp, len > sizeof(tmp) ? sizeof(tmp) : len);
+        if (n <= 0)
+            break;
+        len -= n;
+        rx_hooks[id].hook(id, tmp, n, rx_hooks[id].userdata);
+    }
+}
+
+static void rx_ring_stored(uart_rx_ring_t* r, size_t len) {
+    uart_pace_t* p = lines[r->id].pace;
+    if (p == NULL) {
+        rx_ring_arrive(r, len);
+        return;
+    }
+    r->held += len;
+    pace_kick(p);
+}
+
+int luat_uart_rx_coalesce(int uart_id, uint32_t threshold, uint32_t idle_ms) {
+    if (uart_id < 0 || uart_id >= 128)
+        return -1;
+    rx_coalesce[uart_id].threshold = threshold;
+    rx_coalesce[uart_id].idle_ms = idle_ms;
+    // 关掉合并时把攒着的数据立即通知出去
+    uart_rx_ring_t* r = rx_rings[uart_id];
+    if (r && threshold == 0 && idle_ms == 0)
+        rx_ring_post(r);
+    return 0;
+}
+
+size_t luat_uart_rx_input(int uart_id, const uint8_t* data, size_t len) {
+    // 录制线路上的数据, 包括缓冲区满了丢掉的部分
+    luat_uart_capture(uart_id, 0, data, len);
+    if (rx_hook_deliver(uart_id, data, len))
+        return 0;
+    uart_rx_ring_t* r = rx_ring_get(uart_id);
+    if (r == NULL || len == 0)
+        return 0;
+    size_t n = r->size - r->used;
+    if (n > len)
+        n = len;
+    // 最多分两段拷贝, 与缓冲区大小无关
+    size_t first = r->size - r->head;
+    if (first > n)
+        first = n;
+    memcpy(r->buff + r->head, data, first);
+    memcpy(r->buff, data + first, n - first);
+    r->head += n;
+    if (r->head >= r->size)
+        r->head -= r->size;
+    r->used += n;
+    r->rx_bytes += n;
+    if (n < len) {
+        r->overflow_bytes += len - n;
+        r->overflow_count++;
+        if (!r->overflowed)
+            LLOGW("uart %d 接收缓冲区已满, 丢弃%d字节", uart_id, (int)(len - n));
+        r->overflowed = 1;
+    }
+    if (n)
+        rx_ring_stored(r, n);
+    return n;
+}
+
+uint8_t* luat_uart_rx_reserve(int uart_id, size_t* len) {
+    uart_rx_ring_t* r = rx_ring_get(uart_id);
+    if (r == NULL) {
+        *len = 0;
+        return NULL;
+    }
+    size_t n = r->size - r->head;
+    if (n > r->size - r->used)
+        n = r->size - r->used;
+    *len = n;
+    return r->buff + r->head;
+}
+
+void luat_uart_rx_commit(int uart_id, size_t len) {
+    uart_rx_ring_t* r = rx_ring_get(uart_id);
+    if (r == NULL || len == 0)
+        return;
+    // 驱动直接读进了reserve返回的连续空间
+    luat_uart_capture(uart_id, 0, r->buff + r->head, len);
+    r->head += len;
+    if (r->head >= r->size)
+        r->head -= r->size;
+    r->used += len;
+    r->rx_bytes += len;
+    rx_ring_stored(r, len);
+}
+
+int luat_uart_rx_read(int uart_id, void* buffer, size_t len) {
+    uart_rx_ring_t* r = rx_ring_get(uart_id);
+    if (r == NULL || r->used == r->held)
+        return 0;
+    if (len > r->used - r->held)
+        len = r->used - r->held;
+    size_t tail = r->head >= r->used ? r->head - r->used : r->head + r->size - r->used;
+    size_t first = r->size - tail;
+    if (first > len)
+        first = len;
+    memcpy(buffer, r->buff + tail, first);
+    memcpy((uint8_t*)buffer + first, r->buff, len - first);
+    r->used -= len;
+    r->overflowed = 0;
+    // 不等事件就主动读走的数据不用再通知
+    if (r->pending > r->used - r->held)
+        r->pending = r->used - r->held;
+    // 读空之后从头开始写, 驱动直接读进缓冲区时能拿到最大的连续空间
+    if (r->used == 0)
+        r->head = 0;
+    return (int)len;
+}
+
+int luat_uart_rx_stat(int uart_id, luat_uart_rx_stat_t* stat) {
+    memset(stat, 0, sizeof(luat_uart_rx_stat_t));
+    uart_rx_ring_t* r = rx_ring_get(uart_id);
+    if (r == NULL)
+        return -1;
+    stat->size = r->size;
+    stat->used = r->used;
+    stat->rx_bytes = r->rx_bytes;
+    stat->overflow_bytes = r->overflow_bytes;
+    stat->overflow_count = r->overflow_count;
+    stat->events = r->events;
+    return 0;
+}
+
+static void meter_update(uart_meter_t* m, uint64_t now) {
+    uint64_t elapsed = now - m->win_start;
+    if (elapsed < UART_METER_WINDOW_NS)
+        return;
+    m->rate = (uint32_t)(m->win_bytes * UART_METER_WINDOW_NS / elapsed);
+    m->win_bytes = 0;
+    m->win_start = now;
+}
+
+static void meter_add(uart_meter_t* m, size_t len) {
+    m->bytes += len;
+    m->win_bytes += len;
+    meter_update(m, uv_hrtime());
+}
+
+static void pace_credit(uart_pace_t* p, uint64_t* credit, uint64_t elapsed) {
+    uint64_t burst = p->byte_ns > UART_PACE_BURST_NS ? p->byte_ns : UART_PACE_BURST_NS;
+    *credit += elapsed;
+    if (*credit > burst)
+        *credit = burst;
+}
+
+static void pace_tx(uart_pace_t* p) {
+    while (p->tx_len && p->tx_credit_ns >= p->byte_ns) {
+        size_t n = p->tx_credit_ns / p->byte_ns;
+        if (n > p->tx_len)
+            n = p->tx_len;
+        if (n > p->tx_size - p->tx_pos)
+            n = p->tx_size - p->tx_pos;
+        p->tx_writing = 1;
+        p->tx_drv_done = 0;
+        int ret = uart_drvs[p->id]->write(NULL, p->id, p->tx_buff + p->tx_pos, n);
+        p->tx_writing = 0;
+        // 驱动的发送队列满了, 下次再试
+        if (ret <= 0)
+            break;
+        p->tx_pos += ret;
+        if (p->tx_pos == p->tx_size)
+            p->tx_pos = 0;
+        p->tx_len -= ret;
+        p->tx_credit_ns -= ret * p->byte_ns;
+        meter_add(&lines[p->id].tx, ret);
+        if (p->tx_len == 0 && p->tx_drv_done)
+            luat_uart_tx_done(p->id);
+    }
+    if (p->tx_len == 0) {
+        p->tx_pos = 0;
+        p->tx_full = 0;
+    }
+}
+
+static void pace_rx(uart_pace_t* p) {
+    uart_rx_ring_t* r = rx_rings[p->id];
+    if (r == NULL || r->held == 0 || p->rx_credit_ns < p->byte_ns)
+        return;
+    size_t n = p->rx_credit_ns / p->byte_ns;
+    if (n > r->held)
+        n = r->held;
+    r->held -= n;
+    p->rx_credit_ns -= n * p->byte_ns;
+    rx_ring_arrive(r, n);
+}
+
+static void on_pace_timer(uv_timer_t* t) {
+    uart_pace_t* p = t->data;
+    uint64_t now = uv_hrtime();
+    uint64_t elapsed = now - p->last_ns;
+    p->last_ns = now;
+    pace_credit(p, &p->tx_credit_ns, elapsed);
+    pace_credit(p, &p->rx_credit_ns, elapsed);
+    pace_tx(p);
+    pace_rx(p);
+    // 接管者的回调里可能关掉了限速
+    if (lines[p->id].pace != p)
+        return;
+    uint64_t wait = UINT64_MAX;
+    if (p->tx_len)
+        wait = p->tx_credit_ns >= p->byte_ns ? 0 : p->byte_ns - p->tx_credit_ns;
+    uart_rx_ring_t* r = rx_rings[p->id];
+    if (r && r->held) {
+        uint64_t w = p->rx_credit_ns >= p->byte_ns ? 0 : p->byte_ns - p->rx_credit_ns;
+        if (w < wait)
+            wait = w;
+    }
+    if (wait == UINT64_MAX)
+        return;
+    // 定时器的精度是1ms, 高波特率时每次放行多个字节
+    uint64_t ms = (wait + 999999) / 1000000;
+    uv_timer_start(t, on_pace_timer, ms ? ms : 1, 0);
+}
+
+static void pace_kick(uart_pace_t* p) {
+    if (!uv_is_active((uv_handle_t*)p->timer))
+        uv_timer_start(p->timer, on_pace_timer, 0, 0);
+}
+
+static int pace_write(uart_pace_t* p, const void* data, size_t len) {
+    size_t n = p->tx_size - p->tx_len;
+    if (n > len)
+        n = len;
+    if (n < len && !p->tx_full) {
+        LLOGW("uart %d 限速模式下发送缓冲区已满, 等待sent事件之后再写", p->id);
+        p->tx_full = 1;
+    }
+    size_t head = (p->tx_pos + p->tx_len) % p->tx_size;
+    size_t first = p->tx_size - head;
+    if (first > n)
+        first = n;
+    memcpy(p->tx_buff + head, data, first);
+    memcpy(p->tx_buff, (const uint8_t*)data + first, n - first);
+    p->tx_len += n;
+    if (n)
+        pace_kick(p);
+    return (int)n;
+}
+
+static void pace_open(int uart_id) {
+    uart_line_t* line = &lines[uart_id];
+    if (line->pace || line->baud_rate == 0)
+        return;
+    size_t tx_size = line->bufsz > UART_PACE_TX_MIN ? line->bufsz : UART_PACE_TX_MIN;
+    uart_pace_t* p = luat_heap_malloc(sizeof(uart_pace_t) + tx_size);
+    uv_timer_t* timer = luat_heap_malloc(sizeof(uv_timer_t));
+    if (p == NULL || timer == NULL) {
+        LLOGE("uart %d 限速模式内存不足", uart_id);
+        luat_heap_free(p);
+        luat_heap_free(timer);
+        return;
+    }
+    memset(p, 0, sizeof(uart_pace_t));
+    p->id = uart_id;
+    p->byte_ns = 1000000000ull * line->frame_bits / line->baud_rate;
+    p->last_ns = uv_hrtime();
+    p->tx_buff = (uint8_t*)(p + 1);
+    p->tx_size = tx_size;
+    p->timer = timer;
+    uv_timer_init(main_loop, timer);
+    timer->data = p;
+    line->pace = p;
+    LLOGD("uart %d 限速 %d 波特率, 每字符 %d 位, %d 字节/秒", uart_id, (int)line->baud_rate,
+        line->frame_bits, (int)(1000000000ull / p->byte_ns));
+}
+
+static void pace_close(int uart_id, int flush) {
+    uart_pace_t* p = lines[uart_id].pace;
+    if (p == NULL)
+        return;
+    lines[uart_id].pace = NULL;
+    if (flush) {
+        // 关闭限速时, 排队的数据立即发出, 留着的数据立即通知
+        while (p->tx_len) {
+            size_t n = p->tx_len < p->tx_size - p->tx_pos ? p->tx_len : p->tx_size - p->tx_pos;
+            int ret = uart_drvs[uart_id]->write(NULL, uart_id, p->tx_buff + p->tx_pos, n);
+            if (ret <= 0) {
+                LLOGW("uart %d 关闭限速, 丢弃%d字节没发出的数据", uart_id, (int)p->tx_len);
+                break;
+            }
+            meter_add(&lines[uart_id].tx, ret);
+            p->tx_pos = (p->tx_pos + ret) % p->tx_size;
+            p->tx_len -= ret;
+        }
+    }
+    uart_rx_ring_t* r = rx_rings[uart_id];
+    if (r && r->held) {
+        size_t held = r->held;
+        r->held = 0;
+        if (flush)
+            rx_ring_arrive(r, held);
+        else {
+            // 丢掉还没到达的数据, 它们在缓冲区的最后
+            r->used -= held;
+            r->head = r->head >= held ? r->head - held : r->head + r->size - held;
+        }
+    }
+    free_uv_handle(p->timer);
+    luat_heap_free(p);
+}
+
+int luat_uart_pace(int uart_id, int enable) {
+    if (uart_id < 0 || uart_id >= 128)
+        return -1;
+    lines[uart_id].pace_enable = enable ? 1 : 0;
+    if (!lines[uart_id].opened)
+        return 0;
+    if (enable)
+        pace_open(uart_id);
+    else
+        pace_close(uart_id, 1);
+    return 0;
+}
+
+void luat_uart_tx_done(int uart_id) {
+    if (luat_uart_is_hooked(uart_id))
+        return;
+    // 限速模式下发送缓冲区清空才算发送完成
+    uart_pace_t* p = lines[uart_id].pace;
+    if (p && (p->tx_len || p->tx_writing)) {
+        p->tx_drv_done = p->tx_writing;
+        return;
+    }
+    rtos_msg_t msg = {
+        .handler = l_uart_handler,
+        .arg1 = uart_id,
+        .arg2 = 0
+    };
+    luat_msgbus_put(&msg, 0);
+}
+
+int luat_uart_pace_stat(int uart_id, luat_uart_pace_stat_t* stat) {
+    memset(stat, 0, sizeof(luat_uart_pace_stat_t));
+    if (uart_id < 0 || uart_id >= 128 || !lines[uart_id].opened)
+        return -1;
+    uart_line_t* line = &lines[uart_id];
+    uint64_t now = uv_hrtime();
+    meter_update(&line->tx, now);
+    meter_update(&line->rx, now);
+    stat->paced = line->pace != NULL;
+    stat->byte_rate = line->baud_rate / line->frame_bits;
+    stat->tx_rate = line->tx.rate;
+    stat->rx_rate = line->rx.rate;
+    stat->tx_bytes = line->tx.bytes;
+    if (line->pace)
+        stat->tx_queued = line->pace->tx_len;
+    if (rx_rings[uart_id])
+        stat->rx_held = rx_rings[uart_id]->held;
+    return 0;
+}
@@ -1,3 +1,6 @@
+
+#include "uv.h"
+
 #include <stdlib.h>
 #include <string.h>//add for memset
 #include "luat_base.h"
@@ -8,30 +11,133 @@
 #define LUAT_LOG_TAG "gpio.udp"
 #include "luat_log.h"
 
+// 本机监听127.0.0.1:port, 收到的每一行"pin,level"注入到输入脚, 一个数据报可以有多行
+// 输出脚的电平变化按同样的格式发往127.0.0.1:port+GPIO_UDP_PEER_OFFSET
+#define GPIO_UDP_PEER_OFFSET    10000
+
+extern uv_loop_t *main_loop;
+extern const luat_gpio_drv_opts_t* gpio_drvs[];
+extern uint8_t gpio_levels[];
+
+static uv_udp_t* gpio_udp_handle;
+static struct sockaddr_in gpio_udp_remote;
+
+static char gpio_udp_recv_buff[2048];
+
+static void gpio_udp_alloc(uv_handle_t *handle, size_t size, uv_buf_t *buf) {
+    (void)handle;
+    (void)size;
+    buf->base = gpio_udp_recv_buff;
+    buf->len = sizeof(gpio_udp_recv_buff);
+}
+
+static void gpio_udp_recv_cb(uv_udp_t *udp,
+                        ssize_t nread,
+                        const uv_buf_t *buf,
+                        const struct sockaddr *addr,
+                        unsigned flags) {
+    (void)udp;
+    (void)addr;
+    (void)flags;
+    if (nread <= 0) {
+        return;
+    }
+    // 整个数据报的边沿用同一个时间
+    uint64_t ts = uv_hrtime();
+    const char* ptr = buf->base;
+    const char* end = buf->base + nread;
+    while (ptr < end) {
+        char line[32];
+        size_t len = 0;
+        while (ptr < end && *ptr != '\n' && len < sizeof(line) - 1)
+            line[len++] = *ptr++;
+        while (ptr < end && *ptr != '\n')
+            ptr++;
+        ptr++;
+        line[len] = 0;
+        int pin = 0, level = 0;
+        if (sscanf(line, "%d,%d", &pin, &level) == 2) {
+            luat_gpio_pc_inject(pin, level, ts);
+        }
+        else if (len > 0) {
+            LLOGW("无法解析 %s", line);
+        }
+    }
+}
+
 static int gpio_setup_udp(void* userdata, luat_gpio_t* gpio) {
+    (void)userdata;
+    (void)gpio;
     return 0;
 }
 
 static int gpio_write_udp(void* userdata, int pin, int level) {
+    (void)userdata;
+    if (gpio_udp_handle == NULL)
+        return 0;
+    char tmp[32];
+    int len = snprintf(tmp, sizeof(tmp), "%d,%d\n", pin, level ? 1 : 0);
+    uv_buf_t buf = uv_buf_init(tmp, len);
+    // 对端没有在听时丢掉就行, 与真实的引脚一样
+    uv_udp_try_send(gpio_udp_handle, &buf, 1, (const struct sockaddr*)&gpio_udp_remote);
     return 0;
 }
 
 static int gpio_read_udp(void* userdata, int pin) {
-    return 0;
+    (void)userdata;
+    return gpio_levels[pin];
 }
 
 static int gpio_close_udp(void* userdata, int pin) {
+    (void)userdata;
+    (void)pin;
     return 0;
 }
 
-// 还得想想
-void gpio_udp_init(void) {
-
-}
-
 const luat_gpio_drv_opts_t gpio_udp = {
     .setup = gpio_setup_udp,
     .write = gpio_write_udp,
     .read = gpio_read_udp,
     .close = gpio_close_udp,
 };
+
+int luat_gpio_udp_init(int port) {
+    if (port <= 0 || port + GPIO_UDP_PEER_OFFSET > 65535) {
+        LLOGE("端口 %d 超出范围", port);
+        return -1;
+    }
+    if (gpio_udp_handle) {
+        LLOGE("gpio udp已经初始化");
+        return -1;
+    }
+    uv_udp_t* udp = luat_heap_malloc(sizeof(uv_udp_t));
+    if (udp == NULL)
+        return -1;
+    int ret = uv_udp_init(main_loop, udp);
+    if (ret) {
+        LLOGE("uv_udp_init %s", uv_strerror(ret));
+        luat_heap_free(udp);
+        return -1;
+    }
+    struct sockaddr_in addr;
+    uv_ip4_addr("127.0.0.1", port, &addr);
+    ret = uv_udp_bind(udp, (const struct sockaddr*)&addr, 0);
+    if (ret == 0)
+        ret = uv_udp_recv_start(udp, gpio_udp_alloc, gpio_udp_recv_cb);
+    if (ret) {
+        LLOGE("gpio udp 监听 %d 失败 %s", port, uv_strerror(ret));
+        uv_close((uv_handle_t*)udp, NULL);
+        // 句柄在下一轮事件循环才真正关闭, 留着不释放
+        return -1;
+    }
+    // 不让这个句柄单独撑住事件循环
+    uv_unref((uv_handle_t*)udp);
+    uv_ip4_addr("127.0.0.1", port + GPIO_UDP_PEER_OFFSET, &gpio_udp_remote);
+    gpio_udp_handle = udp;
+    for (size_t i = 0; i < 128; i++)
+    {
+        gpio_drvs[i] = &gpio_udp;
+    }
+    LLOGD("gpio udp 监听 %d, 输出发往 %d", port, port + GPIO_UDP_PEER_OFFSET);
+    return 0;
+}
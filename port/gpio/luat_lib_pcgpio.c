@@ -0,0 +1,139 @@
+/*
+@module  pcgpio
+@summary PC模拟器GPIO调试库
+@version 1.0
+@date    2024.05.20
+@tag LUAT_USE_GPIO
+@usage
+-- 本库仅PC模拟器可用, 用于给输入脚注入电平/脉冲, 观察中断从边沿到lua回调的延迟
+gpio.setup(11, function() end, gpio.PULLDOWN, gpio.RISING)
+pcgpio.pulse(11, 10000, 5000)
+sys.wait(3000)
+log.info("gpio", json.encode(pcgpio.irqStat()))
+*/
+#include "luat_base.h"
+#include "luat_gpio.h"
+#include "luat_gpio_drv.h"
+
+#include "rotable2.h"
+
+#define LUAT_LOG_TAG "pcgpio"
+#include "luat_log.h"
+
+/*
+注入输入脚的电平, 脚配置为中断模式时按触发方式产生中断, 与真实硬件一样经过消息队列回调
+@api pcgpio.inject(pin, level)
+@int 引脚编号
+@int 电平, 0或1
+@return boolean 产生了中断返回true
+@usage
+gpio.setup(11, function(val) log.info("gpio", "中断", val) end, gpio.PULLUP, gpio.FALLING)
+pcgpio.inject(11, 1)
+pcgpio.inject(11, 0)
+*/
+static int l_pcgpio_inject(lua_State *L) {
+    int pin = luaL_checkinteger(L, 1);
+    int level = luaL_checkinteger(L, 2);
+    lua_pushboolean(L, luat_gpio_pc_inject(pin, level, 0) > 0);
+    return 1;
+}
+
+/*
+在输入脚上产生脉冲, 用于测试脉冲计数之类的高频中断
+@api pcgpio.pulse(pin, count, hz)
+@int 引脚编号
+@int 脉冲数, 每个脉冲是一个上升沿加一个下降沿, 0表示停止正在产生的脉冲
+@int 每秒的脉冲数, 0或者不传表示立即全部注入
+@return boolean 成功返回true
+@usage
+-- 每秒1万个脉冲, 持续1秒
+pcgpio.pulse(11, 10000, 10000)
+*/
+static int l_pcgpio_pulse(lua_State *L) {
+    int pin = luaL_checkinteger(L, 1);
+    lua_Integer count = luaL_checkinteger(L, 2);
+    lua_Integer hz = luaL_optinteger(L, 3, 0);
+    if (count < 0 || hz < 0)
+        return luaL_error(L, "count/hz不能为负数");
+    lua_pushboolean(L, luat_gpio_pc_pulse(pin, (uint32_t)count, (uint32_t)hz) == 0);
+    return 1;
+}
+
+/*
+获取还没产生的脉冲数
+@api pcgpio.pulseLeft(pin)
+@int 引脚编号
+@return int 剩余的脉冲数, 已经全部产生时为0
+@usage
+while pcgpio.pulseLeft(11) > 0 do
+    sys.wait(10)
+end
+*/
+static int l_pcgpio_pulse_left(lua_State *L) {
+    lua_pushinteger(L, luat_gpio_pc_pulse_left(luaL_checkinteger(L, 1)));
+    return 1;
+}
+
+/*
+设置排队中断数的上限, 模拟真实模组上有限的消息队列. 默认不限制, 回调跟不上时中断一直排队, 延迟越来越大
+@api pcgpio.irqDepth(depth)
+@int 上限, 0表示不限制. 排队的中断达到上限之后的边沿算作丢失
+@usage
+-- 与模组的消息队列深度一致
+pcgpio.irqDepth(64)
+*/
+static int l_pcgpio_irq_depth(lua_State *L) {
+    lua_Integer depth = luaL_checkinteger(L, 1);
+    luat_gpio_irq_depth(depth > 0 ? (uint32_t)depth : 0);
+    return 0;
+}
+
+/*
+获取中断的统计信息, 所有引脚累计
+@api pcgpio.irqStat(reset)
+@boolean 读取之后是否清零, 默认false
+@return table 计数: edges注入的电平变化, fired产生的中断, handled已执行回调的中断, lost超过上限丢弃的中断, pending排队中的中断, pending_max排队的最大值, depth排队上限. 直方图: latency_ns边沿到回调开始执行的纳秒数, cb_ns回调本身的纳秒数, 都包括count/min/max/avg/p50/p90/p99/p999
+@usage
+local stat = pcgpio.irqStat(true)
+log.info("gpio", "中断延迟p99", stat.latency_ns.p99 // 1000, "us", "丢失", stat.lost)
+*/
+static int l_pcgpio_irq_stat(lua_State *L) {
+    const luat_gpio_irq_stat_t* stat = luat_gpio_irq_stat();
+    lua_createtable(L, 0, 9);
+    lua_pushinteger(L, stat->edges);
+    lua_setfield(L, -2, "edges");
+    lua_pushinteger(L, stat->fired);
+    lua_setfield(L, -2, "fired");
+    lua_pushinteger(L, stat->handled);
+    lua_setfield(L, -2, "handled");
+    lua_pushinteger(L, stat->lost);
+    lua_setfield(L, -2, "lost");
+    lua_pushinteger(L, stat->pending);
+    lua_setfield(L, -2, "pending");
+    lua_pushinteger(L, stat->pending_max);
+    lua_setfield(L, -2, "pending_max");
+    lua_pushinteger(L, stat->depth);
+    lua_setfield(L, -2, "depth");
+    luat_hist_push(L, &stat->latency_ns);
+    lua_setfield(L, -2, "latency_ns");
+    luat_hist_push(L, &stat->cb_ns);
+    lua_setfield(L, -2, "cb_ns");
+    if (lua_toboolean(L, 1))
+        luat_gpio_irq_stat_reset();
+    return 1;
+}
+
+static const rotable_Reg_t reg_pcgpio[] =
+{
+    { "inject",         ROREG_FUNC(l_pcgpio_inject)},
+    { "pulse",          ROREG_FUNC(l_pcgpio_pulse)},
+    { "pulseLeft",      ROREG_FUNC(l_pcgpio_pulse_left)},
+    { "irqDepth",       ROREG_FUNC(l_pcgpio_irq_depth)},
+    { "irqStat",        ROREG_FUNC(l_pcgpio_irq_stat)},
+    { NULL,             ROREG_INT(0)}
+};
+
+LUAMOD_API int luaopen_pcgpio( lua_State *L ) {
+    luat_newlib2(L, reg_pcgpio);
+    return 1;
+}
@@ -5,6 +5,11 @@
 #include "luat_malloc.h"
 #include <stdlib.h>
 #include "luat_mock.h"
+#include "luat_uart_drv.h"
+#include "luat_gpio_drv.h"
+#ifdef LUAT_USE_NETWORK
+#include "luat_network_pc.h"
+#endif
 
 #define LUAT_LOG_TAG "main"
 #include "luat_log.h"
@@ -26,9 +31,11 @@ static const luaL_Reg loadedlibs[] = {
 // 外设类
 #ifdef LUAT_USE_UART
   {"uart",    luaopen_uart},              // 串口操作
+  {"pcuart",  luaopen_pcuart},            // PC模拟器专属的串口调试库
 #endif
 #ifdef LUAT_USE_GPIO
   {"gpio",    luaopen_gpio},              // GPIO脚的操作
+  {"pcgpio",  luaopen_pcgpio},            // PC模拟器专属的GPIO调试库
 #endif
 #ifdef LUAT_USE_I2C
   {"i2c",     luaopen_i2c},               // I2C操作
@@ -120,6 +127,7 @@ static const luaL_Reg loadedlibs[] = {
   {"websocket", luaopen_websocket},
   // {"ftp", luaopen_ftp},
   {"errDump", luaopen_errdump},
+  {"pcnet", luaopen_pcnet},           // PC模拟器专属的网络调试库
 #endif
 #ifdef LUAT_USE_ERCOAP
   {"ercoap", luaopen_ercoap},
@@ -4,7 +4,12 @@
 #include "luat_malloc.h"
 #include "lundump.h"
 #include "luat_mock.h"
+#include "luat_ztt.h"
 #include "luat_luadb2.h"
+#include "luat_network_pc.h"
+#include "luat_uart_drv.h"
+#include "luat_gpio_drv.h"
+#include "luat_pcconf.h"
 
 #define LUAT_LOG_TAG "fs"
 #include "luat_log.h"
@@ -13,6 +18,7 @@
 
 extern int cmdline_argc;
 extern char **cmdline_argv;
+extern luat_pcconf_t g_pcconf;
 
 // luadb数据的上下文
 luat_luadb2_ctx_t luadb_ctx = {0};
@@ -33,6 +39,81 @@ static int luat_cmd_load_luatools(const char *path);
 
 int luadb_do_report(luat_luadb2_ctx_t *ctx);
 
+static int luat_cmd_uart_udp(const char *arg)
+{
+	char *end = NULL;
+	unsigned long port_start = strtoul(arg, &end, 10);
+	unsigned long id_start = g_pcconf.uart_udp_id_start;
+	unsigned long id_count = g_pcconf.uart_udp_id_count;
+	if (end == arg)
+		return -1;
+	if (*end == ',')
+	{
+		arg = end + 1;
+		id_start = strtoul(arg, &end, 10);
+		if (end == arg)
+			return -1;
+	}
+	if (*end == ',')
+	{
+		arg = end + 1;
+		id_count = strtoul(arg, &end, 10);
+		if (end == arg)
+			return -1;
+	}
+	if (*end || id_count == 0 || id_start + id_count > 128 || port_start == 0 || port_start + 10000 + id_count > 65536)
+		return -1;
+	g_pcconf.uart_udp_port_start = port_start;
+	g_pcconf.uart_udp_id_start = id_start;
+	g_pcconf.uart_udp_id_count = id_count;
+	return 0;
+}
+
+// --ztt_shm=path[,capacity]
+static int luat_cmd_ztt_shm(const char *arg)
+{
+	char path[1024];
+	const char *sep = strrchr(arg, ',');
+	unsigned long capacity = 0;
+	size_t len = sep ? (size_t)(sep - arg) : strlen(arg);
+	if (sep)
+	{
+		char *end = NULL;
+		capacity = strtoul(sep + 1, &end, 10);
+		// 没有数字的话逗号是路径的一部分
+		if (end == sep + 1 || *end)
+		{
+			capacity = 0;
+			len = strlen(arg);
+		}
+	}
+	if (len == 0 || len >= sizeof(path))
+		return -1;
+	memcpy(path, arg, len);
+	path[len] = 0x00;
+	return luat_ztt_shm_open(path, capacity);
+}
+
+static int luat_cmd_uart_capture(const char *arg)
+{
+	char path[512] = {0};
+	const char *ids = strchr(arg, ',');
+	if (ids == NULL || ids == arg || (size_t)(ids - arg) >= sizeof(path))
+		return -1;
+	memcpy(path, arg, ids - arg);
+	while (*ids == ',')
+	{
+		char *end = NULL;
+		long uart_id = strtol(ids + 1, &end, 10);
+		if (end == ids + 1 || luat_uart_capture_enable((int)uart_id, 1))
+			return -1;
+		ids = end;
+	}
+	if (*ids)
+		return -1;
+	return luat_uart_capture_start(path);
+}
+
 static int is_opts(const char *key, const char *arg)
 {
 	if (strlen(key) >= strlen(arg))
@@ -102,6 +183,108 @@ int luat_cmd_parse(int argc, char **argv)
 			continue;
 		}
 
+		// mock表加载, 常量类的返回值不经过mock脚本
+		if (is_opts("--mjson=", arg))
+		{
+			if (luat_mock_table_load(arg + strlen("--mjson=")))
+			{
+				LLOGE("加载mock表失败");
+				return -1;
+			}
+			continue;
+		}
+
+		// 外设事件追踪, --ztt=gpio,uart 或者 --ztt=all
+		if (is_opts("--ztt=", arg))
+		{
+			if (luat_ztt_enable_names(arg + strlen("--ztt=")))
+			{
+				LLOGE("开启ztt失败");
+				return -1;
+			}
+			continue;
+		}
+
+		// ztt记录写进共享内存, 外部模拟器映射同一个文件
+		if (is_opts("--ztt_shm=", arg))
+		{
+			if (luat_cmd_ztt_shm(arg + strlen("--ztt_shm=")))
+			{
+				LLOGE("打开ztt共享内存失败");
+				return -1;
+			}
+			continue;
+		}
+
+		// ztt记录通过UDP发送, --ztt_udp=19500
+		if (is_opts("--ztt_udp=", arg))
+		{
+			if (luat_ztt_udp_open(atoi(arg + strlen("--ztt_udp="))))
+			{
+				LLOGE("打开ztt udp失败");
+				return -1;
+			}
+			continue;
+		}
+
+		// GPIO走UDP, --gpio_udp=9200 监听9200接收"pin,level"注入, 输出脚的变化发往19200
+		if (is_opts("--gpio_udp=", arg))
+		{
+			if (luat_gpio_udp_init(atoi(arg + strlen("--gpio_udp="))))
+			{
+				LLOGE("打开gpio udp失败");
+				return -1;
+			}
+			continue;
+		}
+
+		// 串口驱动, --uart=1,tcp://127.0.0.1:7001
+		if (is_opts("--uart=", arg))
+		{
+			char *end = NULL;
+			long uart_id = strtol(arg + strlen("--uart="), &end, 10);
+			if (end == NULL || *end != ',' || luat_uart_drv_config((int)uart_id, end + 1))
+			{
+				LLOGE("串口配置错误 %s", arg);
+				return -1;
+			}
+			continue;
+		}
+
+		// 录制串口数据, --uart_capture=/tmp/gnss.cap,2,3
+		if (is_opts("--uart_capture=", arg))
+		{
+			if (luat_cmd_uart_capture(arg + strlen("--uart_capture=")))
+			{
+				LLOGE("串口录制配置错误 %s", arg);
+				return -1;
+			}
+			continue;
+		}
+
+		// UDP虚拟串口的端口与id范围, --uart_udp=9100,0,16 表示串口0~15监听9100~9115, 发往19100~19115
+		if (is_opts("--uart_udp=", arg))
+		{
+			if (luat_cmd_uart_udp(arg + strlen("--uart_udp=")))
+			{
+				LLOGE("UDP串口配置错误 %s", arg);
+				return -1;
+			}
+			continue;
+		}
+
+		#ifdef LUAT_USE_LWIP
+		// lwip内存池与TCP参数, mcu或host
+		if (is_opts("--lwip_profile=", arg))
+		{
+			if (luat_lwip_profile_select(arg + strlen("--lwip_profile=")))
+			{
+				return -1;
+			}
+			continue;
+		}
+		#endif
+
 		// 导出luadb文件
 		if (is_opts("--dump_luadb=", arg))
 		{
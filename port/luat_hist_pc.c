@@ -0,0 +1,79 @@
+
+#include "luat_base.h"
+#include "luat_hist_pc.h"
+
+#include <string.h>
+#include <stdio.h>
+
+// 桶的上界(包含)
+static uint32_t bucket_upper(uint32_t index) {
+    if (index < LUAT_HIST_SUB_COUNT)
+        return index;
+    uint32_t msb = index / LUAT_HIST_SUB_COUNT + LUAT_HIST_SUB_BITS - 1;
+    uint32_t sub = index % LUAT_HIST_SUB_COUNT;
+    uint64_t lower = ((uint64_t)(LUAT_HIST_SUB_COUNT + sub)) << (msb - LUAT_HIST_SUB_BITS);
+    uint64_t upper = lower + (1ULL << (msb - LUAT_HIST_SUB_BITS)) - 1;
+    return upper > 0xFFFFFFFFULL ? 0xFFFFFFFF : (uint32_t)upper;
+}
+
+void luat_hist_reset(luat_hist_t* h) {
+    memset(h, 0, sizeof(luat_hist_t));
+}
+
+uint32_t luat_hist_percentile(const luat_hist_t* h, double p) {
+    if (h->count == 0)
+        return 0;
+    uint64_t target = (uint64_t)(h->count * p / 100.0 + 0.5);
+    if (target == 0)
+        target = 1;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LUAT_HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= target) {
+            uint32_t upper = bucket_upper(i);
+            return upper > h->max ? h->max : upper;
+        }
+    }
+    return h->max;
+}
+
+void luat_hist_merge(luat_hist_t* dst, const luat_hist_t* src) {
+    if (src->count == 0)
+        return;
+    if (dst->count == 0 || src->min < dst->min)
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+    dst->count += src->count;
+    dst->sum += src->sum;
+    for (uint32_t i = 0; i < LUAT_HIST_BUCKETS; i++)
+        dst->buckets[i] += src->buckets[i];
+}
+
+void luat_hist_push(lua_State* L, const luat_hist_t* h) {
+    lua_createtable(L, 0, 8);
+    lua_pushinteger(L, h->count);
+    lua_setfield(L, -2, "count");
+    lua_pushinteger(L, h->min);
+    lua_setfield(L, -2, "min");
+    lua_pushinteger(L, h->max);
+    lua_setfield(L, -2, "max");
+    lua_pushinteger(L, h->count ? h->sum / h->count : 0);
+    lua_setfield(L, -2, "avg");
+    lua_pushinteger(L, luat_hist_percentile(h, 50));
+    lua_setfield(L, -2, "p50");
+    lua_pushinteger(L, luat_hist_percentile(h, 90));
+    lua_setfield(L, -2, "p90");
+    lua_pushinteger(L, luat_hist_percentile(h, 99));
+    lua_setfield(L, -2, "p99");
+    lua_pushinteger(L, luat_hist_percentile(h, 99.9));
+    lua_setfield(L, -2, "p999");
+}
+
+int luat_hist_sprint(char* buf, size_t len, const luat_hist_t* h) {
+    return snprintf(buf, len, "%u/%u/%u/%u/%u", h->count,
+                    (uint32_t)(h->count ? h->sum / h->count : 0),
+                    luat_hist_percentile(h, 50),
+                    luat_hist_percentile(h, 99),
+                    h->max);
+}
@@ -27,6 +27,11 @@ void luat_pcconf_init(void) {
 
     memcpy(g_pcconf.mcu_unique_id, "LuatOS@PC", strlen("LuatOS@PC"));
     g_pcconf.mcu_unique_id_len = strlen("LuatOS@PC");
+
+    // UDP虚拟串口, 默认与原来一样监听9000+id, 发往19000+id
+    g_pcconf.uart_udp_port_start = 9000;
+    g_pcconf.uart_udp_id_start = 0;
+    g_pcconf.uart_udp_id_count = 128;
     
     #ifdef LUA_USE_WINDOWS
     // LLOGD("执行uart_win32初始化");
@@ -2,100 +2,441 @@
 #include "uv.h"
 #include "luat_base.h"
 #include "luat_ztt.h"
+#include "luat_gpio_drv.h"
 #include "luat_malloc.h"
-#include "printf.h"
-
+#include "luat_pcconf.h"
 
 #define LUAT_LOG_TAG "ztt"
 #include "luat_log.h"
 
-luat_ztt_t* ztt_create(const char* type) {
-    return ztt_add(NULL, "type", type, strlen(type));
-}
-
-luat_ztt_t* ztt_addf(luat_ztt_t* ztt_head, const char* key, const char* _fmt, ...) {
-    char* buff = luat_heap_malloc(4096);
-    if (buff == NULL)
-        return NULL;
-    memset(buff, 0, 4096);
-    va_list args;
-    va_start(args, _fmt);
-    int len = vsnprintf_(buff, 4096 - 1, _fmt, args);
-    va_end(args);
-    if (len <= 0) {
-        luat_heap_free(buff);
-        return NULL;
-    }
-    luat_ztt_t* ret = ztt_add(ztt_head, key, buff, len);
-    luat_heap_free(buff);
-    return ret;
-}
-
-luat_ztt_t* ztt_add(luat_ztt_t* ztt_head, const char* key, const char* value, size_t value_len) {
-    luat_ztt_t* ztt = luat_heap_malloc(sizeof(luat_ztt_t));
-    if (ztt == NULL) {
-        return ztt_head;
-    }
-    memset(ztt, 0, sizeof(luat_ztt_t));
-    ztt->key = luat_heap_malloc(strlen(key) + 1);
-    ztt->value = luat_heap_malloc(value_len);
-    if (ztt->value == NULL || ztt->key == NULL) {
-        if (ztt->value)
-            luat_heap_free(ztt->value);
-        if (ztt->key)
-            luat_heap_free(ztt->key);
-        luat_heap_free(ztt);
-        return ztt_head;
-    }
-    memcpy(ztt->key, key, strlen(key) + 1);
-    memcpy(ztt->value, value, value_len);
-    ztt->value_len = value_len;
-    if (ztt_head == NULL) {
-        return ztt;
-    }
-    luat_ztt_t* head = ztt_head;
-    while (1) {
-        if (head->next) {
-            head = head->next;
-            continue;
+#ifdef LUA_USE_WINDOWS
+#include "windows.h"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// 默认的记录条数, 必须是2的幂
+#define ZTT_DEFAULT_CAPACITY (64 * 1024)
+// 轮询注入和发送UDP的间隔
+#define ZTT_POLL_MS (1)
+// 一个UDP数据报最多带的记录数
+#define ZTT_UDP_BATCH (64000 / sizeof(luat_ztt_rec_t))
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+// x86/x64上msvc的volatile读写本身就带acquire/release语义
+#define ZTT_LOAD(p)     (*(p))
+#define ZTT_STORE(p, v) (*(p) = (v))
+#define ZTT_ADD(p, v)   _InterlockedExchangeAdd64((volatile __int64*)(p), (v))
+static int ztt_cas(volatile uint64_t* p, uint64_t expect, uint64_t v) {
+    return (uint64_t)_InterlockedCompareExchange64((volatile __int64*)p, (__int64)v, (__int64)expect) == expect;
+}
+#else
+#define ZTT_LOAD(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ZTT_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ZTT_ADD(p, v)   __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+static int ztt_cas(volatile uint64_t* p, uint64_t expect, uint64_t v) {
+    return __atomic_compare_exchange_n(p, &expect, v, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+#endif
+
+extern uv_loop_t *main_loop;
+
+volatile uint32_t luat_ztt_mask;
+
+// 没有指定传输方式时放在普通内存里, 只能在进程内读取
+static luat_ztt_shm_t* region;
+static luat_ztt_ring_t* tx;
+static luat_ztt_ring_t* rx;
+static int region_mapped;
+#ifdef LUA_USE_WINDOWS
+static HANDLE map_file = INVALID_HANDLE_VALUE;
+static HANDLE map_handle;
+#endif
+
+static uv_timer_t* poll_timer;
+static uv_udp_t* udp;
+static struct sockaddr_in udp_peer;
+static luat_ztt_rec_t* udp_buff;
+
+static const char* drv_names[LUAT_ZTT_DRV_MAX] = {
+    [LUAT_ZTT_GPIO] = "gpio",
+    [LUAT_ZTT_UART] = "uart",
+    [LUAT_ZTT_ADC]  = "adc",
+    [LUAT_ZTT_PWM]  = "pwm",
+};
+
+static size_t ring_size(size_t capacity) {
+    return sizeof(luat_ztt_ring_t) + capacity * sizeof(luat_ztt_slot_t);
+}
+
+static void ring_init(luat_ztt_ring_t* r, size_t capacity) {
+    memset(r, 0, sizeof(luat_ztt_ring_t));
+    r->capacity = (uint32_t)capacity;
+    luat_ztt_slot_t* slots = LUAT_ZTT_SLOTS(r);
+    for (size_t i = 0; i < capacity; i++)
+        slots[i].state = i;
+}
+
+static size_t region_layout(size_t capacity) {
+    return sizeof(luat_ztt_shm_t) + ring_size(capacity) * 2;
+}
+
+static void region_init(luat_ztt_shm_t* shm, size_t capacity) {
+    memset(shm, 0, sizeof(luat_ztt_shm_t));
+    shm->rec_size = sizeof(luat_ztt_rec_t);
+    shm->slot_size = sizeof(luat_ztt_slot_t);
+    shm->size = region_layout(capacity);
+    shm->tx_offset = sizeof(luat_ztt_shm_t);
+    shm->rx_offset = shm->tx_offset + ring_size(capacity);
+    ring_init((luat_ztt_ring_t*)((char*)shm + shm->tx_offset), capacity);
+    ring_init((luat_ztt_ring_t*)((char*)shm + shm->rx_offset), capacity);
+    shm->version = LUAT_ZTT_VERSION;
+    // magic最后写, 外部程序看到magic就说明布局已经初始化好了
+    ZTT_STORE(&shm->magic, LUAT_ZTT_MAGIC);
+}
+
+static size_t round_capacity(size_t capacity) {
+    size_t size = 1024;
+    while (size < capacity)
+        size *= 2;
+    return size;
+}
+
+static int ring_push(luat_ztt_ring_t* r, uint8_t drv, uint8_t action, uint16_t id,
+                     int32_t a0, int32_t a1, int32_t a2, int32_t a3) {
+    luat_ztt_slot_t* slots = LUAT_ZTT_SLOTS(r);
+    uint64_t mask = r->capacity - 1;
+    uint64_t pos = ZTT_LOAD(&r->head);
+    luat_ztt_slot_t* slot;
+    for (;;) {
+        slot = &slots[pos & mask];
+        int64_t dif = (int64_t)(ZTT_LOAD(&slot->state) - pos);
+        if (dif == 0) {
+            if (ztt_cas(&r->head, pos, pos + 1))
+                break;
         }
-        head->next = ztt;
-        break;
+        else if (dif < 0) {
+            // 读取方跟不上, 丢掉新的记录, 不阻塞驱动
+            ZTT_ADD(&r->dropped, 1);
+            return -1;
+        }
+        pos = ZTT_LOAD(&r->head);
     }
-    return ztt_head;
+    luat_ztt_rec_t* rec = &slot->rec;
+    rec->ts_ns = uv_hrtime();
+    rec->drv = drv;
+    rec->action = action;
+    rec->id = id;
+    rec->args[0] = a0;
+    rec->args[1] = a1;
+    rec->args[2] = a2;
+    rec->args[3] = a3;
+    rec->seq = (uint32_t)pos;
+    ZTT_STORE(&slot->state, pos + 1);
+    return 0;
+}
 
+static int ring_pop(luat_ztt_ring_t* r, luat_ztt_rec_t* recs, int max) {
+    luat_ztt_slot_t* slots = LUAT_ZTT_SLOTS(r);
+    uint64_t mask = r->capacity - 1;
+    uint64_t pos = r->tail;
+    int n = 0;
+    while (n < max) {
+        luat_ztt_slot_t* slot = &slots[pos & mask];
+        if (ZTT_LOAD(&slot->state) != pos + 1)
+            break;
+        recs[n++] = slot->rec;
+        ZTT_STORE(&slot->state, pos + r->capacity);
+        pos++;
+    }
+    ZTT_STORE(&r->tail, pos);
+    return n;
 }
 
+static void region_attach(luat_ztt_shm_t* shm) {
+    region = shm;
+    tx = (luat_ztt_ring_t*)((char*)shm + shm->tx_offset);
+    rx = (luat_ztt_ring_t*)((char*)shm + shm->rx_offset);
+}
 
-int ztt_commit(luat_ztt_t* ztt) {
-    if (ztt == NULL)
+int luat_ztt_init(size_t capacity) {
+    if (region) {
+        return 0;
+    }
+    capacity = round_capacity(capacity);
+    luat_ztt_shm_t* shm = luat_heap_malloc(region_layout(capacity));
+    if (shm == NULL) {
+        LLOGE("ztt缓冲区分配失败 %d条", (int)capacity);
         return -1;
-    luat_ztt_t* head = ztt;
-    size_t len = 0;
-    char* buff = luat_heap_malloc(4);
-    if (buff == NULL) {
-        // TODO clear ztt;
-        return -2;
     }
-    while (head != NULL) {
-        buff = luat_heap_realloc(buff, len + head->value_len + 2);
-        if (buff == NULL) {
-            // TODO clear ztt;
-            return -3;
+    region_init(shm, capacity);
+    region_attach(shm);
+    return 0;
+}
+
+int luat_ztt_enable(int drv, int enable) {
+    if (drv < 0 || drv >= LUAT_ZTT_DRV_MAX)
+        return -1;
+    if (enable && region == NULL && luat_ztt_init(ZTT_DEFAULT_CAPACITY))
+        return -1;
+    if (enable)
+        luat_ztt_mask |= 1u << drv;
+    else
+        luat_ztt_mask &= ~(1u << drv);
+    return 0;
+}
+
+// "gpio,adc"或者"all"
+int luat_ztt_enable_names(const char* names) {
+    const char* p = names;
+    while (*p) {
+        const char* end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        int found = 0;
+        for (int i = 0; i < LUAT_ZTT_DRV_MAX; i++) {
+            if ((len == 3 && memcmp(p, "all", 3) == 0) ||
+                (strlen(drv_names[i]) == len && memcmp(p, drv_names[i], len) == 0)) {
+                if (luat_ztt_enable(i, 1))
+                    return -1;
+                found = 1;
+            }
+        }
+        if (!found && len) {
+            LLOGE("未知的ztt驱动 %.*s", (int)len, p);
+            return -1;
         }
-        memcpy(buff + len, head->value, head->value_len);
-        len += head->value_len;
-        buff[len] = ',';
-        len ++;
-        luat_ztt_t* tmp = head;
-        head = head->next;
-        luat_heap_free(tmp->key);
-        luat_heap_free(tmp->value);
-        luat_heap_free(tmp);
-    }
-    buff[len] = '0';
-
-    // TODO 发送UDP/接收UDP
+        if (end == NULL)
+            break;
+        p = end + 1;
+    }
     return 0;
 }
 
+void luat_ztt_emit(uint8_t drv, uint8_t action, uint16_t id, int32_t a0, int32_t a1, int32_t a2, int32_t a3) {
+    if (tx == NULL)
+        return;
+    ring_push(tx, drv, action, id, a0, a1, a2, a3);
+}
+
+int luat_ztt_read(luat_ztt_rec_t* recs, int max) {
+    if (tx == NULL)
+        return 0;
+    return ring_pop(tx, recs, max);
+}
+
+int luat_ztt_stat(luat_ztt_stat_t* stat) {
+    if (tx == NULL)
+        return -1;
+    uint64_t head = ZTT_LOAD(&tx->head);
+    uint64_t tail = ZTT_LOAD(&tx->tail);
+    stat->capacity = tx->capacity;
+    stat->used = (size_t)(head - tail);
+    stat->written = head;
+    stat->dropped = ZTT_LOAD(&tx->dropped);
+    return 0;
+}
+
+//-------------------------------------------------------------
+// 反向通道, 模拟器写给设备的记录
+
+// 模拟器在同一台电脑上时时间戳与uv_hrtime同源, 可以用来统计中断延迟
+// 明显不对的(来自别的时钟, 或者在另一台电脑上)按收到的时间算
+static uint64_t ztt_edge_ns(uint64_t ts) {
+    uint64_t now = uv_hrtime();
+    if (ts == 0 || ts > now || now - ts > 10000000000ull)
+        return 0;
+    return ts;
+}
+
+static void ztt_inject(const luat_ztt_rec_t* rec) {
+    switch (rec->drv)
+    {
+    case LUAT_ZTT_GPIO:
+        if (rec->action == LUAT_ZTT_SET)
+            luat_gpio_pc_inject(rec->id, rec->args[0], ztt_edge_ns(rec->ts_ns));
+        break;
+    case LUAT_ZTT_ADC:
+        if (rec->action == LUAT_ZTT_SET)
+            luat_adc_pc_inject((int16_t)rec->id, 1, rec->args[0], rec->args[1]);
+        else if (rec->action == LUAT_ZTT_CLOSE)
+            luat_adc_pc_inject((int16_t)rec->id, 0, 0, 0);
+        break;
+    default:
+        break;
+    }
+}
+
+static void udp_flush(void);
+
+static void on_poll(uv_timer_t* handle) {
+    (void)handle;
+    luat_ztt_rec_t recs[256];
+    int n;
+    // 每次最多处理一个缓冲区的量, 注入再快也不会饿死事件循环
+    size_t budget = rx->capacity;
+    while (budget > 0 && (n = ring_pop(rx, recs, 256)) > 0) {
+        for (int i = 0; i < n; i++)
+            ztt_inject(&recs[i]);
+        budget = budget > (size_t)n ? budget - n : 0;
+    }
+    if (udp)
+        udp_flush();
+}
+
+static int poll_start(void) {
+    if (poll_timer)
+        return 0;
+    poll_timer = luat_heap_malloc(sizeof(uv_timer_t));
+    if (poll_timer == NULL)
+        return -1;
+    uv_timer_init(main_loop, poll_timer);
+    // 不让这个定时器单独撑住事件循环
+    uv_unref((uv_handle_t*)poll_timer);
+    uv_timer_start(poll_timer, on_poll, ZTT_POLL_MS, ZTT_POLL_MS);
+    return 0;
+}
+
+//-------------------------------------------------------------
+// 共享内存
+
+int luat_ztt_shm_open(const char* path, size_t capacity) {
+    if (region_mapped || udp) {
+        LLOGE("ztt已经打开了共享内存或者udp, 只能选一种");
+        return -1;
+    }
+    if (capacity == 0)
+        capacity = ZTT_DEFAULT_CAPACITY;
+    capacity = round_capacity(capacity);
+    size_t size = region_layout(capacity);
+    void* ptr = NULL;
+#ifdef LUA_USE_WINDOWS
+    map_file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                           NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map_file == INVALID_HANDLE_VALUE) {
+        LLOGE("打开共享内存文件失败 %s %d", path, (int)GetLastError());
+        return -1;
+    }
+    map_handle = CreateFileMappingA(map_file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, NULL);
+    if (map_handle)
+        ptr = MapViewOfFile(map_handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (ptr == NULL) {
+        LLOGE("映射共享内存失败 %s %d", path, (int)GetLastError());
+        if (map_handle)
+            CloseHandle(map_handle);
+        CloseHandle(map_file);
+        map_file = INVALID_HANDLE_VALUE;
+        return -1;
+    }
+#else
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        LLOGE("打开共享内存文件失败 %s", path);
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)size)) {
+        LLOGE("设置共享内存大小失败 %s", path);
+        close(fd);
+        return -1;
+    }
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        LLOGE("映射共享内存失败 %s", path);
+        return -1;
+    }
+#endif
+    // 旧的文件可能是上一次运行留下的, 清掉magic之后重新初始化
+    ((luat_ztt_shm_t*)ptr)->magic = 0;
+    region_init((luat_ztt_shm_t*)ptr, capacity);
+    // 之前在普通内存里的记录没有人能读到, 直接丢弃
+    if (region)
+        luat_heap_free(region);
+    region_attach((luat_ztt_shm_t*)ptr);
+    region_mapped = 1;
+    LLOGI("ztt共享内存 %s %d条 %d字节", path, (int)capacity, (int)size);
+    return poll_start();
+}
+
+//-------------------------------------------------------------
+// UDP, 没法用共享内存时(例如模拟器在另一台电脑上)的替代方案
+
+static char udp_recv_buff[64 * 1024];
+
+static void udp_alloc(uv_handle_t *handle, size_t size, uv_buf_t *buf) {
+    (void)handle;
+    (void)size;
+    buf->base = udp_recv_buff;
+    buf->len = sizeof(udp_recv_buff);
+}
+
+static void udp_recv_cb(uv_udp_t *handle, ssize_t nread, const uv_buf_t *buf,
+                        const struct sockaddr *addr, unsigned flags) {
+    (void)handle;
+    (void)addr;
+    (void)flags;
+    if (nread <= 0)
+        return;
+    // 不足一条的尾巴丢弃
+    luat_ztt_rec_t rec;
+    for (ssize_t off = 0; off + (ssize_t)sizeof(rec) <= nread; off += sizeof(rec)) {
+        memcpy(&rec, buf->base + off, sizeof(rec));
+        ztt_inject(&rec);
+    }
+}
+
+static void udp_flush(void) {
+    // 用uv_udp_try_send同步发出, 发不出去(对端没开, 缓冲区满)就丢弃, 与UDP本身的语义一致
+    int n;
+    while ((n = ring_pop(tx, udp_buff, ZTT_UDP_BATCH)) > 0) {
+        uv_buf_t buf = uv_buf_init((char*)udp_buff, n * sizeof(luat_ztt_rec_t));
+        int ret = uv_udp_try_send(udp, &buf, 1, (const struct sockaddr*)&udp_peer);
+        if (ret < 0 && ret != UV_EAGAIN && ret != UV_ECONNREFUSED)
+            LLOGD("ztt udp发送失败 %s", uv_strerror(ret));
+        if (ret < 0) {
+            ZTT_ADD(&tx->dropped, n);
+            break;
+        }
+    }
+}
+
+int luat_ztt_udp_open(int port) {
+    if (region_mapped || udp) {
+        LLOGE("ztt已经打开了共享内存或者udp, 只能选一种");
+        return -1;
+    }
+    if (port <= 0 || port >= 65535) {
+        LLOGE("ztt udp端口错误 %d", port);
+        return -1;
+    }
+    if (region == NULL && luat_ztt_init(ZTT_DEFAULT_CAPACITY))
+        return -1;
+    udp_buff = luat_heap_malloc(ZTT_UDP_BATCH * sizeof(luat_ztt_rec_t));
+    udp = luat_heap_malloc(sizeof(uv_udp_t));
+    if (udp == NULL || udp_buff == NULL) {
+        luat_heap_free(udp);
+        luat_heap_free(udp_buff);
+        udp = NULL;
+        udp_buff = NULL;
+        return -1;
+    }
+    uv_udp_init(main_loop, udp);
+    struct sockaddr_in addr;
+    uv_ip4_addr("127.0.0.1", port + 1, &addr);
+    int ret = uv_udp_bind(udp, (const struct sockaddr*)&addr, 0);
+    if (ret) {
+        LLOGE("ztt udp绑定端口 %d 失败 %s", port + 1, uv_strerror(ret));
+        free_uv_handle(udp);
+        luat_heap_free(udp_buff);
+        udp = NULL;
+        udp_buff = NULL;
+        return -1;
+    }
+    uv_ip4_addr("127.0.0.1", port, &udp_peer);
+    uv_udp_recv_start(udp, udp_alloc, udp_recv_cb);
+    uv_unref((uv_handle_t*)udp);
+    LLOGI("ztt udp 发往127.0.0.1:%d, 在%d接收注入", port, port + 1);
+    return poll_start();
+}
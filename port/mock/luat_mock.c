@@ -2,15 +2,29 @@
 #include "luat_base.h"
 #include "luat_fs.h"
 #include "luat_malloc.h"
+#include "luat_mcu.h"
 #include "luat_mock.h"
 
+#include <sys/stat.h>
+
 #define LUAT_LOG_TAG "mock"
 #include "luat_log.h"
 
+// 两次检查mock脚本是否修改的最小间隔, 避免每次调用都stat
+#define MOCK_RELOAD_CHECK_MS (500)
+
 static lua_State *mock_L;
 static char mock_file_path[1024];
 
-static int mock_main(lua_State *L);
+// 编译好的mock函数, 放在注册表里, 文件修改之后才重新加载
+static int mock_ref = LUA_NOREF;
+static time_t mock_mtime;
+static int64_t mock_size;
+static uint64_t mock_check_ms;
+
+// 返回数据的存放区, 每次调用复用, 数据在下一次luat_mock_call之前有效
+static char* mock_arena;
+static size_t mock_arena_size;
 
 static const luaL_Reg loadedlibs[] = {
   {"_G", luaopen_base}, // _G
@@ -95,8 +109,13 @@ static const luaL_Reg loadedlibs[] = {
 };
 
 int luat_mock_init(const char* path) {
+    size_t len = strlen(path);
+    if (len >= sizeof(mock_file_path)) {
+        LLOGE("mock脚本路径太长 %s", path);
+        return -1;
+    }
     mock_L = lua_newstate(luat_heap_alloc, NULL);
-    memcpy(mock_file_path, path, strlen(path) + 1);
+    memcpy(mock_file_path, path, len + 1);
     LLOGI("mock脚本路径 %s", mock_file_path);
     if (mock_L == NULL || mock_file_path[0] == 0x00) {
         return -1;
@@ -112,134 +131,171 @@ int luat_mock_init(const char* path) {
     return 0;
 }
 
+static int load_mock_lua_file(lua_State *L) {
+    const char* path = mock_file_path;
+    size_t len = 0;
+    int ret = 0;
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        LLOGE("文件不存在 %s", path);
+        return -3;
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *tmp = luat_heap_malloc(len + 1);
+    if (tmp == NULL) {
+        fclose(f);
+        LLOGE("文件太大,内存放不下 %s", path);
+        return -3;
+    }
+    len = fread(tmp, 1, len, f);
+    fclose(f);
+
+    ret = luaL_loadbufferx(L, tmp, len, path, NULL);
+    luat_heap_free(tmp);
+    if (ret) {
+        LLOGE("文件加载失败 %s %s", path, lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return -3;
+    }
+    ret = lua_pcall(L, 0, 1, 0);
+    if (ret) {
+        LLOGE("mock加载失败 %s %s", path, lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return -4;
+    }
+    if (!lua_isfunction(L, -1)) {
+        LLOGE("mock脚本需要返回一个函数 %s", path);
+        lua_pop(L, 1);
+        return -4;
+    }
+    // 替换掉旧的mock函数, 同时保留mockf全局变量, 方便脚本里自己调用
+    lua_pushvalue(L, -1);
+    lua_setglobal(L, "mockf");
+    luaL_unref(L, LUA_REGISTRYINDEX, mock_ref);
+    mock_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    return 0;
+}
+
+// 首次调用, 或者文件修改时间/大小变了才重新编译. 重新加载失败时继续用旧的函数
+static int mock_reload_check(lua_State *L) {
+    uint64_t now = luat_mcu_tick64_ms();
+    if (mock_ref != LUA_NOREF && now - mock_check_ms < MOCK_RELOAD_CHECK_MS) {
+        return 0;
+    }
+    mock_check_ms = now;
+    struct stat st;
+    if (stat(mock_file_path, &st)) {
+        if (mock_ref == LUA_NOREF) {
+            LLOGE("文件不存在 %s", mock_file_path);
+            return -3;
+        }
+        return 0;
+    }
+    if (mock_ref != LUA_NOREF && st.st_mtime == mock_mtime && (int64_t)st.st_size == mock_size) {
+        return 0;
+    }
+    int reload = mock_ref != LUA_NOREF;
+    // 先记下时间, 加载失败也不会每次调用都重试一遍
+    mock_mtime = st.st_mtime;
+    mock_size = (int64_t)st.st_size;
+    int ret = load_mock_lua_file(L);
+    if (ret == 0 && reload) {
+        LLOGI("mock脚本已重新加载 %s", mock_file_path);
+    }
+    return mock_ref == LUA_NOREF ? ret : 0;
+}
+
+static char* mock_arena_alloc(size_t len) {
+    if (len > mock_arena_size) {
+        size_t size = mock_arena_size ? mock_arena_size : 64;
+        while (size < len)
+            size *= 2;
+        char* ptr = luat_heap_realloc(mock_arena, size);
+        if (ptr == NULL) {
+            LLOGE("返回数据太大,内存放不下 %d", (int)len);
+            return NULL;
+        }
+        mock_arena = ptr;
+        mock_arena_size = size;
+    }
+    return mock_arena;
+}
+
 int luat_mock_call(luat_mock_ctx_t* ctx) {
+    // 先查mock表, 表里没有的key才进mock脚本
+    if (luat_mock_table_call(ctx) == 0) {
+        return 0;
+    }
     if (mock_L == NULL) {
-        return -0xFF;
+        return MOCK_DISABLED;
     }
     if (mock_file_path[0] == 0x00) {
         return -2;
     }
-    
+    int ret = mock_reload_check(mock_L);
+    if (ret) {
+        LLOGD("加载mock脚本失败 %d", ret);
+        return ret;
+    }
+
     const char *resp;
     lua_Integer intVal;
     lua_Number numVal;
-    lua_pushcfunction(mock_L, &mock_main);
-	  lua_pushstring(mock_L, ctx->key);
-	  lua_pushlstring(mock_L, ctx->req_data, ctx->req_len);
-    int ret = lua_pcall(mock_L, 2, 2, 0);
+    int top = lua_gettop(mock_L);
+    lua_rawgeti(mock_L, LUA_REGISTRYINDEX, mock_ref);
+    lua_pushstring(mock_L, ctx->key);
+    lua_pushlstring(mock_L, ctx->req_data, ctx->req_len);
+    ret = lua_pcall(mock_L, 2, 2, 0);
     if (ret) {
         LLOGE("pcall %d %s", ret, lua_tostring(mock_L, -1));
+        lua_settop(mock_L, top);
         return ret;
     }
-    else {
-        ctx->resp_code = lua_tointeger(mock_L, 1);
-        ctx->resp_type = lua_type(mock_L, 2);
-        switch (lua_type(mock_L, 2))
-        {
-        case LUA_TNIL: // 空值
-            /* code */
-            break;
-        case LUA_TBOOLEAN:
-            ctx->resp_data = luat_heap_malloc(1);
-            ctx->resp_data[0] = lua_toboolean(mock_L, 2);
-            ctx->resp_len = 1;
+    ctx->resp_code = lua_tointeger(mock_L, -2);
+    ctx->resp_type = lua_type(mock_L, -1);
+    switch (ctx->resp_type)
+    {
+    case LUA_TNIL: // 空值
+        /* code */
+        break;
+    case LUA_TBOOLEAN:
+        ctx->resp_data = mock_arena_alloc(1);
+        if (ctx->resp_data == NULL)
             break;
-        case LUA_TNUMBER:
-            ctx->resp_data = luat_heap_malloc(sizeof(lua_Integer));
-            ctx->resp_len = sizeof(lua_Integer);
-            if (lua_isinteger(mock_L, 2)) {
-                intVal = lua_tointeger(mock_L, 2);
-                memcpy(ctx->resp_data, &intVal, sizeof(lua_Integer));
-            }
-            else {
-                numVal = lua_tonumber(mock_L, 2);
-                memcpy(ctx->resp_data, &numVal, sizeof(lua_Integer));
-            }
+        ctx->resp_data[0] = lua_toboolean(mock_L, -1);
+        ctx->resp_len = 1;
+        break;
+    case LUA_TNUMBER:
+        ctx->resp_data = mock_arena_alloc(sizeof(lua_Integer));
+        if (ctx->resp_data == NULL)
             break;
-        case LUA_TSTRING:
-            resp = lua_tolstring(mock_L, 2, &ctx->resp_len);
-            if (ctx->resp_len > 0) {
-                ctx->resp_data = luat_heap_malloc(ctx->resp_len + 1);
-                memcpy(ctx->resp_data, resp, ctx->resp_len + 1);
+        ctx->resp_len = sizeof(lua_Integer);
+        // 外设的C接口都按整数读取, 小数也转成lua_Integer, 舍去小数部分
+        if (lua_isinteger(mock_L, -1)) {
+            intVal = lua_tointeger(mock_L, -1);
+        }
+        else {
+            numVal = lua_tonumber(mock_L, -1);
+            intVal = (lua_Integer)numVal;
+        }
+        memcpy(ctx->resp_data, &intVal, sizeof(lua_Integer));
+        break;
+    case LUA_TSTRING:
+        resp = lua_tolstring(mock_L, -1, &ctx->resp_len);
+        if (ctx->resp_len > 0) {
+            ctx->resp_data = mock_arena_alloc(ctx->resp_len + 1);
+            if (ctx->resp_data == NULL) {
+                ctx->resp_len = 0;
+                break;
             }
-            break;
-        default:
-            break;
+            memcpy(ctx->resp_data, resp, ctx->resp_len + 1);
         }
+        break;
+    default:
+        break;
     }
-    return ret;
-}
-
-static int load_mock_lua_file(lua_State *L) {
-    const char* name = mock_file_path;
-    const char* path = mock_file_path;
-    // 加载mock.lua
-    //----------------------------------------------
-	size_t len = 0;
-	int ret = 0;
-	// LLOGD("把%s当做main.lua运行", path);
-	char tmpname[512] = {0};
-	FILE *f = fopen(name, "rb");
-	if (!f)
-	{
-		LLOGE("文件不存在 %s", path);
-		return -3;
-	}
-	fseek(f, 0, SEEK_END);
-	len = ftell(f);
-	fseek(f, 0, SEEK_SET);
-	// void* fptr = luat_heap_malloc(len);
-	char *tmp = luat_heap_malloc(len);
-	if (tmp == NULL)
-	{
-		fclose(f);
-		LLOGE("文件太大,内存放不下 %s", path);
-        return -3;
-	}
-	fread(tmp, 1, len, f);
-	fclose(f);
-
-	for (size_t i = strlen(path); i > 0; i--)
-	{
-		if (path[i - 1] == '/' || path[i - 1] == '\\')
-		{
-			memcpy(tmpname, name + i, strlen(path) - 1);
-			break;
-		}
-	}
-	if (tmpname[0] == 0x00)
-	{
-		memcpy(tmpname, path, strlen(path));
-	}
-
-    //----------------------------------------------
-
-    ret = luaL_loadbufferx(L, tmp, len, name, NULL);
-    if (ret) {
-        LLOGE("文件加载失败 %s %s", name, lua_tostring(L, -1));
-		return -3;
-    }
-    ret = lua_pcall(L, 0, 1, 0);
-    if (ret) {
-        LLOGE("mock加载失败 %s %s", name, lua_tostring(L, -1));
-		return -4;
-    }
-    // LLOGD("栈顶对象的类型 %d", lua_type(L, -1));
-    lua_setglobal(L, "mockf");
+    lua_settop(mock_L, top);
     return 0;
 }
-
-static int mock_main(lua_State *L) {
-    int ret = 0;
-
-    ret = load_mock_lua_file(L);
-    if (ret) {
-        LLOGD("加载mock脚本失败 %d", ret);
-        return ret;
-    }
-    lua_getglobal(L, "mockf");
-    lua_pushvalue(L, 1);
-    lua_pushvalue(L, 2);
-    lua_call(L, 2, 2);
-    return 2;
-}
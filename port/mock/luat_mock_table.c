@@ -0,0 +1,507 @@
+
+/*
+声明式的mock表, 由--mjson=path加载, 常量/轮换序列/范围/CSV波形这类固定的返回值
+直接在C里查表应答, 不用进入mock的lua虚拟机. 表里没有的key才交给--mlua的脚本处理
+
+{
+    "rtos.bsp.get": "EC618",                         常量, 等同于 {"value": "EC618"}
+    "wdt.feed": 0,                                   单个数字为lua_Integer, adc.read读到的原始值和电压值相同
+    "pm.lastState": [1, 0],                          数字数组按C的int逐个打包
+    "pm.reason": {"seq": [0, 1, 3]},                 每次调用依次返回, 循环
+    "adc.read@1": {"range": [3300, 4200], "step": 10},   来回扫描, 不写step则是范围内的随机数
+    "adc.read@2": {"csv": "wave.csv", "columns": [0, 1], "rate": 1000}
+}
+
+key后面的@N表示只匹配请求数据是整数N的调用, 例如adc.read@1只匹配通道1, 优先于不带@的key.
+range和csv的返回值与数字数组一样按C的int打包, 小数部分舍去, 外设的C接口都是按int读取的.
+csv按行读取数字, column/columns选列(从0开始), 多列时依次打包; rate是每秒的采样点数,
+按时间取点, 不写则每次调用取下一个点. csv的相对路径以json文件所在目录为准
+*/
+
+#include "luat_base.h"
+#include "luat_malloc.h"
+#include "luat_mcu.h"
+#include "luat_mock.h"
+
+#include "cJSON.h"
+
+#include <stdlib.h>
+
+#define LUAT_LOG_TAG "mock"
+#include "luat_log.h"
+
+// 多列波形一次最多返回的列数
+#define MOCK_WAVE_MAX_COLUMNS (8)
+
+enum {
+    MOCK_KIND_CONST,
+    MOCK_KIND_SEQ,
+    MOCK_KIND_RANGE,
+    MOCK_KIND_WAVE,
+};
+
+typedef struct mock_value {
+    char* data;
+    size_t len;
+    int type;
+}mock_value_t;
+
+typedef struct mock_entry {
+    struct mock_entry* next;
+    uint32_t hash;
+    int kind;
+    int code;
+    mock_value_t* values;       // CONST/SEQ
+    size_t count;               // SEQ的值个数, WAVE的采样点数
+    size_t index;
+    double min;                 // RANGE
+    double max;
+    double step;
+    double cur;
+    double* samples;            // WAVE, count行 x columns列
+    size_t columns;
+    uint32_t rate;
+    uint64_t start_ms;
+    char buff[MOCK_WAVE_MAX_COLUMNS * sizeof(int)];
+    char key[1];
+}mock_entry_t;
+
+static mock_entry_t** buckets;
+static size_t bucket_mask;
+static int has_arg_keys;
+
+static uint32_t mock_hash(const char* key) {
+    uint32_t h = 2166136261u;
+    while (*key) {
+        h ^= (uint8_t)*key++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static mock_entry_t* mock_find(const char* key) {
+    uint32_t h = mock_hash(key);
+    for (mock_entry_t* e = buckets[h & bucket_mask]; e; e = e->next) {
+        if (e->hash == h && strcmp(e->key, key) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+// 新旧版本的cJSON类型定义不同, 低8位总是只有一个类型
+static int json_type(cJSON* item) {
+    return item->type & 0xFF;
+}
+
+static void encode_number(double v, char* out, size_t* len, int* type) {
+    lua_Integer i = (lua_Integer)v;
+    memcpy(out, &i, sizeof(lua_Integer));
+    *len = sizeof(lua_Integer);
+    *type = LUA_TNUMBER;
+}
+
+// 与mock脚本的返回值编码一致: 数字为lua_Integer(小数部分舍去), 布尔为1字节, 字符串原样
+static int parse_value(cJSON* item, mock_value_t* val) {
+    char tmp[sizeof(lua_Integer)];
+    switch (json_type(item))
+    {
+    case cJSON_NULL:
+        val->type = LUA_TNIL;
+        return 0;
+    case cJSON_False:
+    case cJSON_True:
+        val->data = luat_heap_malloc(1);
+        if (val->data == NULL)
+            return -1;
+        val->data[0] = json_type(item) == cJSON_True;
+        val->len = 1;
+        val->type = LUA_TBOOLEAN;
+        return 0;
+    case cJSON_Number:
+        encode_number(item->valuedouble, tmp, &val->len, &val->type);
+        val->data = luat_heap_malloc(val->len);
+        if (val->data == NULL)
+            return -1;
+        memcpy(val->data, tmp, val->len);
+        return 0;
+    case cJSON_String:
+        val->len = strlen(item->valuestring);
+        val->data = luat_heap_malloc(val->len + 1);
+        if (val->data == NULL)
+            return -1;
+        memcpy(val->data, item->valuestring, val->len + 1);
+        val->type = LUA_TSTRING;
+        return 0;
+    case cJSON_Array:
+        {
+            int n = cJSON_GetArraySize(item);
+            val->len = n * sizeof(int);
+            val->data = luat_heap_malloc(val->len + 1);
+            if (val->data == NULL)
+                return -1;
+            for (int i = 0; i < n; i++) {
+                cJSON* sub = cJSON_GetArrayItem(item, i);
+                if (json_type(sub) != cJSON_Number) {
+                    LLOGE("数组里只能是数字");
+                    return -1;
+                }
+                int v = (int)sub->valuedouble;
+                memcpy(val->data + i * sizeof(int), &v, sizeof(int));
+            }
+            val->type = LUA_TSTRING;
+        }
+        return 0;
+    default:
+        LLOGE("不支持的值类型 %d", json_type(item));
+        return -1;
+    }
+}
+
+static int load_wave(mock_entry_t* e, const char* dir, const char* name, cJSON* columns) {
+    char path[1024];
+    int col[MOCK_WAVE_MAX_COLUMNS] = {0};
+    e->columns = 1;
+    if (columns && json_type(columns) == cJSON_Array) {
+        e->columns = cJSON_GetArraySize(columns);
+        if (e->columns == 0 || e->columns > MOCK_WAVE_MAX_COLUMNS) {
+            LLOGE("columns需要1~%d列", MOCK_WAVE_MAX_COLUMNS);
+            return -1;
+        }
+        for (size_t i = 0; i < e->columns; i++)
+            col[i] = (int)cJSON_GetArrayItem(columns, i)->valuedouble;
+    }
+    else if (columns) {
+        col[0] = (int)columns->valuedouble;
+    }
+    if (name[0] == '/' || name[0] == '\\' || (name[0] && name[1] == ':'))
+        snprintf(path, sizeof(path), "%s", name);
+    else
+        snprintf(path, sizeof(path), "%s%s", dir, name);
+
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        LLOGE("波形文件不存在 %s", path);
+        return -1;
+    }
+    size_t cap = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        // 按逗号拆开, 取需要的列, 表头或者缺列的行跳过
+        double fields[64];
+        uint8_t valid[64];
+        size_t nfield = 0;
+        int ok = 1;
+        char* p = line;
+        while (nfield < 64) {
+            char* end;
+            fields[nfield] = strtod(p, &end);
+            valid[nfield] = end != p;
+            nfield++;
+            p = strchr(end, ',');
+            if (p == NULL)
+                break;
+            p++;
+        }
+        for (size_t i = 0; i < e->columns; i++) {
+            if (col[i] < 0 || (size_t)col[i] >= nfield || !valid[col[i]])
+                ok = 0;
+        }
+        if (!ok)
+            continue;
+        if (e->count == cap) {
+            cap = cap ? cap * 2 : 256;
+            double* ptr = luat_heap_realloc(e->samples, cap * e->columns * sizeof(double));
+            if (ptr == NULL) {
+                fclose(f);
+                LLOGE("波形文件太大,内存放不下 %s", path);
+                return -1;
+            }
+            e->samples = ptr;
+        }
+        for (size_t i = 0; i < e->columns; i++)
+            e->samples[e->count * e->columns + i] = fields[col[i]];
+        e->count++;
+    }
+    fclose(f);
+    if (e->count == 0) {
+        LLOGE("波形文件里没有数据 %s", path);
+        return -1;
+    }
+    LLOGI("波形 %s %d点 %d列", e->key, (int)e->count, (int)e->columns);
+    return 0;
+}
+
+static int parse_entry(mock_entry_t* e, cJSON* item, const char* dir) {
+    cJSON* sub;
+    if (json_type(item) != cJSON_Object) {
+        e->kind = MOCK_KIND_CONST;
+        e->count = 1;
+        e->values = luat_heap_calloc(1, sizeof(mock_value_t));
+        return e->values == NULL ? -1 : parse_value(item, e->values);
+    }
+    sub = cJSON_GetObjectItem(item, "code");
+    if (sub)
+        e->code = (int)sub->valuedouble;
+    if ((sub = cJSON_GetObjectItem(item, "value")) != NULL) {
+        e->kind = MOCK_KIND_CONST;
+        e->count = 1;
+        e->values = luat_heap_calloc(1, sizeof(mock_value_t));
+        return e->values == NULL ? -1 : parse_value(sub, e->values);
+    }
+    if ((sub = cJSON_GetObjectItem(item, "seq")) != NULL) {
+        if (json_type(sub) != cJSON_Array || cJSON_GetArraySize(sub) == 0) {
+            LLOGE("seq需要非空数组 %s", e->key);
+            return -1;
+        }
+        e->kind = MOCK_KIND_SEQ;
+        e->count = cJSON_GetArraySize(sub);
+        e->values = luat_heap_calloc(e->count, sizeof(mock_value_t));
+        if (e->values == NULL)
+            return -1;
+        for (size_t i = 0; i < e->count; i++) {
+            if (parse_value(cJSON_GetArrayItem(sub, i), &e->values[i]))
+                return -1;
+        }
+        return 0;
+    }
+    if ((sub = cJSON_GetObjectItem(item, "range")) != NULL) {
+        if (json_type(sub) != cJSON_Array || cJSON_GetArraySize(sub) != 2) {
+            LLOGE("range需要[min, max] %s", e->key);
+            return -1;
+        }
+        e->kind = MOCK_KIND_RANGE;
+        e->min = cJSON_GetArrayItem(sub, 0)->valuedouble;
+        e->max = cJSON_GetArrayItem(sub, 1)->valuedouble;
+        if (e->min > e->max) {
+            LLOGE("range的min大于max %s", e->key);
+            return -1;
+        }
+        sub = cJSON_GetObjectItem(item, "step");
+        e->step = sub ? sub->valuedouble : 0;
+        if (e->step < 0)
+            e->step = -e->step;
+        e->cur = e->min;
+        return 0;
+    }
+    if ((sub = cJSON_GetObjectItem(item, "csv")) != NULL) {
+        if (json_type(sub) != cJSON_String) {
+            LLOGE("csv需要文件路径 %s", e->key);
+            return -1;
+        }
+        e->kind = MOCK_KIND_WAVE;
+        cJSON* rate = cJSON_GetObjectItem(item, "rate");
+        e->rate = rate ? (uint32_t)rate->valuedouble : 0;
+        cJSON* columns = cJSON_GetObjectItem(item, "columns");
+        if (columns == NULL)
+            columns = cJSON_GetObjectItem(item, "column");
+        return load_wave(e, dir, sub->valuestring, columns);
+    }
+    LLOGE("需要value/seq/range/csv其中之一 %s", e->key);
+    return -1;
+}
+
+static void free_entry(mock_entry_t* e) {
+    if (e->values) {
+        for (size_t i = 0; i < e->count; i++)
+            luat_heap_free(e->values[i].data);
+        luat_heap_free(e->values);
+    }
+    luat_heap_free(e->samples);
+    luat_heap_free(e);
+}
+
+static void mock_table_clear(void) {
+    if (buckets == NULL)
+        return;
+    for (size_t i = 0; i <= bucket_mask; i++) {
+        while (buckets[i]) {
+            mock_entry_t* e = buckets[i];
+            buckets[i] = e->next;
+            free_entry(e);
+        }
+    }
+    luat_heap_free(buckets);
+    buckets = NULL;
+    has_arg_keys = 0;
+}
+
+int luat_mock_table_load(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        LLOGE("文件不存在 %s", path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* tmp = luat_heap_malloc(len + 1);
+    if (tmp == NULL) {
+        fclose(f);
+        LLOGE("文件太大,内存放不下 %s", path);
+        return -1;
+    }
+    len = fread(tmp, 1, len, f);
+    fclose(f);
+    tmp[len] = 0x00;
+    cJSON* root = cJSON_Parse(tmp);
+    luat_heap_free(tmp);
+    if (root == NULL || json_type(root) != cJSON_Object) {
+        LLOGE("json格式错误 %s", path);
+        cJSON_Delete(root);
+        return -1;
+    }
+
+    // csv的相对路径以json文件所在的目录为准
+    char dir[1024] = {0};
+    size_t dlen = strlen(path);
+    while (dlen > 0 && path[dlen - 1] != '/' && path[dlen - 1] != '\\')
+        dlen--;
+    if (dlen >= sizeof(dir))
+        dlen = 0;
+    memcpy(dir, path, dlen);
+
+    // 重复加载时替换掉之前的表
+    mock_table_clear();
+    size_t count = cJSON_GetArraySize(root);
+    size_t nbucket = 16;
+    while (nbucket < count * 2)
+        nbucket *= 2;
+    buckets = luat_heap_calloc(nbucket, sizeof(mock_entry_t*));
+    if (buckets == NULL) {
+        cJSON_Delete(root);
+        return -1;
+    }
+    bucket_mask = nbucket - 1;
+
+    int ret = 0;
+    for (cJSON* item = root->child; item; item = item->next) {
+        size_t klen = strlen(item->string);
+        if (klen >= sizeof(((luat_mock_ctx_t*)0)->key)) {
+            LLOGE("key太长 %s", item->string);
+            ret = -1;
+            break;
+        }
+        if (mock_find(item->string)) {
+            LLOGW("key重复, 只用第一个 %s", item->string);
+            continue;
+        }
+        mock_entry_t* e = luat_heap_calloc(1, sizeof(mock_entry_t) + klen);
+        if (e == NULL) {
+            ret = -1;
+            break;
+        }
+        memcpy(e->key, item->string, klen + 1);
+        if (parse_entry(e, item, dir)) {
+            LLOGE("mock表项错误 %s", e->key);
+            free_entry(e);
+            ret = -1;
+            break;
+        }
+        if (strchr(e->key, '@'))
+            has_arg_keys = 1;
+        e->hash = mock_hash(e->key);
+        e->next = buckets[e->hash & bucket_mask];
+        buckets[e->hash & bucket_mask] = e;
+    }
+    cJSON_Delete(root);
+    if (ret) {
+        mock_table_clear();
+        return ret;
+    }
+    LLOGI("mock表 %s %d项", path, (int)count);
+    return 0;
+}
+
+static void respond_wave(mock_entry_t* e, luat_mock_ctx_t* ctx) {
+    size_t idx;
+    if (e->rate) {
+        uint64_t now = luat_mcu_tick64_ms();
+        if (e->start_ms == 0)
+            e->start_ms = now;
+        idx = (size_t)((now - e->start_ms) * e->rate / 1000 % e->count);
+    }
+    else {
+        idx = e->index;
+        e->index = (e->index + 1) % e->count;
+    }
+    double* row = e->samples + idx * e->columns;
+    // 单列也按int打包, 与数字数组一致
+    for (size_t i = 0; i < e->columns; i++) {
+        int v = (int)row[i];
+        memcpy(e->buff + i * sizeof(int), &v, sizeof(int));
+    }
+    ctx->resp_len = e->columns * sizeof(int);
+    ctx->resp_type = LUA_TSTRING;
+    ctx->resp_data = e->buff;
+}
+
+static void respond_range(mock_entry_t* e, luat_mock_ctx_t* ctx) {
+    double v;
+    if (e->step != 0) {
+        // 在min和max之间来回扫, 三角波, 到头之后反射回来
+        v = e->cur;
+        e->cur += e->step;
+        if (e->cur > e->max) {
+            e->cur = 2 * e->max - e->cur;
+            e->step = -e->step;
+        }
+        else if (e->cur < e->min) {
+            e->cur = 2 * e->min - e->cur;
+            e->step = -e->step;
+        }
+        // step比整个范围还大
+        if (e->cur < e->min || e->cur > e->max)
+            e->cur = e->min;
+    }
+    else {
+        v = e->min + (e->max - e->min) * ((double)rand() / RAND_MAX);
+        // 整数范围四舍五入, 两端的值也能取到
+        if ((lua_Integer)e->min == e->min && (lua_Integer)e->max == e->max)
+            v = (double)(lua_Integer)(v + 0.5);
+    }
+    int iv = (int)v;
+    memcpy(e->buff, &iv, sizeof(int));
+    ctx->resp_len = sizeof(int);
+    ctx->resp_type = LUA_TSTRING;
+    ctx->resp_data = e->buff;
+}
+
+int luat_mock_table_call(luat_mock_ctx_t* ctx) {
+    if (buckets == NULL)
+        return MOCK_DISABLED;
+    mock_entry_t* e = NULL;
+    if (has_arg_keys && ctx->req_len == sizeof(int)) {
+        char key[sizeof(ctx->key) + 16];
+        int arg;
+        memcpy(&arg, ctx->req_data, sizeof(int));
+        snprintf(key, sizeof(key), "%s@%d", ctx->key, arg);
+        e = mock_find(key);
+    }
+    if (e == NULL)
+        e = mock_find(ctx->key);
+    if (e == NULL)
+        return MOCK_DISABLED;
+
+    ctx->resp_code = e->code;
+    switch (e->kind)
+    {
+    case MOCK_KIND_CONST:
+    case MOCK_KIND_SEQ:
+        {
+            mock_value_t* val = &e->values[e->index];
+            if (e->kind == MOCK_KIND_SEQ)
+                e->index = (e->index + 1) % e->count;
+            ctx->resp_data = val->data;
+            ctx->resp_len = val->len;
+            ctx->resp_type = val->type;
+        }
+        break;
+    case MOCK_KIND_RANGE:
+        respond_range(e, ctx);
+        break;
+    case MOCK_KIND_WAVE:
+        respond_wave(e, ctx);
+        break;
+    }
+    return 0;
+}
@@ -0,0 +1,279 @@
+
+#include "uv.h"
+#include "luat_base.h"
+#include "luat_malloc.h"
+
+#include "luat_network_pc.h"
+
+#define LUAT_LOG_TAG "dns"
+#include "luat_log.h"
+
+// 域名解析缓存
+// 1. 按域名+地址族缓存全部解析结果, 到期后重新解析
+// 2. 解析失败的结果短时间缓存(负缓存), 避免反复解析不存在的域名
+// 3. 相同域名的并发查询合并为一次uv_getaddrinfo, 结果分发给全部等待者
+// uv_getaddrinfo拿不到记录的真实TTL, 所以有效期使用可配置的默认值
+
+enum {
+    DNS_ENTRY_PENDING,
+    DNS_ENTRY_OK,
+    DNS_ENTRY_FAIL
+};
+
+typedef struct dns_waiter
+{
+    luat_dns_cache_cb cb;
+    void* userdata;
+    struct dns_waiter* next;
+}dns_waiter_t;
+
+typedef struct dns_entry
+{
+    struct dns_entry* next;
+    char domain[256];
+    int family;
+    int state;
+    uint64_t expire;    // uv_now时间, 毫秒
+    size_t count;
+    luat_dns_addr_t addrs[LUAT_DNS_CACHE_MAX_ADDR];
+    dns_waiter_t* waiters;
+    struct addrinfo hints;
+    uv_getaddrinfo_t resolver;
+}dns_entry_t;
+
+extern uv_loop_t *main_loop;
+
+static dns_entry_t* entries;
+static luat_dns_cache_stat_t dns_stat;
+static uint32_t cache_ttl = 60;
+static uint32_t cache_neg_ttl = 5;
+
+static uint32_t entry_ttl_left(dns_entry_t* e, uint64_t now) {
+    if (e->expire <= now)
+        return 0;
+    return (uint32_t)((e->expire - now + 999) / 1000);
+}
+
+static void entry_unlink(dns_entry_t* e) {
+    dns_entry_t** pp = &entries;
+    while (*pp) {
+        if (*pp == e) {
+            *pp = e->next;
+            dns_stat.entries--;
+            return;
+        }
+        pp = &(*pp)->next;
+    }
+}
+
+static dns_entry_t* entry_find(const char* domain, int family) {
+    dns_entry_t* e = entries;
+    while (e) {
+        if (e->family == family && !strcmp(e->domain, domain))
+            return e;
+        e = e->next;
+    }
+    return NULL;
+}
+
+// 缓存满了, 优先淘汰已过期的, 其次淘汰最早到期的, 解析中的记录不淘汰
+static void entry_evict(uint64_t now) {
+    dns_entry_t* victim = NULL;
+    dns_entry_t* e = entries;
+    while (e) {
+        if (e->state != DNS_ENTRY_PENDING) {
+            if (e->expire <= now) {
+                victim = e;
+                break;
+            }
+            if (victim == NULL || e->expire < victim->expire)
+                victim = e;
+        }
+        e = e->next;
+    }
+    if (victim) {
+        entry_unlink(victim);
+        luat_heap_free(victim);
+        dns_stat.evictions++;
+    }
+}
+
+static void entry_notify(dns_entry_t* e) {
+    dns_waiter_t* w = e->waiters;
+    uint32_t ttl = entry_ttl_left(e, uv_now(main_loop));
+    e->waiters = NULL;
+    while (w) {
+        dns_waiter_t* next = w->next;
+        if (e->state == DNS_ENTRY_OK)
+            w->cb(e->addrs, e->count, ttl, w->userdata);
+        else
+            w->cb(NULL, 0, 0, w->userdata);
+        luat_heap_free(w);
+        w = next;
+    }
+}
+
+static void on_resolved(uv_getaddrinfo_t *resolver, int status, struct addrinfo *res) {
+    dns_entry_t* e = (dns_entry_t*)resolver->data;
+    uint64_t now = uv_now(main_loop);
+    e->count = 0;
+    if (status == 0) {
+        for (struct addrinfo* ai = res; ai != NULL && e->count < LUAT_DNS_CACHE_MAX_ADDR; ai = ai->ai_next) {
+            luat_dns_addr_t addr = {.family = ai->ai_family};
+            if (ai->ai_family == AF_INET)
+                memcpy(addr.addr, &((struct sockaddr_in*)ai->ai_addr)->sin_addr, 4);
+            else if (ai->ai_family == AF_INET6)
+                memcpy(addr.addr, &((struct sockaddr_in6*)ai->ai_addr)->sin6_addr, 16);
+            else
+                continue;
+            // getaddrinfo可能返回重复的地址
+            size_t i = 0;
+            for (; i < e->count; i++) {
+                if (!memcmp(&e->addrs[i], &addr, sizeof(luat_dns_addr_t)))
+                    break;
+            }
+            if (i == e->count)
+                memcpy(&e->addrs[e->count++], &addr, sizeof(luat_dns_addr_t));
+        }
+        uv_freeaddrinfo(res);
+    }
+    if (e->count > 0) {
+        e->state = DNS_ENTRY_OK;
+        e->expire = now + (uint64_t)cache_ttl * 1000;
+        LLOGI("%s 解析成功, 共%d个地址", e->domain, (int)e->count);
+    }
+    else {
+        LLOGD("%s 解析失败 %d %s", e->domain, status, status ? uv_err_name(status) : "");
+        e->state = DNS_ENTRY_FAIL;
+        e->expire = now + (uint64_t)cache_neg_ttl * 1000;
+        dns_stat.failures++;
+    }
+    entry_notify(e);
+}
+
+int luat_dns_cache_query(const char* domain, size_t len, int family, luat_dns_cache_cb cb, void* userdata) {
+    if (domain == NULL || len == 0 || len >= 256 || cb == NULL)
+        return -1;
+    char name[256] = {0};
+    memcpy(name, domain, len);
+    uint64_t now = uv_now(main_loop);
+    dns_stat.lookups++;
+
+    dns_entry_t* e = entry_find(name, family);
+    if (e != NULL) {
+        if (e->state == DNS_ENTRY_PENDING) {
+            dns_waiter_t* w = luat_heap_zalloc(sizeof(dns_waiter_t));
+            if (w == NULL) {
+                LLOGE("out of memory when malloc dns waiter");
+                return -1;
+            }
+            w->cb = cb;
+            w->userdata = userdata;
+            w->next = e->waiters;
+            e->waiters = w;
+            dns_stat.coalesced++;
+            return 0;
+        }
+        if (e->expire > now) {
+            if (e->state == DNS_ENTRY_OK) {
+                dns_stat.hits++;
+                cb(e->addrs, e->count, entry_ttl_left(e, now), userdata);
+            }
+            else {
+                dns_stat.neg_hits++;
+                cb(NULL, 0, 0, userdata);
+            }
+            return 0;
+        }
+        // 已过期, 复用该记录重新解析
+    }
+    else {
+        if (dns_stat.entries >= LUAT_DNS_CACHE_SIZE)
+            entry_evict(now);
+        e = luat_heap_zalloc(sizeof(dns_entry_t));
+        if (e == NULL) {
+            LLOGE("out of memory when malloc dns entry");
+            return -1;
+        }
+        memcpy(e->domain, name, len);
+        e->family = family;
+        e->next = entries;
+        entries = e;
+        dns_stat.entries++;
+    }
+    dns_stat.misses++;
+
+    dns_waiter_t* w = luat_heap_zalloc(sizeof(dns_waiter_t));
+    if (w == NULL) {
+        LLOGE("out of memory when malloc dns waiter");
+        entry_unlink(e);
+        luat_heap_free(e);
+        return -1;
+    }
+    w->cb = cb;
+    w->userdata = userdata;
+    e->waiters = w;
+    e->state = DNS_ENTRY_PENDING;
+    e->count = 0;
+    e->hints.ai_family = family;
+    e->hints.ai_socktype = SOCK_STREAM;
+    e->hints.ai_protocol = IPPROTO_TCP;
+    e->hints.ai_flags = 0;
+    e->resolver.data = e;
+    dns_stat.resolves++;
+    int ret = uv_getaddrinfo(main_loop, &e->resolver, on_resolved, e->domain, NULL, &e->hints);
+    if (ret) {
+        LLOGI("uv_getaddrinfo %d %s", ret, uv_err_name(ret));
+        e->waiters = NULL;
+        luat_heap_free(w);
+        entry_unlink(e);
+        luat_heap_free(e);
+        dns_stat.failures++;
+        return ret;
+    }
+    return 0;
+}
+
+void luat_dns_cache_clear(void) {
+    dns_entry_t** pp = &entries;
+    while (*pp) {
+        dns_entry_t* e = *pp;
+        if (e->state == DNS_ENTRY_PENDING) {
+            pp = &e->next;
+            continue;
+        }
+        *pp = e->next;
+        dns_stat.entries--;
+        luat_heap_free(e);
+    }
+}
+
+void luat_dns_cache_set_ttl(uint32_t ttl, uint32_t neg_ttl) {
+    cache_ttl = ttl;
+    cache_neg_ttl = neg_ttl;
+}
+
+size_t luat_dns_cache_peers(const luat_dns_addr_t* addr, int family, luat_dns_addr_t* out, size_t max) {
+    uint64_t now = uv_now(main_loop);
+    dns_entry_t* e = entries;
+    while (e) {
+        if (e->state == DNS_ENTRY_OK && e->expire > now && e->family == addr->family) {
+            for (size_t i = 0; i < e->count; i++) {
+                if (memcmp(&e->addrs[i], addr, sizeof(luat_dns_addr_t)))
+                    continue;
+                dns_entry_t* peer = entry_find(e->domain, family);
+                if (peer == NULL || peer->state != DNS_ENTRY_OK || peer->expire <= now)
+                    return 0;
+                size_t count = peer->count < max ? peer->count : max;
+                memcpy(out, peer->addrs, sizeof(luat_dns_addr_t) * count);
+                return count;
+            }
+        }
+        e = e->next;
+    }
+    return 0;
+}
+
+void luat_dns_cache_get_stat(luat_dns_cache_stat_t* out) {
+    memcpy(out, &dns_stat, sizeof(luat_dns_cache_stat_t));
+}
@@ -0,0 +1,752 @@
+
+#ifdef __linux__
+// 要在lwip的头文件之前, lwipopts.h会覆盖这里的TCP_MSS
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#include "uv.h"
+#include "luat_base.h"
+#include "luat_malloc.h"
+#include "luat_pcconf.h"
+
+#include "luat_network_adapter.h"
+#include "luat_network_pc.h"
+
+#define LUAT_LOG_TAG "iperf"
+#include "luat_log.h"
+
+#ifdef LUAT_USE_LWIP
+#include "lwip/opt.h"
+#include "lwip/tcp.h"
+#include "lwip/netif.h"
+#include "net_lwip2.h"
+#endif
+
+// iperf2兼容的TCP吞吐量测试, 与lwip的apps/lwiperf相同的协议:
+// 客户端连接后先发24字节的client_hdr(flags为0, 不要求反向测试), 然后持续发送"0123456789"循环的数据,
+// 到时间或者发够字节数后关闭连接; 服务端只管接收, 对端关闭时出报告. 可以和PC上的iperf -s / iperf -c互通
+// 同一套测试分别跑在lwip(raw API)和libuv(系统协议栈)上, 方便对比
+
+#define IPERF_HDR_LEN       24
+#define IPERF_PATTERN_LEN   10
+// libuv客户端同时提交的uv_write数量
+#define IPERF_UV_INFLIGHT   4
+#define IPERF_RXBUF_SIZE    (64 * 1024)
+
+extern uv_loop_t *main_loop;
+
+typedef struct iperf_session iperf_session_t;
+
+typedef struct iperf_conn
+{
+    iperf_session_t* s;
+#ifdef LUAT_USE_LWIP
+    struct tcp_pcb* pcb;
+#endif
+    uv_tcp_t* tcp;
+    uint64_t start_ns;
+    uint64_t last_ns;
+    uint64_t bytes;         // 服务端为收到的字节数, 客户端为对方已确认(libuv为已写入系统)的字节数
+    uint64_t queued;        // 客户端已提交发送的字节数
+    uv_rusage_t ru;
+    uint32_t rexmit_base;   // 开始时lwip pcb的重传报文段数
+    uint32_t rexmit;        // 最近一次读到的lwip pcb的重传报文段数, pcb被lwip释放之后用它
+    uint8_t hdr[IPERF_HDR_LEN];
+    uint8_t inflight;
+    uint8_t stop;
+    uint8_t done;
+    char remote[48];
+    struct iperf_conn* next;
+}iperf_conn_t;
+
+struct iperf_session
+{
+    int id;
+    uint8_t is_server;
+    uint8_t stopping;       // luat_iperf_stop里统一释放会话
+    luat_iperf_opts_t opts;
+    char host[64];
+#ifdef LUAT_USE_LWIP
+    struct tcp_pcb* lpcb;
+#endif
+    uv_tcp_t* listener;
+    iperf_conn_t* conns;
+    luat_iperf_report_cb cb;
+    void* userdata;
+};
+
+static iperf_session_t* sessions[LUAT_IPERF_MAX_SESSION];
+static uint8_t iperf_txbuf[LUAT_IPERF_MAX_BLOCK + IPERF_PATTERN_LEN];
+static char iperf_rxbuf[IPERF_RXBUF_SIZE];
+
+static uint64_t ru_us(const uv_rusage_t* ru) {
+    return (uint64_t)(ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000000
+        + ru->ru_utime.tv_usec + ru->ru_stime.tv_usec;
+}
+
+// 发送数据的来源, 从任意位置开始连续读LUAT_IPERF_MAX_BLOCK字节都是"0123456789"循环
+static const uint8_t* iperf_pattern(uint64_t offset) {
+    if (iperf_txbuf[0] == 0) {
+        for (size_t i = 0; i < sizeof(iperf_txbuf); i++)
+            iperf_txbuf[i] = '0' + (i % IPERF_PATTERN_LEN);
+    }
+    return iperf_txbuf + (offset % IPERF_PATTERN_LEN);
+}
+
+// lwiperf的client_hdr, 全部是网络字节序, amount为负数时代表时长, 单位10ms
+static void iperf_make_hdr(const iperf_session_t* s, uint8_t* hdr) {
+    int32_t v[6] = {0};
+    v[1] = 1;
+    v[2] = s->opts.port;
+    v[3] = 0;
+    v[4] = 0;
+    v[5] = s->opts.amount ? (int32_t)s->opts.amount : -(int32_t)(s->opts.duration_ms / 10);
+    for (size_t i = 0; i < 6; i++) {
+        uint32_t u = (uint32_t)v[i];
+        hdr[i * 4] = u >> 24;
+        hdr[i * 4 + 1] = u >> 16;
+        hdr[i * 4 + 2] = u >> 8;
+        hdr[i * 4 + 3] = u;
+    }
+}
+
+static int iperf_should_stop(iperf_conn_t* c) {
+    const luat_iperf_opts_t* opts = &c->s->opts;
+    if (c->stop)
+        return 1;
+    if (opts->amount && c->queued >= opts->amount)
+        c->stop = 1;
+    else if (!opts->amount && (uv_hrtime() - c->start_ns) / 1000000 >= opts->duration_ms)
+        c->stop = 1;
+    return c->stop;
+}
+
+static void iperf_conn_begin(iperf_conn_t* c) {
+    c->start_ns = uv_hrtime();
+    c->last_ns = c->start_ns;
+    uv_getrusage(&c->ru);
+#ifdef LUAT_USE_LWIP
+    if (c->pcb)
+        c->rexmit_base = c->rexmit = c->pcb->rexmit_segs;
+#endif
+}
+
+static void iperf_conn_unlink(iperf_conn_t* c) {
+    iperf_conn_t** pp = &c->s->conns;
+    while (*pp) {
+        if (*pp == c) {
+            *pp = c->next;
+            break;
+        }
+        pp = &(*pp)->next;
+    }
+}
+
+static void iperf_session_free(iperf_session_t* s);
+
+// 一条连接结束, 出报告; 连接本身由调用者关闭
+static void iperf_conn_finish(iperf_conn_t* c, int result, int64_t retrans) {
+    iperf_session_t* s = c->s;
+    luat_iperf_report_t report = {0};
+    uv_rusage_t ru;
+    if (c->done)
+        return;
+    c->done = 1;
+    uv_getrusage(&ru);
+    report.is_server = s->is_server;
+    report.backend = s->opts.backend;
+    report.result = result;
+    memcpy(report.remote, c->remote, sizeof(report.remote));
+    report.bytes = c->bytes;
+    if (c->start_ns) {
+        // 统计到最后一次收到数据(客户端为最后一次被确认)为止, 不包括关闭连接的等待时间
+        uint64_t end = c->last_ns;
+        report.ms = (uint32_t)((end - c->start_ns) / 1000000);
+        if (end > c->start_ns)
+            report.kbps = c->bytes * 8 * 1000000 / (end - c->start_ns);
+        report.cpu_us = ru_us(&ru) - ru_us(&c->ru);
+    }
+    report.retrans = retrans;
+    LLOGI("%s %s %s %llu bytes %u ms %llu kbit/s retrans %lld cpu %llu us",
+        s->opts.backend == LUAT_IPERF_LWIP ? "lwip" : "libuv", s->is_server ? "server" : "client",
+        report.remote, (unsigned long long)report.bytes, report.ms, (unsigned long long)report.kbps,
+        (long long)report.retrans, (unsigned long long)report.cpu_us);
+    if (s->cb)
+        s->cb(s->id, &report, s->userdata);
+}
+
+//---------------------------------------
+// lwip后端
+//---------------------------------------
+#ifdef LUAT_USE_LWIP
+
+// MIB2的tcpRetransSegs是全局的, 而且只统计快速重传, 这里用每个pcb自己的计数
+static int64_t iperf_lwip_retrans(iperf_conn_t* c) {
+    if (c->pcb)
+        c->rexmit = c->pcb->rexmit_segs;
+    return (int64_t)(uint32_t)(c->rexmit - c->rexmit_base);
+}
+
+static void iperf_lwip_detach(struct tcp_pcb* pcb) {
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+}
+
+// 在lwip的回调里调用时, 返回ERR_ABRT的话回调也要返回ERR_ABRT
+static err_t iperf_lwip_close(iperf_conn_t* c, int result) {
+    err_t ret = ERR_OK;
+    iperf_conn_finish(c, result, iperf_lwip_retrans(c));
+    if (c->pcb) {
+        iperf_lwip_detach(c->pcb);
+        if (result != LUAT_IPERF_DONE || tcp_close(c->pcb) != ERR_OK) {
+            tcp_abort(c->pcb);
+            ret = ERR_ABRT;
+        }
+        c->pcb = NULL;
+    }
+    iperf_conn_unlink(c);
+    iperf_session_t* s = c->s;
+    luat_heap_free(c);
+    if (!s->is_server && !s->stopping && s->conns == NULL)
+        iperf_session_free(s);
+    return ret;
+}
+
+static void iperf_lwip_pump(iperf_conn_t* c) {
+    const luat_iperf_opts_t* opts = &c->s->opts;
+    u8_t flags = opts->copy ? TCP_WRITE_FLAG_COPY : 0;
+    while (!iperf_should_stop(c)) {
+        size_t n = tcp_sndbuf(c->pcb);
+        if (n > opts->block)
+            n = opts->block;
+        if (n > 0xFFFF)
+            n = 0xFFFF;
+        if (opts->amount && n > opts->amount - c->queued)
+            n = (size_t)(opts->amount - c->queued);
+        if (n == 0 || tcp_sndqueuelen(c->pcb) >= TCP_SND_QUEUELEN)
+            break;
+        if (tcp_write(c->pcb, iperf_pattern(c->queued - IPERF_HDR_LEN), (u16_t)n, flags | TCP_WRITE_FLAG_MORE) != ERR_OK)
+            break;
+        c->queued += n;
+    }
+    tcp_output(c->pcb);
+}
+
+// 发送结束并且全部被确认了才算完成
+static err_t iperf_lwip_check_done(iperf_conn_t* c) {
+    if (iperf_should_stop(c) && c->bytes >= c->queued)
+        return iperf_lwip_close(c, LUAT_IPERF_DONE);
+    return ERR_OK;
+}
+
+static err_t iperf_lwip_sent(void* arg, struct tcp_pcb* pcb, u16_t len) {
+    (void)pcb;
+    iperf_conn_t* c = (iperf_conn_t*)arg;
+    c->bytes += len;
+    c->last_ns = uv_hrtime();
+    iperf_lwip_pump(c);
+    return iperf_lwip_check_done(c);
+}
+
+static err_t iperf_lwip_poll(void* arg, struct tcp_pcb* pcb) {
+    (void)pcb;
+    iperf_conn_t* c = (iperf_conn_t*)arg;
+    // 连接被对方复位时pcb已经释放, 报告用这里最近一次的计数
+    iperf_lwip_retrans(c);
+    // 发送缓冲区满了之后tcp_write失败, 靠这里兜底继续发送
+    iperf_lwip_pump(c);
+    return iperf_lwip_check_done(c);
+}
+
+static void iperf_lwip_err(void* arg, err_t err) {
+    iperf_conn_t* c = (iperf_conn_t*)arg;
+    if (c == NULL)
+        return;
+    // pcb已经被lwip释放了
+    c->pcb = NULL;
+    iperf_lwip_close(c, err == ERR_ABRT ? LUAT_IPERF_ABORTED_LOCAL : LUAT_IPERF_ABORTED_REMOTE);
+}
+
+static err_t iperf_lwip_connected(void* arg, struct tcp_pcb* pcb, err_t err) {
+    iperf_conn_t* c = (iperf_conn_t*)arg;
+    uint8_t hdr[IPERF_HDR_LEN];
+    (void)err;
+    iperf_conn_begin(c);
+    // 最后一个不满MSS的报文段不能被Nagle算法压住, 否则要等对方的延迟确认
+    tcp_nagle_disable(pcb);
+    tcp_sent(pcb, iperf_lwip_sent);
+    tcp_poll(pcb, iperf_lwip_poll, 2);
+    iperf_make_hdr(c->s, hdr);
+    if (tcp_write(pcb, hdr, IPERF_HDR_LEN, TCP_WRITE_FLAG_COPY) != ERR_OK)
+        return iperf_lwip_close(c, LUAT_IPERF_ABORTED_LOCAL);
+    c->queued = IPERF_HDR_LEN;
+    iperf_lwip_pump(c);
+    return ERR_OK;
+}
+
+static err_t iperf_lwip_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err) {
+    iperf_conn_t* c = (iperf_conn_t*)arg;
+    (void)err;
+    if (p == NULL)
+        return iperf_lwip_close(c, LUAT_IPERF_DONE);
+    c->bytes += p->tot_len;
+    c->last_ns = uv_hrtime();
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+static err_t iperf_lwip_accept(void* arg, struct tcp_pcb* pcb, err_t err) {
+    iperf_session_t* s = (iperf_session_t*)arg;
+    if (err != ERR_OK || pcb == NULL)
+        return ERR_VAL;
+    iperf_conn_t* c = luat_heap_zalloc(sizeof(iperf_conn_t));
+    if (c == NULL)
+        return ERR_MEM;
+    c->s = s;
+    c->pcb = pcb;
+    snprintf(c->remote, sizeof(c->remote), "%s:%d", ipaddr_ntoa(&pcb->remote_ip), pcb->remote_port);
+    c->next = s->conns;
+    s->conns = c;
+    iperf_conn_begin(c);
+    tcp_arg(pcb, c);
+    tcp_recv(pcb, iperf_lwip_recv);
+    tcp_err(pcb, iperf_lwip_err);
+    return ERR_OK;
+}
+
+// 绑定到适配器对应网卡的地址上, pair模式下按源地址选择出口网卡
+static void iperf_lwip_local(uint8_t adapter, ip_addr_t* addr) {
+    struct netif* netif = net_lwip2_get_netif(adapter);
+    if (netif)
+        ip_addr_copy(*addr, netif->ip_addr);
+    else
+        ip_addr_set_zero(addr);
+}
+
+static int iperf_lwip_server(iperf_session_t* s) {
+    ip_addr_t local;
+    iperf_lwip_local(s->opts.adapter, &local);
+    struct tcp_pcb* pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+    if (pcb == NULL)
+        return -1;
+    if (tcp_bind(pcb, &local, s->opts.port) != ERR_OK) {
+        tcp_close(pcb);
+        return -1;
+    }
+    s->lpcb = tcp_listen(pcb);
+    if (s->lpcb == NULL) {
+        tcp_close(pcb);
+        return -1;
+    }
+    tcp_arg(s->lpcb, s);
+    tcp_accept(s->lpcb, iperf_lwip_accept);
+    return 0;
+}
+
+static int iperf_lwip_client(iperf_session_t* s) {
+    ip_addr_t local, remote;
+    if (!ipaddr_aton(s->host, &remote))
+        return -1;
+    iperf_lwip_local(s->opts.adapter, &local);
+    iperf_conn_t* c = luat_heap_zalloc(sizeof(iperf_conn_t));
+    if (c == NULL)
+        return -1;
+    c->s = s;
+    snprintf(c->remote, sizeof(c->remote), "%s:%d", s->host, s->opts.port);
+    c->pcb = tcp_new_ip_type(IP_GET_TYPE(&remote));
+    if (c->pcb == NULL) {
+        luat_heap_free(c);
+        return -1;
+    }
+    tcp_arg(c->pcb, c);
+    tcp_err(c->pcb, iperf_lwip_err);
+    if (tcp_bind(c->pcb, &local, 0) != ERR_OK || tcp_connect(c->pcb, &remote, s->opts.port, iperf_lwip_connected) != ERR_OK) {
+        iperf_lwip_detach(c->pcb);
+        tcp_abort(c->pcb);
+        luat_heap_free(c);
+        return -1;
+    }
+    s->conns = c;
+    return 0;
+}
+
+#endif
+
+//---------------------------------------
+// libuv后端
+//---------------------------------------
+
+static int64_t iperf_uv_retrans(iperf_conn_t* c) {
+#if defined(__linux__) && defined(TCP_INFO)
+    uv_os_fd_t fd;
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (c->tcp && uv_fileno((uv_handle_t*)c->tcp, &fd) == 0
+        && getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0)
+        return info.tcpi_total_retrans;
+#else
+    (void)c;
+#endif
+    return -1;
+}
+
+typedef struct iperf_uv_write
+{
+    uv_write_t req;
+    iperf_conn_t* c;
+    size_t len;
+}iperf_uv_write_t;
+
+// 会话已经停止的连接s为NULL
+static void iperf_uv_release(iperf_conn_t* c) {
+    iperf_session_t* s = c->s;
+    if (s)
+        iperf_conn_unlink(c);
+    luat_heap_free(c);
+    if (s && !s->is_server && !s->stopping && s->conns == NULL)
+        iperf_session_free(s);
+}
+
+static void iperf_uv_close(iperf_conn_t* c, int result) {
+    iperf_conn_finish(c, result, iperf_uv_retrans(c));
+    if (c->tcp) {
+        c->tcp->data = NULL;
+        free_uv_handle(c->tcp);
+        c->tcp = NULL;
+    }
+    // 还有没完成的uv_write, 等最后一个回调再释放
+    if (c->inflight == 0)
+        iperf_uv_release(c);
+}
+
+static void on_iperf_uv_alloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf) {
+    (void)handle;
+    (void)suggested_size;
+    buf->base = iperf_rxbuf;
+    buf->len = sizeof(iperf_rxbuf);
+}
+
+static void on_iperf_uv_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+    (void)buf;
+    iperf_conn_t* c = (iperf_conn_t*)stream->data;
+    if (c == NULL)
+        return;
+    if (nread > 0) {
+        c->bytes += nread;
+        c->last_ns = uv_hrtime();
+    }
+    else if (nread == UV_EOF) {
+        iperf_uv_close(c, LUAT_IPERF_DONE);
+    }
+    else if (nread < 0) {
+        iperf_uv_close(c, LUAT_IPERF_ABORTED_REMOTE);
+    }
+}
+
+static void on_iperf_uv_shutdown(uv_shutdown_t* req, int status) {
+    iperf_conn_t* c = (iperf_conn_t*)req->data;
+    luat_heap_free(req);
+    c->inflight--;
+    if (c->tcp)
+        iperf_uv_close(c, status ? LUAT_IPERF_ABORTED_LOCAL : LUAT_IPERF_DONE);
+    else if (c->inflight == 0)
+        iperf_uv_release(c);
+}
+
+static void iperf_uv_pump(iperf_conn_t* c);
+
+static void on_iperf_uv_write(uv_write_t* req, int status) {
+    iperf_uv_write_t* w = (iperf_uv_write_t*)req;
+    iperf_conn_t* c = w->c;
+    c->inflight--;
+    if (status == 0) {
+        c->bytes += w->len;
+        c->last_ns = uv_hrtime();
+    }
+    luat_heap_free(w);
+    if (c->tcp == NULL) {
+        // 连接已经关闭
+        if (c->inflight == 0)
+            iperf_uv_release(c);
+        return;
+    }
+    if (status) {
+        iperf_uv_close(c, LUAT_IPERF_ABORTED_REMOTE);
+        return;
+    }
+    iperf_uv_pump(c);
+}
+
+static int iperf_uv_write(iperf_conn_t* c, const uint8_t* data, size_t len) {
+    iperf_uv_write_t* w = luat_heap_malloc(sizeof(iperf_uv_write_t));
+    if (w == NULL)
+        return -1;
+    uv_buf_t buf = uv_buf_init((char*)data, (unsigned int)len);
+    w->c = c;
+    w->len = len;
+    if (uv_write(&w->req, (uv_stream_t*)c->tcp, &buf, 1, on_iperf_uv_write)) {
+        luat_heap_free(w);
+        return -1;
+    }
+    c->inflight++;
+    c->queued += len;
+    return 0;
+}
+
+// 保持IPERF_UV_INFLIGHT个uv_write在排队, 结束后等全部写完再shutdown
+static void iperf_uv_pump(iperf_conn_t* c) {
+    const luat_iperf_opts_t* opts = &c->s->opts;
+    while (c->inflight < IPERF_UV_INFLIGHT && !iperf_should_stop(c)) {
+        size_t n = opts->block;
+        if (opts->amount && n > opts->amount - c->queued)
+            n = (size_t)(opts->amount - c->queued);
+        if (iperf_uv_write(c, iperf_pattern(c->queued - IPERF_HDR_LEN), n)) {
+            iperf_uv_close(c, LUAT_IPERF_ABORTED_LOCAL);
+            return;
+        }
+    }
+    // shutdown也算一个没完成的请求, 回调之前不能释放连接
+    if (c->inflight == 0 && c->stop) {
+        uv_shutdown_t* req = luat_heap_malloc(sizeof(uv_shutdown_t));
+        req->data = c;
+        if (uv_shutdown(req, (uv_stream_t*)c->tcp, on_iperf_uv_shutdown)) {
+            luat_heap_free(req);
+            iperf_uv_close(c, LUAT_IPERF_ABORTED_LOCAL);
+            return;
+        }
+        c->inflight++;
+    }
+}
+
+static void on_iperf_uv_connect(uv_connect_t* req, int status) {
+    iperf_conn_t* c = (iperf_conn_t*)req->data;
+    luat_heap_free(req);
+    if (status) {
+        LLOGE("连接%s失败 %s", c->remote, uv_err_name(status));
+        iperf_uv_close(c, LUAT_IPERF_ABORTED_LOCAL);
+        return;
+    }
+    iperf_conn_begin(c);
+    iperf_make_hdr(c->s, c->hdr);
+    if (iperf_uv_write(c, c->hdr, IPERF_HDR_LEN)) {
+        iperf_uv_close(c, LUAT_IPERF_ABORTED_LOCAL);
+        return;
+    }
+    iperf_uv_pump(c);
+}
+
+static void on_iperf_uv_accept(uv_stream_t* server, int status) {
+    iperf_session_t* s = (iperf_session_t*)server->data;
+    if (status)
+        return;
+    iperf_conn_t* c = luat_heap_zalloc(sizeof(iperf_conn_t));
+    if (c == NULL)
+        return;
+    c->s = s;
+    c->tcp = luat_heap_malloc(sizeof(uv_tcp_t));
+    uv_tcp_init(main_loop, c->tcp);
+    c->tcp->data = c;
+    if (uv_accept(server, (uv_stream_t*)c->tcp)) {
+        free_uv_handle(c->tcp);
+        luat_heap_free(c);
+        return;
+    }
+    struct sockaddr_storage addr;
+    int namelen = sizeof(addr);
+    char ip[46] = {0};
+    uv_tcp_getpeername(c->tcp, (struct sockaddr*)&addr, &namelen);
+    if (addr.ss_family == AF_INET6) {
+        uv_ip6_name((struct sockaddr_in6*)&addr, ip, sizeof(ip));
+        snprintf(c->remote, sizeof(c->remote), "[%s]:%d", ip, ntohs(((struct sockaddr_in6*)&addr)->sin6_port));
+    }
+    else {
+        uv_ip4_name((struct sockaddr_in*)&addr, ip, sizeof(ip));
+        snprintf(c->remote, sizeof(c->remote), "%s:%d", ip, ntohs(((struct sockaddr_in*)&addr)->sin_port));
+    }
+    c->next = s->conns;
+    s->conns = c;
+    iperf_conn_begin(c);
+    uv_read_start((uv_stream_t*)c->tcp, on_iperf_uv_alloc, on_iperf_uv_read);
+}
+
+static int iperf_uv_addr(const char* host, uint16_t port, struct sockaddr_storage* addr) {
+    if (uv_ip4_addr(host, port, (struct sockaddr_in*)addr) == 0)
+        return 0;
+    return uv_ip6_addr(host, port, (struct sockaddr_in6*)addr);
+}
+
+static int iperf_uv_server(iperf_session_t* s) {
+    struct sockaddr_storage addr;
+    if (iperf_uv_addr(s->host[0] ? s->host : "0.0.0.0", s->opts.port, &addr))
+        return -1;
+    s->listener = luat_heap_malloc(sizeof(uv_tcp_t));
+    uv_tcp_init(main_loop, s->listener);
+    s->listener->data = s;
+    int ret = uv_tcp_bind(s->listener, (const struct sockaddr*)&addr, 0);
+    if (ret == 0)
+        ret = uv_listen((uv_stream_t*)s->listener, 16, on_iperf_uv_accept);
+    if (ret) {
+        LLOGE("监听端口%d失败 %s", s->opts.port, uv_err_name(ret));
+        free_uv_handle(s->listener);
+        s->listener = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static int iperf_uv_client(iperf_session_t* s) {
+    struct sockaddr_storage addr;
+    if (iperf_uv_addr(s->host, s->opts.port, &addr))
+        return -1;
+    iperf_conn_t* c = luat_heap_zalloc(sizeof(iperf_conn_t));
+    uv_connect_t* req = luat_heap_malloc(sizeof(uv_connect_t));
+    if (c == NULL || req == NULL) {
+        luat_heap_free(c);
+        luat_heap_free(req);
+        return -1;
+    }
+    c->s = s;
+    snprintf(c->remote, sizeof(c->remote), "%s:%d", s->host, s->opts.port);
+    c->tcp = luat_heap_malloc(sizeof(uv_tcp_t));
+    uv_tcp_init(main_loop, c->tcp);
+    uv_tcp_nodelay(c->tcp, 1);
+    c->tcp->data = c;
+    req->data = c;
+    s->conns = c;
+    if (uv_tcp_connect(req, c->tcp, (const struct sockaddr*)&addr, on_iperf_uv_connect)) {
+        luat_heap_free(req);
+        s->conns = NULL;
+        free_uv_handle(c->tcp);
+        luat_heap_free(c);
+        return -1;
+    }
+    return 0;
+}
+
+//---------------------------------------
+// 会话管理
+//---------------------------------------
+
+static void iperf_session_free(iperf_session_t* s) {
+    if (sessions[s->id] == s)
+        sessions[s->id] = NULL;
+    luat_heap_free(s);
+}
+
+static iperf_session_t* iperf_session_new(int is_server, const luat_iperf_opts_t* opts, luat_iperf_report_cb cb, void* userdata) {
+    int id;
+    for (id = 0; id < LUAT_IPERF_MAX_SESSION; id++) {
+        if (sessions[id] == NULL)
+            break;
+    }
+    if (id >= LUAT_IPERF_MAX_SESSION) {
+        LLOGE("同时进行的测试太多了");
+        return NULL;
+    }
+    iperf_session_t* s = luat_heap_zalloc(sizeof(iperf_session_t));
+    if (s == NULL)
+        return NULL;
+    s->id = id;
+    s->is_server = is_server;
+    s->opts = *opts;
+    if (opts->host)
+        snprintf(s->host, sizeof(s->host), "%s", opts->host);
+    s->opts.host = s->host;
+    if (s->opts.port == 0)
+        s->opts.port = LUAT_IPERF_PORT_DEFAULT;
+    if (s->opts.block == 0 || s->opts.block > LUAT_IPERF_MAX_BLOCK)
+        s->opts.block = LUAT_IPERF_MAX_BLOCK;
+    if (s->opts.duration_ms == 0 && s->opts.amount == 0)
+        s->opts.duration_ms = 10 * 1000;
+    s->cb = cb;
+    s->userdata = userdata;
+    sessions[id] = s;
+    return s;
+}
+
+int luat_iperf_server(const luat_iperf_opts_t* opts, luat_iperf_report_cb cb, void* userdata) {
+    iperf_session_t* s = iperf_session_new(1, opts, cb, userdata);
+    int ret = -1;
+    if (s == NULL)
+        return -1;
+    if (opts->backend == LUAT_IPERF_LIBUV)
+        ret = iperf_uv_server(s);
+#ifdef LUAT_USE_LWIP
+    else if (opts->backend == LUAT_IPERF_LWIP)
+        ret = iperf_lwip_server(s);
+#endif
+    if (ret) {
+        iperf_session_free(s);
+        return -1;
+    }
+    LLOGI("%s server 端口 %d", opts->backend == LUAT_IPERF_LWIP ? "lwip" : "libuv", s->opts.port);
+    return s->id;
+}
+
+int luat_iperf_client(const luat_iperf_opts_t* opts, luat_iperf_report_cb cb, void* userdata) {
+    if (opts->host == NULL)
+        return -1;
+    iperf_session_t* s = iperf_session_new(0, opts, cb, userdata);
+    int ret = -1;
+    if (s == NULL)
+        return -1;
+    if (opts->backend == LUAT_IPERF_LIBUV)
+        ret = iperf_uv_client(s);
+#ifdef LUAT_USE_LWIP
+    else if (opts->backend == LUAT_IPERF_LWIP)
+        ret = iperf_lwip_client(s);
+#endif
+    if (ret) {
+        LLOGE("连接%s:%d失败", s->host, s->opts.port);
+        iperf_session_free(s);
+        return -1;
+    }
+    return s->id;
+}
+
+// 停止一个测试, 进行中的连接以LUAT_IPERF_ABORTED_LOCAL出报告
+int luat_iperf_stop(int id) {
+    if (id < 0 || id >= LUAT_IPERF_MAX_SESSION || sessions[id] == NULL)
+        return -1;
+    iperf_session_t* s = sessions[id];
+    // 客户端的最后一条连接关闭时会释放会话, 这里要等所有连接关闭后再释放
+    s->stopping = 1;
+    while (s->conns) {
+        iperf_conn_t* c = s->conns;
+#ifdef LUAT_USE_LWIP
+        if (s->opts.backend == LUAT_IPERF_LWIP) {
+            iperf_lwip_close(c, LUAT_IPERF_ABORTED_LOCAL);
+            continue;
+        }
+#endif
+        // 还有请求没有回调的连接先从会话里摘掉, 最后一个回调会释放它
+        iperf_conn_unlink(c);
+        iperf_conn_finish(c, LUAT_IPERF_ABORTED_LOCAL, -1);
+        c->s = NULL;
+        if (c->tcp) {
+            c->tcp->data = NULL;
+            free_uv_handle(c->tcp);
+            c->tcp = NULL;
+        }
+        if (c->inflight == 0)
+            luat_heap_free(c);
+    }
+#ifdef LUAT_USE_LWIP
+    if (s->lpcb) {
+        tcp_accept(s->lpcb, NULL);
+        tcp_close(s->lpcb);
+        s->lpcb = NULL;
+    }
+#endif
+    if (s->listener) {
+        free_uv_handle(s->listener);
+        s->listener = NULL;
+    }
+    iperf_session_free(s);
+    return 0;
+}
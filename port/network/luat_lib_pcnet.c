@@ -0,0 +1,1372 @@
+/*
+@module  pcnet
+@summary PC模拟器网络调试库
+@version 1.0
+@date    2024.03.01
+@tag LUAT_USE_NETWORK
+@usage
+-- 本库仅PC模拟器可用, 用于观察和调整模拟器的网络行为
+log.info("dns", json.encode(pcnet.dnsStat()))
+*/
+#include "uv.h"
+#include "luat_base.h"
+#include "luat_network_pc.h"
+#include "luat_network_adapter.h"
+#include "luat_msgbus.h"
+#include "luat_malloc.h"
+#include "luat_zbuff.h"
+
+#include "rotable2.h"
+
+#define LUAT_LOG_TAG "pcnet"
+#include "luat_log.h"
+
+/*
+获取DNS缓存的统计信息
+@api pcnet.dnsStat()
+@return table 统计信息, 包括lookups/hits/neg_hits/misses/coalesced/resolves/failures/evictions/entries
+@usage
+local stat = pcnet.dnsStat()
+log.info("dns", "命中", stat.hits, "实际解析", stat.resolves)
+*/
+static int l_pcnet_dns_stat(lua_State *L) {
+    luat_dns_cache_stat_t stat = {0};
+    luat_dns_cache_get_stat(&stat);
+    lua_createtable(L, 0, 9);
+    lua_pushinteger(L, stat.lookups);
+    lua_setfield(L, -2, "lookups");
+    lua_pushinteger(L, stat.hits);
+    lua_setfield(L, -2, "hits");
+    lua_pushinteger(L, stat.neg_hits);
+    lua_setfield(L, -2, "neg_hits");
+    lua_pushinteger(L, stat.misses);
+    lua_setfield(L, -2, "misses");
+    lua_pushinteger(L, stat.coalesced);
+    lua_setfield(L, -2, "coalesced");
+    lua_pushinteger(L, stat.resolves);
+    lua_setfield(L, -2, "resolves");
+    lua_pushinteger(L, stat.failures);
+    lua_setfield(L, -2, "failures");
+    lua_pushinteger(L, stat.evictions);
+    lua_setfield(L, -2, "evictions");
+    lua_pushinteger(L, stat.entries);
+    lua_setfield(L, -2, "entries");
+    return 1;
+}
+
+/*
+清空DNS缓存, 正在解析中的记录不受影响
+@api pcnet.dnsClear()
+@return nil 无返回值
+*/
+static int l_pcnet_dns_clear(lua_State *L) {
+    (void)L;
+    luat_dns_cache_clear();
+    return 0;
+}
+
+/*
+设置DNS缓存的有效期
+@api pcnet.dnsTTL(ttl, neg_ttl)
+@int 解析成功的结果的有效期,单位秒,默认60
+@int 解析失败的结果的有效期,单位秒,默认5
+@return nil 无返回值
+@usage
+-- 成功结果缓存5分钟, 失败结果缓存1秒
+pcnet.dnsTTL(300, 1)
+*/
+static int l_pcnet_dns_ttl(lua_State *L) {
+    uint32_t ttl = luaL_optinteger(L, 1, 60);
+    uint32_t neg_ttl = luaL_optinteger(L, 2, 5);
+    luat_dns_cache_set_ttl(ttl, neg_ttl);
+    return 0;
+}
+
+/*
+配置Happy Eyeballs(RFC 8305)连接竞速, 默认开启
+@api pcnet.heConfig(enable, delay)
+@boolean 是否开启, 关闭后只解析A记录, 只连接上层选定的地址
+@int 相邻两次连接尝试的间隔,单位毫秒,默认250
+@return nil 无返回值
+@usage
+pcnet.heConfig(true, 100)
+*/
+static int l_pcnet_he_config(lua_State *L) {
+    int enable = lua_toboolean(L, 1);
+    uint32_t delay = luaL_optinteger(L, 2, 250);
+    luat_libuv_he_config(enable, delay);
+    return 0;
+}
+
+static int pcnet_socket_id(lua_State *L, int idx) {
+    if (lua_isinteger(L, idx))
+        return lua_tointeger(L, idx);
+    luat_socket_ctrl_t *l_ctrl = (luat_socket_ctrl_t *)luaL_checkudata(L, idx, LUAT_NW_CTRL_TYPE);
+    if (l_ctrl->netc == NULL || l_ctrl->netc->adapter_index != NW_ADAPTER_INDEX_ETH0)
+        return -1;
+    return l_ctrl->netc->socket_id;
+}
+
+/*
+获取socket的连接信息, 仅支持默认的libuv网络适配器
+@api pcnet.connectInfo(netc)
+@userdata socket.create返回的对象, 也可以直接传socket id
+@return table 连接信息, 包括state/tcp/family/attempts/connect_ms, 失败返回nil
+@usage
+local info = pcnet.connectInfo(netc)
+if info then
+    log.info("socket", "IPv" .. info.family, "耗时", info.connect_ms, "ms")
+end
+*/
+static int l_pcnet_connect_info(lua_State *L) {
+    luat_libuv_conn_info_t info = {0};
+    if (luat_libuv_conn_info(pcnet_socket_id(L, 1), &info))
+        return 0;
+    lua_createtable(L, 0, 5);
+    lua_pushinteger(L, info.state);
+    lua_setfield(L, -2, "state");
+    lua_pushboolean(L, info.is_tcp);
+    lua_setfield(L, -2, "tcp");
+    lua_pushinteger(L, info.family == AF_INET6 ? 6 : (info.family == AF_INET ? 4 : 0));
+    lua_setfield(L, -2, "family");
+    lua_pushinteger(L, info.attempts);
+    lua_setfield(L, -2, "attempts");
+    lua_pushnumber(L, (lua_Number)info.connect_ns / 1000000);
+    lua_setfield(L, -2, "connect_ms");
+    return 1;
+}
+
+static const char* sockopt_names[LUAT_SOCKOPT_QTY] = {
+    "nodelay", "keepalive", "keepidle", "keepintvl", "keepcnt", "sndbuf", "rcvbuf"
+};
+
+static int pcnet_sockopt(lua_State *L, int socket_id, int idx) {
+    if (lua_istable(L, idx)) {
+        for (int i = 0; i < LUAT_SOCKOPT_QTY; i++) {
+            int type = lua_getfield(L, idx, sockopt_names[i]);
+            if (type == LUA_TBOOLEAN)
+                luat_libuv_sockopt_set(socket_id, i, lua_toboolean(L, -1));
+            else if (type == LUA_TNUMBER)
+                luat_libuv_sockopt_set(socket_id, i, lua_tointeger(L, -1));
+            lua_pop(L, 1);
+        }
+    }
+    lua_createtable(L, 0, LUAT_SOCKOPT_QTY);
+    for (int i = 0; i < LUAT_SOCKOPT_QTY; i++) {
+        int value = 0;
+        if (luat_libuv_sockopt_get(socket_id, i, &value)) {
+            lua_pop(L, 1);
+            return 0;
+        }
+        if (i == LUAT_SOCKOPT_NODELAY || i == LUAT_SOCKOPT_KEEPALIVE)
+            lua_pushboolean(L, value > 0);
+        else
+            lua_pushinteger(L, value);
+        lua_setfield(L, -2, sockopt_names[i]);
+    }
+    return 1;
+}
+
+/*
+设置/读取socket选项, 仅支持默认的libuv网络适配器
+@api pcnet.sockopt(netc, opts)
+@userdata socket.create返回的对象, 也可以直接传socket id
+@table 需要修改的选项, 可选, 支持nodelay/keepalive/keepidle/keepintvl/keepcnt/sndbuf/rcvbuf, 取值-1代表系统默认值
+@return table 当前生效的选项, 已经建立连接的socket读取的是系统里实际的值, 失败返回nil
+@usage
+-- MQTT这类小包交互的场景, 关闭Nagle算法
+pcnet.sockopt(netc, {nodelay=true})
+-- 读取实际生效的值, 注意linux下读取到的缓冲区大小是设置值的2倍
+log.info("sockopt", json.encode(pcnet.sockopt(netc)))
+*/
+static int l_pcnet_sockopt(lua_State *L) {
+    int socket_id = pcnet_socket_id(L, 1);
+    if (socket_id < 0)
+        return 0;
+    return pcnet_sockopt(L, socket_id, 2);
+}
+
+/*
+设置/读取新建socket的默认选项, 对内部创建socket的库(例如mqtt)同样生效
+@api pcnet.sockoptDefault(opts)
+@table 需要修改的选项, 可选, 同pcnet.sockopt
+@return table 当前的默认选项
+@usage
+pcnet.sockoptDefault({nodelay=true, keepidle=30, keepintvl=5, keepcnt=3})
+*/
+static int l_pcnet_sockopt_default(lua_State *L) {
+    return pcnet_sockopt(L, -1, 1);
+}
+
+/*
+获取socket的统计信息
+@api pcnet.sockStat(netc)
+@userdata socket.create返回的对象, 也可以直接传socket id, 不传则返回全部socket的累计值
+@return table 统计信息, 失败返回nil
+@usage
+-- 计数: tx_bytes/tx_count/rx_bytes/rx_count/tx_err/queued_bytes/transitions
+-- 直方图: connect_us/dns_us/write_us/rx_chunk/queued, 每个都包括count/min/max/avg/p50/p90/p99/p999
+-- 状态变化: timeline, 按时间顺序排列, 每项包括state和ms(距离创建socket的时间)
+local stat = pcnet.sockStat(netc)
+log.info("socket", "发送耗时p99", stat.write_us.p99, "us")
+*/
+static int l_pcnet_sock_stat(lua_State *L) {
+    int socket_id = -1;
+    if (!lua_isnoneornil(L, 1)) {
+        socket_id = pcnet_socket_id(L, 1);
+        if (socket_id < 0)
+            return 0;
+    }
+    const luat_libuv_sock_stat_t* stat = luat_libuv_sock_stat(socket_id);
+    if (stat == NULL)
+        return 0;
+    lua_createtable(L, 0, 16);
+    lua_pushinteger(L, stat->tx_bytes);
+    lua_setfield(L, -2, "tx_bytes");
+    lua_pushinteger(L, stat->tx_count);
+    lua_setfield(L, -2, "tx_count");
+    lua_pushinteger(L, stat->rx_bytes);
+    lua_setfield(L, -2, "rx_bytes");
+    lua_pushinteger(L, stat->rx_count);
+    lua_setfield(L, -2, "rx_count");
+    lua_pushinteger(L, stat->tx_err);
+    lua_setfield(L, -2, "tx_err");
+    lua_pushinteger(L, stat->queued_bytes);
+    lua_setfield(L, -2, "queued_bytes");
+    lua_pushinteger(L, stat->transitions);
+    lua_setfield(L, -2, "transitions");
+    luat_hist_push(L, &stat->connect_us);
+    lua_setfield(L, -2, "connect_us");
+    luat_hist_push(L, &stat->dns_us);
+    lua_setfield(L, -2, "dns_us");
+    luat_hist_push(L, &stat->write_us);
+    lua_setfield(L, -2, "write_us");
+    luat_hist_push(L, &stat->rx_chunk);
+    lua_setfield(L, -2, "rx_chunk");
+    luat_hist_push(L, &stat->queued);
+    lua_setfield(L, -2, "queued");
+    if (socket_id >= 0) {
+        uint32_t count = stat->transitions < LUAT_SOCK_TIMELINE_SIZE ? stat->transitions : LUAT_SOCK_TIMELINE_SIZE;
+        lua_createtable(L, count, 0);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t idx = (stat->transitions - count + i) % LUAT_SOCK_TIMELINE_SIZE;
+            lua_createtable(L, 0, 2);
+            lua_pushstring(L, luat_libuv_state_name(stat->timeline[idx].state));
+            lua_setfield(L, -2, "state");
+            lua_pushinteger(L, stat->timeline[idx].ms);
+            lua_setfield(L, -2, "ms");
+            lua_rawseti(L, -2, i + 1);
+        }
+        lua_setfield(L, -2, "timeline");
+    }
+    return 1;
+}
+
+/*
+清零socket的统计信息
+@api pcnet.sockStatReset(netc)
+@userdata socket.create返回的对象, 也可以直接传socket id, 不传则清零累计值
+@return nil 无返回值
+*/
+static int l_pcnet_sock_stat_reset(lua_State *L) {
+    int socket_id = -1;
+    if (!lua_isnoneornil(L, 1)) {
+        socket_id = pcnet_socket_id(L, 1);
+        if (socket_id < 0)
+            return 0;
+    }
+    luat_libuv_sock_stat_reset(socket_id);
+    return 0;
+}
+
+/*
+打印socket统计信息到日志
+@api pcnet.statDump(interval)
+@int 周期打印的间隔,单位毫秒,0为关闭周期打印. 不传则立即打印一次
+@return nil 无返回值
+@usage
+-- 长时间拷机时每分钟打印一次
+pcnet.statDump(60000)
+*/
+static int l_pcnet_stat_dump(lua_State *L) {
+    if (lua_isinteger(L, 1))
+        luat_libuv_stat_dump_interval(lua_tointeger(L, 1));
+    else
+        luat_libuv_stat_dump();
+    return 0;
+}
+
+typedef struct pcnet_vnet_msg
+{
+    int ref;
+    int conn;
+    int event;
+    size_t len;
+    uint8_t data[4];
+}pcnet_vnet_msg_t;
+
+static int l_pcnet_vnet_handler(lua_State *L, void* ptr) {
+    pcnet_vnet_msg_t* m = (pcnet_vnet_msg_t*)ptr;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m->ref);
+    if (lua_isfunction(L, -1)) {
+        lua_pushinteger(L, m->conn);
+        switch (m->event) {
+        case LUAT_VNET_EV_CONNECT:
+            lua_pushliteral(L, "connect");
+            break;
+        case LUAT_VNET_EV_DATA:
+            lua_pushliteral(L, "data");
+            break;
+        default:
+            lua_pushliteral(L, "close");
+            break;
+        }
+        if (m->len)
+            lua_pushlstring(L, (const char*)m->data, m->len);
+        else
+            lua_pushnil(L);
+        lua_call(L, 3, 1);
+        // 返回字符串则作为回复发给客户端
+        if (lua_type(L, -1) == LUA_TSTRING) {
+            size_t len = 0;
+            const char* data = lua_tolstring(L, -1, &len);
+            luat_vnet_send(m->conn, (const uint8_t*)data, len);
+        }
+    }
+    luat_heap_free(m);
+    return 0;
+}
+
+static void pcnet_vnet_handler(uint16_t port, int conn, int event, const uint8_t* data, size_t len, void* userdata) {
+    (void)port;
+    pcnet_vnet_msg_t* m = luat_heap_malloc(sizeof(pcnet_vnet_msg_t) + len);
+    if (m == NULL) {
+        LLOGE("out of memory when malloc vnet msg");
+        return;
+    }
+    m->ref = (int)(intptr_t)userdata;
+    m->conn = conn;
+    m->event = event;
+    m->len = len;
+    if (len)
+        memcpy(m->data, data, len);
+    rtos_msg_t msg = {
+        .handler = l_pcnet_vnet_handler,
+        .ptr = m
+    };
+    luat_msgbus_put(&msg, 0);
+}
+
+static void pcnet_vnet_unref(lua_State *L, uint16_t port) {
+    void* userdata = NULL;
+    if (luat_vnet_unlisten(port, &userdata) == 0 && userdata)
+        luaL_unref(L, LUA_REGISTRYINDEX, (int)(intptr_t)userdata);
+}
+
+/*
+在虚拟网络(vnet)上创建一个端点, socket.create(pcnet.VNET)创建的socket连接这个端口时会连到该端点
+@api pcnet.vnetListen(port, kind, opts)
+@int 端口号, vnet只按端口区分端点, 任意域名/IP都可以
+@any 端点类型, "echo"原样返回, "discard"丢弃, "source"连接后持续发送数据, 或者传入函数自定义处理
+@table 链路参数, 可选, latency单向延时(毫秒), bandwidth单向带宽(字节/秒,0不限), loss丢包率(百分比,可以是小数), size(source端点发送的总字节数,0不限)
+@return boolean 成功返回true
+@usage
+-- 模拟50ms延时, 1Mbps带宽, 1%丢包的echo服务器
+pcnet.vnetListen(7, "echo", {latency=50, bandwidth=125000, loss=1})
+-- 自定义端点, 函数返回的字符串会发回给客户端
+pcnet.vnetListen(1883, function(conn, event, data)
+    log.info("vnet", conn, event, data and #data)
+    if event == "data" then
+        return data:upper()
+    end
+end)
+local netc = socket.create(pcnet.VNET, function() end)
+socket.config(netc)
+socket.connect(netc, "any.host", 7)
+*/
+static int l_pcnet_vnet_listen(lua_State *L) {
+    uint16_t port = luaL_checkinteger(L, 1);
+    int kind = LUAT_VNET_ECHO;
+    int ref = 0;
+    luat_vnet_link_t link = {0};
+    uint64_t size = 0;
+    if (lua_isfunction(L, 2)) {
+        kind = LUAT_VNET_CUSTOM;
+    }
+    else {
+        const char* name = luaL_optstring(L, 2, "echo");
+        if (!strcmp("echo", name))
+            kind = LUAT_VNET_ECHO;
+        else if (!strcmp("discard", name))
+            kind = LUAT_VNET_DISCARD;
+        else if (!strcmp("source", name))
+            kind = LUAT_VNET_SOURCE;
+        else
+            return luaL_error(L, "unknown vnet endpoint kind %s", name);
+    }
+    if (lua_istable(L, 3)) {
+        lua_getfield(L, 3, "latency");
+        link.latency_ms = luaL_optinteger(L, -1, 0);
+        lua_getfield(L, 3, "bandwidth");
+        link.bandwidth = luaL_optinteger(L, -1, 0);
+        lua_getfield(L, 3, "loss");
+        link.loss = (uint32_t)(luaL_optnumber(L, -1, 0) * 100);
+        lua_getfield(L, 3, "size");
+        size = luaL_optinteger(L, -1, 0);
+        lua_pop(L, 4);
+    }
+    pcnet_vnet_unref(L, port);
+    if (kind == LUAT_VNET_CUSTOM) {
+        lua_pushvalue(L, 2);
+        ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    if (luat_vnet_listen(port, kind, &link, size, kind == LUAT_VNET_CUSTOM ? pcnet_vnet_handler : NULL, (void*)(intptr_t)ref)) {
+        if (ref)
+            luaL_unref(L, LUA_REGISTRYINDEX, ref);
+        return 0;
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+/*
+关闭虚拟网络上的端点, 已有的连接全部断开
+@api pcnet.vnetClose(port)
+@int 端口号
+@return nil 无返回值
+*/
+static int l_pcnet_vnet_close(lua_State *L) {
+    pcnet_vnet_unref(L, luaL_checkinteger(L, 1));
+    return 0;
+}
+
+/*
+自定义端点向客户端发送数据
+@api pcnet.vnetSend(conn, data)
+@int 连接编号, 即端点处理函数的第一个参数
+@string 数据
+@return boolean 成功返回true
+@usage
+-- 模拟服务器主动下发
+pcnet.vnetSend(conn, "hello")
+*/
+static int l_pcnet_vnet_send(lua_State *L) {
+    size_t len = 0;
+    int conn = luaL_checkinteger(L, 1);
+    const char* data = luaL_checklstring(L, 2, &len);
+    lua_pushboolean(L, luat_vnet_send(conn, (const uint8_t*)data, len) == 0);
+    return 1;
+}
+
+/*
+自定义端点主动断开连接
+@api pcnet.vnetDisconnect(conn)
+@int 连接编号
+@return boolean 成功返回true
+*/
+static int l_pcnet_vnet_disconnect(lua_State *L) {
+    lua_pushboolean(L, luat_vnet_disconnect(luaL_checkinteger(L, 1)) == 0);
+    return 1;
+}
+
+/*
+获取虚拟网络端点的统计信息
+@api pcnet.vnetStat(port)
+@int 端口号
+@return table 统计信息, 包括conns/rx_bytes/tx_bytes/rx_pkts/lost/retrans, 端点不存在返回nil
+*/
+static int l_pcnet_vnet_stat(lua_State *L) {
+    luat_vnet_endpoint_stat_t stat = {0};
+    if (luat_vnet_endpoint_stat(luaL_checkinteger(L, 1), &stat))
+        return 0;
+    lua_createtable(L, 0, 6);
+    lua_pushinteger(L, stat.conns);
+    lua_setfield(L, -2, "conns");
+    lua_pushinteger(L, stat.rx_bytes);
+    lua_setfield(L, -2, "rx_bytes");
+    lua_pushinteger(L, stat.tx_bytes);
+    lua_setfield(L, -2, "tx_bytes");
+    lua_pushinteger(L, stat.rx_pkts);
+    lua_setfield(L, -2, "rx_pkts");
+    lua_pushinteger(L, stat.lost);
+    lua_setfield(L, -2, "lost");
+    lua_pushinteger(L, stat.retrans);
+    lua_setfield(L, -2, "retrans");
+    return 1;
+}
+
+#ifdef LUAT_USE_LWIP
+static uint32_t pcnet_ipv4(lua_State *L, int idx, const char* def) {
+    uint32_t ip = 0;
+    const char* str = def ? luaL_optstring(L, idx, def) : luaL_checkstring(L, idx);
+    if (uv_inet_pton(AF_INET, str, &ip))
+        luaL_error(L, "invalid ipv4 address %s", str);
+    return ip;
+}
+
+/*
+创建一对首尾相连的lwip虚拟网卡, 两块网卡之间的流量完全在进程内, 用于测试/压测lwip相关的功能
+@api pcnet.lwipPair(adapter_a, adapter_b, ip_a, ip_b, mask)
+@int 网卡A的适配器编号, 默认socket.LWIP_STA
+@int 网卡B的适配器编号, 默认socket.LWIP_AP
+@string 网卡A的IP, 默认"192.168.77.1"
+@string 网卡B的IP, 默认"192.168.77.2"
+@string 子网掩码, 默认"255.255.255.0"
+@return boolean 成功返回true
+@usage
+pcnet.lwipPair(socket.LWIP_STA, socket.LWIP_AP)
+-- socket.LWIP_AP上监听, socket.LWIP_STA上连接192.168.77.2
+*/
+static int l_pcnet_lwip_pair(lua_State *L) {
+    uint8_t index_a = luaL_optinteger(L, 1, NW_ADAPTER_INDEX_LWIP_WIFI_STA);
+    uint8_t index_b = luaL_optinteger(L, 2, NW_ADAPTER_INDEX_LWIP_WIFI_AP);
+    uint32_t ip_a = pcnet_ipv4(L, 3, "192.168.77.1");
+    uint32_t ip_b = pcnet_ipv4(L, 4, "192.168.77.2");
+    uint32_t mask = pcnet_ipv4(L, 5, "255.255.255.0");
+    lua_pushboolean(L, luat_lwip_vnetif_pair(index_a, index_b, ip_a, ip_b, mask) == 0);
+    return 1;
+}
+
+/*
+创建一块lwip虚拟网卡, 通过本机UDP与另一个luatos进程里的虚拟网卡相连
+@api pcnet.lwipLink(adapter, local_port, peer_port, ip, mask, gw)
+@int 适配器编号
+@int 本进程使用的UDP端口
+@int 对端进程使用的UDP端口
+@string 本网卡的IP
+@string 子网掩码, 默认"255.255.255.0"
+@string 网关, 默认"0.0.0.0"
+@return boolean 成功返回true
+@usage
+-- 进程1
+pcnet.lwipLink(socket.LWIP_STA, 40001, 40002, "192.168.77.1")
+-- 进程2
+pcnet.lwipLink(socket.LWIP_STA, 40002, 40001, "192.168.77.2")
+*/
+static int l_pcnet_lwip_link(lua_State *L) {
+    uint8_t adapter_index = luaL_checkinteger(L, 1);
+    uint16_t local_port = luaL_checkinteger(L, 2);
+    uint16_t peer_port = luaL_checkinteger(L, 3);
+    uint32_t ip = pcnet_ipv4(L, 4, NULL);
+    uint32_t mask = pcnet_ipv4(L, 5, "255.255.255.0");
+    uint32_t gw = pcnet_ipv4(L, 6, "0.0.0.0");
+    lua_pushboolean(L, luat_lwip_vnetif_udp(adapter_index, ip, mask, gw, local_port, NULL, peer_port) == 0);
+    return 1;
+}
+
+/*
+获取lwip虚拟网卡的收发统计
+@api pcnet.lwipLinkStat(adapter)
+@int 适配器编号
+@return table 统计信息, 包括tx_bytes/rx_bytes/tx_frames/rx_frames/drops/no_pbuf, 不是虚拟网卡返回nil
+*/
+static int l_pcnet_lwip_link_stat(lua_State *L) {
+    luat_lwip_vnetif_stat_t stat = {0};
+    if (luat_lwip_vnetif_stat(luaL_checkinteger(L, 1), &stat))
+        return 0;
+    lua_createtable(L, 0, 6);
+    lua_pushinteger(L, stat.tx_bytes);
+    lua_setfield(L, -2, "tx_bytes");
+    lua_pushinteger(L, stat.rx_bytes);
+    lua_setfield(L, -2, "rx_bytes");
+    lua_pushinteger(L, stat.tx_frames);
+    lua_setfield(L, -2, "tx_frames");
+    lua_pushinteger(L, stat.rx_frames);
+    lua_setfield(L, -2, "rx_frames");
+    lua_pushinteger(L, stat.drops);
+    lua_setfield(L, -2, "drops");
+    lua_pushinteger(L, stat.no_pbuf);
+    lua_setfield(L, -2, "no_pbuf");
+    return 1;
+}
+
+// lwip引用着的zbuff换成这个元表, 所有zbuff的方法(包括resize/free)和以zbuff为参数的函数都会报错,
+// 最后一帧释放之后再换回原来的元表
+#define PCNET_ZBUFF_PINNED "ZBUFF_PINNED*"
+
+static int l_pcnet_zbuff_pinned_error(lua_State *L) {
+    return luaL_error(L, "zbuff正被lwip引用, 等pcnet.lwipPinned(buff)为0之后再使用");
+}
+
+static void pcnet_zbuff_pin(lua_State *L, int index) {
+    index = lua_absindex(L, index);
+    if (luaL_newmetatable(L, PCNET_ZBUFF_PINNED)) {
+        lua_pushcfunction(L, l_pcnet_zbuff_pinned_error);
+        lua_setfield(L, -2, "__index");
+        lua_pushcfunction(L, l_pcnet_zbuff_pinned_error);
+        lua_setfield(L, -2, "__newindex");
+    }
+    lua_setmetatable(L, index);
+}
+
+// 未被引用的zbuff或者被引用中的zbuff都可以
+static luat_zbuff_t* pcnet_check_zbuff(lua_State *L, int index) {
+    luat_zbuff_t* buff = (luat_zbuff_t*)luaL_testudata(L, index, LUAT_ZBUFF_TYPE);
+    if (buff == NULL)
+        buff = (luat_zbuff_t*)luaL_testudata(L, index, PCNET_ZBUFF_PINNED);
+    if (buff == NULL)
+        buff = (luat_zbuff_t*)luaL_checkudata(L, index, LUAT_ZBUFF_TYPE);
+    return buff;
+}
+
+static int l_pcnet_zbuff_unref(lua_State *L, void* ptr) {
+    (void)ptr;
+    rtos_msg_t* msg = (rtos_msg_t*)lua_topointer(L, -1);
+    int ref = msg->arg1;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+    void* buff = luaL_testudata(L, -1, PCNET_ZBUFF_PINNED);
+    // 同一个zbuff的帧都释放了才解除锁定, 期间又注入的帧会重新计数
+    if (buff && luat_lwip_input_ref_count(buff) == 0)
+        luaL_setmetatable(L, LUAT_ZBUFF_TYPE);
+    lua_pop(L, 1);
+    luaL_unref(L, LUA_REGISTRYINDEX, ref);
+    return 0;
+}
+
+// lwip释放了引用zbuff的pbuf, 回到Lua线程里解除对zbuff的引用
+static void pcnet_zbuff_release(void* owner, int tag) {
+    (void)owner;
+    rtos_msg_t msg = {
+        .handler = l_pcnet_zbuff_unref,
+        .arg1 = tag
+    };
+    luat_msgbus_put(&msg, 0);
+}
+
+/*
+把zbuff里的一帧以太网数据零拷贝地交给lwip网卡, lwip处理完之前zbuff会一直被引用, 不会被回收.
+引用期间zbuff被锁定, 调用它的任何方法(write/resize/free等)或者把它传给其他函数都会报错
+@api pcnet.lwipInput(adapter, buff, len, offset)
+@int 适配器编号
+@zbuff 数据
+@int 数据长度, 默认为buff:used()
+@int 数据在buff里的偏移量, 默认0
+@return boolean 成功返回true
+@return boolean 是否零拷贝, 引用描述符用完时会复制一份
+@usage
+-- 每帧使用独立的zbuff, 或者等pcnet.lwipPinned(buff)为0之后再复用
+local buff = zbuff.create(1514)
+buff:write(frame)
+pcnet.lwipInput(socket.LWIP_ETH, buff)
+*/
+static int l_pcnet_lwip_input(lua_State *L) {
+    uint8_t adapter_index = luaL_checkinteger(L, 1);
+    luat_zbuff_t* buff = pcnet_check_zbuff(L, 2);
+    size_t len = luaL_optinteger(L, 3, buff->used);
+    size_t offset = luaL_optinteger(L, 4, 0);
+    if (offset > buff->len || len > buff->len - offset)
+        return luaL_error(L, "out of zbuff range");
+    lua_pushvalue(L, 2);
+    int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    int ret = luat_lwip_input_ref(adapter_index, buff->addr + offset, len, buff, ref, pcnet_zbuff_release);
+    // 只有零拷贝的情况下才会回调解除引用
+    if (ret != 0)
+        luaL_unref(L, LUA_REGISTRYINDEX, ref);
+    // lwip同步处理完就已经释放了, 不需要锁定
+    else if (luat_lwip_input_ref_count(buff) > 0)
+        pcnet_zbuff_pin(L, 2);
+    lua_pushboolean(L, ret >= 0);
+    lua_pushboolean(L, ret == 0);
+    return 2;
+}
+
+/*
+查询zbuff还有多少帧在lwip里没有释放, 为0时才能修改或复用这个zbuff
+@api pcnet.lwipPinned(buff)
+@zbuff 传给pcnet.lwipInput的zbuff
+@return int 未释放的帧数
+*/
+static int l_pcnet_lwip_pinned(lua_State *L) {
+    luat_zbuff_t* buff = pcnet_check_zbuff(L, 1);
+    size_t count = luat_lwip_input_ref_count(buff);
+    // 锁定要等释放的消息处理完才解除, 在那之前也按未释放算
+    if (count == 0 && luaL_testudata(L, 1, PCNET_ZBUFF_PINNED))
+        count = 1;
+    lua_pushinteger(L, count);
+    return 1;
+}
+
+/*
+查询或设置lwip校验和的实现
+@api pcnet.chksumImpl(name)
+@string 实现名称, "lwip"/"c64"/"sse2"/"avx2", "auto"为按CPU自动选择, 不传则只查询
+@return string 当前使用的实现, 设置失败(CPU不支持)返回nil
+@usage
+log.info("chksum", pcnet.chksumImpl())
+pcnet.chksumImpl("sse2")
+*/
+static int l_pcnet_chksum_impl(lua_State *L) {
+    if (lua_isstring(L, 1)) {
+        const char* name = lua_tostring(L, 1);
+        int impl = -1;
+        if (strcmp(name, "auto")) {
+            for (impl = 0; impl < LUAT_CHKSUM_IMPL_QTY; impl++) {
+                if (!strcmp(name, luat_lwip_chksum_impl_name(impl)))
+                    break;
+            }
+        }
+        if (impl >= LUAT_CHKSUM_IMPL_QTY || luat_lwip_chksum_set_impl(impl))
+            return 0;
+    }
+    lua_pushstring(L, luat_lwip_chksum_impl_name(luat_lwip_chksum_impl()));
+    return 1;
+}
+
+/*
+校验和性能测试, 对比各个实现单独计算与边复制边计算的速度
+@api pcnet.chksumBench(sizes, total)
+@table 数据长度列表, 默认{64, 256, 576, 1460, 4096, 9000}
+@int 每项测试处理的总字节数, 默认64M
+@return table 结果, result[实现名称][长度] = {sum=MB/s, copy=MB/s}
+@usage
+local result = pcnet.chksumBench()
+log.info("chksum", json.encode(result))
+*/
+static int l_pcnet_chksum_bench(lua_State *L) {
+    static const size_t def_sizes[] = {64, 256, 576, 1460, 4096, 9000};
+    size_t sizes[32];
+    size_t count = 0, max = 0;
+    uint64_t total = luaL_optinteger(L, 2, 64 * 1024 * 1024);
+    if (lua_istable(L, 1)) {
+        size_t n = lua_rawlen(L, 1);
+        for (size_t i = 1; i <= n && count < 32; i++) {
+            lua_rawgeti(L, 1, i);
+            lua_Integer len = luaL_checkinteger(L, -1);
+            lua_pop(L, 1);
+            if (len > 0 && len <= 0xffff)
+                sizes[count++] = len;
+        }
+    }
+    else {
+        memcpy(sizes, def_sizes, sizeof(def_sizes));
+        count = sizeof(def_sizes) / sizeof(size_t);
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (sizes[i] > max)
+            max = sizes[i];
+    }
+    uint8_t* src = luat_heap_malloc(max * 2 + 2);
+    if (src == NULL)
+        return 0;
+    uint8_t* dst = src + max + 1;
+    for (size_t i = 0; i < max; i++)
+        src[i] = (uint8_t)(i * 131 + 7);
+    lua_newtable(L);
+    for (int impl = 0; impl < LUAT_CHKSUM_IMPL_QTY; impl++) {
+        if (!luat_lwip_chksum_supported(impl))
+            continue;
+        lua_newtable(L);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t iters = (uint32_t)(total / sizes[i]) + 1;
+            uint64_t bytes = (uint64_t)iters * sizes[i] * 1000;
+            lua_createtable(L, 0, 2);
+            lua_pushinteger(L, bytes / luat_lwip_chksum_bench(impl, 0, src, dst, sizes[i], iters));
+            lua_setfield(L, -2, "sum");
+            lua_pushinteger(L, bytes / luat_lwip_chksum_bench(impl, 1, src, dst, sizes[i], iters));
+            lua_setfield(L, -2, "copy");
+            lua_rawseti(L, -2, sizes[i]);
+        }
+        lua_setfield(L, -2, luat_lwip_chksum_impl_name(impl));
+    }
+    luat_heap_free(src);
+    return 1;
+}
+
+/*
+校验和正确性测试, CPU支持的每个实现都与lwip_standard_chksum对比, 包括单独计算和边复制边计算,
+覆盖0~299的每个长度, 8种不对齐的起始地址, 以及超过SIMD累加器转存轮数的长度
+@api pcnet.chksumVerify()
+@return int 不一致的总次数, 0为全部正确
+@return table 每个实现不一致的次数, result[实现名称] = 次数
+@usage
+local bad, result = pcnet.chksumVerify()
+assert(bad == 0, json.encode(result))
+*/
+static int l_pcnet_chksum_verify(lua_State *L) {
+    lua_Integer total = 0;
+    lua_newtable(L);
+    for (int impl = 0; impl < LUAT_CHKSUM_IMPL_QTY; impl++) {
+        if (!luat_lwip_chksum_supported(impl))
+            continue;
+        int bad = luat_lwip_chksum_verify(impl);
+        // 内存不够也算失败
+        if (bad < 0)
+            bad = 1;
+        total += bad;
+        lua_pushinteger(L, bad);
+        lua_setfield(L, -2, luat_lwip_chksum_impl_name(impl));
+    }
+    lua_pushinteger(L, total);
+    lua_insert(L, -2);
+    return 2;
+}
+
+/*
+查询或设置PPPoS的HDLC转义扫描与FCS的实现
+@api pcnet.hdlcImpl(name)
+@string 实现名称, "lwip"为pppos.c原来的逐字节处理, 其余同chksumImpl, 不传则只查询
+@return string 当前使用的实现, 设置失败(CPU不支持)返回nil
+@usage
+log.info("hdlc", pcnet.hdlcImpl())
+pcnet.hdlcImpl("lwip")
+*/
+static int l_pcnet_hdlc_impl(lua_State *L) {
+    if (lua_isstring(L, 1)) {
+        const char* name = lua_tostring(L, 1);
+        int impl = -1;
+        if (strcmp(name, "auto")) {
+            for (impl = 0; impl < LUAT_CHKSUM_IMPL_QTY; impl++) {
+                if (!strcmp(name, luat_lwip_chksum_impl_name(impl)))
+                    break;
+            }
+        }
+        if (impl >= LUAT_CHKSUM_IMPL_QTY || luat_lwip_hdlc_set_impl(impl))
+            return 0;
+    }
+    lua_pushstring(L, luat_lwip_chksum_impl_name(luat_lwip_hdlc_impl()));
+    return 1;
+}
+
+/*
+HDLC编码/解码性能测试, 对比各个实现的速度
+@api pcnet.hdlcBench(sizes, total, accm)
+@table 帧长度列表, 默认{64, 256, 576, 1500}
+@int 每项测试处理的总字节数, 默认16M
+@int 异步控制字符映射(ACCM), 默认0, 即协商之后只转义0x7D/0x7E, 0xFFFFFFFF为LCP协商之前的默认值
+@return table 结果, result[实现名称][长度] = {encode=MB/s, decode=MB/s}
+@usage
+local result = pcnet.hdlcBench()
+log.info("hdlc", json.encode(result))
+*/
+static int l_pcnet_hdlc_bench(lua_State *L) {
+    static const size_t def_sizes[] = {64, 256, 576, 1500};
+    size_t sizes[32];
+    size_t count = 0, max = 0;
+    uint64_t total = luaL_optinteger(L, 2, 16 * 1024 * 1024);
+    uint32_t async_map = (uint32_t)luaL_optinteger(L, 3, 0);
+    uint8_t accm[32] = {0};
+    memcpy(accm, &async_map, 4);
+    accm[0x7D >> 3] |= 1 << (0x7D & 7);
+    accm[0x7E >> 3] |= 1 << (0x7E & 7);
+    if (lua_istable(L, 1)) {
+        size_t n = lua_rawlen(L, 1);
+        for (size_t i = 1; i <= n && count < 32; i++) {
+            lua_rawgeti(L, 1, i);
+            lua_Integer len = luaL_checkinteger(L, -1);
+            lua_pop(L, 1);
+            if (len > 0 && len <= 0xffff)
+                sizes[count++] = len;
+        }
+    }
+    else {
+        memcpy(sizes, def_sizes, sizeof(def_sizes));
+        count = sizeof(def_sizes) / sizeof(size_t);
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (sizes[i] > max)
+            max = sizes[i];
+    }
+    uint8_t* src = luat_heap_malloc(max * 3 + 8);
+    if (src == NULL)
+        return 0;
+    uint8_t* dst = src + max;
+    for (size_t i = 0; i < max; i++)
+        src[i] = (uint8_t)(i * 131 + 7);
+    lua_newtable(L);
+    for (int impl = 0; impl < LUAT_CHKSUM_IMPL_QTY; impl++) {
+        if (!luat_lwip_chksum_supported(impl))
+            continue;
+        lua_newtable(L);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t iters = (uint32_t)(total / sizes[i]) + 1;
+            uint64_t bytes = (uint64_t)iters * sizes[i] * 1000;
+            uint64_t ns;
+            lua_createtable(L, 0, 2);
+            ns = luat_lwip_hdlc_bench(impl, 0, accm, src, sizes[i], dst, iters);
+            lua_pushinteger(L, ns ? bytes / ns : 0);
+            lua_setfield(L, -2, "encode");
+            ns = luat_lwip_hdlc_bench(impl, 1, accm, src, sizes[i], dst, iters);
+            lua_pushinteger(L, ns ? bytes / ns : 0);
+            lua_setfield(L, -2, "decode");
+            lua_rawseti(L, -2, sizes[i]);
+        }
+        lua_setfield(L, -2, luat_lwip_chksum_impl_name(impl));
+    }
+    luat_heap_free(src);
+    return 1;
+}
+
+static const char* pcnet_opt_string(lua_State *L, int idx, const char* key) {
+    const char* str = NULL;
+    lua_getfield(L, idx, key);
+    if (lua_isstring(L, -1))
+        str = lua_tostring(L, -1);
+    lua_pop(L, 1);
+    return str;
+}
+
+/*
+在串口上创建PPPoS网卡, 串口需要先uart.setup, 之后串口收到的数据全部交给PPP
+@api pcnet.pppOpen(adapter, uart_id, opts)
+@int 适配器编号
+@int 串口id, 可以是UDP虚拟串口或者win32串口
+@table 参数, server为true时作为服务端并给对端分配peer_ip, local_ip服务端的地址, user/passwd客户端的认证信息
+@return boolean 成功返回true, 链路建立的过程是异步的, 可以用pppStat查询
+@usage
+uart.setup(1, 115200)
+pcnet.pppOpen(socket.LWIP_GP, 1, {user="card", passwd="card"})
+*/
+static int l_pcnet_ppp_open(lua_State *L) {
+    uint8_t adapter_index = luaL_checkinteger(L, 1);
+    int uart_id = luaL_checkinteger(L, 2);
+    luat_lwip_ppp_opts_t opts = {0};
+    if (lua_istable(L, 3)) {
+        lua_getfield(L, 3, "server");
+        opts.server = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+        opts.user = pcnet_opt_string(L, 3, "user");
+        opts.passwd = pcnet_opt_string(L, 3, "passwd");
+        const char* ip = pcnet_opt_string(L, 3, "local_ip");
+        if (ip && uv_inet_pton(AF_INET, ip, &opts.local_ip))
+            return luaL_error(L, "invalid ipv4 address %s", ip);
+        ip = pcnet_opt_string(L, 3, "peer_ip");
+        if (ip && uv_inet_pton(AF_INET, ip, &opts.peer_ip))
+            return luaL_error(L, "invalid ipv4 address %s", ip);
+    }
+    if (opts.server && (opts.local_ip == 0 || opts.peer_ip == 0))
+        return luaL_error(L, "ppp server need local_ip and peer_ip");
+    lua_pushboolean(L, luat_lwip_ppp_uart(adapter_index, uart_id, &opts) == 0);
+    return 1;
+}
+
+/*
+创建一对首尾相连的PPPoS网卡, 帧经过完整的HDLC编码/解码, 用于测试PPP链路的吞吐量和开销
+@api pcnet.pppPair(adapter_a, adapter_b, ip_a, ip_b)
+@int 客户端的适配器编号, 默认socket.LWIP_STA
+@int 服务端的适配器编号, 默认socket.LWIP_AP
+@string 客户端的IP, 由服务端在IPCP协商时分配, 默认"192.168.78.1"
+@string 服务端的IP, 默认"192.168.78.2"
+@return boolean 成功返回true
+@usage
+pcnet.pppPair(socket.LWIP_STA, socket.LWIP_AP)
+-- 等两端的pppStat(...).phase都是RUNNING之后, socket.LWIP_AP上监听, socket.LWIP_STA上连接192.168.78.2
+*/
+static int l_pcnet_ppp_pair(lua_State *L) {
+    uint8_t index_a = luaL_optinteger(L, 1, NW_ADAPTER_INDEX_LWIP_WIFI_STA);
+    uint8_t index_b = luaL_optinteger(L, 2, NW_ADAPTER_INDEX_LWIP_WIFI_AP);
+    uint32_t ip_a = pcnet_ipv4(L, 3, "192.168.78.1");
+    uint32_t ip_b = pcnet_ipv4(L, 4, "192.168.78.2");
+    lua_pushboolean(L, luat_lwip_ppp_pair(index_a, index_b, ip_a, ip_b) == 0);
+    return 1;
+}
+
+/*
+关闭PPPoS网卡, pair模式会同时关闭两端
+@api pcnet.pppClose(adapter)
+@int 适配器编号
+@return boolean 成功返回true
+*/
+static int l_pcnet_ppp_close(lua_State *L) {
+    lua_pushboolean(L, luat_lwip_ppp_close(luaL_checkinteger(L, 1)) == 0);
+    return 1;
+}
+
+/*
+获取PPPoS网卡的状态与收发统计
+@api pcnet.pppStat(adapter)
+@int 适配器编号
+@return table 统计信息, phase/err/tx_wire/rx_wire/tx_payload/rx_payload/tx_frames/rx_frames/tx_ns/rx_ns, overhead为线路字节数与载荷字节数之比, 不是PPP网卡返回nil
+@usage
+local stat = pcnet.pppStat(socket.LWIP_STA)
+log.info("ppp", stat.phase == pcnet.PPP_RUNNING, stat.tx_payload, stat.overhead)
+*/
+static int l_pcnet_ppp_stat(lua_State *L) {
+    luat_lwip_ppp_stat_t stat = {0};
+    if (luat_lwip_ppp_stat(luaL_checkinteger(L, 1), &stat))
+        return 0;
+    lua_createtable(L, 0, 11);
+    lua_pushinteger(L, stat.phase);
+    lua_setfield(L, -2, "phase");
+    lua_pushinteger(L, stat.err);
+    lua_setfield(L, -2, "err");
+    lua_pushinteger(L, stat.tx_wire);
+    lua_setfield(L, -2, "tx_wire");
+    lua_pushinteger(L, stat.rx_wire);
+    lua_setfield(L, -2, "rx_wire");
+    lua_pushinteger(L, stat.tx_payload);
+    lua_setfield(L, -2, "tx_payload");
+    lua_pushinteger(L, stat.rx_payload);
+    lua_setfield(L, -2, "rx_payload");
+    lua_pushinteger(L, stat.tx_frames);
+    lua_setfield(L, -2, "tx_frames");
+    lua_pushinteger(L, stat.rx_frames);
+    lua_setfield(L, -2, "rx_frames");
+    lua_pushinteger(L, stat.tx_ns);
+    lua_setfield(L, -2, "tx_ns");
+    lua_pushinteger(L, stat.rx_ns);
+    lua_setfield(L, -2, "rx_ns");
+    lua_pushnumber(L, stat.tx_payload ? (lua_Number)stat.tx_wire / stat.tx_payload : 0);
+    lua_setfield(L, -2, "overhead");
+    return 1;
+}
+
+/*
+模拟大规模局域网, 测试ARP表与网桥转发表的查表性能. 在临时网卡上注入来自hosts个MAC地址的帧, 测试结束后删除
+@api pcnet.lanBench(hosts, rounds, fdb_size)
+@int 主机数, 默认1000, 最大60000
+@int 查表阶段轮询所有主机的次数, 默认10
+@int 网桥动态转发表的表项数, 默认2*hosts
+@return table 结果, arp_entries为学到的ARP表项数, xxx_ns为每个帧的平均耗时(纳秒), arp_misses/fdb_floods为没有命中表项的次数
+@usage
+pcnet.lwipProfile("host")
+local result = pcnet.lanBench(1000)
+log.info("lan", result.arp_entries, result.arp_output_ns, result.fdb_forward_ns, result.fdb_floods)
+*/
+static int l_pcnet_lan_bench(lua_State *L) {
+    luat_lwip_lan_bench_t result;
+    uint32_t hosts = luaL_optinteger(L, 1, 1000);
+    uint32_t rounds = luaL_optinteger(L, 2, 10);
+    uint32_t fdb_size = luaL_optinteger(L, 3, 0);
+    if (luat_lwip_lan_bench(hosts, rounds, fdb_size, &result))
+        return 0;
+    uint64_t outputs = (uint64_t)result.hosts * result.rounds;
+    lua_createtable(L, 0, 9);
+    lua_pushinteger(L, result.hosts);
+    lua_setfield(L, -2, "hosts");
+    lua_pushinteger(L, result.arp_entries);
+    lua_setfield(L, -2, "arp_entries");
+    lua_pushnumber(L, (lua_Number)result.arp_learn_ns / result.hosts);
+    lua_setfield(L, -2, "arp_learn_ns");
+    lua_pushnumber(L, (lua_Number)result.arp_output_ns / outputs);
+    lua_setfield(L, -2, "arp_output_ns");
+    lua_pushinteger(L, result.arp_misses);
+    lua_setfield(L, -2, "arp_misses");
+    lua_pushinteger(L, result.fdb_size);
+    lua_setfield(L, -2, "fdb_size");
+    lua_pushnumber(L, (lua_Number)result.fdb_learn_ns / (result.hosts * 2));
+    lua_setfield(L, -2, "fdb_learn_ns");
+    lua_pushnumber(L, (lua_Number)result.fdb_forward_ns / (outputs * 2));
+    lua_setfield(L, -2, "fdb_forward_ns");
+    lua_pushinteger(L, result.fdb_floods);
+    lua_setfield(L, -2, "fdb_floods");
+    return 1;
+}
+
+static void pcnet_push_profile(lua_State *L, const luat_lwip_profile_t* p) {
+    lua_createtable(L, 0, 14);
+    lua_pushstring(L, p->name ? p->name : "custom");
+    lua_setfield(L, -2, "name");
+    lua_pushinteger(L, p->mem_size);
+    lua_setfield(L, -2, "mem_size");
+    lua_pushinteger(L, p->pool_scale);
+    lua_setfield(L, -2, "pool_scale");
+    lua_pushinteger(L, p->pbuf_pool_size);
+    lua_setfield(L, -2, "pbuf_pool_size");
+    lua_pushinteger(L, p->udp_pcb);
+    lua_setfield(L, -2, "udp_pcb");
+    lua_pushinteger(L, p->tcp_pcb);
+    lua_setfield(L, -2, "tcp_pcb");
+    lua_pushinteger(L, p->tcp_pcb_listen);
+    lua_setfield(L, -2, "tcp_pcb_listen");
+    lua_pushinteger(L, p->tcp_seg);
+    lua_setfield(L, -2, "tcp_seg");
+    lua_pushinteger(L, p->tcp_mss);
+    lua_setfield(L, -2, "tcp_mss");
+    lua_pushinteger(L, p->tcp_rcv_scale);
+    lua_setfield(L, -2, "tcp_rcv_scale");
+    lua_pushinteger(L, p->tcp_wnd);
+    lua_setfield(L, -2, "tcp_wnd");
+    lua_pushinteger(L, p->tcp_snd_buf);
+    lua_setfield(L, -2, "tcp_snd_buf");
+    lua_pushinteger(L, p->tcp_snd_queuelen);
+    lua_setfield(L, -2, "tcp_snd_queuelen");
+    lua_pushinteger(L, p->arp_table_size);
+    lua_setfield(L, -2, "arp_table_size");
+}
+
+#define PCNET_PROFILE_OPT(field) do { \
+        lua_getfield(L, 1, #field); \
+        if (lua_isinteger(L, -1)) profile.field = lua_tointeger(L, -1); \
+        lua_pop(L, 1); \
+    } while (0)
+
+/*
+查询或切换lwip的内存池与TCP参数, 启动时可以用命令行参数--lwip_profile=host选择
+@api pcnet.lwipProfile(profile)
+@string/table 预置的profile名称"mcu"/"host", 或者在当前profile基础上修改的参数表, 不传则只查询
+@return table 当前的profile, 参数不合法或者还有TCP连接时返回nil
+@usage
+-- 已有的连接也会读取TCP参数, 所以要在所有TCP连接(包括监听)关闭之后切换, TIME_WAIT状态的连接会被直接释放
+-- 内存池的上限立即生效, 已经分配的不会回收, 用量超过新上限时之后的分配会失败
+pcnet.lwipProfile("host")
+pcnet.lwipProfile({tcp_pcb = 600, tcp_wnd = 256 * 1024, tcp_rcv_scale = 3})
+log.info("lwip", json.encode(pcnet.lwipProfile()))
+*/
+static int l_pcnet_lwip_profile(lua_State *L) {
+    if (lua_isstring(L, 1)) {
+        if (luat_lwip_profile_select(lua_tostring(L, 1)))
+            return 0;
+    }
+    else if (lua_istable(L, 1)) {
+        luat_lwip_profile_t profile = *luat_lwip_profile_get();
+        profile.name = "custom";
+        PCNET_PROFILE_OPT(mem_size);
+        PCNET_PROFILE_OPT(pool_scale);
+        PCNET_PROFILE_OPT(pbuf_pool_size);
+        PCNET_PROFILE_OPT(udp_pcb);
+        PCNET_PROFILE_OPT(tcp_pcb);
+        PCNET_PROFILE_OPT(tcp_pcb_listen);
+        PCNET_PROFILE_OPT(tcp_seg);
+        PCNET_PROFILE_OPT(tcp_mss);
+        PCNET_PROFILE_OPT(tcp_rcv_scale);
+        PCNET_PROFILE_OPT(tcp_wnd);
+        PCNET_PROFILE_OPT(tcp_snd_buf);
+        PCNET_PROFILE_OPT(tcp_snd_queuelen);
+        PCNET_PROFILE_OPT(arp_table_size);
+        if (luat_lwip_profile_set(&profile))
+            return 0;
+    }
+    pcnet_push_profile(L, luat_lwip_profile_get());
+    return 1;
+}
+
+/*
+获取lwip堆与各个内存池的使用情况(MEMP_STATS)
+@api pcnet.lwipStat()
+@return table 以名称为key, 例如MEM/TCP_PCB/TCP_SEG/PBUF_POOL, 值为{cap=上限, used=当前, max=峰值, err=失败次数, size=元素字节数}
+@usage
+local stat = pcnet.lwipStat()
+log.info("lwip", "tcp_pcb", stat.TCP_PCB.used, stat.TCP_PCB.max, stat.TCP_PCB.cap, stat.TCP_PCB.err)
+*/
+static int l_pcnet_lwip_stat(lua_State *L) {
+    luat_lwip_pool_stat_t stat;
+    lua_newtable(L);
+    for (int i = 0; luat_lwip_pool_stat(i, &stat) == 0; i++) {
+        lua_createtable(L, 0, 5);
+        lua_pushinteger(L, stat.cap);
+        lua_setfield(L, -2, "cap");
+        lua_pushinteger(L, stat.used);
+        lua_setfield(L, -2, "used");
+        lua_pushinteger(L, stat.max);
+        lua_setfield(L, -2, "max");
+        lua_pushinteger(L, stat.err);
+        lua_setfield(L, -2, "err");
+        lua_pushinteger(L, stat.elem_size);
+        lua_setfield(L, -2, "size");
+        lua_setfield(L, -2, stat.name);
+    }
+    return 1;
+}
+
+/*
+重置lwip内存池的统计, 峰值设为当前值, 失败次数清零
+@api pcnet.lwipStatReset()
+@return nil 无返回值
+*/
+static int l_pcnet_lwip_stat_reset(lua_State *L) {
+    (void)L;
+    luat_lwip_pool_stat_reset();
+    return 0;
+}
+#endif
+
+static const char* iperf_result_names[] = {"done", "aborted_local", "aborted_remote"};
+
+static int l_pcnet_iperf_handler(lua_State *L, void* ptr) {
+    rtos_msg_t* msg = (rtos_msg_t*)lua_topointer(L, -1);
+    luat_iperf_report_t* r = (luat_iperf_report_t*)ptr;
+    lua_getglobal(L, "sys_pub");
+    if (lua_isfunction(L, -1)) {
+        lua_pushliteral(L, "IPERF_REPORT");
+        lua_pushinteger(L, msg->arg1);
+        lua_createtable(L, 0, 10);
+        lua_pushstring(L, r->is_server ? "server" : "client");
+        lua_setfield(L, -2, "role");
+        lua_pushstring(L, r->backend == LUAT_IPERF_LWIP ? "lwip" : "libuv");
+        lua_setfield(L, -2, "backend");
+        lua_pushstring(L, iperf_result_names[r->result]);
+        lua_setfield(L, -2, "result");
+        lua_pushstring(L, r->remote);
+        lua_setfield(L, -2, "remote");
+        lua_pushinteger(L, r->bytes);
+        lua_setfield(L, -2, "bytes");
+        lua_pushinteger(L, r->ms);
+        lua_setfield(L, -2, "ms");
+        lua_pushinteger(L, r->kbps);
+        lua_setfield(L, -2, "kbps");
+        lua_pushinteger(L, r->retrans);
+        lua_setfield(L, -2, "retrans");
+        lua_pushinteger(L, r->cpu_us);
+        lua_setfield(L, -2, "cpu_us");
+        lua_pushnumber(L, r->bytes ? (lua_Number)r->cpu_us * 1000 / r->bytes : 0);
+        lua_setfield(L, -2, "cpu_ns_per_byte");
+        lua_call(L, 3, 0);
+    }
+    luat_heap_free(r);
+    return 0;
+}
+
+static void pcnet_iperf_report(int id, const luat_iperf_report_t* report, void* userdata) {
+    (void)userdata;
+    luat_iperf_report_t* r = luat_heap_malloc(sizeof(luat_iperf_report_t));
+    if (r == NULL)
+        return;
+    memcpy(r, report, sizeof(luat_iperf_report_t));
+    rtos_msg_t msg = {
+        .handler = l_pcnet_iperf_handler,
+        .ptr = r,
+        .arg1 = id
+    };
+    luat_msgbus_put(&msg, 0);
+}
+
+static int pcnet_iperf_opts(lua_State *L, luat_iperf_opts_t* opts) {
+    memset(opts, 0, sizeof(luat_iperf_opts_t));
+#ifdef LUAT_USE_LWIP
+    opts->backend = LUAT_IPERF_LWIP;
+#else
+    opts->backend = LUAT_IPERF_LIBUV;
+#endif
+    opts->copy = 1;
+    if (!lua_istable(L, 1))
+        return 0;
+    lua_getfield(L, 1, "backend");
+    if (lua_isstring(L, -1)) {
+        const char* name = lua_tostring(L, -1);
+        if (!strcmp("lwip", name))
+            opts->backend = LUAT_IPERF_LWIP;
+        else if (!strcmp("libuv", name))
+            opts->backend = LUAT_IPERF_LIBUV;
+        else
+            return luaL_error(L, "unknown iperf backend %s", name);
+    }
+    lua_getfield(L, 1, "adapter");
+    opts->adapter = luaL_optinteger(L, -1, 0);
+    lua_getfield(L, 1, "host");
+    opts->host = luaL_optstring(L, -1, NULL);
+    lua_getfield(L, 1, "port");
+    opts->port = luaL_optinteger(L, -1, 0);
+    lua_getfield(L, 1, "time");
+    opts->duration_ms = (uint32_t)(luaL_optnumber(L, -1, 0) * 1000);
+    lua_getfield(L, 1, "bytes");
+    opts->amount = luaL_optinteger(L, -1, 0);
+    lua_getfield(L, 1, "len");
+    opts->block = luaL_optinteger(L, -1, 0);
+    lua_getfield(L, 1, "copy");
+    if (lua_isboolean(L, -1))
+        opts->copy = lua_toboolean(L, -1);
+    // host字符串仍被opts[1]引用, 只弹出其余的值不影响它的生命周期
+    lua_pop(L, 8);
+    return 0;
+}
+
+/*
+启动iperf2兼容的TCP服务端, 可以用PC上的iperf -c测试, 每条连接结束时发布IPERF_REPORT消息
+@api pcnet.iperfServer(opts)
+@table 参数, 可选, backend为"lwip"(进程内的lwip协议栈,默认)或"libuv"(系统协议栈), adapter为lwip后端绑定的网卡适配器编号, host为libuv后端绑定的地址, port端口默认5001
+@return int 成功返回会话id, 失败返回nil
+@usage
+local id = pcnet.iperfServer({backend="libuv", port=5001})
+sys.subscribe("IPERF_REPORT", function(id, r)
+    log.info("iperf", r.role, r.remote, r.kbps, "kbps", r.retrans, r.cpu_ns_per_byte, "ns/B")
+end)
+*/
+static int l_pcnet_iperf_server(lua_State *L) {
+    luat_iperf_opts_t opts;
+    pcnet_iperf_opts(L, &opts);
+    int id = luat_iperf_server(&opts, pcnet_iperf_report, NULL);
+    if (id < 0)
+        return 0;
+    lua_pushinteger(L, id);
+    return 1;
+}
+
+/*
+启动iperf2兼容的TCP客户端, 可以连PC上的iperf -s, 结束时发布IPERF_REPORT消息
+@api pcnet.iperfClient(opts)
+@table 参数, host服务器地址, port端口默认5001, time发送的秒数默认10, bytes发送的字节数(优先于time), len每次提交的字节数, copy为false时lwip后端不复制发送数据, 其余同iperfServer
+@return int 成功返回会话id, 失败返回nil
+@usage
+-- lwip与libuv各跑5秒, 对比吞吐量与每字节的CPU时间
+pcnet.iperfServer({backend="libuv", host="127.0.0.1"})
+pcnet.iperfClient({backend="libuv", host="127.0.0.1", time=5})
+*/
+static int l_pcnet_iperf_client(lua_State *L) {
+    luat_iperf_opts_t opts;
+    pcnet_iperf_opts(L, &opts);
+    if (opts.host == NULL)
+        return luaL_error(L, "iperf client need host");
+    int id = luat_iperf_client(&opts, pcnet_iperf_report, NULL);
+    if (id < 0)
+        return 0;
+    lua_pushinteger(L, id);
+    return 1;
+}
+
+/*
+停止iperf会话, 进行中的连接会以aborted_local结束
+@api pcnet.iperfStop(id)
+@int 会话id
+@return boolean 成功返回true
+*/
+static int l_pcnet_iperf_stop(lua_State *L) {
+    lua_pushboolean(L, luat_iperf_stop(luaL_checkinteger(L, 1)) == 0);
+    return 1;
+}
+
+static const rotable_Reg_t reg_pcnet[] =
+{
+    { "dnsStat",        ROREG_FUNC(l_pcnet_dns_stat)},
+    { "dnsClear",       ROREG_FUNC(l_pcnet_dns_clear)},
+    { "dnsTTL",         ROREG_FUNC(l_pcnet_dns_ttl)},
+    { "heConfig",       ROREG_FUNC(l_pcnet_he_config)},
+    { "connectInfo",    ROREG_FUNC(l_pcnet_connect_info)},
+    { "sockopt",        ROREG_FUNC(l_pcnet_sockopt)},
+    { "sockoptDefault", ROREG_FUNC(l_pcnet_sockopt_default)},
+    { "sockStat",       ROREG_FUNC(l_pcnet_sock_stat)},
+    { "sockStatReset",  ROREG_FUNC(l_pcnet_sock_stat_reset)},
+    { "statDump",       ROREG_FUNC(l_pcnet_stat_dump)},
+    { "vnetListen",     ROREG_FUNC(l_pcnet_vnet_listen)},
+    { "vnetClose",      ROREG_FUNC(l_pcnet_vnet_close)},
+    { "vnetSend",       ROREG_FUNC(l_pcnet_vnet_send)},
+    { "vnetDisconnect", ROREG_FUNC(l_pcnet_vnet_disconnect)},
+    { "vnetStat",       ROREG_FUNC(l_pcnet_vnet_stat)},
+#ifdef LUAT_USE_LWIP
+    { "lwipPair",       ROREG_FUNC(l_pcnet_lwip_pair)},
+    { "lwipLink",       ROREG_FUNC(l_pcnet_lwip_link)},
+    { "lwipLinkStat",   ROREG_FUNC(l_pcnet_lwip_link_stat)},
+    { "lwipInput",      ROREG_FUNC(l_pcnet_lwip_input)},
+    { "lwipPinned",     ROREG_FUNC(l_pcnet_lwip_pinned)},
+    { "chksumImpl",     ROREG_FUNC(l_pcnet_chksum_impl)},
+    { "chksumBench",    ROREG_FUNC(l_pcnet_chksum_bench)},
+    { "chksumVerify",   ROREG_FUNC(l_pcnet_chksum_verify)},
+    { "lwipProfile",    ROREG_FUNC(l_pcnet_lwip_profile)},
+    { "lwipStat",       ROREG_FUNC(l_pcnet_lwip_stat)},
+    { "lwipStatReset",  ROREG_FUNC(l_pcnet_lwip_stat_reset)},
+    { "hdlcImpl",       ROREG_FUNC(l_pcnet_hdlc_impl)},
+    { "hdlcBench",      ROREG_FUNC(l_pcnet_hdlc_bench)},
+    { "pppOpen",        ROREG_FUNC(l_pcnet_ppp_open)},
+    { "pppPair",        ROREG_FUNC(l_pcnet_ppp_pair)},
+    { "pppClose",       ROREG_FUNC(l_pcnet_ppp_close)},
+    { "pppStat",        ROREG_FUNC(l_pcnet_ppp_stat)},
+    { "lanBench",       ROREG_FUNC(l_pcnet_lan_bench)},
+#endif
+    { "iperfServer",    ROREG_FUNC(l_pcnet_iperf_server)},
+    { "iperfClient",    ROREG_FUNC(l_pcnet_iperf_client)},
+    { "iperfStop",      ROREG_FUNC(l_pcnet_iperf_stop)},
+
+    //@const VNET number 虚拟网络的适配器编号
+    { "VNET",           ROREG_INT(LUAT_VNET_ADAPTER_INDEX)},
+    //@const IPERF_PORT number iperf默认端口
+    { "IPERF_PORT",     ROREG_INT(LUAT_IPERF_PORT_DEFAULT)},
+#ifdef LUAT_USE_LWIP
+    //@const PPP_RUNNING number pppStat的phase为此值时链路可用
+    { "PPP_RUNNING",    ROREG_INT(LUAT_LWIP_PPP_PHASE_RUNNING)},
+#endif
+    { NULL,             ROREG_INT(0)}
+};
+
+LUAMOD_API int luaopen_pcnet( lua_State *L ) {
+    luat_newlib2(L, reg_pcnet);
+    return 1;
+}
@@ -0,0 +1,345 @@
+
+#include "uv.h"
+#include "luat_base.h"
+#include "luat_malloc.h"
+
+#include "luat_network_pc.h"
+
+#define LUAT_LOG_TAG "chksum"
+#include "luat_log.h"
+
+#ifdef LUAT_USE_LWIP
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/inet_chksum.h"
+
+// lwip的校验和(RFC 1071), 替换lwip自带的逐个u16_t累加的实现
+// 1. 按CPU支持的指令集在运行时选择AVX2/SSE2/64位通用实现
+// 2. LWIP_CHKSUM_COPY在复制的同时计算校验和, tcp_write/pbuf_fill_chksum只需要读一遍数据
+// 校验和的结果与字节序无关, 所以直接按本机字节序累加16位字, 与lwip_standard_chksum的返回值一致
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CHKSUM_USE_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CHKSUM_TARGET(x)
+#else
+#define CHKSUM_TARGET(x) __attribute__((target(x)))
+#endif
+#else
+#define CHKSUM_USE_X86 0
+#endif
+
+// 32位累加器每次最多加2个0xFFFF, 4096轮之后转存到64位, 不会溢出
+#define CHKSUM_BLOCK_ROUNDS 4096
+
+// lwip自带的实现, 保留下来做对比
+u16_t lwip_standard_chksum(const void *dataptr, int len);
+
+typedef uint64_t (*chksum_bulk_fn)(const uint8_t* src, uint8_t* dst, size_t len, size_t* done);
+
+static const char* impl_names[LUAT_CHKSUM_IMPL_QTY] = {"lwip", "c64", "sse2", "avx2"};
+static int impl_current = -1;
+static chksum_bulk_fn bulk_fn;
+
+static inline uint16_t chksum_fold(uint64_t sum) {
+    sum = (sum >> 32) + (sum & 0xffffffffu);
+    sum = (sum >> 32) + (sum & 0xffffffffu);
+    sum = (sum >> 16) + (sum & 0xffffu);
+    sum = (sum >> 16) + (sum & 0xffffu);
+    return (uint16_t)sum;
+}
+
+// 通用实现, 每次读8字节, 按32位字累加到64位里, 2^32对0xFFFF取模为1, 折叠后与16位累加相同
+static uint64_t bulk_c64(const uint8_t* src, uint8_t* dst, size_t len, size_t* done) {
+    uint64_t sum = 0;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, src + i, 8);
+        if (dst)
+            memcpy(dst + i, &v, 8);
+        sum += (v & 0xffffffffu) + (v >> 32);
+    }
+    *done = i;
+    return sum;
+}
+
+#if CHKSUM_USE_X86
+static uint64_t sum_lanes128(__m128i acc) {
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    return (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+CHKSUM_TARGET("sse2")
+static uint64_t bulk_sse2(const uint8_t* src, uint8_t* dst, size_t len, size_t* done) {
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t sum = 0;
+    size_t i = 0;
+    while (i + 16 <= len) {
+        __m128i acc0 = zero, acc1 = zero;
+        for (size_t n = 0; n < CHKSUM_BLOCK_ROUNDS && i + 16 <= len; n++, i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+            if (dst)
+                _mm_storeu_si128((__m128i*)(dst + i), v);
+            acc0 = _mm_add_epi32(acc0, _mm_unpacklo_epi16(v, zero));
+            acc1 = _mm_add_epi32(acc1, _mm_unpackhi_epi16(v, zero));
+        }
+        sum += sum_lanes128(_mm_add_epi32(acc0, acc1));
+    }
+    *done = i;
+    return sum;
+}
+
+CHKSUM_TARGET("avx2")
+static uint64_t bulk_avx2(const uint8_t* src, uint8_t* dst, size_t len, size_t* done) {
+    const __m256i zero = _mm256_setzero_si256();
+    uint64_t sum = 0;
+    size_t i = 0;
+    while (i + 32 <= len) {
+        __m256i acc0 = zero, acc1 = zero;
+        for (size_t n = 0; n < CHKSUM_BLOCK_ROUNDS && i + 32 <= len; n++, i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+            if (dst)
+                _mm256_storeu_si256((__m256i*)(dst + i), v);
+            acc0 = _mm256_add_epi32(acc0, _mm256_unpacklo_epi16(v, zero));
+            acc1 = _mm256_add_epi32(acc1, _mm256_unpackhi_epi16(v, zero));
+        }
+        acc0 = _mm256_add_epi32(acc0, acc1);
+        // 高128位加到低128位, 再按4个32位求和
+        sum += sum_lanes128(_mm_add_epi32(_mm256_castsi256_si128(acc0), _mm256_extracti128_si256(acc0, 1)));
+    }
+    *done = i;
+    return sum;
+}
+
+static int cpu_has_avx2(void) {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return 0;
+    __cpuid(info, 1);
+    // 需要操作系统开启了YMM寄存器的保存
+    if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6)
+        return 0;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static int cpu_has_sse2(void) {
+#if defined(_M_X64) || defined(__x86_64__)
+    return 1;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+#endif
+
+int luat_lwip_chksum_supported(int impl) {
+    switch (impl) {
+    case LUAT_CHKSUM_IMPL_LWIP:
+    case LUAT_CHKSUM_IMPL_C64:
+        return 1;
+#if CHKSUM_USE_X86
+    case LUAT_CHKSUM_IMPL_SSE2:
+        return cpu_has_sse2();
+    case LUAT_CHKSUM_IMPL_AVX2:
+        return cpu_has_avx2();
+#endif
+    default:
+        return 0;
+    }
+}
+
+const char* luat_lwip_chksum_impl_name(int impl) {
+    if (impl < 0 || impl >= LUAT_CHKSUM_IMPL_QTY)
+        return "unknown";
+    return impl_names[impl];
+}
+
+int luat_lwip_chksum_set_impl(int impl) {
+    if (impl < 0) {
+        impl = LUAT_CHKSUM_IMPL_C64;
+        if (luat_lwip_chksum_supported(LUAT_CHKSUM_IMPL_AVX2))
+            impl = LUAT_CHKSUM_IMPL_AVX2;
+        else if (luat_lwip_chksum_supported(LUAT_CHKSUM_IMPL_SSE2))
+            impl = LUAT_CHKSUM_IMPL_SSE2;
+    }
+    else if (!luat_lwip_chksum_supported(impl)) {
+        return -1;
+    }
+    switch (impl) {
+#if CHKSUM_USE_X86
+    case LUAT_CHKSUM_IMPL_AVX2:
+        bulk_fn = bulk_avx2;
+        break;
+    case LUAT_CHKSUM_IMPL_SSE2:
+        bulk_fn = bulk_sse2;
+        break;
+#endif
+    case LUAT_CHKSUM_IMPL_LWIP:
+        bulk_fn = NULL;
+        break;
+    default:
+        bulk_fn = bulk_c64;
+        break;
+    }
+    if (impl_current != impl)
+        LLOGD("使用%s实现", impl_names[impl]);
+    impl_current = impl;
+    return 0;
+}
+
+int luat_lwip_chksum_impl(void) {
+    if (impl_current < 0)
+        luat_lwip_chksum_set_impl(-1);
+    return impl_current;
+}
+
+static uint16_t chksum_run(const uint8_t* src, uint8_t* dst, size_t len) {
+    size_t done = 0;
+    uint64_t sum = 0;
+    if (impl_current < 0)
+        luat_lwip_chksum_set_impl(-1);
+    if (bulk_fn == NULL) {
+        if (dst)
+            memcpy(dst, src, len);
+        return lwip_standard_chksum(src, (int)len);
+    }
+    // 批量部分的长度是偶数, 剩下的部分16位字的边界不变, 可以直接接着累加
+    sum = bulk_fn(src, dst, len, &done);
+    for (; done + 2 <= len; done += 2) {
+        uint16_t v;
+        memcpy(&v, src + done, 2);
+        if (dst)
+            memcpy(dst + done, &v, 2);
+        sum += v;
+    }
+    if (done < len) {
+        uint16_t t = 0;
+        // 最后一个字节是16位字的第一个字节, 与lwip_standard_chksum的处理一致
+        ((uint8_t*)&t)[0] = src[done];
+        if (dst)
+            dst[done] = src[done];
+        sum += t;
+    }
+    return chksum_fold(sum);
+}
+
+u16_t luat_lwip_chksum(const void *dataptr, int len) {
+    if (len <= 0)
+        return 0;
+    return chksum_run((const uint8_t*)dataptr, NULL, (size_t)len);
+}
+
+u16_t luat_lwip_chksum_copy(void *dst, const void *src, u16_t len) {
+    return chksum_run((const uint8_t*)src, (uint8_t*)dst, len);
+}
+
+uint64_t luat_lwip_chksum_bench(int impl, int copy, const uint8_t* src, uint8_t* dst, size_t len, uint32_t iters) {
+    int old = luat_lwip_chksum_impl();
+    volatile uint16_t sink = 0;
+    if (luat_lwip_chksum_set_impl(impl))
+        return 0;
+    uint64_t start = uv_hrtime();
+    for (uint32_t i = 0; i < iters; i++) {
+        if (copy)
+            sink ^= luat_lwip_chksum_copy(dst, src, (u16_t)len);
+        else
+            sink ^= luat_lwip_chksum(src, (int)len);
+    }
+    uint64_t ns = uv_hrtime() - start;
+    (void)sink;
+    luat_lwip_chksum_set_impl(old);
+    return ns ? ns : 1;
+}
+
+// 与lwip_standard_chksum逐项对比, 覆盖奇数长度, 不对齐的起始地址, 以及超过CHKSUM_BLOCK_ROUNDS轮的长度
+// 数据有伪随机和全0xFF两种, 后者最容易让累加器溢出. 返回不一致的次数
+#define CHKSUM_VERIFY_MAX (CHKSUM_BLOCK_ROUNDS * 32 * 2 + 64)
+
+// lwip_standard_chksum的累加器只有32位, 长数据分成64K的段分别计算再合并
+static uint16_t chksum_reference(const uint8_t* src, size_t len) {
+    uint64_t sum = 0;
+    while (len > 0) {
+        size_t n = len > 65536 ? 65536 : len;
+        sum += lwip_standard_chksum(src, (int)n);
+        src += n;
+        len -= n;
+    }
+    return chksum_fold(sum);
+}
+
+int luat_lwip_chksum_verify(int impl) {
+    static const size_t big_lens[] = {1459, 1460, 4095, 4097, 9001, 65535,
+        CHKSUM_BLOCK_ROUNDS * 16 - 1, CHKSUM_BLOCK_ROUNDS * 16 + 1,
+        CHKSUM_BLOCK_ROUNDS * 32 - 1, CHKSUM_BLOCK_ROUNDS * 32 + 33, CHKSUM_BLOCK_ROUNDS * 32 * 2 + 3};
+    int old = luat_lwip_chksum_impl();
+    int bad = 0;
+    if (luat_lwip_chksum_set_impl(impl))
+        return -1;
+    uint8_t* src = luat_heap_malloc(CHKSUM_VERIFY_MAX + 8);
+    uint8_t* dst = luat_heap_malloc(CHKSUM_VERIFY_MAX + 8);
+    if (src == NULL || dst == NULL) {
+        if (src)
+            luat_heap_free(src);
+        if (dst)
+            luat_heap_free(dst);
+        luat_lwip_chksum_set_impl(old);
+        return -1;
+    }
+    for (int pattern = 0; pattern < 2; pattern++) {
+        uint32_t x = 0x12345678;
+        for (size_t i = 0; i < CHKSUM_VERIFY_MAX + 8; i++) {
+            x = x * 1103515245 + 12345;
+            src[i] = pattern ? 0xff : (uint8_t)(x >> 16);
+        }
+        size_t count = 300 + sizeof(big_lens) / sizeof(size_t);
+        for (size_t n = 0; n < count; n++) {
+            size_t len = n < 300 ? n : big_lens[n - 300];
+            // lwip自带的实现只支持64K以内
+            if (impl == LUAT_CHKSUM_IMPL_LWIP && len > 0xffff)
+                continue;
+            for (size_t offset = 0; offset < 8; offset++) {
+                const uint8_t* s = src + offset;
+                uint16_t expect = chksum_reference(s, len);
+                uint16_t got = luat_lwip_chksum(s, (int)len);
+                if (got != expect) {
+                    if (bad < 8)
+                        LLOGE("%s 长度%d 偏移%d 校验和 %04X != %04X", impl_names[impl_current], (int)len, (int)offset, got, expect);
+                    bad++;
+                }
+                if (len > 0xffff)
+                    continue;
+                // 目的地址用另一个偏移, 源和目的的对齐不同
+                uint8_t* d = dst + 7 - offset;
+                memset(dst, 0, len + 8);
+                got = luat_lwip_chksum_copy(d, s, (u16_t)len);
+                if (got != expect || memcmp(d, s, len)) {
+                    if (bad < 8)
+                        LLOGE("%s 长度%d 偏移%d 复制校验和 %04X != %04X", impl_names[impl_current], (int)len, (int)offset, got, expect);
+                    bad++;
+                }
+            }
+        }
+    }
+    luat_heap_free(src);
+    luat_heap_free(dst);
+    luat_lwip_chksum_set_impl(old);
+    return bad;
+}
+
+#endif
@@ -0,0 +1,347 @@
+
+#include "uv.h"
+#include "luat_base.h"
+#include "luat_malloc.h"
+
+#include "luat_network_pc.h"
+
+#define LUAT_LOG_TAG "hdlc"
+#include "luat_log.h"
+
+#ifdef LUAT_USE_LWIP
+
+#include "lwip/opt.h"
+
+// PPPoS的HDLC转义与FCS(RFC 1662), pppos.c原本逐字节查ACCM位图和FCS表
+// 1. PPPOS_HDLC_SCAN找出开头连续不需要转义的字节, pppos.c整段复制, 只有特殊字节才走逐字节的状态机
+//    SIMD实现一次比较16/32字节里的0x7D/0x7E和控制字符, 命中之后再查ACCM位图确认
+// 2. PPPOS_FCS_BLOCK用slice-by-8查表, 每次处理8字节
+// 实现的编号与校验和共用LUAT_CHKSUM_IMPL_xxx, lwip表示不走批量路径, 与原来的逐字节处理完全一致
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define HDLC_USE_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define HDLC_TARGET(x)
+#else
+#define HDLC_TARGET(x) __attribute__((target(x)))
+#endif
+#else
+#define HDLC_USE_X86 0
+#endif
+
+#define HDLC_FLAG       0x7E
+#define HDLC_ESCAPE     0x7D
+#define HDLC_INITFCS    0xFFFF
+#define HDLC_FCS_POLY   0x8408
+
+typedef size_t (*hdlc_scan_fn)(const uint8_t* accm, const uint8_t* s, size_t len);
+
+static int impl_current = -1;
+static hdlc_scan_fn scan_fn;
+// fcs_table[0]与pppos.c的fcstab相同, fcs_table[k]是多处理k个0字节之后的结果
+static uint16_t fcs_table[8][256];
+static uint8_t fcs_table_ready;
+
+static inline int accm_escaped(const uint8_t* accm, uint8_t c) {
+    return accm[c >> 3] & (1 << (c & 7));
+}
+
+// ACCM位图里除了0x7D/0x7E和0x00~0x1F之外还有别的字节要转义时, SIMD只比较这几个值不够
+static int accm_simple(const uint8_t* accm) {
+    for (int i = 4; i < 32; i++) {
+        if (accm[i] != (i == 15 ? 0x60 : 0))
+            return 0;
+    }
+    return 1;
+}
+
+static inline int accm_has_ctrl(const uint8_t* accm) {
+    return accm[0] | accm[1] | accm[2] | accm[3];
+}
+
+static size_t scan_c64(const uint8_t* accm, const uint8_t* s, size_t len) {
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        if (accm_escaped(accm, s[i]))
+            return i;
+        if (accm_escaped(accm, s[i + 1]))
+            return i + 1;
+        if (accm_escaped(accm, s[i + 2]))
+            return i + 2;
+        if (accm_escaped(accm, s[i + 3]))
+            return i + 3;
+    }
+    for (; i < len; i++) {
+        if (accm_escaped(accm, s[i]))
+            return i;
+    }
+    return len;
+}
+
+#if HDLC_USE_X86
+// mask里是可能要转义的字节, 逐个查位图, 找到第一个真正要转义的
+static inline int scan_confirm(const uint8_t* accm, const uint8_t* s, uint32_t mask) {
+    while (mask) {
+#ifdef _MSC_VER
+        unsigned long j;
+        _BitScanForward(&j, mask);
+#else
+        int j = __builtin_ctz(mask);
+#endif
+        if (accm_escaped(accm, s[j]))
+            return (int)j;
+        mask &= mask - 1;
+    }
+    return -1;
+}
+
+HDLC_TARGET("sse2")
+static size_t scan_sse2(const uint8_t* accm, const uint8_t* s, size_t len) {
+    if (!accm_simple(accm))
+        return scan_c64(accm, s, len);
+    const __m128i flag = _mm_set1_epi8((char)HDLC_FLAG);
+    const __m128i esc = _mm_set1_epi8((char)HDLC_ESCAPE);
+    const __m128i ctrl_max = _mm_set1_epi8(0x1F);
+    const int ctrl = accm_has_ctrl(accm);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, flag), _mm_cmpeq_epi8(v, esc));
+        if (ctrl)
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(v, ctrl_max), v));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(m);
+        if (mask) {
+            int j = scan_confirm(accm, s + i, mask);
+            if (j >= 0)
+                return i + j;
+        }
+    }
+    return i + scan_c64(accm, s + i, len - i);
+}
+
+HDLC_TARGET("avx2")
+static size_t scan_avx2(const uint8_t* accm, const uint8_t* s, size_t len) {
+    if (!accm_simple(accm))
+        return scan_c64(accm, s, len);
+    const __m256i flag = _mm256_set1_epi8((char)HDLC_FLAG);
+    const __m256i esc = _mm256_set1_epi8((char)HDLC_ESCAPE);
+    const __m256i ctrl_max = _mm256_set1_epi8(0x1F);
+    const int ctrl = accm_has_ctrl(accm);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, flag), _mm256_cmpeq_epi8(v, esc));
+        if (ctrl)
+            m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctrl_max), v));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+        if (mask) {
+            int j = scan_confirm(accm, s + i, mask);
+            if (j >= 0)
+                return i + j;
+        }
+    }
+    return i + scan_sse2(accm, s + i, len - i);
+}
+#endif
+
+static void fcs_table_init(void) {
+    for (int i = 0; i < 256; i++) {
+        uint16_t v = (uint16_t)i;
+        for (int b = 0; b < 8; b++)
+            v = (v & 1) ? (v >> 1) ^ HDLC_FCS_POLY : v >> 1;
+        fcs_table[0][i] = v;
+    }
+    for (int i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++)
+            fcs_table[k][i] = (fcs_table[k - 1][i] >> 8) ^ fcs_table[0][fcs_table[k - 1][i] & 0xFF];
+    }
+    fcs_table_ready = 1;
+}
+
+static inline uint16_t fcs_byte(uint16_t fcs, uint8_t c) {
+    return (fcs >> 8) ^ fcs_table[0][(fcs ^ c) & 0xFF];
+}
+
+static uint16_t fcs_run(uint16_t fcs, const uint8_t* s, size_t len) {
+    if (!fcs_table_ready)
+        fcs_table_init();
+    if (impl_current == LUAT_CHKSUM_IMPL_LWIP) {
+        while (len--)
+            fcs = fcs_byte(fcs, *s++);
+        return fcs;
+    }
+    // FCS只有16位, 前两个字节与它异或之后, 8个字节各自查一张表再合起来
+    for (; len >= 8; len -= 8, s += 8) {
+        uint16_t x = fcs ^ (uint16_t)(s[0] | (s[1] << 8));
+        fcs = fcs_table[7][x & 0xFF] ^ fcs_table[6][x >> 8] ^
+              fcs_table[5][s[2]] ^ fcs_table[4][s[3]] ^
+              fcs_table[3][s[4]] ^ fcs_table[2][s[5]] ^
+              fcs_table[1][s[6]] ^ fcs_table[0][s[7]];
+    }
+    while (len--)
+        fcs = fcs_byte(fcs, *s++);
+    return fcs;
+}
+
+int luat_lwip_hdlc_set_impl(int impl) {
+    if (impl < 0) {
+        // 按校验和的选择结果, 两者用的是同一套CPU检测
+        impl = LUAT_CHKSUM_IMPL_C64;
+        if (luat_lwip_chksum_supported(LUAT_CHKSUM_IMPL_AVX2))
+            impl = LUAT_CHKSUM_IMPL_AVX2;
+        else if (luat_lwip_chksum_supported(LUAT_CHKSUM_IMPL_SSE2))
+            impl = LUAT_CHKSUM_IMPL_SSE2;
+    }
+    else if (impl >= LUAT_CHKSUM_IMPL_QTY || !luat_lwip_chksum_supported(impl)) {
+        return -1;
+    }
+    switch (impl) {
+#if HDLC_USE_X86
+    case LUAT_CHKSUM_IMPL_AVX2:
+        scan_fn = scan_avx2;
+        break;
+    case LUAT_CHKSUM_IMPL_SSE2:
+        scan_fn = scan_sse2;
+        break;
+#endif
+    case LUAT_CHKSUM_IMPL_LWIP:
+        scan_fn = NULL;
+        break;
+    default:
+        scan_fn = scan_c64;
+        break;
+    }
+    if (!fcs_table_ready)
+        fcs_table_init();
+    if (impl_current != impl)
+        LLOGD("使用%s实现", luat_lwip_chksum_impl_name(impl));
+    impl_current = impl;
+    return 0;
+}
+
+int luat_lwip_hdlc_impl(void) {
+    if (impl_current < 0)
+        luat_lwip_hdlc_set_impl(-1);
+    return impl_current;
+}
+
+unsigned int luat_lwip_hdlc_scan(const unsigned char *accm, const unsigned char *data, unsigned int len) {
+    if (impl_current < 0)
+        luat_lwip_hdlc_set_impl(-1);
+    // 返回0时pppos.c走原来的逐字节处理
+    if (scan_fn == NULL || len == 0)
+        return 0;
+    return (unsigned int)scan_fn(accm, data, len);
+}
+
+unsigned short luat_lwip_hdlc_fcs(unsigned short fcs, const unsigned char *data, unsigned int len) {
+    return fcs_run(fcs, data, len);
+}
+
+// 与pppos.c相同的编码过程, 用于测试和对比: 0x7E + 转义后的数据和FCS + 0x7E
+size_t luat_lwip_hdlc_encode(const uint8_t* accm, const uint8_t* src, size_t len, uint8_t* dst) {
+    size_t n = 0;
+    uint16_t fcs = HDLC_INITFCS;
+    luat_lwip_hdlc_impl();
+    dst[n++] = HDLC_FLAG;
+    for (size_t i = 0; i < len;) {
+        size_t run = luat_lwip_hdlc_scan(accm, src + i, (unsigned int)(len - i));
+        if (run) {
+            memcpy(dst + n, src + i, run);
+            fcs = fcs_run(fcs, src + i, run);
+            n += run;
+            i += run;
+            continue;
+        }
+        uint8_t c = src[i++];
+        fcs = fcs_byte(fcs, c);
+        if (accm_escaped(accm, c)) {
+            dst[n++] = HDLC_ESCAPE;
+            dst[n++] = c ^ 0x20;
+        }
+        else {
+            dst[n++] = c;
+        }
+    }
+    fcs = ~fcs;
+    for (int k = 0; k < 2; k++) {
+        uint8_t c = (uint8_t)(k ? fcs >> 8 : fcs);
+        if (accm_escaped(accm, c)) {
+            dst[n++] = HDLC_ESCAPE;
+            dst[n++] = c ^ 0x20;
+        }
+        else {
+            dst[n++] = c;
+        }
+    }
+    dst[n++] = HDLC_FLAG;
+    return n;
+}
+
+// 解码一个完整的帧(包括首尾的0x7E), 返回去掉FCS之后的长度, FCS错误返回-1
+int luat_lwip_hdlc_decode(const uint8_t* accm, const uint8_t* src, size_t len, uint8_t* dst) {
+    size_t n = 0;
+    uint16_t fcs = HDLC_INITFCS;
+    int escaped = 0;
+    luat_lwip_hdlc_impl();
+    for (size_t i = 0; i < len;) {
+        if (!escaped) {
+            size_t run = luat_lwip_hdlc_scan(accm, src + i, (unsigned int)(len - i));
+            if (run) {
+                memcpy(dst + n, src + i, run);
+                fcs = fcs_run(fcs, src + i, run);
+                n += run;
+                i += run;
+                continue;
+            }
+        }
+        uint8_t c = src[i++];
+        if (accm_escaped(accm, c)) {
+            if (c == HDLC_ESCAPE)
+                escaped = 1;
+            continue;
+        }
+        if (escaped) {
+            escaped = 0;
+            c ^= 0x20;
+        }
+        dst[n++] = c;
+        fcs = fcs_byte(fcs, c);
+    }
+    // 对包括FCS在内的数据计算, 结果是固定的0xF0B8
+    if (fcs != 0xF0B8 || n < 2)
+        return -1;
+    return (int)(n - 2);
+}
+
+uint64_t luat_lwip_hdlc_bench(int impl, int decode, const uint8_t* accm, const uint8_t* src, size_t len, uint8_t* dst, uint32_t iters) {
+    int old = luat_lwip_hdlc_impl();
+    if (luat_lwip_hdlc_set_impl(impl))
+        return 0;
+    uint8_t* frame = NULL;
+    size_t frame_len = 0;
+    if (decode) {
+        frame = luat_heap_malloc(len * 2 + 8);
+        if (frame == NULL) {
+            luat_lwip_hdlc_set_impl(old);
+            return 0;
+        }
+        frame_len = luat_lwip_hdlc_encode(accm, src, len, frame);
+    }
+    uint64_t start = uv_hrtime();
+    for (uint32_t i = 0; i < iters; i++) {
+        if (decode)
+            luat_lwip_hdlc_decode(accm, frame, frame_len, dst);
+        else
+            luat_lwip_hdlc_encode(accm, src, len, dst);
+    }
+    uint64_t ns = uv_hrtime() - start;
+    if (frame)
+        luat_heap_free(frame);
+    luat_lwip_hdlc_set_impl(old);
+    return ns ? ns : 1;
+}
+
+#endif
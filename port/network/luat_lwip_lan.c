@@ -0,0 +1,263 @@
+
+#include "uv.h"
+#include "luat_base.h"
+#include "luat_network_pc.h"
+
+#define LUAT_LOG_TAG "lan"
+#include "luat_log.h"
+
+#ifdef LUAT_USE_LWIP
+
+#include "lwip/opt.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/etharp.h"
+#include "lwip/prot/etharp.h"
+#include "lwip/prot/iana.h"
+#include "netif/ethernet.h"
+#include "netif/bridgeif.h"
+
+// 模拟上千台主机的局域网, 测ARP表和网桥转发表在表项很多时的查表开销
+// 1. ARP: 一块虚拟以太网卡, 依次注入hosts台主机的ARP请求让协议栈学习, 再轮流向每台主机发IP包,
+//    相邻两次的目的地址不同, etharp_output缓存的上一次表项不会命中, 每次都要查表
+// 2. 网桥: 3个端口, 端口0和端口1各挂hosts台主机, 两侧主机两两互发, 端口2只用来统计广播的帧数
+// 发出去的帧只计数不真正发送, 测到的是lwip本身的处理时间
+
+#define LAN_HOSTS_MAX       60000
+#define LAN_FRAME_LEN       60
+#define LAN_PORTS           3
+
+typedef struct lan_port
+{
+    struct netif netif;
+    uint32_t tx_frames;
+    uint32_t tx_arp;
+}lan_port_t;
+
+// 协议栈只有一个, 测试是同步执行的
+static struct pbuf* lan_ip_pkt;
+static uint32_t lan_netif_seq;
+
+static void lan_mac(uint8_t* mac, uint8_t side, uint32_t host) {
+    mac[0] = 0x02;
+    mac[1] = 0x4C;
+    mac[2] = side;
+    mac[3] = (uint8_t)(host >> 16);
+    mac[4] = (uint8_t)(host >> 8);
+    mac[5] = (uint8_t)host;
+}
+
+// 10.77.0.0/16, 本机10.77.0.1, 主机从10.77.0.2开始
+static void lan_host_ip(ip4_addr_t* ip, uint32_t host) {
+    IP4_ADDR(ip, 10, 77, (uint8_t)((host + 2) >> 8), (uint8_t)(host + 2));
+}
+
+static err_t lan_linkoutput(struct netif *netif, struct pbuf *p) {
+    lan_port_t* port = (lan_port_t*)netif;
+    struct eth_hdr* eth = (struct eth_hdr*)p->payload;
+    port->tx_frames++;
+    if (eth->type == PP_HTONS(ETHTYPE_ARP))
+        port->tx_arp++;
+    // 测试用的IP包反复发送, 去掉etharp_output加上的以太网头
+    if (p == lan_ip_pkt)
+        pbuf_remove_header(p, SIZEOF_ETH_HDR);
+    return ERR_OK;
+}
+
+static err_t lan_netif_init(struct netif *netif) {
+    netif->name[0] = 'l';
+    netif->name[1] = 'n';
+    netif->output = etharp_output;
+    netif->linkoutput = lan_linkoutput;
+    netif->mtu = 1500;
+    netif->hwaddr_len = ETH_HWADDR_LEN;
+    lan_mac(netif->hwaddr, 0xFF, lan_netif_seq++);
+    netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_ETHERNET | NETIF_FLAG_LINK_UP;
+    return ERR_OK;
+}
+
+static void lan_inject(struct netif *netif, uint8_t* frame, uint16_t len) {
+    struct pbuf* p = pbuf_alloc(PBUF_RAW, len, PBUF_REF);
+    if (p == NULL)
+        return;
+    p->payload = frame;
+    if (netif->input(p, netif) != ERR_OK)
+        pbuf_free(p);
+}
+
+static void lan_arp_request(uint8_t* frame, uint32_t host, const ip4_addr_t* target) {
+    struct eth_hdr* eth = (struct eth_hdr*)frame;
+    struct etharp_hdr* arp = (struct etharp_hdr*)(frame + SIZEOF_ETH_HDR);
+    ip4_addr_t ip;
+    memset(frame, 0, LAN_FRAME_LEN);
+    memset(eth->dest.addr, 0xFF, ETH_HWADDR_LEN);
+    lan_mac(eth->src.addr, 0, host);
+    eth->type = PP_HTONS(ETHTYPE_ARP);
+    arp->hwtype = PP_HTONS(LWIP_IANA_HWTYPE_ETHERNET);
+    arp->proto = PP_HTONS(ETHTYPE_IP);
+    arp->hwlen = ETH_HWADDR_LEN;
+    arp->protolen = sizeof(ip4_addr_t);
+    arp->opcode = PP_HTONS(ARP_REQUEST);
+    lan_mac(arp->shwaddr.addr, 0, host);
+    lan_host_ip(&ip, host);
+    memcpy(&arp->sipaddr, &ip, sizeof(ip));
+    memcpy(&arp->dipaddr, target, sizeof(ip4_addr_t));
+}
+
+static void lan_eth_frame(uint8_t* frame, uint8_t src_side, uint8_t dst_side, uint32_t host) {
+    struct eth_hdr* eth = (struct eth_hdr*)frame;
+    memset(frame, 0, LAN_FRAME_LEN);
+    lan_mac(eth->dest.addr, dst_side, host);
+    lan_mac(eth->src.addr, src_side, host);
+    eth->type = PP_HTONS(ETHTYPE_IP);
+}
+
+static int lan_arp_bench(uint32_t hosts, uint32_t rounds, luat_lwip_lan_bench_t* result) {
+    lan_port_t lan = {0};
+    ip4_addr_t ip, mask, gw, dst;
+    uint8_t frame[LAN_FRAME_LEN];
+    uint64_t t;
+    IP4_ADDR(&ip, 10, 77, 0, 1);
+    IP4_ADDR(&mask, 255, 255, 0, 0);
+    ip4_addr_set_zero(&gw);
+    if (netif_add(&lan.netif, &ip, &mask, &gw, NULL, lan_netif_init, ethernet_input) == NULL) {
+        LLOGE("添加网卡失败");
+        return -1;
+    }
+    netif_set_up(&lan.netif);
+
+    t = uv_hrtime();
+    for (uint32_t i = 0; i < hosts; i++) {
+        lan_arp_request(frame, i, &ip);
+        lan_inject(&lan.netif, frame, LAN_FRAME_LEN);
+    }
+    result->arp_learn_ns = uv_hrtime() - t;
+    for (size_t i = 0; i < ARP_TABLE_SIZE; i++) {
+        ip4_addr_t* entry_ip;
+        struct netif* entry_netif;
+        struct eth_addr* entry_eth;
+        if (etharp_get_entry(i, &entry_ip, &entry_netif, &entry_eth) && entry_netif == &lan.netif)
+            result->arp_entries++;
+    }
+
+    lan_ip_pkt = pbuf_alloc(PBUF_IP, 28, PBUF_RAM);
+    if (lan_ip_pkt == NULL) {
+        netif_remove(&lan.netif);
+        return -1;
+    }
+    memset(lan_ip_pkt->payload, 0, lan_ip_pkt->len);
+    uint32_t tx_arp = lan.tx_arp;
+    t = uv_hrtime();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (uint32_t i = 0; i < hosts; i++) {
+            lan_host_ip(&dst, i);
+            etharp_output(&lan.netif, lan_ip_pkt, &dst);
+            // 没有命中, 包被挂在ARP表项上等待应答, 换一个包继续
+            if (lan_ip_pkt->ref > 1) {
+                pbuf_free(lan_ip_pkt);
+                lan_ip_pkt = pbuf_alloc(PBUF_IP, 28, PBUF_RAM);
+                if (lan_ip_pkt == NULL)
+                    break;
+            }
+        }
+        if (lan_ip_pkt == NULL)
+            break;
+    }
+    result->arp_output_ns = uv_hrtime() - t;
+    result->arp_misses = lan.tx_arp - tx_arp;
+    if (lan_ip_pkt) {
+        pbuf_free(lan_ip_pkt);
+        lan_ip_pkt = NULL;
+    }
+    // 网卡down的时候会删除它的ARP表项
+    netif_remove(&lan.netif);
+    return 0;
+}
+
+static int lan_fdb_bench(uint32_t hosts, uint32_t rounds, uint32_t fdb_size, luat_lwip_lan_bench_t* result) {
+    struct netif br = {0};
+    lan_port_t ports[LAN_PORTS] = {0};
+    bridgeif_initdata_t init = {0};
+    uint8_t frame[LAN_FRAME_LEN];
+    uint64_t t;
+    int ret = -1;
+    lan_mac(init.ethaddr.addr, 0xFE, 0);
+    init.max_ports = LAN_PORTS;
+    init.max_fdb_dynamic_entries = (u16_t)fdb_size;
+    init.max_fdb_static_entries = 0;
+    if (netif_add(&br, NULL, NULL, NULL, &init, bridgeif_init, ethernet_input) == NULL) {
+        LLOGE("创建网桥失败");
+        return -1;
+    }
+    size_t added = 0;
+    for (; added < LAN_PORTS; added++) {
+        if (netif_add(&ports[added].netif, NULL, NULL, NULL, NULL, lan_netif_init, ethernet_input) == NULL)
+            goto cleanup;
+        netif_set_up(&ports[added].netif);
+        if (bridgeif_add_port(&br, &ports[added].netif) != ERR_OK) {
+            netif_remove(&ports[added].netif);
+            goto cleanup;
+        }
+    }
+    netif_set_up(&br);
+
+    // 端口0的主机i先发给端口1的主机i(目的未知, 广播), 端口1的主机i再回复(已学到, 单播)
+    t = uv_hrtime();
+    for (uint32_t i = 0; i < hosts; i++) {
+        lan_eth_frame(frame, 0, 1, i);
+        lan_inject(&ports[0].netif, frame, LAN_FRAME_LEN);
+    }
+    for (uint32_t i = 0; i < hosts; i++) {
+        lan_eth_frame(frame, 1, 0, i);
+        lan_inject(&ports[1].netif, frame, LAN_FRAME_LEN);
+    }
+    result->fdb_learn_ns = uv_hrtime() - t;
+
+    uint32_t floods = ports[2].tx_frames;
+    uint8_t frames[2][LAN_FRAME_LEN];
+    t = uv_hrtime();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (uint32_t i = 0; i < hosts; i++) {
+            lan_eth_frame(frames[0], 0, 1, i);
+            lan_eth_frame(frames[1], 1, 0, i);
+            lan_inject(&ports[0].netif, frames[0], LAN_FRAME_LEN);
+            lan_inject(&ports[1].netif, frames[1], LAN_FRAME_LEN);
+        }
+    }
+    result->fdb_forward_ns = uv_hrtime() - t;
+    result->fdb_floods = ports[2].tx_frames - floods;
+    ret = 0;
+
+cleanup:
+    for (size_t i = 0; i < added; i++)
+        netif_remove(&ports[i].netif);
+    netif_remove(&br);
+    bridgeif_deinit(&br);
+    return ret;
+}
+
+int luat_lwip_lan_bench(uint32_t hosts, uint32_t rounds, uint32_t fdb_size, luat_lwip_lan_bench_t* result) {
+    memset(result, 0, sizeof(luat_lwip_lan_bench_t));
+    if (hosts == 0 || hosts > LAN_HOSTS_MAX)
+        hosts = hosts ? LAN_HOSTS_MAX : 1000;
+    if (rounds == 0)
+        rounds = 1;
+    if (fdb_size == 0)
+        fdb_size = hosts * 2;
+    // 转发表的链表下标是u16_t, 0xFFFF表示空
+    if (fdb_size > 0xFFFE)
+        fdb_size = 0xFFFE;
+    result->hosts = hosts;
+    result->rounds = rounds;
+    result->fdb_size = fdb_size;
+    luat_lwip_profile_get();
+    if (lan_arp_bench(hosts, rounds, result))
+        return -1;
+    if (lan_fdb_bench(hosts, rounds, fdb_size, result))
+        return -1;
+    LLOGD("hosts %u arp %u miss %u fdb %u flood %u", hosts, result->arp_entries, result->arp_misses,
+        fdb_size, result->fdb_floods);
+    return 0;
+}
+
+#endif
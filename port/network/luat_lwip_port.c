@@ -12,10 +12,148 @@ void lwip_init(void);
 #include "luat_log.h"
 
 #include "stdint.h"
+#include "uv.h"
+#include "luat_base.h"
+#include "luat_network_pc.h"
+
+#ifdef LUAT_USE_LWIP
+#include "lwip/timeouts.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+#include "net_lwip2.h"
+
+extern uv_loop_t *main_loop;
+
+// lwip的定时器不再固定5ms轮询, 而是按最近一个超时的时间设置libuv定时器,
+// 处理完再按下一个超时重新设置; lwip新增了更早的超时时(例如TCP开始重传)
+// 由LWIP_HOOK_TIMEOUTS_HEAD_CHANGED调用luat_lwip_timer_kick提前唤醒
+static uv_timer_t lwip_timer;
+static uint8_t lwip_timer_ready;
+static uint8_t lwip_in_check;
+
+static void on_lwip_timer(uv_timer_t *handle);
+
+static void lwip_timer_rearm(void) {
+    uint32_t sleep = sys_timeouts_sleeptime();
+    if (sleep == SYS_TIMEOUTS_SLEEPTIME_INFINITE) {
+        uv_timer_stop(&lwip_timer);
+        return;
+    }
+    // 定时器以uv_now为起点, 先更新一下循环时间, 避免在超时之前就被唤醒
+    uv_update_time(main_loop);
+    uv_timer_start(&lwip_timer, on_lwip_timer, sleep, 0);
+}
+
+static void on_lwip_timer(uv_timer_t *handle) {
+    (void)handle;
+    lwip_in_check = 1;
+    sys_check_timeouts();
+    lwip_in_check = 0;
+    lwip_timer_rearm();
+}
+
+void luat_lwip_timer_kick(void) {
+    // sys_check_timeouts里新增的超时, 处理完会统一重新设置
+    if (!lwip_timer_ready || lwip_in_check)
+        return;
+    lwip_timer_rearm();
+}
 
 void luat_lwip_init(void) {
+    // 命令行没有指定profile时使用默认的
+    luat_lwip_profile_get();
+    uv_timer_init(main_loop, &lwip_timer);
     lwip_init();
+    lwip_timer_ready = 1;
+    lwip_timer_rearm();
+}
+
+// 零拷贝输入: 用PBUF_REF类型的custom pbuf直接引用外部内存(例如zbuff),
+// lwip释放pbuf时回调调用者解除引用. 描述符用固定数量的池, 用完了退回到复制
+#define LWIP_REF_PBUF_NUM 256
+
+typedef struct lwip_ref_pbuf
+{
+    struct pbuf_custom pc;  // 必须是第一个成员
+    luat_lwip_ref_free_cb cb;
+    void* owner;
+    int tag;
+    struct lwip_ref_pbuf* next;
+}lwip_ref_pbuf_t;
+
+static lwip_ref_pbuf_t ref_pbufs[LWIP_REF_PBUF_NUM];
+static lwip_ref_pbuf_t* ref_free_list;
+static uint8_t ref_pool_ready;
+
+static void ref_pbuf_free(struct pbuf *p) {
+    lwip_ref_pbuf_t* r = (lwip_ref_pbuf_t*)p;
+    luat_lwip_ref_free_cb cb = r->cb;
+    void* owner = r->owner;
+    int tag = r->tag;
+    r->owner = NULL;
+    r->next = ref_free_list;
+    ref_free_list = r;
+    if (cb)
+        cb(owner, tag);
+}
+
+int luat_lwip_input_ref(uint8_t adapter_index, const uint8_t* data, size_t len, void* owner, int tag, luat_lwip_ref_free_cb cb) {
+    struct netif* netif = net_lwip2_get_netif(adapter_index);
+    struct pbuf* p;
+    if (netif == NULL || netif->input == NULL || len == 0 || len > 0xffff)
+        return -1;
+    if (!ref_pool_ready) {
+        for (size_t i = 0; i < LWIP_REF_PBUF_NUM; i++) {
+            ref_pbufs[i].next = ref_free_list;
+            ref_free_list = &ref_pbufs[i];
+        }
+        ref_pool_ready = 1;
+    }
+    lwip_ref_pbuf_t* r = ref_free_list;
+    if (r == NULL) {
+        // 引用描述符用完了, 说明lwip里积压了大量的帧, 这一帧复制一份
+        p = pbuf_alloc(PBUF_RAW, (u16_t)len, PBUF_POOL);
+        if (p == NULL)
+            return -1;
+        pbuf_take(p, data, (u16_t)len);
+        if (netif->input(p, netif) != ERR_OK)
+            pbuf_free(p);
+        return 1;
+    }
+    ref_free_list = r->next;
+    r->pc.custom_free_function = ref_pbuf_free;
+    r->cb = cb;
+    r->owner = owner;
+    r->tag = tag;
+    p = pbuf_alloced_custom(PBUF_RAW, (u16_t)len, PBUF_REF, &r->pc, (void*)data, (u16_t)len);
+    // 处理失败时pbuf_free会调用ref_pbuf_free, 调用者同样会收到回调
+    if (netif->input(p, netif) != ERR_OK)
+        pbuf_free(p);
+    return 0;
+}
+
+size_t luat_lwip_input_ref_count(const void* owner) {
+    size_t count = 0;
+    if (!ref_pool_ready)
+        return 0;
+    for (size_t i = 0; i < LWIP_REF_PBUF_NUM; i++) {
+        if (ref_pbufs[i].owner == owner)
+            count++;
+    }
+    return count;
+}
+
+struct netif *luat_lwip_vnetif_route4(const struct ip4_addr *src, const struct ip4_addr *dest);
+struct netif *luat_lwip_ppp_route4(const struct ip4_addr *src, const struct ip4_addr *dest);
+
+// LWIP_HOOK_IP4_ROUTE_SRC, 虚拟网卡和PPP的pair模式都要按源地址选择出口
+struct netif *luat_lwip_route4(const struct ip4_addr *src, const struct ip4_addr *dest) {
+    struct netif *netif = luat_lwip_vnetif_route4(src, dest);
+    if (netif == NULL)
+        netif = luat_lwip_ppp_route4(src, dest);
+    return netif;
 }
+#endif
 
 uint32_t lwip_port_rand(void) {
     uint32_t t = 0;
@@ -27,3 +165,8 @@ uint32_t sys_now(void) {
     uint32_t ticks = luat_mcu_ticks();
     return ticks;
 }
+
+// PPP用来给随机数加盐
+uint32_t sys_jiffies(void) {
+    return (uint32_t)uv_hrtime();
+}
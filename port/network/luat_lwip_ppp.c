@@ -0,0 +1,408 @@
+
+#include "uv.h"
+#include "luat_base.h"
+#include "luat_malloc.h"
+#include "luat_pcconf.h"
+#include "luat_uart.h"
+#include "luat_uart_drv.h"
+
+#include "luat_network_adapter.h"
+#include "luat_network_pc.h"
+
+#define LUAT_LOG_TAG "ppp"
+#include "luat_log.h"
+
+#ifdef LUAT_USE_LWIP
+
+#include "lwip/opt.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "netif/ppp/ppp.h"
+#include "netif/ppp/pppos.h"
+#include "net_lwip2.h"
+
+#if PPP_PHASE_RUNNING != LUAT_LWIP_PPP_PHASE_RUNNING
+#error "LUAT_LWIP_PPP_PHASE_RUNNING与lwip不一致"
+#endif
+
+// lwip的PPPoS网卡
+// 1. uart模式: 绑定一个PC串口(UDP/Windows串口驱动), 串口的接收数据由luat_uart_set_rx_hook接管,
+//    与模组上用PPP拨号的链路一致, 对端可以是pppd(socat把串口UDP端口转成pty)
+// 2. pair模式: 同一进程里的两个PPPoS首尾相连, 一端作为服务端分配地址, 编码后的字节直接写进对端的队列,
+//    由uv_idle在下一轮事件循环里解码, 用来测量HDLC编解码与PPP封装的开销
+// HDLC的转义与FCS走luat_lwip_hdlc.c的批量实现
+
+// uart驱动每次写入不超过这个长度, UDP驱动超过512字节会分包并且每包之间休眠1ms
+#define PPP_UART_CHUNK      512
+#define PPP_UART_RXBUF      4096
+// pair模式每个方向每轮事件循环最多解码的字节数, 避免饿死其他事件
+#define PPP_PAIR_BATCH      (64 * 1024)
+
+enum {
+    PPP_MODE_UART,
+    PPP_MODE_PAIR,
+};
+
+typedef struct ppp_link
+{
+    struct netif netif;
+    ppp_pcb* pcb;
+    uint8_t adapter_index;
+    uint8_t mode;
+    uint8_t server;
+    uint8_t closing;
+    int uart_id;
+    struct ppp_link* peer;
+    // pair模式对端写进来的字节, 解码时换成备用缓冲区, 解码过程中产生的回复写进新的缓冲区
+    uint8_t* rxq;
+    size_t rxq_len;
+    size_t rxq_cap;
+    uint8_t* rxq_spare;
+    size_t rxq_spare_cap;
+    netif_output_fn ip4_output;
+#if LWIP_IPV6
+    netif_output_ip6_fn ip6_output;
+#endif
+    char user[64];
+    char passwd[64];
+    luat_lwip_ppp_stat_t stat;
+}ppp_link_t;
+
+extern uv_loop_t *main_loop;
+
+static ppp_link_t* links[NW_ADAPTER_INDEX_LWIP_NETIF_QTY];
+static uv_idle_t* ppp_idle;
+static uint8_t ppp_uart_rxbuf[PPP_UART_RXBUF];
+
+static void on_ppp_idle(uv_idle_t* handle);
+
+static void ppp_idle_kick(void) {
+    if (!uv_is_active((uv_handle_t*)ppp_idle))
+        uv_idle_start(ppp_idle, on_ppp_idle);
+}
+
+static void ppp_link_input(ppp_link_t* link, const uint8_t* data, size_t len) {
+    uint64_t start = uv_hrtime();
+    link->stat.rx_wire += len;
+    pppos_input(link->pcb, data, (int)len);
+    link->stat.rx_ns += uv_hrtime() - start;
+}
+
+static int ppp_rxq_append(ppp_link_t* link, const uint8_t* data, size_t len) {
+    if (link->rxq_len + len > link->rxq_cap) {
+        size_t cap = link->rxq_cap ? link->rxq_cap : 4096;
+        while (cap < link->rxq_len + len)
+            cap <<= 1;
+        uint8_t* ptr = luat_heap_realloc(link->rxq, cap);
+        if (ptr == NULL)
+            return -1;
+        link->rxq = ptr;
+        link->rxq_cap = cap;
+    }
+    memcpy(link->rxq + link->rxq_len, data, len);
+    link->rxq_len += len;
+    return 0;
+}
+
+static void ppp_link_free(ppp_link_t* link) {
+    links[link->adapter_index] = NULL;
+    if (link->mode == PPP_MODE_UART)
+        luat_uart_set_rx_hook(link->uart_id, NULL, NULL);
+    if (link->peer && link->peer->peer == link)
+        link->peer->peer = NULL;
+    net_lwip2_set_link_state(link->adapter_index, 0);
+    net_lwip2_set_netif(link->adapter_index, NULL);
+    ppp_free(link->pcb);
+    luat_heap_free(link->rxq);
+    luat_heap_free(link->rxq_spare);
+    luat_heap_free(link);
+}
+
+static void on_ppp_idle(uv_idle_t* handle) {
+    int busy = 0;
+    for (size_t i = 0; i < NW_ADAPTER_INDEX_LWIP_NETIF_QTY; i++) {
+        ppp_link_t* link = links[i];
+        if (link == NULL)
+            continue;
+        // 状态回调里不能释放, pppos_input返回之前还会访问pcb; 还没断开的等状态回调再来
+        if (link->closing) {
+            if (link->pcb->phase == PPP_PHASE_DEAD)
+                ppp_link_free(link);
+            continue;
+        }
+        if (link->rxq_len == 0)
+            continue;
+        uint8_t* data = link->rxq;
+        size_t len = link->rxq_len;
+        size_t cap = link->rxq_cap;
+        link->rxq = link->rxq_spare;
+        link->rxq_cap = link->rxq_spare_cap;
+        link->rxq_len = 0;
+        link->rxq_spare = NULL;
+        link->rxq_spare_cap = 0;
+        for (size_t off = 0; off < len && !link->closing; off += PPP_PAIR_BATCH)
+            ppp_link_input(link, data + off, len - off > PPP_PAIR_BATCH ? PPP_PAIR_BATCH : len - off);
+        // 解码期间对端没有再写入的话, 原来的缓冲区留作备用
+        if (link->rxq_spare == NULL) {
+            link->rxq_spare = data;
+            link->rxq_spare_cap = cap;
+        }
+        else {
+            luat_heap_free(data);
+        }
+    }
+    for (size_t i = 0; i < NW_ADAPTER_INDEX_LWIP_NETIF_QTY; i++) {
+        if (links[i] && !links[i]->closing && links[i]->rxq_len)
+            busy = 1;
+    }
+    if (!busy)
+        uv_idle_stop(handle);
+}
+
+static u32_t ppp_output_cb(ppp_pcb* pcb, const void* data, u32_t len, void* ctx) {
+    (void)pcb;
+    ppp_link_t* link = (ppp_link_t*)ctx;
+    if (link->mode == PPP_MODE_PAIR) {
+        // 和真实串口一样, 对端不在了就当作线路断开, 数据直接丢掉
+        if (link->peer && !link->peer->closing) {
+            if (ppp_rxq_append(link->peer, (const uint8_t*)data, len))
+                return 0;
+            ppp_idle_kick();
+        }
+    }
+    else {
+        const uint8_t* ptr = (const uint8_t*)data;
+        for (u32_t off = 0; off < len; off += PPP_UART_CHUNK) {
+            u32_t n = len - off > PPP_UART_CHUNK ? PPP_UART_CHUNK : len - off;
+            if (luat_uart_write(link->uart_id, (void*)(ptr + off), n) < 0)
+                return off;
+        }
+    }
+    link->stat.tx_wire += len;
+    return len;
+}
+
+static void ppp_uart_rx(int uart_id, const uint8_t* data, size_t len, void* userdata) {
+    ppp_link_t* link = (ppp_link_t*)userdata;
+    if (link->closing)
+        return;
+    if (data) {
+        ppp_link_input(link, data, len);
+        return;
+    }
+    // 驱动只通知了长度, 读到没有数据为止
+    int n;
+    while (!link->closing && (n = luat_uart_read(uart_id, ppp_uart_rxbuf, sizeof(ppp_uart_rxbuf))) > 0)
+        ppp_link_input(link, ppp_uart_rxbuf, n);
+}
+
+static ppp_link_t* ppp_link_of(struct netif* netif) {
+    return (ppp_link_t*)((ppp_pcb*)netif->state)->ctx_cb;
+}
+
+// 统计发送路径的耗时, 包括HDLC编码和写串口/对端队列
+static err_t ppp_link_output4(struct netif* netif, struct pbuf* p, const ip4_addr_t* ipaddr) {
+    ppp_link_t* link = ppp_link_of(netif);
+    uint64_t start = uv_hrtime();
+    err_t err = link->ip4_output(netif, p, ipaddr);
+    link->stat.tx_ns += uv_hrtime() - start;
+    return err;
+}
+
+#if LWIP_IPV6
+static err_t ppp_link_output6(struct netif* netif, struct pbuf* p, const ip6_addr_t* ipaddr) {
+    ppp_link_t* link = ppp_link_of(netif);
+    uint64_t start = uv_hrtime();
+    err_t err = link->ip6_output(netif, p, ipaddr);
+    link->stat.tx_ns += uv_hrtime() - start;
+    return err;
+}
+#endif
+
+static void ppp_link_restart(ppp_link_t* link, u16_t holdoff) {
+    if (link->server)
+        ppp_listen(link->pcb);
+    else
+        ppp_connect(link->pcb, holdoff);
+}
+
+static void ppp_status_cb(ppp_pcb* pcb, int err, void* ctx) {
+    ppp_link_t* link = (ppp_link_t*)ctx;
+    link->stat.err = err;
+    if (err == PPPERR_NONE) {
+        // IPCP和IPV6CP各自完成时都会回调一次
+#if LWIP_IPV6
+        if (ip4_addr_isany_val(*netif_ip4_addr(pcb->netif))) {
+            char ip6[40];
+            ip6addr_ntoa_r(netif_ip6_addr(pcb->netif, 0), ip6, sizeof(ip6));
+            LLOGI("adapter %d ppp已连接 %s", link->adapter_index, ip6);
+            net_lwip2_set_link_state(link->adapter_index, 1);
+            return;
+        }
+#endif
+        char ip[16], gw[16];
+        ip4addr_ntoa_r(netif_ip4_addr(pcb->netif), ip, sizeof(ip));
+        ip4addr_ntoa_r(netif_ip4_gw(pcb->netif), gw, sizeof(gw));
+        LLOGI("adapter %d ppp已连接 %s 对端 %s", link->adapter_index, ip, gw);
+        net_lwip2_set_link_state(link->adapter_index, 1);
+        return;
+    }
+    net_lwip2_set_link_state(link->adapter_index, 0);
+    if (err == PPPERR_USER || link->closing) {
+        link->closing = 1;
+        ppp_idle_kick();
+        return;
+    }
+    LLOGW("adapter %d ppp断开 err %d, 重新%s", link->adapter_index, err, link->server ? "监听" : "连接");
+    ppp_link_restart(link, 1);
+}
+
+static ppp_link_t* ppp_link_create(uint8_t adapter_index, uint8_t mode, uint8_t server) {
+    if (adapter_index >= NW_ADAPTER_INDEX_LWIP_NETIF_QTY || adapter_index == NW_ADAPTER_INDEX_LWIP_NONE) {
+        LLOGE("adapter %d 不是lwip的网卡", adapter_index);
+        return NULL;
+    }
+    if (links[adapter_index]) {
+        LLOGE("adapter %d 已经创建过ppp", adapter_index);
+        return NULL;
+    }
+    if (ppp_idle == NULL) {
+        ppp_idle = luat_heap_malloc(sizeof(uv_idle_t));
+        if (ppp_idle == NULL)
+            return NULL;
+        uv_idle_init(main_loop, ppp_idle);
+    }
+    ppp_link_t* link = luat_heap_zalloc(sizeof(ppp_link_t));
+    if (link == NULL) {
+        LLOGE("out of memory when malloc ppp link");
+        return NULL;
+    }
+    link->adapter_index = adapter_index;
+    link->mode = mode;
+    link->server = server;
+    link->uart_id = -1;
+    link->pcb = pppos_create(&link->netif, ppp_output_cb, ppp_status_cb, link);
+    if (link->pcb == NULL) {
+        LLOGE("pppos_create失败, 检查MEMP_NUM_PPP_PCB");
+        luat_heap_free(link);
+        return NULL;
+    }
+    link->ip4_output = link->netif.output;
+    link->netif.output = ppp_link_output4;
+#if LWIP_IPV6
+    link->ip6_output = link->netif.output_ip6;
+    link->netif.output_ip6 = ppp_link_output6;
+#endif
+    links[adapter_index] = link;
+    net_lwip2_set_netif(adapter_index, &link->netif);
+    net_lwip2_register_adapter(adapter_index);
+    return link;
+}
+
+static void ppp_link_server(ppp_link_t* link, uint32_t local_ip, uint32_t peer_ip) {
+    ip4_addr_t addr;
+    ip4_addr_set_u32(&addr, local_ip);
+    ppp_set_ipcp_ouraddr(link->pcb, &addr);
+    ip4_addr_set_u32(&addr, peer_ip);
+    ppp_set_ipcp_hisaddr(link->pcb, &addr);
+    ppp_set_auth_required(link->pcb, 0);
+}
+
+int luat_lwip_ppp_uart(uint8_t adapter_index, int uart_id, const luat_lwip_ppp_opts_t* opts) {
+    if (!luat_uart_exist(uart_id))
+        return -1;
+    if (luat_uart_is_hooked(uart_id)) {
+        LLOGE("uart %d 已经被占用", uart_id);
+        return -1;
+    }
+    ppp_link_t* link = ppp_link_create(adapter_index, PPP_MODE_UART, opts->server);
+    if (link == NULL)
+        return -1;
+    link->uart_id = uart_id;
+    luat_uart_set_rx_hook(uart_id, ppp_uart_rx, link);
+    if (opts->server) {
+        ppp_link_server(link, opts->local_ip, opts->peer_ip);
+    }
+    else if (opts->user) {
+        snprintf(link->user, sizeof(link->user), "%s", opts->user);
+        snprintf(link->passwd, sizeof(link->passwd), "%s", opts->passwd ? opts->passwd : "");
+        ppp_set_auth(link->pcb, PPPAUTHTYPE_ANY, link->user, link->passwd);
+    }
+    ppp_link_restart(link, 0);
+    LLOGI("adapter %d ppp %s uart %d", adapter_index, opts->server ? "服务端" : "客户端", uart_id);
+    return 0;
+}
+
+int luat_lwip_ppp_pair(uint8_t index_a, uint8_t index_b, uint32_t ip_a, uint32_t ip_b) {
+    if (index_a == index_b)
+        return -1;
+    ppp_link_t* a = ppp_link_create(index_a, PPP_MODE_PAIR, 0);
+    if (a == NULL)
+        return -1;
+    ppp_link_t* b = ppp_link_create(index_b, PPP_MODE_PAIR, 1);
+    if (b == NULL) {
+        ppp_link_free(a);
+        return -1;
+    }
+    a->peer = b;
+    b->peer = a;
+    // b是服务端, 通过IPCP把ip_a分配给a
+    ppp_link_server(b, ip_b, ip_a);
+    ppp_link_restart(b, 0);
+    ppp_link_restart(a, 0);
+    LLOGI("adapter %d <-> %d ppp已连接线路", index_a, index_b);
+    return 0;
+}
+
+int luat_lwip_ppp_close(uint8_t adapter_index) {
+    if (adapter_index >= NW_ADAPTER_INDEX_LWIP_NETIF_QTY || links[adapter_index] == NULL)
+        return -1;
+    ppp_link_t* link = links[adapter_index];
+    ppp_link_t* peer = link->mode == PPP_MODE_PAIR ? link->peer : NULL;
+    // pair的两端一起关闭, 否则剩下的一端会一直重连
+    link->closing = 1;
+    if (peer)
+        peer->closing = 1;
+    ppp_close(link->pcb, 1);
+    if (peer)
+        ppp_close(peer->pcb, 1);
+    ppp_idle_kick();
+    return 0;
+}
+
+int luat_lwip_ppp_stat(uint8_t adapter_index, luat_lwip_ppp_stat_t* stat) {
+    if (adapter_index >= NW_ADAPTER_INDEX_LWIP_NETIF_QTY || links[adapter_index] == NULL)
+        return -1;
+    ppp_link_t* link = links[adapter_index];
+    memcpy(stat, &link->stat, sizeof(luat_lwip_ppp_stat_t));
+    stat->phase = link->pcb->phase;
+#if MIB2_STATS
+    // 包括LCP/IPCP等控制帧在内的PPP帧载荷字节数
+    stat->tx_payload = link->netif.mib2_counters.ifoutoctets;
+    stat->rx_payload = link->netif.mib2_counters.ifinoctets;
+    stat->tx_frames = link->netif.mib2_counters.ifoutucastpkts;
+    stat->rx_frames = link->netif.mib2_counters.ifinucastpkts;
+#endif
+    return 0;
+}
+
+// pair模式的两端互为对端, 和虚拟网卡一样按源地址选择出口
+struct netif *luat_lwip_ppp_route4(const struct ip4_addr *src, const struct ip4_addr *dest) {
+    if (src == NULL)
+        return NULL;
+    for (size_t i = 0; i < NW_ADAPTER_INDEX_LWIP_NETIF_QTY; i++) {
+        ppp_link_t* link = links[i];
+        if (link == NULL || link->mode != PPP_MODE_PAIR || !netif_is_up(&link->netif))
+            continue;
+        if (ip4_addr_isany(src)) {
+            if (ip4_addr_cmp(dest, netif_ip4_gw(&link->netif)))
+                return &link->netif;
+        }
+        else if (ip4_addr_cmp(src, netif_ip4_addr(&link->netif))) {
+            return &link->netif;
+        }
+    }
+    return NULL;
+}
+
+#endif
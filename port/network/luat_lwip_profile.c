@@ -0,0 +1,279 @@
+
+#include "luat_base.h"
+#include "luat_network_pc.h"
+
+#define LUAT_LOG_TAG "lwip"
+#include "luat_log.h"
+
+#ifdef LUAT_USE_LWIP
+
+#include <stdlib.h>
+#include "lwip/opt.h"
+#include "lwip/mem.h"
+#include "lwip/memp.h"
+#include "lwip/stats.h"
+#include "netif/ppp/ppp_opts.h"
+#include "lwip/etharp.h"
+#include "lwip/priv/tcp_priv.h"
+
+// lwip的内存池与TCP参数在运行时按profile设置, 同一个可执行文件既能模拟模组上的资源限制,
+// 也能在PC上跑几百个TCP连接的压力测试:
+// 1. MEMP_MEM_MALLOC, 内存池的元素从堆里分配, 每个池的上限由LWIP_HOOK_MEMP_LIMIT检查
+// 2. 堆用系统malloc, 上限是profile的mem_size加上所有内存池上限占用的字节数
+// 3. TCP_MSS/TCP_WND等是变量, 已有连接的窗口更新/发送队列也会读取它们,
+//    所以只在没有TCP连接的时候允许切换, 见profile_tcp_busy
+
+unsigned short luat_lwip_tcp_mss;
+unsigned int luat_lwip_tcp_snd_buf;
+unsigned short luat_lwip_tcp_snd_queuelen;
+unsigned int luat_lwip_tcp_wnd;
+unsigned char luat_lwip_tcp_rcv_scale;
+unsigned short luat_lwip_arp_table_size;
+
+// host profile的tcp_mss, TCP_OVERSIZE要按它来定, 否则每个报文段都要拆成多个pbuf
+#if !TCP_OVERSIZE || TCP_OVERSIZE < 1460
+#error "TCP_OVERSIZE must be a constant no smaller than the largest profile tcp_mss"
+#endif
+
+// 编译期的MEMP_NUM_xxx, 即mcu profile下每个内存池的数量
+static const uint32_t memp_default_num[MEMP_MAX] = {
+#define LWIP_MEMPOOL(name, num, size, desc) (num),
+#include "lwip/priv/memp_std.h"
+};
+
+static const luat_lwip_profile_t profiles[] = {
+    {
+        .name = "mcu",
+        .mem_size = MEM_SIZE,
+        .pool_scale = 1,
+        .pbuf_pool_size = PBUF_POOL_SIZE,
+        .udp_pcb = MEMP_NUM_UDP_PCB,
+        .tcp_pcb = MEMP_NUM_TCP_PCB,
+        .tcp_pcb_listen = MEMP_NUM_TCP_PCB_LISTEN,
+        .tcp_seg = MEMP_NUM_TCP_SEG,
+        .tcp_mss = 1024,
+        .tcp_rcv_scale = 0,
+        .tcp_wnd = 20 * 1024,
+        .tcp_snd_buf = 2048,
+        .arp_table_size = 10,
+    },
+    {
+        .name = "host",
+        .mem_size = 64 * 1024 * 1024,
+        .pool_scale = 16,
+        .pbuf_pool_size = 8192,
+        .udp_pcb = 256,
+        .tcp_pcb = 1024,
+        .tcp_pcb_listen = 64,
+        .tcp_seg = 32768,
+        .tcp_mss = 1460,
+        // 窗口超过64K需要窗口扩大选项; 再大的话几百个连接同时发送会把虚拟网卡的缓冲区填满而丢帧
+        .tcp_rcv_scale = 2,
+        .tcp_wnd = 64 * 1024,
+        .tcp_snd_buf = 32 * 1024,
+        // 模拟上千台主机的局域网
+        .arp_table_size = 2048,
+    },
+};
+
+static luat_lwip_profile_t profile_current;
+static uint32_t memp_cap[MEMP_MAX];
+static size_t mem_cap;
+
+static const luat_lwip_profile_t* profile_default(void) {
+    return &profiles[0];
+}
+
+const luat_lwip_profile_t* luat_lwip_profile_find(const char* name) {
+    for (size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++) {
+        if (!strcmp(profiles[i].name, name))
+            return &profiles[i];
+    }
+    return NULL;
+}
+
+const luat_lwip_profile_t* luat_lwip_profile_get(void) {
+    if (profile_current.name == NULL)
+        luat_lwip_profile_set(profile_default());
+    return &profile_current;
+}
+
+static uint16_t profile_queuelen(const luat_lwip_profile_t* p) {
+    if (p->tcp_snd_queuelen)
+        return p->tcp_snd_queuelen;
+    uint32_t n = 4 * p->tcp_snd_buf / p->tcp_mss;
+    return (uint16_t)(n > 0xFFFF ? 0xFFFF : n);
+}
+
+// 原本在init.c里的编译期检查(窗口扩大与TCP sanity checks), 参数变成变量之后
+// 预处理器没法比较, init.c里跳过, 在这里按同样的条件检查
+static const char* profile_check(const luat_lwip_profile_t* p) {
+    if (p->tcp_mss < 536 || p->tcp_mss >= 16 * 1024 - 1)
+        return "tcp_mss必须在536~16382之间";
+    if (p->tcp_mss > TCP_OVERSIZE)
+        return "tcp_mss不能超过TCP_OVERSIZE";
+    if (p->tcp_rcv_scale > 14)
+        return "tcp_rcv_scale最大为14";
+    if (p->tcp_wnd < p->tcp_mss)
+        return "tcp_wnd不能小于tcp_mss";
+    if (p->tcp_wnd > (0xFFFFu << p->tcp_rcv_scale))
+        return "tcp_wnd超出了tcp_rcv_scale允许的范围";
+    if ((p->tcp_wnd >> p->tcp_rcv_scale) == 0)
+        return "tcp_wnd按tcp_rcv_scale缩小之后为0";
+    if (p->tcp_snd_buf < 2u * p->tcp_mss)
+        return "tcp_snd_buf至少是2倍tcp_mss";
+    // TCP_SNDLOWAT是tcp_snd_buf/2
+    if (p->tcp_snd_buf / 2 >= 0xFFFFu - 4u * p->tcp_mss)
+        return "tcp_snd_buf/2距离u16_t溢出至少要留4倍tcp_mss";
+    uint32_t queuelen = profile_queuelen(p);
+    if (queuelen < 2 || queuelen < 2 * (p->tcp_snd_buf / p->tcp_mss))
+        return "tcp_snd_queuelen至少是2倍tcp_snd_buf/tcp_mss";
+    // TCP_SNDQUEUELOWAT是LWIP_MAX(tcp_snd_queuelen/2, 5)
+    if (LWIP_MAX(queuelen / 2, 5) >= queuelen)
+        return "tcp_snd_queuelen至少为6";
+    if (p->tcp_seg < queuelen)
+        return "tcp_seg不能小于tcp_snd_queuelen";
+    if ((uint32_t)p->pbuf_pool_size * (PBUF_POOL_BUFSIZE - (PBUF_LINK_ENCAPSULATION_HLEN + PBUF_LINK_HLEN + PBUF_IP_HLEN + PBUF_TRANSPORT_HLEN)) < p->tcp_wnd)
+        return "tcp_wnd超过了pbuf_pool_size个PBUF_POOL能容纳的数据";
+    if (p->tcp_pcb == 0 || p->pbuf_pool_size == 0 || p->pool_scale == 0)
+        return "内存池的数量不能为0";
+    if (p->arp_table_size == 0 || p->arp_table_size > ARP_TABLE_SIZE)
+        return "arp_table_size必须在1~ARP_TABLE_SIZE之间";
+    return NULL;
+}
+
+// 已有连接的tcp_recved/窗口更新读TCP_WND/TCP_RCV_SCALE, tcp_write读TCP_SND_QUEUELEN,
+// 连接建立时按旧参数协商的窗口扩大因子也不能再变, 所以有TCP连接时不允许切换.
+// TIME_WAIT的连接已经不收发数据, 直接释放掉, 免得等2MSL
+static int profile_tcp_busy(void) {
+    while (tcp_tw_pcbs)
+        tcp_abort(tcp_tw_pcbs);
+    int count = 0;
+    struct tcp_pcb* lists[] = {tcp_bound_pcbs, tcp_active_pcbs, tcp_listen_pcbs.pcbs};
+    for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+        for (struct tcp_pcb* pcb = lists[i]; pcb; pcb = pcb->next)
+            count++;
+    }
+    return count;
+}
+
+int luat_lwip_profile_set(const luat_lwip_profile_t* p) {
+    const char* err = profile_check(p);
+    if (err) {
+        LLOGE("profile %s 无效: %s", p->name ? p->name : "?", err);
+        return -1;
+    }
+    // 第一次设置时协议栈还没有任何连接
+    if (profile_current.name) {
+        int busy = profile_tcp_busy();
+        if (busy) {
+            LLOGE("还有%d个TCP连接, 关闭之后才能切换profile", busy);
+            return -1;
+        }
+    }
+    profile_current = *p;
+    profile_current.tcp_snd_queuelen = profile_queuelen(p);
+
+    for (size_t i = 0; i < MEMP_MAX; i++)
+        memp_cap[i] = memp_default_num[i] * p->pool_scale;
+    memp_cap[MEMP_PBUF_POOL] = p->pbuf_pool_size;
+    memp_cap[MEMP_UDP_PCB] = p->udp_pcb;
+    memp_cap[MEMP_TCP_PCB] = p->tcp_pcb;
+    memp_cap[MEMP_TCP_PCB_LISTEN] = p->tcp_pcb_listen;
+    memp_cap[MEMP_TCP_SEG] = p->tcp_seg;
+
+    // 内存池的元素也从堆里分配, 堆的上限要把它们算进去
+    mem_cap = p->mem_size;
+    for (size_t i = 0; i < MEMP_MAX; i++) {
+        mem_cap += (size_t)memp_cap[i] * (MEMP_SIZE + MEMP_ALIGN_SIZE(memp_pools[i]->size));
+#if MEMP_STATS
+        memp_pools[i]->stats->avail = memp_cap[i];
+#endif
+    }
+#if MEM_STATS
+    lwip_stats.mem.avail = mem_cap;
+#endif
+
+    luat_lwip_tcp_mss = p->tcp_mss;
+    luat_lwip_tcp_snd_buf = p->tcp_snd_buf;
+    luat_lwip_tcp_snd_queuelen = profile_current.tcp_snd_queuelen;
+    luat_lwip_tcp_wnd = p->tcp_wnd;
+    luat_lwip_tcp_rcv_scale = p->tcp_rcv_scale;
+    // ARP表在下一次创建表项时按新的大小重新分配
+    if (luat_lwip_arp_table_size != p->arp_table_size) {
+#if ETHARP_TABLE_HASH
+        if (luat_lwip_arp_table_size)
+            etharp_table_reset();
+#endif
+        luat_lwip_arp_table_size = p->arp_table_size;
+    }
+    LLOGD("profile %s tcp_pcb %d pbuf_pool %d mss %d wnd %d", p->name ? p->name : "custom",
+        p->tcp_pcb, p->pbuf_pool_size, p->tcp_mss, (int)p->tcp_wnd);
+    return 0;
+}
+
+int luat_lwip_profile_select(const char* name) {
+    const luat_lwip_profile_t* p = luat_lwip_profile_find(name);
+    if (p == NULL) {
+        LLOGE("没有名为%s的profile", name);
+        return -1;
+    }
+    return luat_lwip_profile_set(p);
+}
+
+int luat_lwip_memp_limit(int type) {
+    if (mem_cap == 0)
+        luat_lwip_profile_get();
+    return memp_pools[type]->stats->used >= memp_cap[type];
+}
+
+void *luat_lwip_mem_malloc(size_t size) {
+    if (mem_cap == 0)
+        luat_lwip_profile_get();
+    if (lwip_stats.mem.used + size > mem_cap)
+        return NULL;
+    return malloc(size);
+}
+
+void *luat_lwip_mem_calloc(size_t count, size_t size) {
+    return calloc(count, size);
+}
+
+void luat_lwip_mem_free(void *mem) {
+    free(mem);
+}
+
+int luat_lwip_pool_stat(int index, luat_lwip_pool_stat_t* stat) {
+    luat_lwip_profile_get();
+    memset(stat, 0, sizeof(luat_lwip_pool_stat_t));
+    if (index == 0) {
+        stat->name = "MEM";
+        stat->cap = mem_cap;
+        stat->used = lwip_stats.mem.used;
+        stat->max = lwip_stats.mem.max;
+        stat->err = lwip_stats.mem.err;
+        return 0;
+    }
+    index--;
+    if (index < 0 || index >= MEMP_MAX)
+        return -1;
+    const struct memp_desc* desc = memp_pools[index];
+    stat->name = desc->desc;
+    stat->elem_size = desc->size;
+    stat->cap = memp_cap[index];
+    stat->used = desc->stats->used;
+    stat->max = desc->stats->max;
+    stat->err = desc->stats->err;
+    return 0;
+}
+
+void luat_lwip_pool_stat_reset(void) {
+    lwip_stats.mem.max = lwip_stats.mem.used;
+    lwip_stats.mem.err = 0;
+    for (size_t i = 0; i < MEMP_MAX; i++) {
+        memp_pools[i]->stats->max = memp_pools[i]->stats->used;
+        memp_pools[i]->stats->err = 0;
+    }
+}
+
+#endif
@@ -0,0 +1,307 @@
+
+#include "uv.h"
+#include "luat_base.h"
+#include "luat_malloc.h"
+#include "luat_pcconf.h"
+
+#include "luat_network_adapter.h"
+#include "luat_network_pc.h"
+
+#define LUAT_LOG_TAG "vnetif"
+#include "luat_log.h"
+
+#ifdef LUAT_USE_LWIP
+
+#include "lwip/opt.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/etharp.h"
+#include "lwip/ethip6.h"
+#include "netif/ethernet.h"
+#include "net_lwip2.h"
+
+// lwip的虚拟网卡
+// 1. pair模式: 同一进程里的两块网卡首尾相连, 帧直接写进对端的接收环形缓冲区(共享内存),
+//    由uv_idle在下一轮事件循环里交给对端的lwip, 不经过任何系统调用
+// 2. udp模式: 每个以太网帧作为一个UDP报文发给另一个进程里的网卡, 用于两个luatos进程互通
+// 进程里只有一套lwip协议栈, pair模式的两块网卡在同一个网段, 需要按源地址选择出口网卡,
+// 见luat_lwip_vnetif_route4
+
+#define VNETIF_MTU          1500
+#define VNETIF_FRAME_MAX    (VNETIF_MTU + SIZEOF_ETH_HDR + 4)
+// 每块网卡接收环形缓冲区的帧数, 按当前profile的pbuf池大小取2的幂, 限制在这个范围内
+#define VNETIF_RING_MIN     128
+#define VNETIF_RING_MAX     8192
+// 每轮事件循环每块网卡最多处理的帧数, 避免饿死其他事件
+#define VNETIF_BATCH        32
+
+enum {
+    VNETIF_MODE_PAIR,
+    VNETIF_MODE_UDP,
+};
+
+typedef struct vnetif_frame
+{
+    uint16_t len;
+    uint8_t data[VNETIF_FRAME_MAX];
+}vnetif_frame_t;
+
+typedef struct vnetif
+{
+    struct netif netif;
+    uint8_t adapter_index;
+    uint8_t mode;
+    struct vnetif* peer;
+    vnetif_frame_t* ring;
+    uint32_t ring_size;     // 2的幂
+    uint32_t head;          // 对端写入的位置
+    uint32_t tail;          // 本端读取的位置
+    uv_udp_t* udp;
+    struct sockaddr_in peer_addr;
+    luat_lwip_vnetif_stat_t stat;
+}vnetif_t;
+
+extern uv_loop_t *main_loop;
+
+static vnetif_t* vnetifs[NW_ADAPTER_INDEX_LWIP_NETIF_QTY];
+static uv_idle_t* vnetif_idle;
+static uint8_t vnetif_rxbuf[VNETIF_FRAME_MAX];
+
+static void vnetif_input(vnetif_t* vif, const uint8_t* data, size_t len) {
+    struct pbuf* p = pbuf_alloc(PBUF_RAW, (u16_t)len, PBUF_POOL);
+    if (p == NULL) {
+        vif->stat.no_pbuf++;
+        return;
+    }
+    pbuf_take(p, data, (u16_t)len);
+    vif->stat.rx_frames++;
+    vif->stat.rx_bytes += len;
+    if (vif->netif.input(p, &vif->netif) != ERR_OK)
+        pbuf_free(p);
+}
+
+static void on_vnetif_idle(uv_idle_t* handle) {
+    size_t i;
+    for (i = 0; i < NW_ADAPTER_INDEX_LWIP_NETIF_QTY; i++) {
+        vnetif_t* vif = vnetifs[i];
+        if (vif == NULL || vif->ring == NULL)
+            continue;
+        // 交给lwip处理时可能马上产生回复帧写进对端的缓冲区, 所以这里每次都重新读head
+        for (size_t n = 0; n < VNETIF_BATCH && vif->tail != vif->head; n++) {
+            vnetif_frame_t* frame = &vif->ring[vif->tail & (vif->ring_size - 1)];
+            vnetif_input(vif, frame->data, frame->len);
+            vif->tail++;
+        }
+    }
+    // 后处理的网卡可能又往前面的网卡写了帧, 所以处理完一轮再统一检查
+    // 有帧没有处理完就留到下一轮, 全部处理完才停止, 否则uv_run不会阻塞等待
+    for (i = 0; i < NW_ADAPTER_INDEX_LWIP_NETIF_QTY; i++) {
+        if (vnetifs[i] && vnetifs[i]->ring && vnetifs[i]->tail != vnetifs[i]->head)
+            return;
+    }
+    uv_idle_stop(handle);
+}
+
+static err_t vnetif_linkoutput(struct netif *netif, struct pbuf *p) {
+    vnetif_t* vif = (vnetif_t*)netif->state;
+    if (p->tot_len > VNETIF_FRAME_MAX) {
+        vif->stat.drops++;
+        return ERR_IF;
+    }
+    if (vif->mode == VNETIF_MODE_PAIR) {
+        vnetif_t* peer = vif->peer;
+        // 和真实网卡一样, 对端来不及接收就丢帧, 由上层协议重传
+        if (peer->head - peer->tail >= peer->ring_size) {
+            vif->stat.drops++;
+            return ERR_OK;
+        }
+        vnetif_frame_t* frame = &peer->ring[peer->head & (peer->ring_size - 1)];
+        frame->len = pbuf_copy_partial(p, frame->data, p->tot_len, 0);
+        peer->head++;
+        if (!uv_is_active((uv_handle_t*)vnetif_idle))
+            uv_idle_start(vnetif_idle, on_vnetif_idle);
+    }
+    else {
+        uint8_t buff[VNETIF_FRAME_MAX];
+        uv_buf_t buf = uv_buf_init((char*)buff, pbuf_copy_partial(p, buff, p->tot_len, 0));
+        int ret = uv_udp_try_send(vif->udp, &buf, 1, (const struct sockaddr*)&vif->peer_addr);
+        if (ret < 0) {
+            vif->stat.drops++;
+            return ERR_OK;
+        }
+    }
+    vif->stat.tx_frames++;
+    vif->stat.tx_bytes += p->tot_len;
+    return ERR_OK;
+}
+
+static err_t vnetif_init(struct netif *netif) {
+    vnetif_t* vif = (vnetif_t*)netif->state;
+    netif->name[0] = 'v';
+    netif->name[1] = 'n';
+    netif->mtu = VNETIF_MTU;
+    netif->hwaddr_len = ETH_HWADDR_LEN;
+    // 本地管理的MAC地址, 最后一字节是适配器编号
+    netif->hwaddr[0] = 0x02;
+    netif->hwaddr[1] = 0x4c;
+    netif->hwaddr[2] = 0x55;
+    netif->hwaddr[3] = 0x41;
+    netif->hwaddr[4] = 0x54;
+    netif->hwaddr[5] = vif->adapter_index;
+    netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_ETHERNET | NETIF_FLAG_IGMP;
+    netif->output = etharp_output;
+#if LWIP_IPV6
+    netif->output_ip6 = ethip6_output;
+#endif
+    netif->linkoutput = vnetif_linkoutput;
+    return ERR_OK;
+}
+
+static vnetif_t* vnetif_create(uint8_t adapter_index, uint8_t mode, uint32_t ip, uint32_t mask, uint32_t gw) {
+    if (adapter_index >= NW_ADAPTER_INDEX_LWIP_NETIF_QTY || adapter_index == NW_ADAPTER_INDEX_LWIP_NONE) {
+        LLOGE("adapter %d 不是lwip的网卡", adapter_index);
+        return NULL;
+    }
+    if (vnetifs[adapter_index]) {
+        LLOGE("adapter %d 已经创建过虚拟网卡", adapter_index);
+        return NULL;
+    }
+    if (vnetif_idle == NULL) {
+        vnetif_idle = luat_heap_malloc(sizeof(uv_idle_t));
+        if (vnetif_idle == NULL)
+            return NULL;
+        uv_idle_init(main_loop, vnetif_idle);
+    }
+    vnetif_t* vif = luat_heap_zalloc(sizeof(vnetif_t));
+    if (vif == NULL) {
+        LLOGE("out of memory when malloc vnetif");
+        return NULL;
+    }
+    if (mode == VNETIF_MODE_PAIR) {
+        // 几百个连接同时发送时, 缓冲区太小会频繁丢帧, 只能靠重传超时恢复
+        vif->ring_size = VNETIF_RING_MIN;
+        while (vif->ring_size < luat_lwip_profile_get()->pbuf_pool_size && vif->ring_size < VNETIF_RING_MAX)
+            vif->ring_size <<= 1;
+        vif->ring = luat_heap_malloc(sizeof(vnetif_frame_t) * vif->ring_size);
+        if (vif->ring == NULL) {
+            LLOGE("out of memory when malloc vnetif ring");
+            luat_heap_free(vif);
+            return NULL;
+        }
+    }
+    vif->adapter_index = adapter_index;
+    vif->mode = mode;
+    ip4_addr_t addr, netmask, gateway;
+    ip4_addr_set_u32(&addr, ip);
+    ip4_addr_set_u32(&netmask, mask);
+    ip4_addr_set_u32(&gateway, gw);
+    netif_add(&vif->netif, &addr, &netmask, &gateway, vif, vnetif_init, ethernet_input);
+    vnetifs[adapter_index] = vif;
+    return vif;
+}
+
+static void vnetif_up(vnetif_t* vif) {
+    netif_set_up(&vif->netif);
+    netif_set_link_up(&vif->netif);
+    net_lwip2_set_netif(vif->adapter_index, &vif->netif);
+    net_lwip2_register_adapter(vif->adapter_index);
+    net_lwip2_set_link_state(vif->adapter_index, 1);
+}
+
+int luat_lwip_vnetif_pair(uint8_t index_a, uint8_t index_b, uint32_t ip_a, uint32_t ip_b, uint32_t mask) {
+    if (index_a == index_b)
+        return -1;
+    vnetif_t* a = vnetif_create(index_a, VNETIF_MODE_PAIR, ip_a, mask, ip_b);
+    if (a == NULL)
+        return -1;
+    vnetif_t* b = vnetif_create(index_b, VNETIF_MODE_PAIR, ip_b, mask, ip_a);
+    if (b == NULL) {
+        netif_remove(&a->netif);
+        vnetifs[index_a] = NULL;
+        luat_heap_free(a->ring);
+        luat_heap_free(a);
+        return -1;
+    }
+    a->peer = b;
+    b->peer = a;
+    vnetif_up(a);
+    vnetif_up(b);
+    LLOGI("adapter %d <-> %d 虚拟网卡已连接", index_a, index_b);
+    return 0;
+}
+
+static void vnetif_udp_alloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf) {
+    (void)handle;
+    (void)suggested_size;
+    buf->base = (char*)vnetif_rxbuf;
+    buf->len = sizeof(vnetif_rxbuf);
+}
+
+static void on_vnetif_udp_read(uv_udp_t* handle, ssize_t nread, const uv_buf_t* buf, const struct sockaddr* addr, unsigned flags) {
+    (void)addr;
+    vnetif_t* vif = (vnetif_t*)handle->data;
+    if (nread <= 0)
+        return;
+    if (flags & UV_UDP_PARTIAL) {
+        vif->stat.drops++;
+        return;
+    }
+    vnetif_input(vif, (const uint8_t*)buf->base, nread);
+}
+
+int luat_lwip_vnetif_udp(uint8_t adapter_index, uint32_t ip, uint32_t mask, uint32_t gw, uint16_t local_port, const char* peer_host, uint16_t peer_port) {
+    struct sockaddr_in local;
+    int ret;
+    vnetif_t* vif = vnetif_create(adapter_index, VNETIF_MODE_UDP, ip, mask, gw);
+    if (vif == NULL)
+        return -1;
+    uv_ip4_addr(peer_host ? peer_host : "127.0.0.1", peer_port, &vif->peer_addr);
+    uv_ip4_addr("127.0.0.1", local_port, &local);
+    vif->udp = luat_heap_malloc(sizeof(uv_udp_t));
+    uv_udp_init(main_loop, vif->udp);
+    vif->udp->data = vif;
+    ret = uv_udp_bind(vif->udp, (const struct sockaddr*)&local, 0);
+    if (ret == 0)
+        ret = uv_udp_recv_start(vif->udp, vnetif_udp_alloc, on_vnetif_udp_read);
+    if (ret) {
+        LLOGE("udp %d 绑定失败 %s", local_port, uv_err_name(ret));
+        netif_remove(&vif->netif);
+        vnetifs[adapter_index] = NULL;
+        free_uv_handle(vif->udp);
+        luat_heap_free(vif);
+        return ret;
+    }
+    vnetif_up(vif);
+    LLOGI("adapter %d 虚拟网卡 udp %d -> %d", adapter_index, local_port, peer_port);
+    return 0;
+}
+
+int luat_lwip_vnetif_stat(uint8_t adapter_index, luat_lwip_vnetif_stat_t* stat) {
+    if (adapter_index >= NW_ADAPTER_INDEX_LWIP_NETIF_QTY || vnetifs[adapter_index] == NULL)
+        return -1;
+    memcpy(stat, &vnetifs[adapter_index]->stat, sizeof(luat_lwip_vnetif_stat_t));
+    return 0;
+}
+
+// pair模式两块网卡在同一个网段, 按目的地址选路的话两边都会选中同一块网卡.
+// 这里按源地址选择出口: 源地址是哪块网卡的就从哪块发出; 还没有绑定源地址时,
+// 发往某块网卡地址的报文从它的对端发出, 这样报文一定经过"网线"
+struct netif *luat_lwip_vnetif_route4(const struct ip4_addr *src, const struct ip4_addr *dest) {
+    if (src == NULL)
+        return NULL;
+    for (size_t i = 0; i < NW_ADAPTER_INDEX_LWIP_NETIF_QTY; i++) {
+        vnetif_t* vif = vnetifs[i];
+        if (vif == NULL || vif->mode != VNETIF_MODE_PAIR || !netif_is_up(&vif->netif))
+            continue;
+        if (ip4_addr_isany(src)) {
+            if (ip4_addr_cmp(dest, netif_ip4_addr(&vif->peer->netif)))
+                return &vif->netif;
+        }
+        else if (ip4_addr_cmp(src, netif_ip4_addr(&vif->netif))) {
+            return &vif->netif;
+        }
+    }
+    return NULL;
+}
+
+#endif
@@ -9,6 +9,7 @@
 #include "luat_pcconf.h"
 
 #include "luat_network_adapter.h"
+#include "luat_network_pc.h"
 
 #include <stdio.h>
 
@@ -16,6 +17,10 @@
 #include "luat_log.h"
 
 #define MAX_SOCK_NUM 8
+// Happy Eyeballs 单次连接最多尝试的地址数量
+#define HE_MAX_ATTEMPTS 4
+// A记录先返回时, 最多再等待AAAA记录的时间, 毫秒
+#define HE_RESOLUTION_DELAY 50
 
 #ifndef LUAT_CONF_NETWORK_DEBUG
 #define LUAT_CONF_NETWORK_DEBUG 0
@@ -52,29 +57,21 @@ typedef struct
     uint8_t next_socket_index;
 } libuv_ctrl_c;
 
-typedef struct uv_dns_query
-{
-    char domain[256];
-    void *param;
-    // libuv所需的数据结构
-    struct addrinfo hints;
-    uv_getaddrinfo_t resolver;
-} uv_dns_query_t;
-
 typedef struct uv_udp_data
 {
-    struct sockaddr_in from;
+    struct sockaddr_storage from;
     void *next;
     size_t len;
     char data[4];
 } uv_udp_data_t;
 
+struct he_ctx;
+
 typedef struct uv_conn
 {
     int state;
     uint64_t tag;
-    uv_connect_t c;
-    uv_tcp_t tcp;
+    uv_tcp_t *tcp;          // 连接成功后才有值, 是Happy Eyeballs竞速的胜出者
     uv_udp_t udp;
     void *param;
     char *recv_buff;
@@ -83,6 +80,14 @@ typedef struct uv_conn
     // struct sockaddr_in remote;
     int is_ipv6;
     int is_tcp;
+    struct he_ctx *he;      // 进行中的连接竞速
+    int family;             // 实际连接所用的地址族
+    uint32_t attempts;      // 本次连接发起过的连接尝试数量
+    uint64_t connect_start; // uv_hrtime, 纳秒
+    uint64_t connect_ns;    // 连接耗时, 纳秒
+    int opts[LUAT_SOCKOPT_QTY]; // socket选项, 创建fd时应用, 见sockopt_apply
+    uint64_t create_ms;     // 创建socket时的uv_now
+    luat_libuv_sock_stat_t stat;
 } uv_conn_t;
 
 int libuv_init(uint8_t adapter_index);
@@ -116,6 +121,12 @@ extern uv_loop_t *main_loop;
 
 static uv_conn_t sockets[MAX_SOCK_NUM];
 static uint64_t socket_tag_counter = 0xFAFB;
+// 全部socket的累计统计, 不随socket释放清零
+static luat_libuv_sock_stat_t total_stat;
+static uint8_t he_enable = 1;
+static uint32_t he_delay = 250;
+// 新建socket的默认选项, 默认开启keepalive, 60秒, 与之前的行为一致
+static int default_opts[LUAT_SOCKOPT_QTY] = {0, 1, 60, -1, -1, -1, -1};
 
 static const char* socket_state_str(int state) {
     if (state >= 0 && state <= SC_CLOSED) {
@@ -129,10 +140,195 @@ static inline int set_socket_state(int socket_id, int state) {
         return 0;
     }
     LLOGD("socket[%d]状态变化 %s --> %s", socket_id, socket_state_str(sockets[socket_id].state), socket_state_str(state));
+    if (sockets[socket_id].state != state) {
+        luat_libuv_sock_stat_t *stat = &sockets[socket_id].stat;
+        uint32_t i = stat->transitions % LUAT_SOCK_TIMELINE_SIZE;
+        stat->timeline[i].state = state;
+        stat->timeline[i].ms = (uint32_t)(uv_now(main_loop) - sockets[socket_id].create_ms);
+        stat->transitions++;
+        total_stat.transitions++;
+    }
     sockets[socket_id].state = state;
     return 0;
 }
 
+// 同时记录到socket和累计统计里
+#define SOCK_HIST(socket_id, name, value) do { \
+        luat_hist_record(&sockets[socket_id].stat.name, value); \
+        luat_hist_record(&total_stat.name, value); \
+    } while (0)
+
+//---------------------------------------
+// DNS耗时
+// 上层先解析域名后创建socket, 两者通过param(上层的network_ctrl_t)关联
+//---------------------------------------
+
+#define DNS_TIMING_SIZE 16
+
+typedef struct dns_timing
+{
+    void *param;
+    uint64_t start;
+    uint32_t us;
+    uint8_t done;
+} dns_timing_t;
+
+static dns_timing_t dns_timings[DNS_TIMING_SIZE];
+static size_t dns_timing_next;
+
+static void dns_timing_begin(void *param)
+{
+    dns_timing_t *t = &dns_timings[dns_timing_next++ % DNS_TIMING_SIZE];
+    t->param = param;
+    t->start = uv_hrtime();
+    t->done = 0;
+}
+
+static void dns_timing_end(void *param)
+{
+    for (size_t i = 0; i < DNS_TIMING_SIZE; i++)
+    {
+        dns_timing_t *t = &dns_timings[i];
+        if (t->param != param || t->done)
+            continue;
+        t->us = (uint32_t)((uv_hrtime() - t->start) / 1000);
+        t->done = 1;
+        luat_hist_record(&total_stat.dns_us, t->us);
+        for (size_t s = 0; s < MAX_SOCK_NUM; s++)
+        {
+            if (sockets[s].tag && sockets[s].param == param)
+            {
+                luat_hist_record(&sockets[s].stat.dns_us, t->us);
+                t->param = NULL;
+                break;
+            }
+        }
+        return;
+    }
+}
+
+// 创建socket时取走之前的解析耗时
+static void dns_timing_take(int socket_id)
+{
+    for (size_t i = 0; i < DNS_TIMING_SIZE; i++)
+    {
+        dns_timing_t *t = &dns_timings[i];
+        if (t->done && t->param && t->param == sockets[socket_id].param)
+        {
+            luat_hist_record(&sockets[socket_id].stat.dns_us, t->us);
+            t->param = NULL;
+        }
+    }
+}
+
+//---------------------------------------
+// 地址转换
+//---------------------------------------
+
+static int ip_is_v6(const luat_ip_addr_t *ip) {
+    #ifdef LUAT_USE_LWIP
+    return IP_IS_V6(ip);
+    #else
+    return ip->is_ipv6;
+    #endif
+}
+
+static void ip_set_ipv6(luat_ip_addr_t *ip, const uint8_t *addr) {
+    #ifdef LUAT_USE_LWIP
+    memcpy(ip_2_ip6(ip)->addr, addr, 16);
+    ip6_addr_clear_zone(ip_2_ip6(ip));
+    IP_SET_TYPE(ip, IPADDR_TYPE_V6);
+    #else
+    memcpy(ip->ipv6_u8_addr, addr, 16);
+    ip->is_ipv6 = 1;
+    #endif
+}
+
+static void ip_to_dns_addr(const luat_ip_addr_t *ip, luat_dns_addr_t *out) {
+    memset(out, 0, sizeof(luat_dns_addr_t));
+    if (ip_is_v6(ip)) {
+        out->family = AF_INET6;
+        #ifdef LUAT_USE_LWIP
+        memcpy(out->addr, ip_2_ip6(ip)->addr, 16);
+        #else
+        memcpy(out->addr, ip->ipv6_u8_addr, 16);
+        #endif
+    }
+    else {
+        out->family = AF_INET;
+        #ifdef LUAT_USE_LWIP
+        memcpy(out->addr, &ip_2_ip4(ip)->addr, 4);
+        #else
+        memcpy(out->addr, &ip->ipv4, 4);
+        #endif
+    }
+}
+
+static void ip_from_dns_addr(luat_ip_addr_t *ip, const luat_dns_addr_t *addr) {
+    if (addr->family == AF_INET6) {
+        ip_set_ipv6(ip, addr->addr);
+    }
+    else {
+        uint32_t ipv4 = 0;
+        memcpy(&ipv4, addr->addr, 4);
+        #ifndef LUAT_USE_LWIP
+        ip->is_ipv6 = 0;
+        #endif
+        network_set_ip_ipv4(ip, ipv4);
+    }
+}
+
+static void dns_addr_to_sockaddr(const luat_dns_addr_t *addr, uint16_t port, struct sockaddr_storage *out) {
+    memset(out, 0, sizeof(struct sockaddr_storage));
+    if (addr->family == AF_INET6) {
+        struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *)out;
+        sa6->sin6_family = AF_INET6;
+        sa6->sin6_port = htons(port);
+        memcpy(&sa6->sin6_addr, addr->addr, 16);
+    }
+    else {
+        struct sockaddr_in *sa = (struct sockaddr_in *)out;
+        sa->sin_family = AF_INET;
+        sa->sin_port = htons(port);
+        memcpy(&sa->sin_addr, addr->addr, 4);
+    }
+}
+
+static void ip_to_sockaddr(const luat_ip_addr_t *ip, uint16_t port, struct sockaddr_storage *out) {
+    luat_dns_addr_t addr;
+    ip_to_dns_addr(ip, &addr);
+    dns_addr_to_sockaddr(&addr, port, out);
+}
+
+// 返回端口号
+static uint16_t ip_from_sockaddr(luat_ip_addr_t *ip, const struct sockaddr *sa) {
+    luat_dns_addr_t addr = {.family = sa->sa_family};
+    uint16_t port = 0;
+    if (sa->sa_family == AF_INET6) {
+        memcpy(addr.addr, &((const struct sockaddr_in6 *)sa)->sin6_addr, 16);
+        port = ((const struct sockaddr_in6 *)sa)->sin6_port;
+    }
+    else {
+        memcpy(addr.addr, &((const struct sockaddr_in *)sa)->sin_addr, 4);
+        port = ((const struct sockaddr_in *)sa)->sin_port;
+    }
+    ip_from_dns_addr(ip, &addr);
+    return ntohs(port);
+}
+
+static size_t sockaddr_len(const struct sockaddr *sa) {
+    return sa->sa_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+}
+
+static const char* sockaddr_name(const struct sockaddr *sa, char *buf, size_t len) {
+    buf[0] = 0;
+    if (sa->sa_family == AF_INET6)
+        uv_ip6_name((const struct sockaddr_in6 *)sa, buf, len);
+    else
+        uv_ip4_name((const struct sockaddr_in *)sa, buf, len);
+    return buf;
+}
+
 typedef struct task_event_async
 {
     // uv_async_t async;
@@ -212,12 +408,12 @@ static int libuv_create_socket(uint8_t is_tcp, uint64_t *tag, void *param, uint8
         // }
         if (sockets[tmpi].tag == 0 && (sockets[tmpi].state == SC_IDLE || sockets[tmpi].state == SC_CLOSED))
         {
-            if (is_tcp) {
-                uv_tcp_init(main_loop, &sockets[tmpi].tcp);
-                uv_tcp_keepalive(&sockets[tmpi].tcp, 1, 60);
-                sockets[tmpi].tcp.data = (void*)tmpi;
+            if (sockets[tmpi].tcp) {
+                free_uv_handle(sockets[tmpi].tcp);
+                sockets[tmpi].tcp = NULL;
             }
-            else {
+            // tcp句柄在连接时才创建, 见he_start_next
+            if (!is_tcp) {
                 uv_udp_init(main_loop, &sockets[tmpi].udp);
                 sockets[tmpi].udp.data = (void*)tmpi;
             }
@@ -226,9 +422,16 @@ static int libuv_create_socket(uint8_t is_tcp, uint64_t *tag, void *param, uint8
             sockets[tmpi].param = param;
             sockets[tmpi].is_tcp = is_tcp;
             sockets[tmpi].is_ipv6 = is_ipv6;
+            sockets[tmpi].family = 0;
+            sockets[tmpi].attempts = 0;
+            sockets[tmpi].connect_ns = 0;
+            memcpy(sockets[tmpi].opts, default_opts, sizeof(default_opts));
+            memset(&sockets[tmpi].stat, 0, sizeof(luat_libuv_sock_stat_t));
+            sockets[tmpi].create_ms = uv_now(main_loop);
             // sockets[i].state = SC_IDLE;
             set_socket_state(tmpi, SC_USED);
             ctrl.next_socket_index = tmpi + 1;
+            dns_timing_take(tmpi);
             // LLOGD("socket[%d] tag %016X", tmpi, stag);
             return tmpi;
         }
@@ -317,6 +520,11 @@ static void on_recv(uv_stream_t *handler,
         sockets[socket_id].recv_size += nread;
     }
     luat_heap_free(buf->base);
+    sockets[socket_id].stat.rx_bytes += nread;
+    sockets[socket_id].stat.rx_count++;
+    total_stat.rx_bytes += nread;
+    total_stat.rx_count++;
+    SOCK_HIST(socket_id, rx_chunk, nread);
     cb_to_nw_task(EV_NW_SOCKET_RX_NEW, socket_id, nread, sockets[socket_id].param);
     return;
 }
@@ -350,7 +558,7 @@ static void on_recv_udp(uv_udp_t *udp,
     memset(d, 0, sizeof(uv_udp_data_t));
     memcpy(d->data, buf->base, nread);
     if (addr)
-        memcpy(&d->from, addr, sizeof(struct sockaddr_in));
+        memcpy(&d->from, addr, sockaddr_len(addr));
     d->len = nread;
     // LLOGD("是否缓冲区");
     luat_heap_free(buf->base);
@@ -374,14 +582,17 @@ static void on_recv_udp(uv_udp_t *udp,
             head = head->next;
         }
     }
+    sockets[socket_id].stat.rx_bytes += nread;
+    sockets[socket_id].stat.rx_count++;
+    total_stat.rx_bytes += nread;
+    total_stat.rx_count++;
+    SOCK_HIST(socket_id, rx_chunk, nread);
     cb_to_nw_task(EV_NW_SOCKET_RX_NEW, socket_id, nread, sockets[socket_id].param);
     // LLOGD("完成on_recv_udp函数");
 }
 
-static void on_connect(uv_connect_t *req, int status)
+static void socket_connect_done(int32_t socket_id, int status)
 {
-    // LLOGD("on_connect %d", status);
-    int32_t socket_id = (int32_t)req->data;
     int ret = 0;
     if (status != 0)
     {
@@ -392,6 +603,8 @@ static void on_connect(uv_connect_t *req, int status)
     else
     {
         // sockets[socket_id].state = SC_CONNECTED;
+        sockets[socket_id].connect_ns = uv_hrtime() - sockets[socket_id].connect_start;
+        SOCK_HIST(socket_id, connect_us, (uint32_t)(sockets[socket_id].connect_ns / 1000));
         set_socket_state(socket_id, SC_CONNECTED);
         cb_to_nw_task(EV_NW_SOCKET_CONNECT_OK, socket_id, 0, 0);
     }
@@ -401,7 +614,7 @@ static void on_connect(uv_connect_t *req, int status)
         // LLOGD("启动接收回调");
         if (sockets[socket_id].is_tcp)
         {
-            ret = uv_read_start(&sockets[socket_id].tcp, uv_buf_alloc, on_recv);
+            ret = uv_read_start((uv_stream_t *)sockets[socket_id].tcp, uv_buf_alloc, on_recv);
             if (ret) // TODO 中止连接
                 LLOGD("socket_id[%d] uv_read_start %d", socket_id, ret);
         }
@@ -418,21 +631,448 @@ static void on_connect(uv_connect_t *req, int status)
     }
 }
 
+//---------------------------------------
+// socket选项
+// 上层传入的是lwIP或本机的选项编号, 先转换成LUAT_SOCKOPT_XXX保存在uv_conn_t里,
+// 有fd时立即应用到fd上, 没有fd时等创建fd的时候再应用
+//---------------------------------------
+
+#ifdef LUAT_USE_LWIP
+// 启用lwIP时, 上层使用的是lwIP的选项编号, 与本机的编号不一定相同
+#define NW_SOL_SOCKET       0xfff
+#define NW_IPPROTO_TCP      6
+#define NW_SO_KEEPALIVE     0x0008
+#define NW_SO_SNDBUF        0x1001
+#define NW_SO_RCVBUF        0x1002
+#define NW_TCP_NODELAY      0x01
+#define NW_TCP_KEEPIDLE     0x03
+#define NW_TCP_KEEPINTVL    0x04
+#define NW_TCP_KEEPCNT      0x05
+#else
+#define NW_SOL_SOCKET       SOL_SOCKET
+#define NW_IPPROTO_TCP      IPPROTO_TCP
+#define NW_SO_KEEPALIVE     SO_KEEPALIVE
+#define NW_SO_SNDBUF        SO_SNDBUF
+#define NW_SO_RCVBUF        SO_RCVBUF
+#define NW_TCP_NODELAY      TCP_NODELAY
+#ifdef TCP_KEEPIDLE
+#define NW_TCP_KEEPIDLE     TCP_KEEPIDLE
+#else
+#define NW_TCP_KEEPIDLE     -1
+#endif
+#ifdef TCP_KEEPINTVL
+#define NW_TCP_KEEPINTVL    TCP_KEEPINTVL
+#else
+#define NW_TCP_KEEPINTVL    -1
+#endif
+#ifdef TCP_KEEPCNT
+#define NW_TCP_KEEPCNT      TCP_KEEPCNT
+#else
+#define NW_TCP_KEEPCNT      -1
+#endif
+#endif
+
+static int sockopt_map(int level, int optname)
+{
+    if (level == NW_SOL_SOCKET)
+    {
+        switch (optname)
+        {
+        case NW_SO_KEEPALIVE: return LUAT_SOCKOPT_KEEPALIVE;
+        case NW_SO_SNDBUF: return LUAT_SOCKOPT_SNDBUF;
+        case NW_SO_RCVBUF: return LUAT_SOCKOPT_RCVBUF;
+        }
+    }
+    else if (level == NW_IPPROTO_TCP)
+    {
+        if (optname == NW_TCP_NODELAY)
+            return LUAT_SOCKOPT_NODELAY;
+        if (optname == NW_TCP_KEEPIDLE)
+            return LUAT_SOCKOPT_KEEPIDLE;
+        if (optname == NW_TCP_KEEPINTVL)
+            return LUAT_SOCKOPT_KEEPINTVL;
+        if (optname == NW_TCP_KEEPCNT)
+            return LUAT_SOCKOPT_KEEPCNT;
+    }
+    return -1;
+}
+
+static int sockopt_fd(uv_handle_t *h, uv_os_sock_t *sock)
+{
+    uv_os_fd_t fd;
+    if (h == NULL || uv_fileno(h, &fd))
+        return -1;
+    *sock = (uv_os_sock_t)fd;
+    return 0;
+}
+
+// 本机没有对应选项的, 返回-1
+static int sockopt_native(int opt, int *level, int *optname)
+{
+    switch (opt)
+    {
+    case LUAT_SOCKOPT_NODELAY: *level = IPPROTO_TCP; *optname = TCP_NODELAY; return 0;
+    case LUAT_SOCKOPT_KEEPALIVE: *level = SOL_SOCKET; *optname = SO_KEEPALIVE; return 0;
+    #if defined(TCP_KEEPIDLE)
+    case LUAT_SOCKOPT_KEEPIDLE: *level = IPPROTO_TCP; *optname = TCP_KEEPIDLE; return 0;
+    #elif defined(TCP_KEEPALIVE)
+    case LUAT_SOCKOPT_KEEPIDLE: *level = IPPROTO_TCP; *optname = TCP_KEEPALIVE; return 0;
+    #endif
+    #ifdef TCP_KEEPINTVL
+    case LUAT_SOCKOPT_KEEPINTVL: *level = IPPROTO_TCP; *optname = TCP_KEEPINTVL; return 0;
+    #endif
+    #ifdef TCP_KEEPCNT
+    case LUAT_SOCKOPT_KEEPCNT: *level = IPPROTO_TCP; *optname = TCP_KEEPCNT; return 0;
+    #endif
+    }
+    return -1;
+}
+
+static int sockopt_apply(int socket_id, uv_handle_t *h, int opt)
+{
+    int *opts = sockets[socket_id].opts;
+    int value = opts[opt];
+    int ret = 0;
+    if (h == NULL)
+        return 0;
+    if (opt == LUAT_SOCKOPT_SNDBUF || opt == LUAT_SOCKOPT_RCVBUF)
+    {
+        // 取值为0时uv_xxx_buffer_size是读取, 所以只设置正数
+        if (value <= 0)
+            return 0;
+        ret = opt == LUAT_SOCKOPT_SNDBUF ? uv_send_buffer_size(h, &value) : uv_recv_buffer_size(h, &value);
+    }
+    else if (h->type != UV_TCP)
+    {
+        return 0;
+    }
+    else if (opt == LUAT_SOCKOPT_NODELAY)
+    {
+        if (value < 0)
+            return 0;
+        ret = uv_tcp_nodelay((uv_tcp_t *)h, value);
+    }
+    else if (opt == LUAT_SOCKOPT_KEEPALIVE || opt == LUAT_SOCKOPT_KEEPIDLE)
+    {
+        if (opts[LUAT_SOCKOPT_KEEPALIVE] < 0)
+            return 0;
+        ret = uv_tcp_keepalive((uv_tcp_t *)h, opts[LUAT_SOCKOPT_KEEPALIVE] > 0, opts[LUAT_SOCKOPT_KEEPIDLE] > 0 ? opts[LUAT_SOCKOPT_KEEPIDLE] : 60);
+        // 部分libuv版本会顺带改写探测间隔和次数, 重新设置一次
+        if (ret == 0 && opts[LUAT_SOCKOPT_KEEPALIVE] > 0)
+        {
+            sockopt_apply(socket_id, h, LUAT_SOCKOPT_KEEPINTVL);
+            sockopt_apply(socket_id, h, LUAT_SOCKOPT_KEEPCNT);
+        }
+    }
+    else
+    {
+        int level, optname;
+        uv_os_sock_t sock;
+        if (value < 0 || sockopt_native(opt, &level, &optname) || sockopt_fd(h, &sock))
+            return 0;
+        ret = setsockopt(sock, level, optname, (const char *)&value, sizeof(value));
+        if (ret)
+        #ifdef _WIN32
+            ret = uv_translate_sys_error(WSAGetLastError());
+        #else
+            ret = uv_translate_sys_error(errno);
+        #endif
+    }
+    if (ret)
+        LLOGW("socket[%d] 设置选项%d=%d失败 %s", socket_id, opt, value, uv_err_name(ret));
+    return ret;
+}
+
+static void sockopt_apply_all(int socket_id, uv_handle_t *h)
+{
+    for (int i = 0; i < LUAT_SOCKOPT_QTY; i++)
+        sockopt_apply(socket_id, h, i);
+}
+
+static uv_handle_t* sockopt_handle(int socket_id)
+{
+    if (sockets[socket_id].is_tcp)
+        return (uv_handle_t *)sockets[socket_id].tcp;
+    return (uv_handle_t *)&sockets[socket_id].udp;
+}
+
+int luat_libuv_sockopt_set(int socket_id, int opt, int value)
+{
+    if (opt < 0 || opt >= LUAT_SOCKOPT_QTY)
+        return -1;
+    if (socket_id == -1)
+    {
+        default_opts[opt] = value;
+        return 0;
+    }
+    if (socket_id < 0 || socket_id >= MAX_SOCK_NUM || sockets[socket_id].tag == 0)
+        return -1;
+    sockets[socket_id].opts[opt] = value;
+    return sockopt_apply(socket_id, sockopt_handle(socket_id), opt);
+}
+
+int luat_libuv_sockopt_get(int socket_id, int opt, int* value)
+{
+    if (opt < 0 || opt >= LUAT_SOCKOPT_QTY)
+        return -1;
+    if (socket_id == -1)
+    {
+        *value = default_opts[opt];
+        return 0;
+    }
+    if (socket_id < 0 || socket_id >= MAX_SOCK_NUM || sockets[socket_id].tag == 0)
+        return -1;
+    *value = sockets[socket_id].opts[opt];
+    uv_handle_t *h = sockopt_handle(socket_id);
+    uv_os_sock_t sock;
+    if (sockopt_fd(h, &sock))
+        return 0;
+    if (opt == LUAT_SOCKOPT_SNDBUF || opt == LUAT_SOCKOPT_RCVBUF)
+    {
+        int tmp = 0;
+        if ((opt == LUAT_SOCKOPT_SNDBUF ? uv_send_buffer_size(h, &tmp) : uv_recv_buffer_size(h, &tmp)) == 0)
+            *value = tmp;
+        return 0;
+    }
+    int level, optname;
+    if (h->type != UV_TCP || sockopt_native(opt, &level, &optname))
+        return 0;
+    int tmp = 0;
+    socklen_t len = sizeof(tmp);
+    if (getsockopt(sock, level, optname, (char *)&tmp, &len) == 0)
+    {
+        if (opt == LUAT_SOCKOPT_NODELAY || opt == LUAT_SOCKOPT_KEEPALIVE)
+            tmp = tmp ? 1 : 0;
+        *value = tmp;
+    }
+    return 0;
+}
+
+//---------------------------------------
+// Happy Eyeballs (RFC 8305)
+// 1. DNS阶段同时查询A和AAAA, A先返回时最多再等HE_RESOLUTION_DELAY毫秒的AAAA
+// 2. 连接阶段IPv6/IPv4地址交替排列, 每隔he_delay毫秒发起下一个连接尝试,
+//    某个尝试失败时立即发起下一个, 第一个连接成功的胜出, 其余的全部取消
+//---------------------------------------
+
+typedef struct he_attempt
+{
+    struct he_ctx *ctx;
+    uv_tcp_t *tcp;
+    uv_connect_t req;
+    struct sockaddr_storage addr;
+} he_attempt_t;
+
+typedef struct he_ctx
+{
+    int socket_id;
+    uint64_t tag;
+    uv_timer_t timer;
+    uint8_t count;      // 候选地址数量
+    uint8_t next;       // 下一个待发起的尝试
+    uint8_t inflight;   // 进行中的尝试数量
+    uint8_t done;       // 竞速已结束
+    uint8_t timer_closed;
+    int last_err;
+    he_attempt_t attempts[HE_MAX_ATTEMPTS];
+} he_ctx_t;
+
+static void he_step(he_ctx_t *ctx);
+
+static void he_ctx_try_free(he_ctx_t *ctx)
+{
+    if (ctx->done && ctx->inflight == 0 && ctx->timer_closed)
+        luat_heap_free(ctx);
+}
+
+static void on_he_timer_close(uv_handle_t *handle)
+{
+    he_ctx_t *ctx = (he_ctx_t *)handle->data;
+    ctx->timer_closed = 1;
+    he_ctx_try_free(ctx);
+}
+
+// 结束竞速, 除winner外的尝试全部取消, 被取消的尝试仍会以UV_ECANCELED回调on_he_connect
+static void he_finish(he_ctx_t *ctx, he_attempt_t *winner)
+{
+    ctx->done = 1;
+    uv_close((uv_handle_t *)&ctx->timer, on_he_timer_close);
+    if (sockets[ctx->socket_id].he == ctx)
+        sockets[ctx->socket_id].he = NULL;
+    for (size_t i = 0; i < ctx->next; i++)
+    {
+        he_attempt_t *a = &ctx->attempts[i];
+        if (a != winner && a->tcp)
+        {
+            free_uv_handle(a->tcp);
+            a->tcp = NULL;
+        }
+    }
+}
+
+static int he_socket_valid(he_ctx_t *ctx)
+{
+    return sockets[ctx->socket_id].tag == ctx->tag && sockets[ctx->socket_id].state == SC_CONNECTING;
+}
+
+static void on_he_connect(uv_connect_t *req, int status)
+{
+    he_attempt_t *a = (he_attempt_t *)req->data;
+    he_ctx_t *ctx = a->ctx;
+    int socket_id = ctx->socket_id;
+    char name[64];
+    ctx->inflight--;
+    if (ctx->done)
+    {
+        he_ctx_try_free(ctx);
+        return;
+    }
+    if (status == 0)
+    {
+        he_finish(ctx, a);
+        if (he_socket_valid(ctx))
+        {
+            sockets[socket_id].tcp = a->tcp;
+            sockets[socket_id].family = a->addr.ss_family;
+            sockets[socket_id].attempts = ctx->next;
+            LLOGD("socket[%d] %s 竞速胜出, 共发起%d个尝试", socket_id, sockaddr_name((struct sockaddr *)&a->addr, name, sizeof(name)), ctx->next);
+            socket_connect_done(socket_id, 0);
+        }
+        else
+        {
+            free_uv_handle(a->tcp);
+        }
+        a->tcp = NULL;
+        he_ctx_try_free(ctx);
+        return;
+    }
+    LLOGD("socket[%d] 连接 %s 失败 %s", socket_id, sockaddr_name((struct sockaddr *)&a->addr, name, sizeof(name)), uv_err_name(status));
+    ctx->last_err = status;
+    free_uv_handle(a->tcp);
+    a->tcp = NULL;
+    he_step(ctx);
+    he_ctx_try_free(ctx);
+}
+
+static void on_he_timer(uv_timer_t *timer)
+{
+    he_step((he_ctx_t *)timer->data);
+}
+
+static void he_start_next(he_ctx_t *ctx)
+{
+    int ret = 0;
+    while (ctx->next < ctx->count)
+    {
+        he_attempt_t *a = &ctx->attempts[ctx->next++];
+        a->ctx = ctx;
+        a->tcp = luat_heap_zalloc(sizeof(uv_tcp_t));
+        if (a->tcp == NULL)
+        {
+            LLOGE("out of memory when malloc uv_tcp_t");
+            ctx->last_err = UV_ENOMEM;
+            continue;
+        }
+        // 先创建fd, 缓冲区大小等选项需要在connect之前设置
+        ret = uv_tcp_init_ex(main_loop, a->tcp, a->addr.ss_family);
+        if (ret)
+        {
+            LLOGE("socket[%d] uv_tcp_init_ex ret %d", ctx->socket_id, ret);
+            ctx->last_err = ret;
+            luat_heap_free(a->tcp);
+            a->tcp = NULL;
+            continue;
+        }
+        a->tcp->data = (void *)ctx->socket_id;
+        sockopt_apply_all(ctx->socket_id, (uv_handle_t *)a->tcp);
+        a->req.data = a;
+        ret = uv_tcp_connect(&a->req, a->tcp, (const struct sockaddr *)&a->addr, on_he_connect);
+        if (ret == 0)
+        {
+            ctx->inflight++;
+            return;
+        }
+        LLOGE("socket[%d] uv_tcp_connect ret %d", ctx->socket_id, ret);
+        ctx->last_err = ret;
+        free_uv_handle(a->tcp);
+        a->tcp = NULL;
+    }
+}
+
+// 发起下一个尝试, 没有可发起的尝试且全部失败时, 竞速以失败结束
+static void he_step(he_ctx_t *ctx)
+{
+    he_start_next(ctx);
+    if (ctx->next < ctx->count)
+    {
+        uv_timer_start(&ctx->timer, on_he_timer, he_delay, 0);
+    }
+    else if (ctx->inflight == 0)
+    {
+        he_finish(ctx, NULL);
+        if (he_socket_valid(ctx))
+        {
+            sockets[ctx->socket_id].attempts = ctx->next;
+            socket_connect_done(ctx->socket_id, ctx->last_err ? ctx->last_err : UV_ECONNREFUSED);
+        }
+    }
+}
+
+// 上层传入的地址放在它所属地址族的首位, 同一域名的其他地址取自DNS缓存
+// 按RFC 8305交替排列两个地址族, IPv6在前, 一个地址族用完之后剩下的依次排在后面
+static uint8_t he_candidates(he_ctx_t *ctx, const luat_ip_addr_t *remote_ip, uint16_t remote_port)
+{
+    luat_dns_addr_t same[LUAT_DNS_CACHE_MAX_ADDR + 1];
+    luat_dns_addr_t other[LUAT_DNS_CACHE_MAX_ADDR];
+    luat_dns_addr_t tmp[LUAT_DNS_CACHE_MAX_ADDR];
+    size_t same_count = 1;
+    size_t other_count = 0;
+    ip_to_dns_addr(remote_ip, &same[0]);
+    if (he_enable)
+    {
+        int family = same[0].family;
+        size_t n = luat_dns_cache_peers(&same[0], family, tmp, LUAT_DNS_CACHE_MAX_ADDR);
+        for (size_t i = 0; i < n; i++)
+        {
+            if (memcmp(&tmp[i], &same[0], sizeof(luat_dns_addr_t)))
+                same[same_count++] = tmp[i];
+        }
+        other_count = luat_dns_cache_peers(&same[0], family == AF_INET6 ? AF_INET : AF_INET6, other, LUAT_DNS_CACHE_MAX_ADDR);
+    }
+    const luat_dns_addr_t *v6 = same[0].family == AF_INET6 ? same : other;
+    const luat_dns_addr_t *v4 = same[0].family == AF_INET6 ? other : same;
+    size_t v6_count = same[0].family == AF_INET6 ? same_count : other_count;
+    size_t v4_count = same[0].family == AF_INET6 ? other_count : same_count;
+    size_t i6 = 0, i4 = 0;
+    while (ctx->count < HE_MAX_ATTEMPTS && (i6 < v6_count || i4 < v4_count))
+    {
+        if (i6 < v6_count)
+            dns_addr_to_sockaddr(&v6[i6++], remote_port, &ctx->attempts[ctx->count++].addr);
+        if (ctx->count < HE_MAX_ATTEMPTS && i4 < v4_count)
+            dns_addr_to_sockaddr(&v4[i4++], remote_port, &ctx->attempts[ctx->count++].addr);
+    }
+    return ctx->count;
+}
+
+static void he_cancel(int socket_id)
+{
+    he_ctx_t *ctx = sockets[socket_id].he;
+    if (ctx == NULL)
+        return;
+    he_finish(ctx, NULL);
+    he_ctx_try_free(ctx);
+}
+
 typedef struct on_connect_udp
 {
     uv_async_t async;
     int socket_id;
-    struct sockaddr_in addr;
 } on_connect_udp_t;
 
 static void udp_connect_async(uv_async_t *async)
 {
-    int ret = 0;
     on_connect_udp_t *c = (on_connect_udp_t *)async->data;
-    int socket_id = c->socket_id;
-    // ret = uv_udp_connect(&sockets[socket_id].udp, (const struct sockaddr *)&c->addr);
-    // memcpy(&sockets[socket_id].remote, (const struct sockaddr *)&c->addr, sizeof(const struct sockaddr));
-    on_connect(&sockets[socket_id].udp, ret);
+    socket_connect_done(c->socket_id, 0);
     free_uv_handle(async);
 }
 
@@ -443,41 +1083,60 @@ static int libuv_socket_connect(int socket_id, uint64_t tag, uint16_t local_port
 
     int ret = 0;
 
-    struct sockaddr_in saddr = {.sin_family = AF_INET};
-    #ifdef LUAT_USE_LWIP
-    saddr.sin_addr.s_addr = ip_2_ip4(remote_ip)->addr;
-    #else
-    saddr.sin_addr.s_addr = remote_ip->ipv4;
-    #endif
-    saddr.sin_port = htons(remote_port);
-    char addr[17] = {'\0'};
-    uv_ip4_name(&saddr, addr, 16);
-    LLOGI("socket[%d] connect to %s:%d %s", socket_id, addr, remote_port, sockets[socket_id].is_tcp ? "TCP" : "UDP");
-    sockets[socket_id].c.data = (void *)socket_id;
+    struct sockaddr_storage saddr;
+    ip_to_sockaddr(remote_ip, remote_port, &saddr);
+    char addr[64] = {'\0'};
+    LLOGI("socket[%d] connect to %s:%d %s", socket_id, sockaddr_name((struct sockaddr *)&saddr, addr, sizeof(addr)), remote_port, sockets[socket_id].is_tcp ? "TCP" : "UDP");
+    sockets[socket_id].connect_start = uv_hrtime();
+    sockets[socket_id].connect_ns = 0;
+    sockets[socket_id].family = saddr.ss_family;
+    sockets[socket_id].attempts = 1;
     if (sockets[socket_id].is_tcp)
     {
-        ret = uv_tcp_connect(&sockets[socket_id].c, &sockets[socket_id].tcp, (const struct sockaddr *)&saddr, on_connect);
-        if (ret)
-            LLOGE("socket[%d] uv_tcp_connect ret %d", socket_id, ret);
-        else {
-            // sockets[socket_id].state = SC_CONNECTING;
-            set_socket_state(socket_id, SC_CONNECTING);
+        he_cancel(socket_id);
+        if (sockets[socket_id].tcp)
+        {
+            free_uv_handle(sockets[socket_id].tcp);
+            sockets[socket_id].tcp = NULL;
+        }
+        he_ctx_t *ctx = luat_heap_zalloc(sizeof(he_ctx_t));
+        if (ctx == NULL)
+        {
+            LLOGE("out of memory when malloc he ctx");
+            return -1;
         }
+        ctx->socket_id = socket_id;
+        ctx->tag = tag;
+        uv_timer_init(main_loop, &ctx->timer);
+        ctx->timer.data = ctx;
+        he_candidates(ctx, remote_ip, remote_port);
+        sockets[socket_id].he = ctx;
+        // sockets[socket_id].state = SC_CONNECTING;
+        set_socket_state(socket_id, SC_CONNECTING);
+        he_step(ctx);
     }
     else
     {
         if (local_port)
         {
-            struct sockaddr_in saddr2 = {
-                .sin_family = AF_INET};
-            saddr2.sin_addr.s_addr = 0;
-            saddr2.sin_port = htons(local_port);
+            struct sockaddr_storage saddr2;
+            luat_dns_addr_t any = {.family = saddr.ss_family};
+            dns_addr_to_sockaddr(&any, local_port, &saddr2);
             ret = uv_udp_bind(&sockets[socket_id].udp, (const struct sockaddr *)&saddr2, 0);
             if (ret)
                 LLOGD("socket[%d] uv_udp_bind ret %d", socket_id, ret);
         }
+        else if (sockets[socket_id].opts[LUAT_SOCKOPT_SNDBUF] > 0 || sockets[socket_id].opts[LUAT_SOCKOPT_RCVBUF] > 0)
+        {
+            // 需要设置缓冲区大小, 提前绑定随机端口以创建fd
+            struct sockaddr_storage saddr2;
+            luat_dns_addr_t any = {.family = saddr.ss_family};
+            dns_addr_to_sockaddr(&any, 0, &saddr2);
+            uv_udp_bind(&sockets[socket_id].udp, (const struct sockaddr *)&saddr2, 0);
+        }
+        ret = 0;
+        sockopt_apply_all(socket_id, (uv_handle_t *)&sockets[socket_id].udp);
         on_connect_udp_t *c = luat_heap_malloc(sizeof(on_connect_udp_t));
-        memcpy(&c->addr, &saddr, sizeof(struct sockaddr_in));
         c->socket_id = socket_id;
         c->async.data = c;
         uv_async_init(main_loop, &c->async, udp_connect_async);
@@ -559,9 +1218,15 @@ static int close_socket(int socket_id, const char *tag)
     int ret = 0;
     if (sockets[socket_id].is_tcp)
     {
+        he_cancel(socket_id);
+        if (sockets[socket_id].tcp == NULL) {
+            // 还没有连接成功
+            set_socket_state(socket_id, SC_CLOSED);
+            return 0;
+        }
         uv_shutdown_t *shutdown = luat_heap_malloc(sizeof(uv_shutdown_t));
         shutdown->data = (void *)socket_id;
-        ret = uv_shutdown(shutdown, &sockets[socket_id].tcp, on_shutdown);
+        ret = uv_shutdown(shutdown, (uv_stream_t *)sockets[socket_id].tcp, on_shutdown);
         if (ret) {
             luat_heap_free(shutdown);
             // if (ret != ENOTCONN)
@@ -686,30 +1351,71 @@ static int libuv_socket_receive(int socket_id, uint64_t tag, uint8_t *buf, uint3
             len = sockets[socket_id].udp_data->len;
         }
         memcpy(buf, sockets[socket_id].udp_data->data, len);
+        luat_ip_addr_t from_ip = {0};
+        uint16_t from_port = ip_from_sockaddr(&from_ip, (struct sockaddr *)&sockets[socket_id].udp_data->from);
         if (remote_ip)
-        {
-            #ifndef LUAT_USE_LWIP
-            remote_ip->is_ipv6 = 0;
-            #endif
-            network_set_ip_ipv4(remote_ip, sockets[socket_id].udp_data->from.sin_addr.s_addr);
-        }
+            memcpy(remote_ip, &from_ip, sizeof(luat_ip_addr_t));
         if (remote_port)
-            *remote_port = ntohs(sockets[socket_id].udp_data->from.sin_port);
+            *remote_port = from_port;
         sockets[socket_id].udp_data = sockets[socket_id].udp_data->next;
     }
     LLOGD("socket[%d] 返回数据长度 %d", socket_id, len);
     return len;
 }
 
+typedef struct uv_write_req
+{
+    uv_write_t req;
+    uint32_t len;
+    uint64_t tag;       // 提交时socket的tag, on_sent时socket有可能已经被复用
+    uint64_t start;     // uv_hrtime, 纳秒
+} uv_write_req_t;
+
+typedef struct uv_udp_send_req
+{
+    uv_udp_send_t req;
+    uint32_t len;
+    uint64_t tag;
+    uint64_t start;
+} uv_udp_send_req_t;
+
+static void sent_stat(int socket_id, uint64_t tag, uint32_t len, uint64_t start, int status)
+{
+    uint32_t us = (uint32_t)((uv_hrtime() - start) / 1000);
+    int same = sockets[socket_id].tag == tag;
+    if (sockets[socket_id].is_tcp)
+    {
+        if (same && sockets[socket_id].stat.queued_bytes >= len)
+            sockets[socket_id].stat.queued_bytes -= len;
+        if (total_stat.queued_bytes >= len)
+            total_stat.queued_bytes -= len;
+    }
+    if (status)
+    {
+        total_stat.tx_err++;
+        if (same)
+            sockets[socket_id].stat.tx_err++;
+        return;
+    }
+    total_stat.tx_bytes += len;
+    total_stat.tx_count++;
+    luat_hist_record(&total_stat.write_us, us);
+    if (same)
+    {
+        sockets[socket_id].stat.tx_bytes += len;
+        sockets[socket_id].stat.tx_count++;
+        luat_hist_record(&sockets[socket_id].stat.write_us, us);
+    }
+}
+
 static void on_sent(uv_write_t *req, int status)
 {
-    char *tmp = (char *)req;
-    tmp += sizeof(uv_write_t);
-    uint32_t len = 0;
-    memcpy(&len, tmp, 4);
+    uv_write_req_t *wr = (uv_write_req_t *)req;
+    uint32_t len = wr->len;
     int socket_id = (int32_t)req->data;
     LLOGD("socket[%d] tcp sent %d %d", socket_id, status, len);
-    luat_heap_free(req);
+    sent_stat(socket_id, wr->tag, len, wr->start, status);
+    luat_heap_free(wr);
 
     if (status == 0)
     {
@@ -725,12 +1431,11 @@ static void on_sent(uv_write_t *req, int status)
 
 static void on_sent_udp(uv_udp_send_t *req, int status)
 {
-    char *tmp = (char *)req;
-    tmp += sizeof(uv_udp_send_t);
-    uint32_t len = 0;
-    memcpy(&len, tmp, 4);
+    uv_udp_send_req_t *sr = (uv_udp_send_req_t *)req;
+    uint32_t len = sr->len;
     int socket_id = (int32_t)req->data;
     LLOGD("socket[%d] udp sent %d %d", socket_id, status, len);
+    sent_stat(socket_id, sr->tag, len, sr->start, status);
 
     if (status == 0)
     {
@@ -742,7 +1447,7 @@ static void on_sent_udp(uv_udp_send_t *req, int status)
         // LLOGD("发送成功, 执行ERROR消息");
         cb_to_nw_task(EV_NW_SOCKET_ERROR, socket_id, 0, sockets[socket_id].param);
     }
-    luat_heap_free(req);
+    luat_heap_free(sr);
 }
 
 static void on_sent_void(uv_udp_send_t *req, int status) {}
@@ -753,14 +1458,13 @@ static int libuv_socket_send(int socket_id, uint64_t tag, const uint8_t *buf, ui
 
     uv_buf_t buff;
     int ret = 0;
-    char *tmp = NULL;
 
     // TCP
-    uv_write_t *req = NULL;
+    uv_write_req_t *req = NULL;
 
     // UDP
-    uv_udp_send_t *send_req = NULL;
-    struct sockaddr_in send_addr = {.sin_family = AF_INET};
+    uv_udp_send_req_t *send_req = NULL;
+    struct sockaddr_storage send_addr;
 
     if (len == 0)
         return 0;
@@ -773,37 +1477,34 @@ static int libuv_socket_send(int socket_id, uint64_t tag, const uint8_t *buf, ui
     // LLOGD("待发送的内容 %.*s", len, buf);
     if (sockets[socket_id].is_tcp)
     {
-        req = luat_heap_malloc(sizeof(uv_write_t) + 4);
-        memset(req, 0, sizeof(uv_write_t));
-        tmp = (char *)req;
-        tmp += sizeof(uv_write_t);
-        memcpy(tmp, &len, 4);
-        req->data = (void *)socket_id;
-        ret = uv_write(req, (uv_stream_t *)&sockets[socket_id].tcp, &buff, 1, on_sent);
+        req = luat_heap_malloc(sizeof(uv_write_req_t));
+        memset(req, 0, sizeof(uv_write_req_t));
+        req->len = len;
+        req->tag = tag;
+        req->start = uv_hrtime();
+        req->req.data = (void *)socket_id;
+        ret = uv_write(&req->req, (uv_stream_t *)sockets[socket_id].tcp, &buff, 1, on_sent);
         if (ret) {
             luat_heap_free(req);
             LLOGI("socket[%d] uv_write %d", socket_id, ret);
         }
+        else {
+            sockets[socket_id].stat.queued_bytes += len;
+            total_stat.queued_bytes += len;
+            SOCK_HIST(socket_id, queued, sockets[socket_id].stat.queued_bytes);
+        }
     }
     else
     {
-        send_req = luat_heap_malloc(sizeof(uv_udp_send_t) + 4);
-        memset(send_req, 0, sizeof(uv_udp_send_t));
-        tmp = (char *)send_req;
-        tmp += sizeof(uv_udp_send_t);
-        memcpy(tmp, &len, 4);
-        send_req->data = (void *)socket_id;
-        #ifdef LUAT_USE_LWIP
-        send_addr.sin_addr.s_addr = ip_2_ip4(remote_ip)->addr;
-        #else
-        send_addr.sin_addr.s_addr = remote_ip->ipv4;
-        #endif
-        send_addr.sin_port = htons(remote_port);
-        char addr[17] = {'\0'};
-        uv_ip4_name((struct sockaddr_in *)&send_addr, addr, 16);
-        // uv_ip4_addr(addr, remote_port, &send_addr);
+        send_req = luat_heap_malloc(sizeof(uv_udp_send_req_t));
+        memset(send_req, 0, sizeof(uv_udp_send_req_t));
+        send_req->len = len;
+        send_req->tag = tag;
+        send_req->start = uv_hrtime();
+        send_req->req.data = (void *)socket_id;
+        ip_to_sockaddr(remote_ip, remote_port, &send_addr);
         // LLOGD("UDP发送 %s:%d", addr, remote_port);
-        ret = uv_udp_send(send_req, &sockets[socket_id].udp, &buff, 1, (const struct sockaddr *)&send_addr, on_sent_udp);
+        ret = uv_udp_send(&send_req->req, &sockets[socket_id].udp, &buff, 1, (const struct sockaddr *)&send_addr, on_sent_udp);
         if (ret) {
             luat_heap_free(send_req);
             LLOGI("socket[%d] uv_udp_send %d %s", socket_id, ret, uv_err_name(ret));
@@ -850,6 +1551,11 @@ void libuv_socket_clean(int *vaild_socket_list, uint32_t num, void *user_data)
                 }
                 sockets[socket_id].udp_data = NULL;
             }
+            if (sockets[socket_id].tcp != NULL)
+            {
+                free_uv_handle(sockets[socket_id].tcp);
+                sockets[socket_id].tcp = NULL;
+            }
             sockets[socket_id].state = SC_IDLE;
             continue;
         }
@@ -862,7 +1568,11 @@ static int libuv_get_local_ip_info(luat_ip_addr_t *ip, luat_ip_addr_t *submask,
     uv_interface_address_t *info;
     int count, i;
 
-    uv_interface_addresses(&info, &count);
+    int ret = uv_interface_addresses(&info, &count);
+    if (ret) {
+        LLOGE("uv_interface_addresses %s", uv_strerror(ret));
+        return -1;
+    }
     i = count;
 
     // printf("Number of interfaces: %d\n", count);
@@ -892,8 +1602,40 @@ static int libuv_get_local_ip_info(luat_ip_addr_t *ip, luat_ip_addr_t *submask,
 
 static int libuv_get_full_ip_info(luat_ip_addr_t *ip, luat_ip_addr_t *submask, luat_ip_addr_t *gateway, luat_ip_addr_t *ipv6, void *user_data)
 {
-    LLOGI("获取全部本地IP信息, 未实现");
-    return -1;
+    char buf[64] = {0};
+    uv_interface_address_t *info;
+    int count, i;
+    int flag = 0;
+
+    if (libuv_get_local_ip_info(ip, submask, gateway, user_data) == 0)
+        flag = 1;
+    if (ipv6 == NULL)
+        return flag ? 0 : -1;
+
+    int ret = uv_interface_addresses(&info, &count);
+    if (ret) {
+        LLOGE("uv_interface_addresses %s", uv_strerror(ret));
+        return flag ? 0 : -1;
+    }
+    i = count;
+    // 取第一个非本地链路(fe80::/10)的IPv6地址
+    while (i--) {
+        uv_interface_address_t interface_a = info[i];
+        if (interface_a.is_internal || interface_a.address.address6.sin6_family != AF_INET6)
+            continue;
+        const uint8_t *addr = (const uint8_t *)&interface_a.address.address6.sin6_addr;
+        if (addr[0] == 0xfe && (addr[1] & 0xc0) == 0x80)
+            continue;
+        uv_ip6_name(&interface_a.address.address6, buf, sizeof(buf));
+        LLOGD("%s ipv6 addr: %s", interface_a.name, buf);
+        ip_set_ipv6(ipv6, addr);
+        flag = 1;
+        break;
+    }
+    uv_free_interface_addresses(info, count);
+    if (flag == 0)
+        return -1;
+    return 0;
 }
 
 static int libuv_user_cmd(int socket_id, uint64_t tag, uint32_t cmd, uint32_t value, void *user_data)
@@ -902,68 +1644,149 @@ static int libuv_user_cmd(int socket_id, uint64_t tag, uint32_t cmd, uint32_t va
     return 0;
 }
 
-static void on_resolved(uv_getaddrinfo_t *resolver, int status, struct addrinfo *res)
+static void on_dns_cache_result(const luat_dns_addr_t* addrs, size_t count, uint32_t ttl, void* userdata)
 {
-    uv_dns_query_t *query = resolver->data;
-    // LLOGD("dns result %d %p", status, query);
-    if (status < 0)
+    dns_timing_end(userdata);
+    if (count == 0)
     {
         LLOGD("dns query failed");
-        cb_to_nw_task(EV_NW_DNS_RESULT, 0, 0, query->param);
-        luat_heap_free(query);
+        cb_to_nw_task(EV_NW_DNS_RESULT, 0, 0, userdata);
+        return;
+    }
+    luat_dns_ip_result *ip_result = zalloc(sizeof(luat_dns_ip_result) * count);
+    if (ip_result == NULL)
+    {
+        LLOGE("out of memory when malloc dns result");
+        cb_to_nw_task(EV_NW_DNS_RESULT, 0, 0, userdata);
         return;
     }
-    char addr[17] = {'\0'};
-    uv_ip4_name((struct sockaddr_in *)res->ai_addr, addr, 16);
-    LLOGI("dns result ip %s", addr);
+    for (size_t i = 0; i < count; i++)
+    {
+        ip_from_dns_addr(&ip_result[i].ip, &addrs[i]);
+        ip_result[i].ttl_end = ttl;
+    }
+    char addr[64] = {'\0'};
+    uv_inet_ntop(addrs[0].family, addrs[0].addr, addr, sizeof(addr));
+    LLOGI("dns result ip %s, total %d", addr, (int)count);
+    cb_to_nw_task(EV_NW_DNS_RESULT, count, (int)ip_result, userdata);
+}
 
-    luat_dns_ip_result *ip_result = zalloc(sizeof(luat_dns_ip_result));
-    network_set_ip_ipv4(&ip_result->ip, ((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr);
-    ip_result->ttl_end = 60;
-    cb_to_nw_task(EV_NW_DNS_RESULT, 1, (int)ip_result, query->param);
-    luat_heap_free(query);
-    uv_freeaddrinfo(res);
+// Happy Eyeballs的DNS阶段, A和AAAA同时查询
+// 上报给上层的依然是A记录, AAAA记录留在缓存里, 连接时由he_candidates取出参与竞速
+// 只有AAAA记录的域名, 上报AAAA记录
+typedef struct he_dns
+{
+    uv_timer_t timer;
+    void *param;
+    uint8_t a_done;
+    uint8_t aaaa_done;
+    uint8_t reported;
+    uint8_t aaaa_count;
+    uint32_t ttl;
+    size_t count;
+    luat_dns_addr_t addrs[LUAT_DNS_CACHE_MAX_ADDR];
+} he_dns_t;
+
+static void he_dns_report(he_dns_t *d)
+{
+    if (d->reported)
+        return;
+    d->reported = 1;
+    uv_timer_stop(&d->timer);
+    on_dns_cache_result(d->addrs, d->count, d->ttl, d->param);
+    if (d->a_done && d->aaaa_done)
+        free_uv_handle(&d->timer);
 }
 
-static int libuv_dns(const char *domain_name, uint32_t len, void *param, void *user_data)
+static void on_he_dns_timer(uv_timer_t *timer)
 {
-    // LLOGD("执行libuv_dns %.*s %p", len, domain_name, param);
-    uv_dns_query_t *query = luat_heap_zalloc(sizeof(uv_dns_query_t));
-    if (query == NULL)
+    LLOGD("等待AAAA记录超时");
+    he_dns_report((he_dns_t *)timer->data);
+}
+
+static void on_he_dns_a(const luat_dns_addr_t* addrs, size_t count, uint32_t ttl, void* userdata)
+{
+    he_dns_t *d = (he_dns_t *)userdata;
+    d->a_done = 1;
+    if (count)
     {
-        LLOGE("out of memory when malloc dns query");
-        return -1;
+        memcpy(d->addrs, addrs, sizeof(luat_dns_addr_t) * count);
+        d->count = count;
+        d->ttl = ttl;
     }
-    memcpy(query->domain, domain_name, len);
-    query->param = param;
-    // query->user_data = user_data;
-    // LLOGD("query %p", query);
-
-    query->hints.ai_family = PF_INET;
-    query->hints.ai_socktype = SOCK_STREAM;
-    query->hints.ai_protocol = IPPROTO_TCP;
-    query->hints.ai_flags = 0;
-    query->resolver.data = query;
+    if (d->aaaa_done)
+    {
+        if (d->reported)
+            free_uv_handle(&d->timer);
+        else
+            he_dns_report(d);
+    }
+    else if (count)
+    {
+        uv_timer_start(&d->timer, on_he_dns_timer, HE_RESOLUTION_DELAY, 0);
+    }
+    // A记录解析失败, 等AAAA的结果
+}
 
-    int r = uv_getaddrinfo(main_loop, &query->resolver, on_resolved, query->domain, NULL, &query->hints);
+static void on_he_dns_aaaa(const luat_dns_addr_t* addrs, size_t count, uint32_t ttl, void* userdata)
+{
+    he_dns_t *d = (he_dns_t *)userdata;
+    d->aaaa_done = 1;
+    if (d->a_done && d->count == 0 && count)
+    {
+        memcpy(d->addrs, addrs, sizeof(luat_dns_addr_t) * count);
+        d->count = count;
+        d->ttl = ttl;
+    }
+    if (!d->a_done)
+        return;
+    if (d->reported)
+        free_uv_handle(&d->timer);
+    else
+        he_dns_report(d);
+}
 
-    if (r != 0)
+static int libuv_dns(const char *domain_name, uint32_t len, void *param, void *user_data)
+{
+    // LLOGD("执行libuv_dns %.*s %p", len, domain_name, param);
+    int r = 0;
+    dns_timing_begin(param);
+    if (!he_enable)
+    {
+        r = luat_dns_cache_query(domain_name, len, AF_INET, on_dns_cache_result, param);
+        if (r != 0)
+        {
+            cb_to_nw_task(EV_NW_DNS_RESULT, 0, 0, param);
+        }
+        return r;
+    }
+    he_dns_t *d = luat_heap_zalloc(sizeof(he_dns_t));
+    if (d == NULL)
     {
-        LLOGI("uv_getaddrinfo %d", r);
-        luat_heap_free(query);
+        LLOGE("out of memory when malloc he dns ctx");
         cb_to_nw_task(EV_NW_DNS_RESULT, 0, 0, param);
+        return -1;
     }
-    return r;
+    d->param = param;
+    uv_timer_init(main_loop, &d->timer);
+    d->timer.data = d;
+    // 缓存命中时回调是同步执行的, 所以先发起AAAA查询
+    if (luat_dns_cache_query(domain_name, len, AF_INET6, on_he_dns_aaaa, d))
+        on_he_dns_aaaa(NULL, 0, 0, d);
+    if (luat_dns_cache_query(domain_name, len, AF_INET, on_he_dns_a, d))
+        on_he_dns_a(NULL, 0, 0, d);
+    return 0;
 }
 
 static int libuv_dns_ipv6(const char *domain_name, uint32_t len, void *param, void *user_data)
 {
-    LLOGD("执行libuv_dns_ipv6, 未实现");
-    // char* ptr = luat_heap_malloc(len + 1);
-    // memcpy(ptr, domain_name, len);
-    // ptr[len] = 0x00;
-    // libuv_send_event(EV_LIBUV_SOCKET_DNS_IPV6, ptr, 0); // TODO 检查返回值
-    return -1;
+    dns_timing_begin(param);
+    int r = luat_dns_cache_query(domain_name, len, AF_INET6, on_dns_cache_result, param);
+    if (r != 0)
+    {
+        cb_to_nw_task(EV_NW_DNS_RESULT, 0, 0, param);
+    }
+    return r;
 }
 
 static int libuv_set_dns_server(uint8_t server_index, luat_ip_addr_t *ip, void *user_data)
@@ -997,14 +1820,40 @@ static void libuv_socket_set_callback(CBFuncEx_t cb_fun, void *param, void *user
 
 int libuv_getsockopt2(int socket_id, uint64_t tag, int level, int optname, void *optval, uint32_t *optlen, void *user_data)
 {
-    LLOGD("not support yet: getsockopt");
+    CHECK_SOCKET_ID
+
+    int opt = sockopt_map(level, optname);
+    int value = 0;
+    if (opt < 0 || optval == NULL || optlen == NULL || *optlen < sizeof(int))
+    {
+        LLOGD("socket[%d] getsockopt 不支持的选项 %d %d", socket_id, level, optname);
+        return -1;
+    }
+    if (luat_libuv_sockopt_get(socket_id, opt, &value))
+        return -1;
+    memcpy(optval, &value, sizeof(int));
+    *optlen = sizeof(int);
     return 0;
 }
 
 int libuv_setsockopt2(int socket_id, uint64_t tag, int level, int optname, const void *optval, uint32_t optlen, void *user_data)
 {
-    LLOGD("not support yet: setsockopt");
-    return 0;
+    CHECK_SOCKET_ID
+
+    int opt = sockopt_map(level, optname);
+    int value = 0;
+    if (opt < 0 || optval == NULL || optlen == 0)
+    {
+        LLOGD("socket[%d] setsockopt 不支持的选项 %d %d", socket_id, level, optname);
+        return -1;
+    }
+    // 上层有可能传uint8_t
+    if (optlen >= sizeof(int))
+        memcpy(&value, optval, sizeof(int));
+    else
+        value = *(const uint8_t *)optval;
+    LLOGD("socket[%d] setsockopt %d = %d", socket_id, opt, value);
+    return luat_libuv_sockopt_set(socket_id, opt, value);
 }
 
 static const network_adapter_info prv_libuv_adapter =
@@ -1076,6 +1925,7 @@ static void ip_ready_timer_cb(uv_timer_t *t)
 void luat_network_init(void)
 {
     network_register_adapter(NW_ADAPTER_INDEX_ETH0, &prv_libuv_adapter, NULL);
+    luat_vnet_init();
 
     // 延时500ms后发布联网成功的消息
 
@@ -1085,6 +1935,105 @@ void luat_network_init(void)
     uv_timer_start(t, ip_ready_timer_cb, 500, 0);
 }
 
+int luat_libuv_conn_info(int socket_id, luat_libuv_conn_info_t* info)
+{
+    if (socket_id < 0 || socket_id >= MAX_SOCK_NUM || sockets[socket_id].tag == 0)
+        return -1;
+    info->state = sockets[socket_id].state;
+    info->is_tcp = sockets[socket_id].is_tcp;
+    info->family = sockets[socket_id].family;
+    info->attempts = sockets[socket_id].attempts;
+    info->connect_ns = sockets[socket_id].connect_ns;
+    return 0;
+}
+
+const luat_libuv_sock_stat_t* luat_libuv_sock_stat(int socket_id)
+{
+    if (socket_id == -1)
+        return &total_stat;
+    if (socket_id < 0 || socket_id >= MAX_SOCK_NUM || sockets[socket_id].tag == 0)
+        return NULL;
+    return &sockets[socket_id].stat;
+}
+
+void luat_libuv_sock_stat_reset(int socket_id)
+{
+    if (socket_id == -1)
+    {
+        // 排队字节数是实时值, 不能清零
+        uint32_t queued_bytes = total_stat.queued_bytes;
+        memset(&total_stat, 0, sizeof(luat_libuv_sock_stat_t));
+        total_stat.queued_bytes = queued_bytes;
+    }
+    else if (socket_id >= 0 && socket_id < MAX_SOCK_NUM)
+    {
+        uint32_t queued_bytes = sockets[socket_id].stat.queued_bytes;
+        memset(&sockets[socket_id].stat, 0, sizeof(luat_libuv_sock_stat_t));
+        sockets[socket_id].stat.queued_bytes = queued_bytes;
+    }
+}
+
+const char* luat_libuv_state_name(int state)
+{
+    return socket_state_str(state);
+}
+
+static void stat_dump_one(const char *name, const luat_libuv_sock_stat_t *stat)
+{
+    char connect[64], dns[64], write[64], rx[64];
+    luat_hist_sprint(connect, sizeof(connect), &stat->connect_us);
+    luat_hist_sprint(dns, sizeof(dns), &stat->dns_us);
+    luat_hist_sprint(write, sizeof(write), &stat->write_us);
+    luat_hist_sprint(rx, sizeof(rx), &stat->rx_chunk);
+    LLOGI("%s tx %llu/%u rx %llu/%u err %u queued %u trans %u | connect %s dns %s write %s rx %s",
+          name, (unsigned long long)stat->tx_bytes, stat->tx_count, (unsigned long long)stat->rx_bytes, stat->rx_count,
+          stat->tx_err, stat->queued_bytes, stat->transitions, connect, dns, write, rx);
+}
+
+void luat_libuv_stat_dump(void)
+{
+    char name[32];
+    LLOGI("socket统计, 直方图格式 count/avg/p50/p99/max, 时间单位us, 长度单位字节");
+    for (size_t i = 0; i < MAX_SOCK_NUM; i++)
+    {
+        if (sockets[i].tag == 0)
+            continue;
+        snprintf(name, sizeof(name), "socket[%d] %s", (int)i, socket_state_str(sockets[i].state));
+        stat_dump_one(name, &sockets[i].stat);
+    }
+    stat_dump_one("total", &total_stat);
+}
+
+static uv_timer_t *stat_dump_timer;
+
+static void on_stat_dump_timer(uv_timer_t *timer)
+{
+    (void)timer;
+    luat_libuv_stat_dump();
+}
+
+void luat_libuv_stat_dump_interval(uint32_t ms)
+{
+    if (stat_dump_timer)
+    {
+        free_uv_handle(stat_dump_timer);
+        stat_dump_timer = NULL;
+    }
+    if (ms == 0)
+        return;
+    stat_dump_timer = luat_heap_malloc(sizeof(uv_timer_t));
+    if (stat_dump_timer == NULL)
+        return;
+    uv_timer_init(main_loop, stat_dump_timer);
+    uv_timer_start(stat_dump_timer, on_stat_dump_timer, ms, ms);
+}
+
+void luat_libuv_he_config(int enable, uint32_t delay_ms)
+{
+    he_enable = enable ? 1 : 0;
+    he_delay = delay_ms;
+}
+
 #ifndef LUAT_USE_LWIP
 int net_lwip_check_all_ack(int socket_id) {
     return 0;
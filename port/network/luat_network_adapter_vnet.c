@@ -0,0 +1,904 @@
+
+#include "uv.h"
+#include "luat_base.h"
+#include "luat_malloc.h"
+#include "luat_msgbus.h"
+
+#include "luat_network_adapter.h"
+#include "luat_network_pc.h"
+
+#define LUAT_LOG_TAG "vnet"
+#include "luat_log.h"
+
+// 进程内的虚拟网络
+// socket不经过操作系统, 直接连到本进程内的端点(echo/discard/source或者自定义的C/Lua处理函数)
+// 端点按端口区分, 不关心IP. 每个端点可以设置链路的延时/带宽/丢包率, 全部由main_loop上的一个定时器驱动
+// 链路模型:
+// 1. 每个方向是一条串行链路, 数据按带宽排队发送, 发送完成的时刻再加上延时就是到达时刻
+// 2. TCP按MSS分段, 丢包的分段在RTO后重传, 并且阻塞后续分段(队头阻塞), UDP丢包直接丢弃
+// 3. TCP建立连接需要1个RTT
+
+#define VNET_MAX_SOCK       16
+#define VNET_MAX_ENDPOINT   8
+#define VNET_MSS            1460
+// source端点每次产生的数据量
+#define VNET_SOURCE_CHUNK   (VNET_MSS * 4)
+// 客户端未读取的数据超过这个值, source端点暂停发送
+#define VNET_RX_HIGH_WATER  (64 * 1024)
+// 最小重传超时, 毫秒
+#define VNET_MIN_RTO        200
+
+#ifndef LUAT_CONF_NETWORK_DEBUG
+#define LUAT_CONF_NETWORK_DEBUG 0
+#endif
+
+#if (LUAT_CONF_NETWORK_DEBUG == 0)
+#undef LLOGD
+#define LLOGD(...)
+#endif
+
+enum
+{
+    VS_IDLE,
+    VS_USED,
+    VS_CONNECTING,
+    VS_CONNECTED,
+    VS_CLOSING,
+    VS_CLOSED
+};
+
+enum
+{
+    VI_DNS,         // 域名解析结果
+    VI_CONNECT,     // 连接建立/被拒绝
+    VI_TO_EP,       // 数据到达端点
+    VI_TO_CLIENT,   // 数据到达客户端
+    VI_TX_OK,       // 客户端的数据已经发送到链路上
+    VI_EP_CLOSE,    // 客户端关闭的通知到达端点
+    VI_CLIENT_CLOSE,// 端点关闭的通知到达客户端
+    VI_CLOSE_OK,    // 客户端主动关闭完成
+    VI_SOURCE,      // source端点继续产生数据
+};
+
+typedef struct vnet_item
+{
+    struct vnet_item *next;
+    uint64_t due;       // 微秒, 与vnet_now_us同一时基
+    uint8_t type;
+    int sock;
+    uint64_t tag;
+    void *param;
+    size_t len;
+    uint8_t data[4];
+} vnet_item_t;
+
+typedef struct vnet_chunk
+{
+    struct vnet_chunk *next;
+    size_t len;
+    size_t offset;
+    uint8_t data[4];
+} vnet_chunk_t;
+
+// 单个方向的链路
+typedef struct vnet_dir
+{
+    uint64_t link_free;     // 链路空闲的时刻
+    uint64_t last_due;      // 最后一个分段的到达时刻, 保证TCP按序到达
+} vnet_dir_t;
+
+typedef struct vnet_endpoint
+{
+    uint16_t port;
+    uint8_t used;
+    uint8_t kind;
+    luat_vnet_link_t link;
+    uint64_t source_size;
+    luat_vnet_handler handler;
+    void *userdata;
+    uint32_t rand;
+    luat_vnet_endpoint_stat_t stat;
+} vnet_endpoint_t;
+
+typedef struct vnet_sock
+{
+    uint64_t tag;
+    void *param;
+    uint8_t state;
+    uint8_t is_tcp;
+    uint8_t ep_open;        // 端点还认为连接是打开的
+    uint8_t source_paused;
+    vnet_endpoint_t *ep;
+    vnet_dir_t up;          // 客户端 -> 端点
+    vnet_dir_t down;        // 端点 -> 客户端
+    vnet_chunk_t *rx_head;
+    vnet_chunk_t *rx_tail;
+    size_t rx_size;
+    uint64_t source_left;
+} vnet_sock_t;
+
+typedef struct
+{
+    CBFuncEx_t socket_cb;
+    void *user_data;
+    uint8_t next_socket_index;
+} vnet_ctrl_t;
+
+extern uv_loop_t *main_loop;
+
+static vnet_ctrl_t ctrl;
+static vnet_sock_t socks[VNET_MAX_SOCK];
+static vnet_endpoint_t endpoints[VNET_MAX_ENDPOINT];
+static uint64_t sock_tag_counter = 0xF0F0;
+static vnet_item_t *items;
+static uv_timer_t *vnet_timer;
+static uint32_t vnet_ip; // 虚拟网络里全部远端地址, 10.0.0.1
+
+#define CHECK_SOCKET_ID                                         \
+    if (socket_id < 0 || socket_id >= VNET_MAX_SOCK)            \
+    {                                                           \
+        LLOGE("socket id不合法 %d", socket_id);                  \
+        return -1;                                              \
+    }                                                           \
+    if (socks[socket_id].tag == 0 || socks[socket_id].tag != tag) \
+    {                                                           \
+        LLOGD("socket[%d] tag不匹配或已关闭", socket_id);         \
+        return -1;                                              \
+    }
+
+static uint64_t vnet_now_us(void)
+{
+    return uv_hrtime() / 1000;
+}
+
+static void vnet_schedule(void);
+
+//---------------------------------------
+// 事件
+//---------------------------------------
+
+static void vnet_event(uint32_t event_id, int socket_id, uint32_t param2, void *param3, uint64_t tag)
+{
+    OS_EVENT event = {.ID = event_id, .Param1 = socket_id, .Param2 = param2, .Param3 = (uint32_t)param3};
+    luat_network_cb_param_t param = {.tag = tag, .param = ctrl.user_data};
+    LLOGD("socket[%d] 发送nw_task消息 %08X", socket_id, event_id);
+    ctrl.socket_cb(&event, &param);
+}
+
+static void vnet_sock_event(uint32_t event_id, int socket_id, uint32_t param2)
+{
+    vnet_event(event_id, socket_id, param2, socks[socket_id].param, socks[socket_id].tag);
+}
+
+//---------------------------------------
+// 调度
+//---------------------------------------
+
+static vnet_item_t *item_new(uint8_t type, int sock, const uint8_t *data, size_t len)
+{
+    vnet_item_t *it = luat_heap_malloc(sizeof(vnet_item_t) + len);
+    if (it == NULL)
+    {
+        LLOGE("out of memory when malloc vnet item");
+        return NULL;
+    }
+    memset(it, 0, sizeof(vnet_item_t));
+    it->type = type;
+    it->sock = sock;
+    if (sock >= 0)
+        it->tag = socks[sock].tag;
+    it->len = len;
+    if (len)
+        memcpy(it->data, data, len);
+    return it;
+}
+
+// 按到达时刻插入, 时刻相同的保持先后顺序
+static void item_insert(vnet_item_t *it, uint64_t due)
+{
+    vnet_item_t **pp = &items;
+    it->due = due;
+    while (*pp && (*pp)->due <= due)
+        pp = &(*pp)->next;
+    it->next = *pp;
+    *pp = it;
+    vnet_schedule();
+}
+
+static int item_post(uint8_t type, int sock, const uint8_t *data, size_t len, uint64_t due)
+{
+    vnet_item_t *it = item_new(type, sock, data, len);
+    if (it == NULL)
+        return -1;
+    item_insert(it, due);
+    return 0;
+}
+
+static uint32_t vnet_rand(vnet_endpoint_t *ep)
+{
+    // xorshift32, 每个端点固定种子, 保证结果可复现
+    uint32_t x = ep->rand;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    ep->rand = x;
+    return x;
+}
+
+// 把一段数据放到链路上, 返回到达时刻, 丢包时lost置1
+static uint64_t link_transmit(vnet_sock_t *s, vnet_dir_t *dir, size_t len, int *lost)
+{
+    vnet_endpoint_t *ep = s->ep;
+    uint64_t now = vnet_now_us();
+    // 端点已经撤销, 数据没有去处
+    if (ep == NULL)
+    {
+        *lost = 1;
+        return now;
+    }
+    uint64_t start = dir->link_free > now ? dir->link_free : now;
+    uint64_t ser = ep->link.bandwidth ? (uint64_t)len * 1000000 / ep->link.bandwidth : 0;
+    uint64_t latency = (uint64_t)ep->link.latency_ms * 1000;
+    dir->link_free = start + ser;
+    uint64_t due = dir->link_free + latency;
+    *lost = 0;
+    if (ep->link.loss && vnet_rand(ep) % 10000 < ep->link.loss)
+    {
+        ep->stat.lost++;
+        *lost = 1;
+        if (s->is_tcp)
+        {
+            // TCP重传, 按RTO推迟到达
+            uint64_t rto = ep->link.latency_ms * 4 > VNET_MIN_RTO ? ep->link.latency_ms * 4 : VNET_MIN_RTO;
+            due += rto * 1000;
+            ep->stat.retrans++;
+            *lost = 0;
+        }
+    }
+    if (s->is_tcp)
+    {
+        if (due < dir->last_due)
+            due = dir->last_due;
+        dir->last_due = due;
+    }
+    return due;
+}
+
+// 把数据按链路模型发出去, type是到达时的事件, 返回最后一个分段发送完成的时刻
+static uint64_t link_send(int sock, vnet_dir_t *dir, uint8_t type, const uint8_t *data, size_t len)
+{
+    vnet_sock_t *s = &socks[sock];
+    size_t mss = s->is_tcp ? VNET_MSS : len;
+    size_t offset = 0;
+    int lost = 0;
+    do
+    {
+        size_t seg = len - offset > mss ? mss : len - offset;
+        uint64_t due = link_transmit(s, dir, seg, &lost);
+        if (!lost)
+            item_post(type, sock, data + offset, seg, due);
+        offset += seg;
+    } while (offset < len);
+    return dir->link_free;
+}
+
+//---------------------------------------
+// 端点
+//---------------------------------------
+
+static vnet_endpoint_t *endpoint_find(uint16_t port)
+{
+    for (size_t i = 0; i < VNET_MAX_ENDPOINT; i++)
+    {
+        if (endpoints[i].used && endpoints[i].port == port)
+            return &endpoints[i];
+    }
+    return NULL;
+}
+
+static void source_pump(int sock)
+{
+    vnet_sock_t *s = &socks[sock];
+    uint8_t buff[VNET_SOURCE_CHUNK];
+    if (s->state != VS_CONNECTED || !s->ep_open || s->source_left == 0)
+        return;
+    if (s->rx_size >= VNET_RX_HIGH_WATER)
+    {
+        s->source_paused = 1;
+        return;
+    }
+    s->source_paused = 0;
+    size_t len = s->source_left > VNET_SOURCE_CHUNK ? VNET_SOURCE_CHUNK : (size_t)s->source_left;
+    for (size_t i = 0; i < len; i++)
+        buff[i] = (uint8_t)(' ' + i % 95);
+    if (s->source_left != UINT64_MAX)
+        s->source_left -= len;
+    s->ep->stat.tx_bytes += len;
+    uint64_t done = link_send(sock, &s->down, VI_TO_CLIENT, buff, len);
+    // 链路发送完这一段后再产生下一段
+    item_post(VI_SOURCE, sock, NULL, 0, done);
+}
+
+static void endpoint_on_connect(int sock)
+{
+    vnet_sock_t *s = &socks[sock];
+    s->ep->stat.conns++;
+    s->ep_open = 1;
+    if (s->ep->kind == LUAT_VNET_SOURCE)
+    {
+        s->source_left = s->ep->source_size ? s->ep->source_size : UINT64_MAX;
+        source_pump(sock);
+    }
+    else if (s->ep->kind == LUAT_VNET_CUSTOM && s->ep->handler)
+    {
+        s->ep->handler(s->ep->port, sock, LUAT_VNET_EV_CONNECT, NULL, 0, s->ep->userdata);
+    }
+}
+
+static void endpoint_on_data(int sock, const uint8_t *data, size_t len)
+{
+    vnet_sock_t *s = &socks[sock];
+    vnet_endpoint_t *ep = s->ep;
+    ep->stat.rx_bytes += len;
+    ep->stat.rx_pkts++;
+    switch (ep->kind)
+    {
+    case LUAT_VNET_ECHO:
+        luat_vnet_send(sock, data, len);
+        break;
+    case LUAT_VNET_CUSTOM:
+        if (ep->handler)
+            ep->handler(ep->port, sock, LUAT_VNET_EV_DATA, data, len, ep->userdata);
+        break;
+    default:
+        break;
+    }
+}
+
+static void endpoint_on_close(int sock)
+{
+    vnet_sock_t *s = &socks[sock];
+    if (!s->ep_open)
+        return;
+    s->ep_open = 0;
+    if (s->ep->kind == LUAT_VNET_CUSTOM && s->ep->handler)
+        s->ep->handler(s->ep->port, sock, LUAT_VNET_EV_CLOSE, NULL, 0, s->ep->userdata);
+}
+
+//---------------------------------------
+// 事件处理
+//---------------------------------------
+
+static void rx_append(int sock, const uint8_t *data, size_t len)
+{
+    vnet_sock_t *s = &socks[sock];
+    vnet_chunk_t *c = luat_heap_malloc(sizeof(vnet_chunk_t) + len);
+    if (c == NULL)
+    {
+        LLOGE("socket[%d] out of memory when malloc rx chunk", sock);
+        return;
+    }
+    c->next = NULL;
+    c->len = len;
+    c->offset = 0;
+    memcpy(c->data, data, len);
+    if (s->rx_tail)
+        s->rx_tail->next = c;
+    else
+        s->rx_head = c;
+    s->rx_tail = c;
+    s->rx_size += len;
+}
+
+static void rx_free(vnet_sock_t *s)
+{
+    vnet_chunk_t *c = s->rx_head;
+    while (c)
+    {
+        vnet_chunk_t *next = c->next;
+        luat_heap_free(c);
+        c = next;
+    }
+    s->rx_head = NULL;
+    s->rx_tail = NULL;
+    s->rx_size = 0;
+}
+
+static void item_handle(vnet_item_t *it)
+{
+    vnet_sock_t *s = it->sock >= 0 ? &socks[it->sock] : NULL;
+    if (it->type == VI_DNS)
+    {
+        luat_dns_ip_result *ip_result = zalloc(sizeof(luat_dns_ip_result));
+        if (ip_result == NULL)
+        {
+            vnet_event(EV_NW_DNS_RESULT, 0, 0, it->param, 0);
+            return;
+        }
+        network_set_ip_ipv4(&ip_result->ip, vnet_ip);
+        ip_result->ttl_end = 600;
+        vnet_event(EV_NW_DNS_RESULT, 1, (uint32_t)ip_result, it->param, 0);
+        return;
+    }
+    // 端点侧的事件不受客户端tag影响, 端点需要知道连接关闭
+    if (it->type == VI_EP_CLOSE)
+    {
+        endpoint_on_close(it->sock);
+        return;
+    }
+    if (s->tag != it->tag || s->tag == 0)
+        return;
+    switch (it->type)
+    {
+    case VI_CONNECT:
+        if (s->state != VS_CONNECTING)
+            break;
+        if (s->ep == NULL)
+        {
+            s->state = VS_CLOSED;
+            vnet_sock_event(EV_NW_SOCKET_ERROR, it->sock, 0);
+            break;
+        }
+        s->state = VS_CONNECTED;
+        vnet_sock_event(EV_NW_SOCKET_CONNECT_OK, it->sock, 0);
+        endpoint_on_connect(it->sock);
+        break;
+    case VI_TO_EP:
+        if (s->ep_open)
+            endpoint_on_data(it->sock, it->data, it->len);
+        break;
+    case VI_TO_CLIENT:
+        if (s->state != VS_CONNECTED && s->state != VS_CLOSING)
+            break;
+        rx_append(it->sock, it->data, it->len);
+        vnet_sock_event(EV_NW_SOCKET_RX_NEW, it->sock, it->len);
+        break;
+    case VI_TX_OK:
+        vnet_sock_event(EV_NW_SOCKET_TX_OK, it->sock, it->len);
+        break;
+    case VI_CLIENT_CLOSE:
+        if (s->state == VS_CONNECTED)
+        {
+            s->state = VS_CLOSING;
+            vnet_sock_event(EV_NW_SOCKET_REMOTE_CLOSE, it->sock, 0);
+        }
+        break;
+    case VI_CLOSE_OK:
+        s->state = VS_CLOSED;
+        vnet_sock_event(EV_NW_SOCKET_CLOSE_OK, it->sock, 0);
+        s->tag = 0;
+        break;
+    case VI_SOURCE:
+        source_pump(it->sock);
+        break;
+    }
+}
+
+static void on_vnet_timer(uv_timer_t *timer)
+{
+    (void)timer;
+    uint64_t now = vnet_now_us();
+    while (items && items->due <= now)
+    {
+        vnet_item_t *it = items;
+        items = it->next;
+        item_handle(it);
+        luat_heap_free(it);
+    }
+    vnet_schedule();
+}
+
+static void vnet_schedule(void)
+{
+    if (vnet_timer == NULL)
+        return;
+    if (items == NULL)
+    {
+        uv_timer_stop(vnet_timer);
+        return;
+    }
+    uint64_t now = vnet_now_us();
+    uint64_t timeout = items->due > now ? (items->due - now + 999) / 1000 : 0;
+    uv_timer_start(vnet_timer, on_vnet_timer, timeout, 0);
+}
+
+//---------------------------------------
+// network_adapter_info
+//---------------------------------------
+
+static uint8_t vnet_check_ready(void *user_data)
+{
+    (void)user_data;
+    return 1;
+}
+
+static int vnet_create_socket(uint8_t is_tcp, uint64_t *tag, void *param, uint8_t is_ipv6, void *user_data)
+{
+    for (size_t iz = 0; iz < VNET_MAX_SOCK; iz++)
+    {
+        size_t i = (iz + ctrl.next_socket_index) % VNET_MAX_SOCK;
+        vnet_sock_t *s = &socks[i];
+        // 端点还没收到关闭通知的不能复用, 否则端点会把两个连接当成一个
+        if (s->tag || s->ep_open || (s->state != VS_IDLE && s->state != VS_CLOSED))
+            continue;
+        rx_free(s);
+        memset(s, 0, sizeof(vnet_sock_t));
+        s->tag = sock_tag_counter++;
+        s->param = param;
+        s->is_tcp = is_tcp;
+        s->state = VS_USED;
+        *tag = s->tag;
+        ctrl.next_socket_index = i + 1;
+        return i;
+    }
+    LLOGE("没有空闲的socket可创建了");
+    return -1;
+}
+
+static int vnet_socket_connect(int socket_id, uint64_t tag, uint16_t local_port, luat_ip_addr_t *remote_ip, uint16_t remote_port, void *user_data)
+{
+    CHECK_SOCKET_ID
+    vnet_sock_t *s = &socks[socket_id];
+    uint64_t now = vnet_now_us();
+    s->ep = endpoint_find(remote_port);
+    s->state = VS_CONNECTING;
+    if (s->ep == NULL)
+    {
+        LLOGW("socket[%d] 端口%d没有端点, 连接被拒绝", socket_id, remote_port);
+        return item_post(VI_CONNECT, socket_id, NULL, 0, now);
+    }
+    s->up.link_free = s->up.last_due = now;
+    s->down.link_free = s->down.last_due = now;
+    // TCP握手需要1个RTT
+    uint64_t rtt = s->is_tcp ? (uint64_t)s->ep->link.latency_ms * 2000 : 0;
+    return item_post(VI_CONNECT, socket_id, NULL, 0, now + rtt);
+}
+
+static int vnet_socket_listen(int socket_id, uint64_t tag, uint16_t local_port, void *user_data)
+{
+    LLOGI("socket[%d] 执行listen, 未支持", socket_id);
+    return -1;
+}
+
+static int vnet_socket_accept(int socket_id, uint64_t tag, luat_ip_addr_t *remote_ip, uint16_t *remote_port, void *user_data)
+{
+    LLOGI("socket[%d] 执行accept, 未支持", socket_id);
+    return -1;
+}
+
+// 客户端关闭, 等已发出的数据全部到达端点后, 端点再收到关闭通知
+static void sock_close(int socket_id, int notify)
+{
+    vnet_sock_t *s = &socks[socket_id];
+    if (s->ep && s->ep_open)
+    {
+        uint64_t due = s->up.last_due > vnet_now_us() ? s->up.last_due : vnet_now_us();
+        item_post(VI_EP_CLOSE, socket_id, NULL, 0, due + (uint64_t)s->ep->link.latency_ms * 1000);
+    }
+    if (notify)
+    {
+        s->state = VS_CLOSING;
+        item_post(VI_CLOSE_OK, socket_id, NULL, 0, vnet_now_us());
+    }
+    else
+    {
+        s->state = VS_CLOSED;
+        s->tag = 0;
+    }
+}
+
+static int vnet_socket_disconnect(int socket_id, uint64_t tag, void *user_data)
+{
+    CHECK_SOCKET_ID
+    if (socks[socket_id].state == VS_CLOSED)
+        return 0;
+    sock_close(socket_id, 1);
+    return 0;
+}
+
+static int vnet_socket_close(int socket_id, uint64_t tag, void *user_data)
+{
+    return vnet_socket_disconnect(socket_id, tag, user_data);
+}
+
+static int vnet_socket_force_close(int socket_id, void *user_data)
+{
+    if (socket_id < 0 || socket_id >= VNET_MAX_SOCK)
+        return -1;
+    if (socks[socket_id].tag == 0 || socks[socket_id].state == VS_CLOSED)
+        return 0;
+    sock_close(socket_id, 0);
+    return 0;
+}
+
+static int vnet_socket_receive(int socket_id, uint64_t tag, uint8_t *buf, uint32_t len, int flags, luat_ip_addr_t *remote_ip, uint16_t *remote_port, void *user_data)
+{
+    CHECK_SOCKET_ID
+    vnet_sock_t *s = &socks[socket_id];
+    if (buf == NULL)
+        return s->is_tcp ? s->rx_size : (s->rx_head ? s->rx_head->len : 0);
+    if (remote_ip)
+        network_set_ip_ipv4(remote_ip, vnet_ip);
+    if (remote_port && s->ep)
+        *remote_port = s->ep->port;
+    uint32_t total = 0;
+    while (s->rx_head && total < len)
+    {
+        vnet_chunk_t *c = s->rx_head;
+        size_t n = c->len - c->offset;
+        if (n > len - total)
+            n = len - total;
+        memcpy(buf + total, c->data + c->offset, n);
+        c->offset += n;
+        total += n;
+        s->rx_size -= n;
+        // UDP每次只读一个包, 没读完的部分丢弃
+        if (c->offset == c->len || !s->is_tcp)
+        {
+            s->rx_size -= c->len - c->offset;
+            s->rx_head = c->next;
+            if (s->rx_head == NULL)
+                s->rx_tail = NULL;
+            luat_heap_free(c);
+        }
+        if (!s->is_tcp)
+            break;
+    }
+    // 暂停时source_pump的链已经断了, 只续上一条, 之后的读取不再重复投递
+    if (s->source_paused && s->rx_size < VNET_RX_HIGH_WATER / 2)
+    {
+        s->source_paused = 0;
+        item_post(VI_SOURCE, socket_id, NULL, 0, vnet_now_us());
+    }
+    return total;
+}
+
+static int vnet_socket_send(int socket_id, uint64_t tag, const uint8_t *buf, uint32_t len, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port, void *user_data)
+{
+    CHECK_SOCKET_ID
+    vnet_sock_t *s = &socks[socket_id];
+    if (len == 0)
+        return 0;
+    if (s->state != VS_CONNECTED)
+    {
+        LLOGW("socket[%d] 链接没建立,不能发送数据", socket_id);
+        return -1;
+    }
+    uint64_t done = link_send(socket_id, &s->up, VI_TO_EP, buf, len);
+    // 数据全部发送到链路上之后才算发送完成, 这样带宽限制能反映到上层
+    vnet_item_t *it = item_new(VI_TX_OK, socket_id, NULL, 0);
+    if (it == NULL)
+        return -1;
+    it->len = len;
+    item_insert(it, done);
+    return len;
+}
+
+static int vnet_socket_check(int socket_id, uint64_t tag, void *user_data)
+{
+    if (socket_id < 0 || socket_id >= VNET_MAX_SOCK)
+        return -1;
+    return socks[socket_id].tag == tag ? 0 : -1;
+}
+
+static void vnet_socket_clean(int *vaild_socket_list, uint32_t num, void *user_data)
+{
+    for (size_t i = 0; i < num; i++)
+    {
+        int socket_id = vaild_socket_list[i];
+        if (socket_id < 0 || socket_id >= VNET_MAX_SOCK)
+            continue;
+        if (socks[socket_id].tag == 0 || socks[socket_id].state == VS_CLOSED)
+        {
+            rx_free(&socks[socket_id]);
+            socks[socket_id].state = VS_IDLE;
+        }
+    }
+}
+
+static int vnet_getsockopt(int socket_id, uint64_t tag, int level, int optname, void *optval, uint32_t *optlen, void *user_data)
+{
+    return -1;
+}
+
+static int vnet_setsockopt(int socket_id, uint64_t tag, int level, int optname, const void *optval, uint32_t optlen, void *user_data)
+{
+    // 虚拟链路没有这些选项, 直接忽略
+    return 0;
+}
+
+static int vnet_user_cmd(int socket_id, uint64_t tag, uint32_t cmd, uint32_t value, void *user_data)
+{
+    return 0;
+}
+
+static int vnet_dns(const char *domain_name, uint32_t len, void *param, void *user_data)
+{
+    // 任意域名都解析到同一个地址, 端点只按端口区分
+    vnet_item_t *it = item_new(VI_DNS, -1, NULL, 0);
+    if (it == NULL)
+        return -1;
+    it->param = param;
+    item_insert(it, vnet_now_us());
+    return 0;
+}
+
+static int vnet_set_dns_server(uint8_t server_index, luat_ip_addr_t *ip, void *user_data)
+{
+    return 0;
+}
+
+static int vnet_set_mac(uint8_t *mac, void *user_data)
+{
+    return 0;
+}
+
+static int vnet_set_static_ip(luat_ip_addr_t *ip, luat_ip_addr_t *submask, luat_ip_addr_t *gateway, luat_ip_addr_t *ipv6, void *user_data)
+{
+    return 0;
+}
+
+static int vnet_get_local_ip_info(luat_ip_addr_t *ip, luat_ip_addr_t *submask, luat_ip_addr_t *gateway, void *user_data)
+{
+    // 10.0.0.2/24, 网关10.0.0.1
+    network_set_ip_ipv4(ip, vnet_ip + 0x01000000);
+    network_set_ip_ipv4(submask, 0x00FFFFFF);
+    network_set_ip_ipv4(gateway, vnet_ip);
+    return 0;
+}
+
+static int vnet_get_full_ip_info(luat_ip_addr_t *ip, luat_ip_addr_t *submask, luat_ip_addr_t *gateway, luat_ip_addr_t *ipv6, void *user_data)
+{
+    return vnet_get_local_ip_info(ip, submask, gateway, user_data);
+}
+
+static int32_t vnet_dummy_callback(void *pData, void *pParam)
+{
+    return 0;
+}
+
+static void vnet_socket_set_callback(CBFuncEx_t cb_fun, void *param, void *user_data)
+{
+    ctrl.socket_cb = cb_fun ? cb_fun : vnet_dummy_callback;
+    ctrl.user_data = param;
+}
+
+static const network_adapter_info prv_vnet_adapter =
+    {
+        .check_ready = vnet_check_ready,
+        .create_soceket = vnet_create_socket,
+        .socket_connect = vnet_socket_connect,
+        .socket_listen = vnet_socket_listen,
+        .socket_accept = vnet_socket_accept,
+        .socket_disconnect = vnet_socket_disconnect,
+        .socket_close = vnet_socket_close,
+        .socket_force_close = vnet_socket_force_close,
+        .socket_receive = vnet_socket_receive,
+        .socket_send = vnet_socket_send,
+        .socket_check = vnet_socket_check,
+        .socket_clean = vnet_socket_clean,
+        .getsockopt = vnet_getsockopt,
+        .setsockopt = vnet_setsockopt,
+        .user_cmd = vnet_user_cmd,
+        .dns = vnet_dns,
+        .set_dns_server = vnet_set_dns_server,
+        .dns_ipv6 = vnet_dns,
+        .set_mac = vnet_set_mac,
+        .set_static_ip = vnet_set_static_ip,
+        .get_local_ip_info = vnet_get_local_ip_info,
+        .get_full_ip_info = vnet_get_full_ip_info,
+        .socket_set_callback = vnet_socket_set_callback,
+        .name = "vnet",
+        .max_socket_num = VNET_MAX_SOCK,
+        .no_accept = 1,
+        .is_posix = 0,
+};
+
+//---------------------------------------
+// 对外接口
+//---------------------------------------
+
+int luat_vnet_listen(uint16_t port, int kind, const luat_vnet_link_t *link, uint64_t source_size, luat_vnet_handler handler, void *userdata)
+{
+    vnet_endpoint_t *ep = endpoint_find(port);
+    if (ep == NULL)
+    {
+        for (size_t i = 0; i < VNET_MAX_ENDPOINT; i++)
+        {
+            if (!endpoints[i].used)
+            {
+                ep = &endpoints[i];
+                break;
+            }
+        }
+    }
+    else if (ep->handler && ep->userdata != userdata)
+    {
+        LLOGW("端口%d已经有端点了", port);
+        return -1;
+    }
+    if (ep == NULL)
+    {
+        LLOGE("端点数量已达上限 %d", VNET_MAX_ENDPOINT);
+        return -1;
+    }
+    memset(ep, 0, sizeof(vnet_endpoint_t));
+    ep->used = 1;
+    ep->port = port;
+    ep->kind = kind;
+    if (link)
+        memcpy(&ep->link, link, sizeof(luat_vnet_link_t));
+    ep->source_size = source_size;
+    ep->handler = handler;
+    ep->userdata = userdata;
+    ep->rand = 0x12345678 ^ port;
+    LLOGD("端点%d kind %d 延时%dms 带宽%dB/s 丢包%d/10000", port, kind, ep->link.latency_ms, ep->link.bandwidth, ep->link.loss);
+    return 0;
+}
+
+int luat_vnet_unlisten(uint16_t port, void **userdata)
+{
+    vnet_endpoint_t *ep = endpoint_find(port);
+    if (ep == NULL)
+        return -1;
+    if (userdata)
+        *userdata = ep->userdata;
+    // 已有的连接全部由端点关闭
+    for (size_t i = 0; i < VNET_MAX_SOCK; i++)
+    {
+        if (socks[i].ep == ep)
+        {
+            luat_vnet_disconnect(i);
+            socks[i].ep_open = 0;
+            // 槽位之后可能被新的端点复用, 旧连接不能再指向它
+            socks[i].ep = NULL;
+        }
+    }
+    ep->used = 0;
+    ep->handler = NULL;
+    return 0;
+}
+
+int luat_vnet_send(int conn, const uint8_t *data, size_t len)
+{
+    if (conn < 0 || conn >= VNET_MAX_SOCK || len == 0)
+        return -1;
+    vnet_sock_t *s = &socks[conn];
+    if (s->ep == NULL || !s->ep_open || s->tag == 0)
+        return -1;
+    s->ep->stat.tx_bytes += len;
+    link_send(conn, &s->down, VI_TO_CLIENT, data, len);
+    return 0;
+}
+
+int luat_vnet_disconnect(int conn)
+{
+    if (conn < 0 || conn >= VNET_MAX_SOCK)
+        return -1;
+    vnet_sock_t *s = &socks[conn];
+    if (s->ep == NULL || !s->ep_open)
+        return -1;
+    s->ep_open = 0;
+    uint64_t due = s->down.last_due > vnet_now_us() ? s->down.last_due : vnet_now_us();
+    return item_post(VI_CLIENT_CLOSE, conn, NULL, 0, due + (uint64_t)s->ep->link.latency_ms * 1000);
+}
+
+int luat_vnet_endpoint_stat(uint16_t port, luat_vnet_endpoint_stat_t *stat)
+{
+    vnet_endpoint_t *ep = endpoint_find(port);
+    if (ep == NULL)
+        return -1;
+    memcpy(stat, &ep->stat, sizeof(luat_vnet_endpoint_stat_t));
+    return 0;
+}
+
+void luat_vnet_init(void)
+{
+    vnet_ip = 0x0100000A; // 10.0.0.1, 网络字节序
+    vnet_timer = luat_heap_malloc(sizeof(uv_timer_t));
+    if (vnet_timer == NULL)
+        return;
+    uv_timer_init(main_loop, vnet_timer);
+    ctrl.socket_cb = vnet_dummy_callback;
+    network_register_adapter(LUAT_VNET_ADAPTER_INDEX, &prv_vnet_adapter, NULL);
+}
@@ -9,6 +9,7 @@
 #include "luat_log.h"
 
 static uv_queue_item_t head;
+static uv_queue_item_t *tail = &head;
 
 static uv_mutex_t m;
 extern uv_loop_t *main_loop;
@@ -31,31 +32,36 @@ uint32_t luat_msgbus_put(rtos_msg_t *msg, size_t timeout)
     memset(item, 0, sizeof(uv_queue_item_t));
     memcpy(item->msg, msg, sizeof(rtos_msg_t));
     item->size = sizeof(rtos_msg_t);
+    // 直接挂在队尾, 不再从头遍历, 积压很多消息时放入也是O(1)
     uv_mutex_lock(&m);
-    int ret = luat_queue_push(&head, item);
+    tail->next = item;
+    tail = item;
     uv_mutex_unlock(&m);
-    return ret;
+    return 0;
 }
 uint32_t luat_msgbus_get(rtos_msg_t *msg, size_t timeout)
 {
     // LLOGD("luat_msgbus_get %d", timeout);
     (void)timeout;
-    uv_queue_item_t *item = luat_heap_malloc(sizeof(uv_queue_item_t) + sizeof(rtos_msg_t));
-    int ret = 0;
-    int ret2 = 0;
+    uv_queue_item_t *item;
     while (1)
     {
-        
         uv_mutex_lock(&m);
-        ret = luat_queue_pop(&head, item);
+        item = head.next;
+        if (item != NULL)
+        {
+            head.next = item->next;
+            if (head.next == NULL)
+                tail = &head;
+        }
         uv_mutex_unlock(&m);
-        if (ret == 0)
+        if (item != NULL)
         {
             memcpy(msg, item->msg, sizeof(rtos_msg_t));
             luat_heap_free(item);
             return 0;
         }
-        ret2 = uv_run(main_loop, UV_RUN_ONCE);
+        uv_run(main_loop, UV_RUN_ONCE);
     }
     return 1;
 }
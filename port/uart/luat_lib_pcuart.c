@@ -0,0 +1,216 @@
+/*
+@module  pcuart
+@summary PC模拟器串口调试库
+@version 1.0
+@date    2024.03.20
+@tag LUAT_USE_UART
+@usage
+-- 本库仅PC模拟器可用, 用于选择串口的驱动和观察串口的收发情况
+pcuart.config(1, "tcp://127.0.0.1:7001")
+uart.setup(1, 115200)
+log.info("uart", json.encode(pcuart.stat(1)))
+*/
+#include "luat_base.h"
+#include "luat_uart.h"
+#include "luat_uart_drv.h"
+
+#include "rotable2.h"
+
+#define LUAT_LOG_TAG "pcuart"
+#include "luat_log.h"
+
+/*
+给串口选择驱动, 需要在uart.setup之前调用, 与命令行参数--uart=id,url相同
+@api pcuart.config(id, url)
+@int 串口id
+@string 驱动, udp为默认的UDP虚拟串口, 也可以是tcp://ip:port, tcp-listen://ip:port, unix://path, unix-listen://path, replay://录制文件?speed=倍速或max&id=录制的串口id&loop=次数, linux/macos上还可以是tty://设备路径, pty, pty://符号链接路径
+@return boolean 成功返回true
+@usage
+pcuart.config(2, "tcp-listen://127.0.0.1:7102")
+*/
+static int l_pcuart_config(lua_State *L) {
+    int uart_id = luaL_checkinteger(L, 1);
+    const char* url = luaL_checkstring(L, 2);
+    lua_pushboolean(L, luat_uart_drv_config(uart_id, url) == 0);
+    return 1;
+}
+
+/*
+获取tty串口的设备路径, pty驱动返回从设备的路径, 外部程序打开它就能与模拟器通信
+@api pcuart.ttyName(id)
+@int 串口id, 需要已经uart.setup
+@return string 设备路径, 不是tty/pty驱动返回nil
+@usage
+pcuart.config(1, "pty")
+uart.setup(1, 9600)
+log.info("uart", "用串口工具打开", pcuart.ttyName(1))
+*/
+static int l_pcuart_tty_name(lua_State *L) {
+    const char* name = luat_uart_tty_name(luaL_checkinteger(L, 1));
+    if (name == NULL)
+        return 0;
+    lua_pushstring(L, name);
+    return 1;
+}
+
+/*
+获取串口收发的统计信息
+@api pcuart.stat(id)
+@int 串口id
+@return table 统计信息, 串口没有打开时返回nil. 接收缓冲区: size缓冲区大小, used未读的字节数, rx_bytes收到的总字节数, overflow_bytes/overflow_count缓冲区满了丢弃的字节数与次数, events发出的receive事件数. 线路速度: paced是否限速, byte_rate按波特率算出的字节/秒, tx_rate/rx_rate最近1秒实际的字节/秒, tx_bytes发出的总字节数, tx_queued限速排队中的字节数, rx_held限速还没到达的字节数
+@usage
+local stat = pcuart.stat(1)
+if stat and stat.overflow_bytes > 0 then
+    log.warn("uart", "读得太慢, 丢了", stat.overflow_bytes, "字节")
+end
+log.info("uart", "发送", stat.tx_rate, "字节/秒, 线路上限", stat.byte_rate)
+*/
+static int l_pcuart_stat(lua_State *L) {
+    int uart_id = luaL_checkinteger(L, 1);
+    luat_uart_rx_stat_t stat;
+    luat_uart_pace_stat_t pace;
+    int ret = luat_uart_rx_stat(uart_id, &stat);
+    if (luat_uart_pace_stat(uart_id, &pace) && ret)
+        return 0;
+    lua_createtable(L, 0, 13);
+    lua_pushinteger(L, stat.size);
+    lua_setfield(L, -2, "size");
+    lua_pushinteger(L, stat.used);
+    lua_setfield(L, -2, "used");
+    lua_pushinteger(L, stat.rx_bytes);
+    lua_setfield(L, -2, "rx_bytes");
+    lua_pushinteger(L, stat.overflow_bytes);
+    lua_setfield(L, -2, "overflow_bytes");
+    lua_pushinteger(L, stat.overflow_count);
+    lua_setfield(L, -2, "overflow_count");
+    lua_pushinteger(L, stat.events);
+    lua_setfield(L, -2, "events");
+    lua_pushboolean(L, pace.paced);
+    lua_setfield(L, -2, "paced");
+    lua_pushinteger(L, pace.byte_rate);
+    lua_setfield(L, -2, "byte_rate");
+    lua_pushinteger(L, pace.tx_rate);
+    lua_setfield(L, -2, "tx_rate");
+    lua_pushinteger(L, pace.rx_rate);
+    lua_setfield(L, -2, "rx_rate");
+    lua_pushinteger(L, pace.tx_bytes);
+    lua_setfield(L, -2, "tx_bytes");
+    lua_pushinteger(L, pace.tx_queued);
+    lua_setfield(L, -2, "tx_queued");
+    lua_pushinteger(L, pace.rx_held);
+    lua_setfield(L, -2, "rx_held");
+    return 1;
+}
+
+/*
+按波特率限制收发速度. 默认驱动有多快就收发多快, 开启之后按uart.setup的波特率/数据位/校验位/停止位计算每个字符的时间, 发送和接收分别限速, 与真实串口的线路速度一致
+@api pcuart.pace(id, enable)
+@int 串口id
+@boolean 是否开启, 默认true. 可以在uart.setup之前设置, uart.close之后保留
+@return boolean 成功返回true
+@usage
+-- 9600 8N1, 每秒960字节
+pcuart.pace(1, true)
+uart.setup(1, 9600)
+*/
+static int l_pcuart_pace(lua_State *L) {
+    int uart_id = luaL_checkinteger(L, 1);
+    int enable = lua_isnoneornil(L, 2) ? 1 : lua_toboolean(L, 2);
+    lua_pushboolean(L, luat_uart_pace(uart_id, enable) == 0);
+    return 1;
+}
+
+/*
+设置接收事件合并, 与硬件串口的FIFO阈值和接收超时类似, 攒够bytes字节或者线路空闲idle_ms毫秒之后才触发一次receive回调, 减少按行发送的数据(如NMEA)产生的事件数
+@api pcuart.rxCoalesce(id, bytes, idle_ms)
+@int 串口id
+@int 字节数阈值, 0表示不按字节数触发, 缓冲区满了总是立即触发
+@int 空闲超时, 单位毫秒, 0表示只按字节数触发. 两者都为0时关闭合并, 每收到一段数据就触发一次
+@return boolean 成功返回true
+@usage
+-- 收到1024字节或者20ms没有新数据时回调一次
+pcuart.rxCoalesce(1, 1024, 20)
+uart.setup(1, 115200)
+*/
+static int l_pcuart_rx_coalesce(lua_State *L) {
+    int uart_id = luaL_checkinteger(L, 1);
+    lua_Integer threshold = luaL_optinteger(L, 2, 0);
+    lua_Integer idle_ms = luaL_optinteger(L, 3, 0);
+    if (threshold < 0 || idle_ms < 0)
+        return luaL_error(L, "bytes/idle_ms不能为负数");
+    lua_pushboolean(L, luat_uart_rx_coalesce(uart_id, (uint32_t)threshold, (uint32_t)idle_ms) == 0);
+    return 1;
+}
+
+/*
+录制串口数据, 收到和写入的数据都带时间戳写进文件, 之后可以用replay://文件路径回放. 与命令行参数--uart_capture=path,id,id相同
+@api pcuart.capture(path, id, ...)
+@string 录制文件的路径, 不传则停止录制
+@int 要录制的串口id, 可以传多个
+@return boolean/int 开始录制时返回是否成功, 停止录制时返回录制的字节数
+@usage
+pcuart.capture("/tmp/gnss.cap", 2)
+-- ... 一段时间之后
+log.info("uart", "录制了", pcuart.capture(), "字节")
+*/
+static int l_pcuart_capture(lua_State *L) {
+    if (lua_isnoneornil(L, 1)) {
+        lua_pushinteger(L, (lua_Integer)luat_uart_capture_stop());
+        return 1;
+    }
+    const char* path = luaL_checkstring(L, 1);
+    int top = lua_gettop(L);
+    for (int i = 0; i < 128; i++)
+        luat_uart_capture_enable(i, 0);
+    for (int i = 2; i <= top; i++)
+        luat_uart_capture_enable(luaL_checkinteger(L, i), 1);
+    lua_pushboolean(L, luat_uart_capture_start(path) == 0);
+    return 1;
+}
+
+/*
+获取回放的进度, 串口需要用replay://配置并已经uart.setup
+@api pcuart.replayStat(id)
+@int 串口id
+@return table done是否回放完, loops完成的遍数, records/bytes送出的记录数和字节数, elapsed_ms从开始到现在(或者到回放完)的毫秒数, 不是回放串口返回nil
+@usage
+pcuart.config(2, "replay:///tmp/gnss.cap?speed=max")
+uart.setup(2, 9600)
+-- 全部解析完之后
+local stat = pcuart.replayStat(2)
+log.info("uart", "解析速度", stat.bytes * 1000 // stat.elapsed_ms, "字节/秒")
+*/
+static int l_pcuart_replay_stat(lua_State *L) {
+    luat_uart_replay_stat_t stat;
+    if (luat_uart_replay_stat(luaL_checkinteger(L, 1), &stat))
+        return 0;
+    lua_createtable(L, 0, 5);
+    lua_pushboolean(L, stat.done);
+    lua_setfield(L, -2, "done");
+    lua_pushinteger(L, stat.loops);
+    lua_setfield(L, -2, "loops");
+    lua_pushinteger(L, stat.records);
+    lua_setfield(L, -2, "records");
+    lua_pushinteger(L, stat.bytes);
+    lua_setfield(L, -2, "bytes");
+    lua_pushinteger(L, stat.elapsed_ms);
+    lua_setfield(L, -2, "elapsed_ms");
+    return 1;
+}
+
+static const rotable_Reg_t reg_pcuart[] =
+{
+    { "config",         ROREG_FUNC(l_pcuart_config)},
+    { "ttyName",        ROREG_FUNC(l_pcuart_tty_name)},
+    { "stat",           ROREG_FUNC(l_pcuart_stat)},
+    { "rxCoalesce",     ROREG_FUNC(l_pcuart_rx_coalesce)},
+    { "pace",           ROREG_FUNC(l_pcuart_pace)},
+    { "capture",        ROREG_FUNC(l_pcuart_capture)},
+    { "replayStat",     ROREG_FUNC(l_pcuart_replay_stat)},
+    { NULL,             ROREG_INT(0)}
+};
+
+LUAMOD_API int luaopen_pcuart( lua_State *L ) {
+    luat_newlib2(L, reg_pcuart);
+    return 1;
+}
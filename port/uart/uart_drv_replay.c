@@ -0,0 +1,476 @@
+
+#include "uv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "luat_base.h"
+#include "luat_malloc.h"
+#include "luat_uart.h"
+#include "luat_uart_drv.h"
+#include "luat_pcconf.h"
+
+#define LUAT_LOG_TAG "uart.replay"
+#include "luat_log.h"
+
+// 串口数据的录制与回放, 让GNSS/AT解析之类的测试每次都拿到完全相同的输入
+// 文件格式, 整数都是小端:
+//   文件头16字节: "LUATUART" 版本(u32) 保留(u32)
+//   记录: 标志(u8, bit7为方向, 0收1发, 低7位是串口id) 距上一条记录的微秒数(varint) 长度(varint) 数据
+// 录制: 共用层在数据进入接收缓冲区(或交给接管者)和uart.write接受数据时调用luat_uart_capture
+// 回放: replay://文件路径?speed=倍速&id=录制时的串口id&loop=次数, 作为驱动挂在uart_drvs[]上,
+//   只回放收到的数据, 写入的数据直接丢弃. speed=max时不按时间, 接收缓冲区一有空间就继续送, 测的是解析的吞吐量
+
+#define UART_CAPTURE_MAGIC      "LUATUART"
+#define UART_CAPTURE_VERSION    1
+#define UART_CAPTURE_HEAD_LEN   16
+#define UART_CAPTURE_TX         0x80
+#define UART_CAPTURE_BUFF       (256 * 1024)
+// 一次最多送出的字节数, 数据被接管时不会因为缓冲区满而停下, 分批送避免卡住事件循环
+#define UART_REPLAY_BATCH       (64 * 1024)
+
+typedef struct uart_capture
+{
+    FILE* fp;
+    char* buff;
+    uint64_t last_us;
+    uint64_t bytes;
+    uint32_t records;
+    uint8_t ids[128];
+}uart_capture_t;
+
+static uart_capture_t capture;
+
+typedef struct uart_replay
+{
+    int id;
+    int src_id;             // 回放文件里的哪个串口, 默认与id相同
+    uint32_t speed;         // 倍速乘以1000, 0表示最快速度
+    uint32_t loops;         // 回放次数, 0表示一直循环
+    char path[256];
+    uint8_t opened;
+    uint8_t done;
+    uint8_t* data;
+    size_t size;
+    size_t pos;             // 下一条记录的位置
+    size_t rec_off;         // 最快速度时当前记录已经送出的字节数
+    uint64_t rec_us;        // 当前记录在文件里的时间
+    uint64_t start_ns;      // 这一遍开始的时间
+    uint64_t begin_ns;      // 第一遍开始的时间
+    uint64_t end_ns;
+    uint32_t loop_done;
+    uint64_t bytes;
+    uint32_t records;
+    uv_timer_t* timer;
+}uart_replay_t;
+
+static uart_replay_t* replays[128];
+extern uv_loop_t *main_loop;
+extern const luat_uart_drv_opts_t* uart_drvs[];
+extern const luat_uart_drv_opts_t uart_replay;
+
+static size_t varint_put(uint8_t* p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static int varint_get(const uint8_t* p, size_t size, size_t* pos, uint64_t* v) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64 && *pos < size; shift += 7) {
+        uint8_t b = p[(*pos)++];
+        value |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = value;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+//---------------------------------------------------------------
+// 录制
+
+int luat_uart_capture_start(const char* path) {
+    luat_uart_capture_stop();
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        LLOGE("无法创建录制文件 %s", path);
+        return -1;
+    }
+    // 记录很碎, 用大缓冲区减少系统调用
+    capture.buff = luat_heap_malloc(UART_CAPTURE_BUFF);
+    if (capture.buff)
+        setvbuf(fp, capture.buff, _IOFBF, UART_CAPTURE_BUFF);
+    uint8_t head[UART_CAPTURE_HEAD_LEN] = {0};
+    memcpy(head, UART_CAPTURE_MAGIC, 8);
+    head[8] = UART_CAPTURE_VERSION;
+    fwrite(head, 1, sizeof(head), fp);
+    capture.fp = fp;
+    capture.last_us = uv_hrtime() / 1000;
+    capture.bytes = 0;
+    capture.records = 0;
+    LLOGI("开始录制串口数据 %s", path);
+    return 0;
+}
+
+int luat_uart_capture_enable(int uart_id, int enable) {
+    if (uart_id < 0 || uart_id >= 128)
+        return -1;
+    capture.ids[uart_id] = enable ? 1 : 0;
+    return 0;
+}
+
+uint64_t luat_uart_capture_stop(void) {
+    uint64_t bytes = capture.bytes;
+    if (capture.fp == NULL)
+        return 0;
+    fclose(capture.fp);
+    capture.fp = NULL;
+    luat_heap_free(capture.buff);
+    capture.buff = NULL;
+    LLOGI("录制结束, %u条记录 %llu字节", capture.records, (unsigned long long)bytes);
+    return bytes;
+}
+
+void luat_uart_capture(int uart_id, int tx, const void* data, size_t len) {
+    if (capture.fp == NULL || len == 0 || uart_id < 0 || uart_id >= 128 || !capture.ids[uart_id])
+        return;
+    uint8_t head[1 + 10 + 10];
+    uint64_t now = uv_hrtime() / 1000;
+    size_t n = 0;
+    head[n++] = (uint8_t)(uart_id | (tx ? UART_CAPTURE_TX : 0));
+    n += varint_put(head + n, now - capture.last_us);
+    n += varint_put(head + n, len);
+    capture.last_us = now;
+    if (fwrite(head, 1, n, capture.fp) != n || fwrite(data, 1, len, capture.fp) != len) {
+        LLOGE("写入录制文件失败, 停止录制");
+        luat_uart_capture_stop();
+        return;
+    }
+    capture.bytes += len;
+    capture.records++;
+}
+
+//---------------------------------------------------------------
+// 回放
+
+static uart_replay_t* replay_get(int uart_id) {
+    if (uart_id < 0 || uart_id >= 128)
+        return NULL;
+    return replays[uart_id];
+}
+
+// 读入整个文件并检查每条记录, 回放时不再检查边界
+static int replay_load(uart_replay_t* r) {
+    FILE* fp = fopen(r->path, "rb");
+    if (fp == NULL) {
+        LLOGE("uart %d 无法打开回放文件 %s", r->id, r->path);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t* data = size > 0 ? luat_heap_malloc(size) : NULL;
+    if (data == NULL || fread(data, 1, size, fp) != (size_t)size) {
+        LLOGE("uart %d 读取回放文件失败 %s", r->id, r->path);
+        luat_heap_free(data);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    if (size < UART_CAPTURE_HEAD_LEN || memcmp(data, UART_CAPTURE_MAGIC, 8) || data[8] != UART_CAPTURE_VERSION) {
+        LLOGE("uart %d %s 不是串口录制文件", r->id, r->path);
+        luat_heap_free(data);
+        return -1;
+    }
+    size_t pos = UART_CAPTURE_HEAD_LEN;
+    uint32_t records = 0;
+    uint64_t bytes = 0;
+    while (pos < (size_t)size) {
+        uint64_t dt, len;
+        size_t start = pos;
+        uint8_t flag = data[pos++];
+        if (varint_get(data, size, &pos, &dt) || varint_get(data, size, &pos, &len) || len > (size_t)size - pos) {
+            // 录制时进程被杀掉, 文件末尾可能不完整, 从这条记录的开头截掉, 前面的记录照常回放
+            LLOGW("uart %d %s 在%d字节处截断", r->id, r->path, (int)start);
+            size = start;
+            break;
+        }
+        pos += len;
+        if ((flag & 0x7F) == r->src_id && !(flag & UART_CAPTURE_TX)) {
+            records++;
+            bytes += len;
+        }
+    }
+    // 没有数据可送时, loop=0会在replay_feed里空转
+    if (bytes == 0) {
+        LLOGE("uart %d %s 里没有串口%d收到的数据", r->id, r->path, r->src_id);
+        luat_heap_free(data);
+        return -1;
+    }
+    r->data = data;
+    r->size = size;
+    LLOGD("uart %d 回放%s, 串口%d共%u条记录 %llu字节", r->id, r->path, r->src_id, records, (unsigned long long)bytes);
+    return 0;
+}
+
+static void replay_rewind(uart_replay_t* r) {
+    r->pos = UART_CAPTURE_HEAD_LEN;
+    r->rec_off = 0;
+    r->rec_us = 0;
+    r->start_ns = uv_hrtime();
+}
+
+// 解析pos处的记录, 不是要回放的记录时len为0
+static const uint8_t* replay_peek(uart_replay_t* r, size_t* next, uint64_t* at_us, size_t* len) {
+    size_t pos = r->pos;
+    uint64_t dt, n;
+    uint8_t flag = r->data[pos++];
+    varint_get(r->data, r->size, &pos, &dt);
+    varint_get(r->data, r->size, &pos, &n);
+    *next = pos + n;
+    *at_us = r->rec_us + dt;
+    *len = ((flag & 0x7F) == r->src_id && !(flag & UART_CAPTURE_TX)) ? n : 0;
+    return r->data + pos;
+}
+
+static void on_replay_timer(uv_timer_t* t);
+
+// 只存进缓冲区放得下的部分, 不算溢出, 剩下的等Lua读走数据之后再送
+static size_t replay_store(uart_replay_t* r, const uint8_t* data, size_t len) {
+    if (luat_uart_is_hooked(r->id)) {
+        luat_uart_rx_input(r->id, data, len);
+        return len;
+    }
+    size_t stored = 0;
+    while (stored < len) {
+        size_t space;
+        uint8_t* ptr = luat_uart_rx_reserve(r->id, &space);
+        if (space == 0)
+            break;
+        if (space > len - stored)
+            space = len - stored;
+        memcpy(ptr, data + stored, space);
+        luat_uart_rx_commit(r->id, space);
+        stored += space;
+    }
+    return stored;
+}
+
+static void replay_feed(uart_replay_t* r) {
+    size_t batch = 0;
+    uint64_t elapsed_us = (uv_hrtime() - r->start_ns) / 1000;
+    while (r->opened && !r->done) {
+        if (r->pos >= r->size) {
+            r->loop_done++;
+            if (r->loops && r->loop_done >= r->loops) {
+                r->done = 1;
+                r->end_ns = uv_hrtime();
+                LLOGI("uart %d 回放结束, %u条记录 %llu字节", r->id, r->records, (unsigned long long)r->bytes);
+                return;
+            }
+            replay_rewind(r);
+            elapsed_us = 0;
+            if (r->pos >= r->size)
+                return;
+        }
+        size_t next, len;
+        uint64_t at_us;
+        const uint8_t* data = replay_peek(r, &next, &at_us, &len);
+        if (r->speed) {
+            // 按时间回放, 缓冲区满了就丢数据, 与真实串口一样
+            uint64_t due_us = at_us * 1000 / r->speed;
+            if (due_us > elapsed_us) {
+                uint64_t ms = (due_us - elapsed_us + 999) / 1000;
+                uv_timer_start(r->timer, on_replay_timer, ms, 0);
+                return;
+            }
+            if (len) {
+                luat_uart_rx_input(r->id, data, len);
+                r->bytes += len;
+                r->records++;
+            }
+        }
+        else if (len) {
+            // 最快速度, 缓冲区满了等Lua读走数据再继续, 一个字节都不丢
+            size_t n = len - r->rec_off;
+            size_t stored = replay_store(r, data + r->rec_off, n);
+            r->bytes += stored;
+            if (stored < n) {
+                r->rec_off += stored;
+                return;
+            }
+            r->records++;
+        }
+        r->pos = next;
+        r->rec_off = 0;
+        r->rec_us = at_us;
+        batch += len;
+        if (batch >= UART_REPLAY_BATCH) {
+            uv_timer_start(r->timer, on_replay_timer, 0, 0);
+            return;
+        }
+    }
+}
+
+static void on_replay_timer(uv_timer_t* t) {
+    replay_feed((uart_replay_t*)t->data);
+}
+
+static int uart_setup_replay(void* userdata, luat_uart_t* uart) {
+    (void)userdata;
+    uart_replay_t* r = replay_get(uart->id);
+    if (r == NULL)
+        return -1;
+    if (r->opened)
+        return 0;
+    if (r->data == NULL && replay_load(r))
+        return -1;
+    if (luat_uart_rx_open(uart->id, uart->bufsz ? uart->bufsz : 1024))
+        return -1;
+    if (r->timer == NULL) {
+        r->timer = luat_heap_malloc(sizeof(uv_timer_t));
+        if (r->timer == NULL) {
+            luat_uart_rx_close(uart->id);
+            return -1;
+        }
+        uv_timer_init(main_loop, r->timer);
+        r->timer->data = r;
+    }
+    r->opened = 1;
+    r->done = 0;
+    r->loop_done = 0;
+    r->bytes = 0;
+    r->records = 0;
+    r->end_ns = 0;
+    replay_rewind(r);
+    r->begin_ns = r->start_ns;
+    // 等setup返回, Lua注册好回调之后再开始
+    uv_timer_start(r->timer, on_replay_timer, 0, 0);
+    return 0;
+}
+
+static int uart_write_replay(void* userdata, int uart_id, void* data, size_t length) {
+    (void)userdata;
+    (void)data;
+    uart_replay_t* r = replay_get(uart_id);
+    if (r == NULL || !r->opened)
+        return 0;
+    luat_uart_tx_done(uart_id);
+    return length;
+}
+
+static int uart_read_replay(void* userdata, int uart_id, void* buffer, size_t length) {
+    (void)userdata;
+    uart_replay_t* r = replay_get(uart_id);
+    if (r == NULL || !r->opened)
+        return 0;
+    int ret = luat_uart_rx_read(uart_id, buffer, length);
+    // 最快速度回放时, 读走数据之后继续送
+    if (ret > 0 && r->speed == 0 && !r->done && !uv_is_active((uv_handle_t*)r->timer))
+        uv_timer_start(r->timer, on_replay_timer, 0, 0);
+    return ret;
+}
+
+static int uart_close_replay(void* userdata, int uart_id) {
+    (void)userdata;
+    uart_replay_t* r = replay_get(uart_id);
+    if (r == NULL || !r->opened)
+        return 0;
+    r->opened = 0;
+    uv_timer_stop(r->timer);
+    luat_uart_rx_close(uart_id);
+    // 下次setup重新读文件, 可以换一个录制文件
+    luat_heap_free(r->data);
+    r->data = NULL;
+    return 0;
+}
+
+const luat_uart_drv_opts_t uart_replay = {
+    .setup = uart_setup_replay,
+    .write = uart_write_replay,
+    .read = uart_read_replay,
+    .close = uart_close_replay,
+};
+
+int luat_uart_replay_config(int uart_id, const char* url) {
+    const char* prefix = "replay://";
+    if (uart_id < 0 || uart_id >= 128 || strncmp(url, prefix, strlen(prefix)))
+        return -1;
+    const char* path = url + strlen(prefix);
+    const char* query = strchr(path, '?');
+    size_t len = query ? (size_t)(query - path) : strlen(path);
+    uart_replay_t tmp = {0};
+    tmp.id = uart_id;
+    tmp.src_id = uart_id;
+    tmp.speed = 1000;
+    tmp.loops = 1;
+    if (len == 0 || len >= sizeof(tmp.path))
+        return -1;
+    memcpy(tmp.path, path, len);
+    // speed=2 speed=0.5 speed=max, id=录制时的串口id, loop=次数, 0为一直循环
+    while (query) {
+        query++;
+        char* end = NULL;
+        if (!strncmp(query, "speed=max", 9)) {
+            tmp.speed = 0;
+            end = (char*)query + 9;
+        }
+        else if (!strncmp(query, "speed=", 6)) {
+            double speed = strtod(query + 6, &end);
+            if (speed <= 0 || speed > 1000000)
+                return -1;
+            tmp.speed = (uint32_t)(speed * 1000);
+            if (tmp.speed == 0)
+                tmp.speed = 1;
+        }
+        else if (!strncmp(query, "id=", 3)) {
+            tmp.src_id = (int)strtol(query + 3, &end, 10);
+            if (tmp.src_id < 0 || tmp.src_id >= 128)
+                return -1;
+        }
+        else if (!strncmp(query, "loop=", 5)) {
+            tmp.loops = (uint32_t)strtoul(query + 5, &end, 10);
+        }
+        if (end == NULL || (*end && *end != '&'))
+            return -1;
+        query = *end ? end : NULL;
+    }
+    uart_replay_t* r = replays[uart_id];
+    if (r == NULL) {
+        r = luat_heap_malloc(sizeof(uart_replay_t));
+        if (r == NULL)
+            return -1;
+        memset(r, 0, sizeof(uart_replay_t));
+        replays[uart_id] = r;
+    }
+    else if (r->opened) {
+        LLOGE("uart %d 已经打开, 不能修改配置", uart_id);
+        return -1;
+    }
+    r->id = tmp.id;
+    r->src_id = tmp.src_id;
+    r->speed = tmp.speed;
+    r->loops = tmp.loops;
+    memcpy(r->path, tmp.path, sizeof(r->path));
+    uart_drvs[uart_id] = &uart_replay;
+    return 0;
+}
+
+int luat_uart_replay_stat(int uart_id, luat_uart_replay_stat_t* stat) {
+    memset(stat, 0, sizeof(luat_uart_replay_stat_t));
+    uart_replay_t* r = replay_get(uart_id);
+    if (r == NULL || !r->opened)
+        return -1;
+    stat->done = r->done;
+    stat->loops = r->loop_done;
+    stat->records = r->records;
+    stat->bytes = r->bytes;
+    stat->elapsed_ms = ((r->done ? r->end_ns : uv_hrtime()) - r->begin_ns) / 1000000;
+    return 0;
+}
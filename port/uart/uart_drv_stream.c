@@ -0,0 +1,473 @@
+
+#include "uv.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "luat_base.h"
+#include "luat_malloc.h"
+#include "luat_uart.h"
+#include "luat_uart_drv.h"
+#include "luat_msgbus.h"
+#include "luat_pcconf.h"
+
+#define LUAT_LOG_TAG "uart.stream"
+#include "luat_log.h"
+
+// 基于TCP或Unix域套接字(windows上是命名管道)的虚拟串口
+// 字节流本身保证顺序, 写入直接排进libuv的发送队列, 不拆包也不sleep, 吞吐量只受对端限制
+// 1. 写: 每次write复制一份数据提交给uv_write, 发送队列全部写完时产生一次"sent"事件;
+//    连接建立之前写入的数据先缓存, 连上之后按顺序发出
+// 2. 读: libuv直接读进串口接收缓冲区的空闲部分, 缓冲区满了就停止读取, 对端会因为TCP流控而阻塞,
+//    不会像UDP那样丢数据; Lua读走数据之后恢复读取
+// 3. 客户端模式断开或者连不上时每秒重连一次, 服务端模式同时只保留最新的一个连接
+
+#define UART_STREAM_MAX         128
+// 已提交但还没写完的字节数上限, 超过之后write返回0
+#define UART_STREAM_TX_MAX      (4 * 1024 * 1024)
+#define UART_STREAM_RETRY_MS    1000
+
+enum {
+    UART_STREAM_TCP,
+    UART_STREAM_UNIX,
+};
+
+typedef union uart_stream_handle
+{
+    uv_handle_t handle;
+    uv_stream_t stream;
+    uv_tcp_t tcp;
+    uv_pipe_t pipe;
+}uart_stream_handle_t;
+
+typedef struct uart_stream
+{
+    int id;
+    uint8_t type;
+    uint8_t listen;
+    uint8_t opened;         // uart.setup之后, uart.close之前
+    uint8_t rx_paused;
+    uint8_t tx_full;        // 发送队列满了已经告警过, 清空之前不再重复
+    char addr[128];         // tcp为ip地址, unix为路径
+    int port;
+    uv_stream_t* server;
+    uv_stream_t* conn;
+    uv_stream_t* connecting;
+    uv_timer_t* retry;
+    size_t tx_inflight;     // 已提交给libuv还没写完的字节数
+    uint8_t* backlog;       // 连接建立之前写入的数据
+    size_t backlog_len;
+}uart_stream_t;
+
+typedef struct uart_stream_write
+{
+    uv_write_t req;
+    uart_stream_t* s;
+    size_t len;
+}uart_stream_write_t;
+
+// 配置在进程退出之前一直有效, 回调里可以直接引用
+static uart_stream_t* streams[UART_STREAM_MAX];
+extern uv_loop_t *main_loop;
+extern const luat_uart_drv_opts_t* uart_drvs[];
+extern const luat_uart_drv_opts_t uart_stream;
+
+static void stream_connect(uart_stream_t* s);
+static void stream_read_start(uart_stream_t* s);
+
+static uart_stream_t* stream_get(int uart_id) {
+    if (uart_id < 0 || uart_id >= UART_STREAM_MAX)
+        return NULL;
+    return streams[uart_id];
+}
+
+static uv_stream_t* stream_handle_new(uart_stream_t* s) {
+    uart_stream_handle_t* h = luat_heap_malloc(sizeof(uart_stream_handle_t));
+    if (h == NULL)
+        return NULL;
+    memset(h, 0, sizeof(uart_stream_handle_t));
+    if (s->type == UART_STREAM_TCP)
+        uv_tcp_init(main_loop, &h->tcp);
+    else
+        uv_pipe_init(main_loop, &h->pipe, 0);
+    h->handle.data = s;
+    return &h->stream;
+}
+
+static void on_retry(uv_timer_t* t) {
+    uart_stream_t* s = t->data;
+    if (s->opened && s->conn == NULL && s->connecting == NULL)
+        stream_connect(s);
+}
+
+static void stream_schedule_retry(uart_stream_t* s) {
+    if (s->listen || !s->opened)
+        return;
+    if (s->retry == NULL) {
+        s->retry = luat_heap_malloc(sizeof(uv_timer_t));
+        if (s->retry == NULL)
+            return;
+        uv_timer_init(main_loop, s->retry);
+        s->retry->data = s;
+    }
+    uv_timer_start(s->retry, on_retry, UART_STREAM_RETRY_MS, 0);
+}
+
+static void stream_drop_conn(uart_stream_t* s) {
+    if (s->conn) {
+        free_uv_handle(s->conn);
+        s->conn = NULL;
+    }
+    s->rx_paused = 0;
+    stream_schedule_retry(s);
+}
+
+static void on_write(uv_write_t* req, int status) {
+    uart_stream_write_t* w = (uart_stream_write_t*)req;
+    uart_stream_t* s = w->s;
+    s->tx_inflight -= w->len;
+    luat_heap_free(w);
+    if (status < 0) {
+        if (status != UV_ECANCELED)
+            LLOGW("uart %d 发送失败 %s", s->id, uv_strerror(status));
+        return;
+    }
+    // 发送队列清空时才通知, 相当于硬件串口的发送完成
+    if (s->tx_inflight == 0) {
+        s->tx_full = 0;
+        if (s->opened)
+            luat_uart_tx_done(s->id);
+    }
+}
+
+static int stream_submit(uart_stream_t* s, const void* data, size_t len) {
+    uart_stream_write_t* w = luat_heap_malloc(sizeof(uart_stream_write_t) + len);
+    if (w == NULL) {
+        LLOGE("out of memory when uart stream send");
+        return -1;
+    }
+    memcpy(w + 1, data, len);
+    w->s = s;
+    w->len = len;
+    uv_buf_t buf = uv_buf_init((char*)(w + 1), len);
+    int ret = uv_write(&w->req, s->conn, &buf, 1, on_write);
+    if (ret) {
+        LLOGE("uart %d uv_write %s", s->id, uv_strerror(ret));
+        luat_heap_free(w);
+        return -1;
+    }
+    s->tx_inflight += len;
+    return 0;
+}
+
+static void stream_alloc(uv_handle_t* handle, size_t suggested, uv_buf_t* buf) {
+    (void)suggested;
+    uart_stream_t* s = handle->data;
+    // 直接读进接收缓冲区, 没有空闲时长度为0, read回调里会收到UV_ENOBUFS
+    size_t len;
+    buf->base = (char*)luat_uart_rx_reserve(s->id, &len);
+    buf->len = len;
+}
+
+static void on_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+    uart_stream_t* s = stream->data;
+    if (nread == UV_ENOBUFS) {
+        uv_read_stop(stream);
+        s->rx_paused = 1;
+        return;
+    }
+    if (nread < 0) {
+        if (nread != UV_EOF)
+            LLOGW("uart %d 读取失败 %s", s->id, uv_strerror((int)nread));
+        else
+            LLOGD("uart %d 对端断开", s->id);
+        stream_drop_conn(s);
+        return;
+    }
+    if (nread == 0)
+        return;
+    // 被PPP等C模块接管的串口, 数据直接交给接管者, 不留在缓冲区里
+    if (luat_uart_rx_hook_input(s->id, (const uint8_t*)buf->base, nread))
+        return;
+    luat_uart_rx_commit(s->id, nread);
+}
+
+static void stream_read_start(uart_stream_t* s) {
+    if (s->conn == NULL)
+        return;
+    s->rx_paused = 0;
+    int ret = uv_read_start(s->conn, stream_alloc, on_read);
+    if (ret)
+        LLOGW("uart %d uv_read_start %s", s->id, uv_strerror(ret));
+}
+
+static void stream_attach(uart_stream_t* s, uv_stream_t* conn) {
+    s->conn = conn;
+    if (s->type == UART_STREAM_TCP)
+        uv_tcp_nodelay((uv_tcp_t*)conn, 1);
+    stream_read_start(s);
+    if (s->backlog_len) {
+        stream_submit(s, s->backlog, s->backlog_len);
+        luat_heap_free(s->backlog);
+        s->backlog = NULL;
+        s->backlog_len = 0;
+    }
+}
+
+static void on_connect(uv_connect_t* req, int status) {
+    uart_stream_t* s = req->data;
+    uv_stream_t* handle = req->handle;
+    luat_heap_free(req);
+    // uart.close之后的回调, 句柄已经在关闭了
+    if (s->connecting != handle)
+        return;
+    s->connecting = NULL;
+    if (status < 0) {
+        LLOGD("uart %d 连接%s:%d失败 %s", s->id, s->addr, s->port, uv_strerror(status));
+        free_uv_handle(handle);
+        stream_schedule_retry(s);
+        return;
+    }
+    LLOGD("uart %d 已连接%s:%d", s->id, s->addr, s->port);
+    stream_attach(s, handle);
+}
+
+static int stream_sockaddr(uart_stream_t* s, struct sockaddr_storage* addr) {
+    if (uv_ip4_addr(s->addr, s->port, (struct sockaddr_in*)addr) == 0)
+        return 0;
+    if (uv_ip6_addr(s->addr, s->port, (struct sockaddr_in6*)addr) == 0)
+        return 0;
+    LLOGE("uart %d 无效的地址 %s", s->id, s->addr);
+    return UV_EINVAL;
+}
+
+static void stream_connect(uart_stream_t* s) {
+    struct sockaddr_storage addr;
+    uv_connect_t* req = luat_heap_malloc(sizeof(uv_connect_t));
+    if (req == NULL)
+        return;
+    uv_stream_t* handle = stream_handle_new(s);
+    if (handle == NULL) {
+        luat_heap_free(req);
+        return;
+    }
+    req->data = s;
+    s->connecting = handle;
+    if (s->type == UART_STREAM_UNIX) {
+        uv_pipe_connect(req, (uv_pipe_t*)handle, s->addr, on_connect);
+        return;
+    }
+    int ret = stream_sockaddr(s, &addr);
+    if (ret == 0)
+        ret = uv_tcp_connect(req, (uv_tcp_t*)handle, (const struct sockaddr*)&addr, on_connect);
+    if (ret) {
+        s->connecting = NULL;
+        luat_heap_free(req);
+        free_uv_handle(handle);
+    }
+}
+
+static void on_accept(uv_stream_t* server, int status) {
+    uart_stream_t* s = server->data;
+    if (status < 0) {
+        LLOGW("uart %d accept %s", s->id, uv_strerror(status));
+        return;
+    }
+    uv_stream_t* conn = stream_handle_new(s);
+    if (conn == NULL)
+        return;
+    if (uv_accept(server, conn)) {
+        free_uv_handle(conn);
+        return;
+    }
+    // 同一时间只有一个对端, 新连接替换旧连接
+    if (s->conn) {
+        LLOGD("uart %d 新连接替换旧连接", s->id);
+        stream_drop_conn(s);
+    }
+    LLOGD("uart %d 对端已连接", s->id);
+    stream_attach(s, conn);
+}
+
+static int stream_listen(uart_stream_t* s) {
+    struct sockaddr_storage addr;
+    int ret;
+    uv_stream_t* server = stream_handle_new(s);
+    if (server == NULL)
+        return -1;
+    if (s->type == UART_STREAM_UNIX) {
+#ifndef LUA_USE_WINDOWS
+        // 上次没有正常退出时留下的套接字文件
+        remove(s->addr);
+#endif
+        ret = uv_pipe_bind((uv_pipe_t*)server, s->addr);
+    }
+    else {
+        ret = stream_sockaddr(s, &addr);
+        if (ret == 0)
+            ret = uv_tcp_bind((uv_tcp_t*)server, (const struct sockaddr*)&addr, 0);
+    }
+    if (ret == 0)
+        ret = uv_listen(server, 1, on_accept);
+    if (ret) {
+        LLOGE("uart %d 监听%s:%d失败 %s", s->id, s->addr, s->port, uv_strerror(ret));
+        free_uv_handle(server);
+        return -1;
+    }
+    s->server = server;
+    LLOGD("uart %d 监听%s:%d", s->id, s->addr, s->port);
+    return 0;
+}
+
+static int uart_setup_stream(void* userdata, luat_uart_t* uart) {
+    (void)userdata;
+    uart_stream_t* s = stream_get(uart->id);
+    if (s == NULL)
+        return -1;
+    if (s->opened)
+        return 0;
+    if (luat_uart_rx_open(uart->id, uart->bufsz ? uart->bufsz : 1024))
+        return -1;
+    s->opened = 1;
+    if (s->listen) {
+        if (stream_listen(s)) {
+            s->opened = 0;
+            luat_uart_rx_close(uart->id);
+            return -1;
+        }
+    }
+    else {
+        stream_connect(s);
+    }
+    return 0;
+}
+
+static int uart_write_stream(void* userdata, int uart_id, void* data, size_t length) {
+    (void)userdata;
+    uart_stream_t* s = stream_get(uart_id);
+    if (s == NULL || !s->opened || length == 0)
+        return 0;
+    if (s->tx_inflight + s->backlog_len + length > UART_STREAM_TX_MAX) {
+        if (!s->tx_full)
+            LLOGW("uart %d 发送队列已满, 等待sent事件之后再写", uart_id);
+        s->tx_full = 1;
+        return 0;
+    }
+    if (s->conn) {
+        if (stream_submit(s, data, length))
+            return 0;
+        return length;
+    }
+    uint8_t* ptr = luat_heap_realloc(s->backlog, s->backlog_len + length);
+    if (ptr == NULL)
+        return 0;
+    memcpy(ptr + s->backlog_len, data, length);
+    s->backlog = ptr;
+    s->backlog_len += length;
+    return length;
+}
+
+static int uart_read_stream(void* userdata, int uart_id, void* buffer, size_t length) {
+    (void)userdata;
+    uart_stream_t* s = stream_get(uart_id);
+    if (s == NULL || !s->opened)
+        return 0;
+    int ret = luat_uart_rx_read(uart_id, buffer, length);
+    if (ret > 0 && s->rx_paused)
+        stream_read_start(s);
+    return ret;
+}
+
+static int uart_close_stream(void* userdata, int uart_id) {
+    (void)userdata;
+    uart_stream_t* s = stream_get(uart_id);
+    if (s == NULL || !s->opened)
+        return 0;
+    s->opened = 0;
+    if (s->retry)
+        uv_timer_stop(s->retry);
+    if (s->connecting) {
+        free_uv_handle(s->connecting);
+        s->connecting = NULL;
+    }
+    if (s->server) {
+        free_uv_handle(s->server);
+        s->server = NULL;
+    }
+    stream_drop_conn(s);
+    luat_uart_rx_close(uart_id);
+    luat_heap_free(s->backlog);
+    s->backlog = NULL;
+    s->backlog_len = 0;
+    return 0;
+}
+
+// tcp://ip:port, tcp-listen://ip:port, unix://path, unix-listen://path
+int luat_uart_stream_config(int uart_id, const char* url) {
+    static const struct {
+        const char* prefix;
+        uint8_t type;
+        uint8_t listen;
+    } schemes[] = {
+        {"tcp://", UART_STREAM_TCP, 0},
+        {"tcp-listen://", UART_STREAM_TCP, 1},
+        {"unix://", UART_STREAM_UNIX, 0},
+        {"unix-listen://", UART_STREAM_UNIX, 1},
+    };
+    if (uart_id < 0 || uart_id >= UART_STREAM_MAX)
+        return -1;
+    uart_stream_t tmp = {0};
+    size_t i;
+    for (i = 0; i < sizeof(schemes) / sizeof(schemes[0]); i++) {
+        if (!strncmp(url, schemes[i].prefix, strlen(schemes[i].prefix)))
+            break;
+    }
+    if (i == sizeof(schemes) / sizeof(schemes[0]))
+        return -1;
+    const char* addr = url + strlen(schemes[i].prefix);
+    size_t len = strlen(addr);
+    tmp.type = schemes[i].type;
+    tmp.listen = schemes[i].listen;
+    if (tmp.type == UART_STREAM_TCP) {
+        // ipv6地址写成[::1]:port
+        const char* colon = strrchr(addr, ':');
+        if (colon == NULL || colon == addr)
+            return -1;
+        tmp.port = atoi(colon + 1);
+        len = colon - addr;
+        if (addr[0] == '[' && len > 2 && addr[len - 1] == ']') {
+            addr++;
+            len -= 2;
+        }
+        if (tmp.port <= 0 || tmp.port > 0xFFFF)
+            return -1;
+    }
+    if (len == 0 || len >= sizeof(tmp.addr))
+        return -1;
+    memcpy(tmp.addr, addr, len);
+    uart_stream_t* s = streams[uart_id];
+    if (s == NULL) {
+        s = luat_heap_malloc(sizeof(uart_stream_t));
+        if (s == NULL)
+            return -1;
+        memset(s, 0, sizeof(uart_stream_t));
+        streams[uart_id] = s;
+    }
+    else if (s->opened) {
+        LLOGE("uart %d 已经打开, 不能修改配置", uart_id);
+        return -1;
+    }
+    s->id = uart_id;
+    s->type = tmp.type;
+    s->listen = tmp.listen;
+    s->port = tmp.port;
+    memcpy(s->addr, tmp.addr, sizeof(s->addr));
+    uart_drvs[uart_id] = &uart_stream;
+    return 0;
+}
+
+const luat_uart_drv_opts_t uart_stream = {
+    .setup = uart_setup_stream,
+    .write = uart_write_stream,
+    .read = uart_read_stream,
+    .close = uart_close_stream,
+};
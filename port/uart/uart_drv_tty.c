@@ -0,0 +1,465 @@
+
+// posix_openpt/ptsname
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "uv.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "luat_base.h"
+#include "luat_malloc.h"
+#include "luat_uart.h"
+#include "luat_uart_drv.h"
+#include "luat_msgbus.h"
+#include "luat_pcconf.h"
+
+#define LUAT_LOG_TAG "uart.tty"
+#include "luat_log.h"
+
+// linux/macos的真实串口与伪终端(PTY)
+// 1. tty:///dev/ttyUSB0 打开真实串口, 波特率/数据位/停止位/校验按uart.setup的参数用termios设置
+// 2. pty 或 pty:///tmp/ttyV1 创建一个伪终端, 外部程序(或者另一个用tty://打开它的串口)打开从设备,
+//    就像接在模组串口上的设备; 带路径时在该路径创建指向从设备的符号链接
+// 文件描述符是非阻塞的, 用uv_poll挂在事件循环上:
+// - 可读时直接读进串口的接收缓冲区, 缓冲区满了就暂停监听可读, 内核缓冲区满了之后由tty层流控
+// - 写入时先尝试直接write, 写不完的部分排队, 等可写时继续, 队列清空时产生"sent"事件
+
+#if defined(LUA_USE_LINUX) || defined(LUA_USE_MACOSX)
+
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <termios.h>
+
+#define UART_TTY_MAX        128
+// 排队等待写入的字节数上限, 超过之后write返回0
+#define UART_TTY_TX_MAX     (4 * 1024 * 1024)
+
+typedef struct uart_tty
+{
+    int id;
+    uint8_t is_pty;
+    uint8_t opened;
+    uint8_t tx_full;
+    int events;             // 当前监听的UV_READABLE/UV_WRITABLE
+    int fd;
+    int slave_fd;           // pty模式自己也打开从设备, 外部程序关闭从设备时主设备不会读到EIO
+    char path[128];         // tty为设备路径, pty为符号链接的路径, 可以为空
+    char slave_name[128];
+    uv_poll_t* poll;
+    uint8_t* tx_buff;       // 还没写进内核的数据, [tx_pos, tx_len)有效
+    size_t tx_pos;
+    size_t tx_len;
+    size_t tx_size;
+}uart_tty_t;
+
+static uart_tty_t* ttys[UART_TTY_MAX];
+extern uv_loop_t *main_loop;
+extern const luat_uart_drv_opts_t* uart_drvs[];
+extern const luat_uart_drv_opts_t uart_tty;
+
+static uart_tty_t* tty_get(int uart_id) {
+    if (uart_id < 0 || uart_id >= UART_TTY_MAX)
+        return NULL;
+    return ttys[uart_id];
+}
+
+static speed_t tty_speed(int baud_rate) {
+    static const struct {
+        int baud;
+        speed_t speed;
+    } speeds[] = {
+        {1200, B1200}, {2400, B2400}, {4800, B4800}, {9600, B9600}, {19200, B19200},
+        {38400, B38400}, {57600, B57600}, {115200, B115200}, {230400, B230400},
+#ifdef B460800
+        {460800, B460800},
+#endif
+#ifdef B921600
+        {921600, B921600},
+#endif
+#ifdef B1000000
+        {1000000, B1000000},
+#endif
+#ifdef B2000000
+        {2000000, B2000000},
+#endif
+#ifdef B3000000
+        {3000000, B3000000},
+#endif
+    };
+    for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+        if (speeds[i].baud == baud_rate)
+            return speeds[i].speed;
+    }
+    return 0;
+}
+
+static int tty_set_attr(int fd, const luat_uart_t* uart) {
+    struct termios tio;
+    if (tcgetattr(fd, &tio))
+        return -1;
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSIZE | CSTOPB | PARENB | PARODD);
+#ifdef CRTSCTS
+    tio.c_cflag &= ~CRTSCTS;
+#endif
+    switch (uart->data_bits) {
+    case 5: tio.c_cflag |= CS5; break;
+    case 6: tio.c_cflag |= CS6; break;
+    case 7: tio.c_cflag |= CS7; break;
+    default: tio.c_cflag |= CS8; break;
+    }
+    if (uart->stop_bits == 2)
+        tio.c_cflag |= CSTOPB;
+    if (uart->parity == LUAT_PARITY_ODD)
+        tio.c_cflag |= PARENB | PARODD;
+    else if (uart->parity == LUAT_PARITY_EVEN)
+        tio.c_cflag |= PARENB;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    speed_t speed = tty_speed(uart->baud_rate);
+    if (speed) {
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+    }
+    else {
+        LLOGW("uart %d 不支持的波特率 %d, 保持原来的设置", uart->id, uart->baud_rate);
+    }
+    return tcsetattr(fd, TCSANOW, &tio);
+}
+
+static void on_poll(uv_poll_t* handle, int status, int events);
+
+static void tty_poll_update(uart_tty_t* t, int events) {
+    if (t->poll == NULL || events == t->events)
+        return;
+    t->events = events;
+    if (events)
+        uv_poll_start(t->poll, events, on_poll);
+    else
+        uv_poll_stop(t->poll);
+}
+
+// 尽量写进内核, 返回-1表示出错
+static int tty_flush(uart_tty_t* t) {
+    while (t->tx_pos < t->tx_len) {
+        ssize_t n = write(t->fd, t->tx_buff + t->tx_pos, t->tx_len - t->tx_pos);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            LLOGW("uart %d 写入失败 %s", t->id, strerror(errno));
+            t->tx_pos = t->tx_len = 0;
+            return -1;
+        }
+        t->tx_pos += n;
+    }
+    t->tx_pos = t->tx_len = 0;
+    return 0;
+}
+
+static int tty_queue(uart_tty_t* t, const void* data, size_t len) {
+    if (t->tx_len + len > t->tx_size) {
+        // 已经写出去的部分先挪走, 还不够再扩大
+        if (t->tx_pos) {
+            memmove(t->tx_buff, t->tx_buff + t->tx_pos, t->tx_len - t->tx_pos);
+            t->tx_len -= t->tx_pos;
+            t->tx_pos = 0;
+        }
+        if (t->tx_len + len > t->tx_size) {
+            size_t size = t->tx_size ? t->tx_size * 2 : 4096;
+            while (size < t->tx_len + len)
+                size *= 2;
+            uint8_t* ptr = luat_heap_realloc(t->tx_buff, size);
+            if (ptr == NULL) {
+                LLOGE("out of memory when uart tty send");
+                return -1;
+            }
+            t->tx_buff = ptr;
+            t->tx_size = size;
+        }
+    }
+    memcpy(t->tx_buff + t->tx_len, data, len);
+    t->tx_len += len;
+    tty_poll_update(t, t->events | UV_WRITABLE);
+    return 0;
+}
+
+static void tty_on_readable(uart_tty_t* t) {
+    uint8_t tmp[4096];
+    while (1) {
+        size_t len;
+        uint8_t* ptr;
+        int hooked = luat_uart_is_hooked(t->id);
+        if (hooked) {
+            ptr = tmp;
+            len = sizeof(tmp);
+        }
+        else {
+            ptr = luat_uart_rx_reserve(t->id, &len);
+            if (len == 0) {
+                // 接收缓冲区满了, Lua读走数据之后再继续
+                tty_poll_update(t, t->events & ~UV_READABLE);
+                return;
+            }
+        }
+        ssize_t n = read(t->fd, ptr, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LLOGW("uart %d 读取失败 %s", t->id, strerror(errno));
+                tty_poll_update(t, t->events & ~UV_READABLE);
+            }
+            return;
+        }
+        if (n == 0)
+            return;
+        if (hooked)
+            luat_uart_rx_input(t->id, ptr, n);
+        else
+            luat_uart_rx_commit(t->id, n);
+    }
+}
+
+static void on_poll(uv_poll_t* handle, int status, int events) {
+    uart_tty_t* t = handle->data;
+    if (status < 0) {
+        LLOGW("uart %d poll %s", t->id, uv_strerror(status));
+        tty_poll_update(t, 0);
+        return;
+    }
+    if (events & UV_READABLE)
+        tty_on_readable(t);
+    if ((events & UV_WRITABLE) && t->tx_len) {
+        if (tty_flush(t)) {
+            // 队列里的数据已经丢弃, 不能再报sent事件, 停止等待可写, 下次write再试
+            t->tx_full = 0;
+            tty_poll_update(t, t->events & ~UV_WRITABLE);
+            return;
+        }
+        if (t->tx_len == 0) {
+            t->tx_full = 0;
+            tty_poll_update(t, t->events & ~UV_WRITABLE);
+            luat_uart_tx_done(t->id);
+        }
+    }
+}
+
+static int tty_open_pty(uart_tty_t* t) {
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) || unlockpt(fd) || ptsname(fd) == NULL) {
+        LLOGE("uart %d 创建伪终端失败 %s", t->id, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    snprintf(t->slave_name, sizeof(t->slave_name), "%s", ptsname(fd));
+    t->slave_fd = open(t->slave_name, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (t->path[0]) {
+        unlink(t->path);
+        if (symlink(t->slave_name, t->path))
+            LLOGW("uart %d 创建符号链接%s失败 %s", t->id, t->path, strerror(errno));
+    }
+    LLOGI("uart %d 伪终端 %s %s", t->id, t->slave_name, t->path);
+    return fd;
+}
+
+static int uart_setup_tty(void* userdata, luat_uart_t* uart) {
+    (void)userdata;
+    uart_tty_t* t = tty_get(uart->id);
+    if (t == NULL)
+        return -1;
+    if (t->opened)
+        return 0;
+    t->slave_fd = -1;
+    if (t->is_pty)
+        t->fd = tty_open_pty(t);
+    else
+        t->fd = open(t->path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (t->fd < 0) {
+        if (!t->is_pty)
+            LLOGE("uart %d 打开%s失败 %s", uart->id, t->path, strerror(errno));
+        return -1;
+    }
+    fcntl(t->fd, F_SETFL, fcntl(t->fd, F_GETFL) | O_NONBLOCK);
+    // pty在从设备一侧设置, 主设备一侧的行规程由它决定
+    if (tty_set_attr(t->slave_fd >= 0 ? t->slave_fd : t->fd, uart))
+        LLOGW("uart %d 设置串口参数失败 %s", uart->id, strerror(errno));
+    if (luat_uart_rx_open(uart->id, uart->bufsz ? uart->bufsz : 1024))
+        goto fail;
+    t->poll = luat_heap_malloc(sizeof(uv_poll_t));
+    if (t->poll == NULL || uv_poll_init(main_loop, t->poll, t->fd)) {
+        luat_heap_free(t->poll);
+        t->poll = NULL;
+        luat_uart_rx_close(uart->id);
+        goto fail;
+    }
+    t->poll->data = t;
+    t->events = 0;
+    t->opened = 1;
+    tty_poll_update(t, UV_READABLE);
+    return 0;
+fail:
+    close(t->fd);
+    t->fd = -1;
+    if (t->slave_fd >= 0) {
+        close(t->slave_fd);
+        t->slave_fd = -1;
+    }
+    return -1;
+}
+
+static int uart_write_tty(void* userdata, int uart_id, void* data, size_t length) {
+    (void)userdata;
+    uart_tty_t* t = tty_get(uart_id);
+    if (t == NULL || !t->opened || length == 0)
+        return 0;
+    if (t->tx_len - t->tx_pos + length > UART_TTY_TX_MAX) {
+        if (!t->tx_full)
+            LLOGW("uart %d 发送队列已满, 等待sent事件之后再写", uart_id);
+        t->tx_full = 1;
+        return 0;
+    }
+    if (t->tx_len == 0) {
+        // 队列为空时直接写, 大部分情况下不需要复制
+        ssize_t n;
+        do {
+            n = write(t->fd, data, length);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            LLOGW("uart %d 写入失败 %s", uart_id, strerror(errno));
+            return 0;
+        }
+        if (n == (ssize_t)length) {
+            luat_uart_tx_done(uart_id);
+            return length;
+        }
+        if (n > 0) {
+            data = (uint8_t*)data + n;
+            length -= n;
+        }
+        else {
+            n = 0;
+        }
+        return tty_queue(t, data, length) ? n : n + length;
+    }
+    if (tty_queue(t, data, length))
+        return 0;
+    return length;
+}
+
+static int uart_read_tty(void* userdata, int uart_id, void* buffer, size_t length) {
+    (void)userdata;
+    uart_tty_t* t = tty_get(uart_id);
+    if (t == NULL || !t->opened)
+        return 0;
+    int ret = luat_uart_rx_read(uart_id, buffer, length);
+    if (ret > 0 && !(t->events & UV_READABLE))
+        tty_poll_update(t, t->events | UV_READABLE);
+    return ret;
+}
+
+static int uart_close_tty(void* userdata, int uart_id) {
+    (void)userdata;
+    uart_tty_t* t = tty_get(uart_id);
+    if (t == NULL || !t->opened)
+        return 0;
+    t->opened = 0;
+    free_uv_handle(t->poll);
+    t->poll = NULL;
+    close(t->fd);
+    t->fd = -1;
+    if (t->slave_fd >= 0) {
+        close(t->slave_fd);
+        t->slave_fd = -1;
+    }
+    if (t->is_pty && t->path[0])
+        unlink(t->path);
+    luat_heap_free(t->tx_buff);
+    t->tx_buff = NULL;
+    t->tx_pos = t->tx_len = t->tx_size = 0;
+    t->tx_full = 0;
+    luat_uart_rx_close(uart_id);
+    return 0;
+}
+
+// tty:///dev/ttyUSB0, pty, pty:///tmp/ttyV1
+int luat_uart_tty_config(int uart_id, const char* url) {
+    uint8_t is_pty;
+    const char* path;
+    if (uart_id < 0 || uart_id >= UART_TTY_MAX)
+        return -1;
+    if (!strncmp(url, "tty://", 6)) {
+        is_pty = 0;
+        path = url + 6;
+        if (path[0] == 0)
+            return -1;
+    }
+    else if (!strcmp(url, "pty")) {
+        is_pty = 1;
+        path = "";
+    }
+    else if (!strncmp(url, "pty://", 6)) {
+        is_pty = 1;
+        path = url + 6;
+    }
+    else {
+        return -1;
+    }
+    if (strlen(path) >= sizeof(ttys[0]->path))
+        return -1;
+    uart_tty_t* t = ttys[uart_id];
+    if (t == NULL) {
+        t = luat_heap_malloc(sizeof(uart_tty_t));
+        if (t == NULL)
+            return -1;
+        memset(t, 0, sizeof(uart_tty_t));
+        t->fd = -1;
+        t->slave_fd = -1;
+        ttys[uart_id] = t;
+    }
+    else if (t->opened) {
+        LLOGE("uart %d 已经打开, 不能修改配置", uart_id);
+        return -1;
+    }
+    t->id = uart_id;
+    t->is_pty = is_pty;
+    snprintf(t->path, sizeof(t->path), "%s", path);
+    t->slave_name[0] = 0;
+    uart_drvs[uart_id] = &uart_tty;
+    return 0;
+}
+
+const char* luat_uart_tty_name(int uart_id) {
+    uart_tty_t* t = tty_get(uart_id);
+    if (t == NULL || !t->opened)
+        return NULL;
+    return t->is_pty ? t->slave_name : t->path;
+}
+
+const luat_uart_drv_opts_t uart_tty = {
+    .setup = uart_setup_tty,
+    .write = uart_write_tty,
+    .read = uart_read_tty,
+    .close = uart_close_tty,
+};
+
+#else
+
+int luat_uart_tty_config(int uart_id, const char* url) {
+    (void)uart_id;
+    (void)url;
+    return -1;
+}
+
+const char* luat_uart_tty_name(int uart_id) {
+    (void)uart_id;
+    return NULL;
+}
+
+#endif
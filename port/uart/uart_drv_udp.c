@@ -14,169 +14,187 @@
 
 #include "luat_pcconf.h"
 
-void uv_buf_alloc(uv_handle_t *tcp, size_t size, uv_buf_t *buf);
-
 typedef struct uart_drv_udp
 {
     // UDP实例
     uv_udp_t udp;
     // void* userdata;
-    // 远端配置, 默认应该是广播地址
+    // 远端地址, 127.0.0.1:port_start+UART_UDP_PEER_OFFSET+序号
     struct sockaddr_in remote;
     int state; // 0, closed, 1, open
-    char* recv_buff;
-    size_t recv_len;
+    int inited; // udp句柄已经创建, uart.close只停止接收, 端口一直保留
+    int id;
 }uart_drv_udp_t;
 
-static uart_drv_udp_t udps[8];
+// 本机监听port_start+序号, 发往port_start+UART_UDP_PEER_OFFSET+序号, 序号是串口id减去id_start
+// 端口范围可以用--uart_udp=port_start,id_start,id_count修改, 同一台电脑上跑多个模拟器时互不冲突
+#define UART_UDP_PEER_OFFSET    10000
+
+extern luat_pcconf_t g_pcconf;
 extern uv_loop_t *main_loop;
 
+// 实例在uart.setup时才分配, 表的大小是id_count
+static uart_drv_udp_t** udps;
+static size_t udps_count;
+
+static uart_drv_udp_t* udp_get(int uart_id) {
+    size_t index = (size_t)uart_id - g_pcconf.uart_udp_id_start;
+    if (uart_id < 0 || (size_t)uart_id < g_pcconf.uart_udp_id_start || index >= udps_count)
+        return NULL;
+    return udps[index];
+}
+
+static uart_drv_udp_t* udp_new(int uart_id) {
+    size_t index = (size_t)uart_id - g_pcconf.uart_udp_id_start;
+    if (uart_id < 0 || (size_t)uart_id < g_pcconf.uart_udp_id_start || index >= g_pcconf.uart_udp_id_count) {
+        LLOGE("uart %d 不在UDP虚拟串口的范围内 %d~%d", uart_id, (int)g_pcconf.uart_udp_id_start,
+            (int)(g_pcconf.uart_udp_id_start + g_pcconf.uart_udp_id_count - 1));
+        return NULL;
+    }
+    if (g_pcconf.uart_udp_port_start + UART_UDP_PEER_OFFSET + index > 65535) {
+        LLOGE("uart %d 的UDP端口超出范围, 请检查uart_udp_port_start", uart_id);
+        return NULL;
+    }
+    if (udps == NULL) {
+        udps = luat_heap_malloc(sizeof(uart_drv_udp_t*) * g_pcconf.uart_udp_id_count);
+        if (udps == NULL)
+            return NULL;
+        memset(udps, 0, sizeof(uart_drv_udp_t*) * g_pcconf.uart_udp_id_count);
+        udps_count = g_pcconf.uart_udp_id_count;
+    }
+    if (udps[index])
+        return udps[index];
+    uart_drv_udp_t* u = luat_heap_malloc(sizeof(uart_drv_udp_t));
+    if (u == NULL)
+        return NULL;
+    memset(u, 0, sizeof(uart_drv_udp_t));
+    u->id = uart_id;
+    uv_ip4_addr("127.0.0.1", (int)(g_pcconf.uart_udp_port_start + UART_UDP_PEER_OFFSET + index), &u->remote);
+    udps[index] = u;
+    return u;
+}
+
+// libuv接收数据报用的临时缓冲区, 回调里就拷进串口的接收缓冲区, 所有串口共用一个
+static char udp_recv_buff[64 * 1024];
+
+static void uart_udp_alloc(uv_handle_t *handle, size_t size, uv_buf_t *buf) {
+    (void)handle;
+    (void)size;
+    buf->base = udp_recv_buff;
+    buf->len = sizeof(udp_recv_buff);
+}
+
 static void uart_udp_recv_cb(uv_udp_t *udp,
                         ssize_t nread,
                         const uv_buf_t *buf,
                         const struct sockaddr *addr,
                         unsigned flags) {
-    if (nread < 0) {
-        luat_heap_free(buf->base);
-        return;
-    }
-    if (nread == 0) {
-        luat_heap_free(buf->base);
+    if (nread <= 0) {
         return;
     }
-    int uart_id = (int)udp->data;
-    size_t newsize = udps[uart_id].recv_len + nread;
-    if (udps[uart_id].recv_buff == NULL) {
-        udps[uart_id].recv_buff = luat_heap_malloc(nread);
-        udps[uart_id].recv_len = nread;
-        memcpy(udps[uart_id].recv_buff, buf->base, nread);
-    }
-    else {
-        void* ptr = luat_heap_realloc(udps[uart_id].recv_buff, newsize);
-        if (ptr == NULL) {
-            LLOGE("overflow when uart recv");
-            luat_heap_free(buf->base);
-            return;
-        }
-        udps[uart_id].recv_buff = ptr;
-        memcpy(udps[uart_id].recv_buff + udps[uart_id].recv_len, buf->base, nread);
-    }
-    luat_heap_free(buf->base);
-    rtos_msg_t msg = {
-        .handler = l_uart_handler,
-        .arg1 = uart_id,
-        .arg2 = nread
-    };
-    luat_msgbus_put(&msg, 0);
+    int uart_id = ((uart_drv_udp_t*)udp->data)->id;
+    // 被PPP等C模块接管的串口, 数据直接交给接管者; 缓冲区满了丢弃并计数
+    luat_uart_rx_input(uart_id, (const uint8_t*)buf->base, nread);
 }
 
 static int uart_setup_udp(void* userdata, luat_uart_t* uart) {
-    if (uart->id < 0 || uart->id >= 8) {
+    uart_drv_udp_t* u = udp_new(uart->id);
+    if (u == NULL) {
         return -1;
     }
-    if (udps[uart->id].state) {
+    if (u->state) {
         return 0;
     }
     int ret = 0;
-    LLOGD("初始化uart udp %d port %d %d", uart->id, 9000 + uart->id, 19000 + uart->id);
-    ret = uv_udp_init(main_loop, &udps[uart->id].udp);
-    if (ret)
-        LLOGW("uv_udp_init %d", ret);
-    udps[uart->id].udp.data = (void*)uart->id;
-    struct sockaddr_in addr;
-    uv_ip4_addr("0.0.0.0", 9000 + uart->id, &addr);
-    ret = uv_udp_bind(&udps[uart->id].udp, (const struct sockaddr*) &addr, 0);
-    if (ret)
-        LLOGW("uv_udp_bind %d", ret);
-    ret = uv_udp_recv_start(&udps[uart->id].udp, uv_buf_alloc, uart_udp_recv_cb);
+    if (!u->inited) {
+        int port = (int)(g_pcconf.uart_udp_port_start + uart->id - g_pcconf.uart_udp_id_start);
+        LLOGD("初始化uart udp %d port %d %d", uart->id, port, port + UART_UDP_PEER_OFFSET);
+        ret = uv_udp_init(main_loop, &u->udp);
+        if (ret) {
+            LLOGE("uv_udp_init %s", uv_strerror(ret));
+            return -1;
+        }
+        u->udp.data = u;
+        struct sockaddr_in addr;
+        uv_ip4_addr("0.0.0.0", port, &addr);
+        ret = uv_udp_bind(&u->udp, (const struct sockaddr*) &addr, 0);
+        if (ret) {
+            // 端口被占用, 多半是另一个模拟器用了同一段端口
+            LLOGE("uart %d 绑定端口 %d 失败 %s", uart->id, port, uv_strerror(ret));
+            udps[uart->id - g_pcconf.uart_udp_id_start] = NULL;
+            free_uv_handle(u);
+            return -1;
+        }
+        u->inited = 1;
+    }
+    if (luat_uart_rx_open(uart->id, uart->bufsz ? uart->bufsz : 1024))
+        return -1;
+    ret = uv_udp_recv_start(&u->udp, uart_udp_alloc, uart_udp_recv_cb);
     if (ret)
         LLOGW("uv_udp_recv_start %d", ret);
-    udps[uart->id].state = 1;
+    u->state = 1;
     return 0;
 }
 
 static void on_sent_udp(uv_udp_send_t *req, int status) {
+    int uart_id = (int)req->data;
+    luat_heap_free(req);
     if (status < 0) {
         LLOGW("uart udp 发送失败 %d", status);
         return;
     }
-    rtos_msg_t msg = {
-        .handler = l_uart_handler,
-        .arg1 = (int)req->data,
-        .arg2 = 0
-    };
-    luat_msgbus_put(&msg, 0);
+    luat_uart_tx_done(uart_id);
 }
 
 static int uart_write_udp(void* userdata, int uart_id, void* data, size_t length) {
-    if (uart_id < 0 || uart_id >= 8) {
-        return 0;
-    }
-    if (udps[uart_id].state == 0) {
+    uart_drv_udp_t* u = udp_get(uart_id);
+    if (u == NULL || u->state == 0) {
         return 0;
     }
     char* ptr = data;
     uv_buf_t buf;
-    struct sockaddr_in dst_addr;
     int ret = 0;
-    uv_ip4_addr("127.0.0.1", 19000 + uart_id, &dst_addr);
     while (length > 0) {
-        if (length > 512) {
-            buf = uv_buf_init(ptr, 512);
-            length -= 512;
-        }
-        else {
-            buf = uv_buf_init(ptr, length);
-            length = 0;
+        size_t n = length > 512 ? 512 : length;
+        // uv_udp_send发不出去时会排队, 数据要保留到回调, 所以复制一份跟在req后面
+        uv_udp_send_t* req = luat_heap_malloc(sizeof(uv_udp_send_t) + n);
+        if (req == NULL) {
+            LLOGE("out of memory when uart udp send");
+            break;
         }
-        uv_udp_send_t* req = luat_heap_malloc(sizeof(uv_udp_send_t));
+        memcpy(req + 1, ptr, n);
+        buf = uv_buf_init((char*)(req + 1), n);
+        ptr += n;
+        length -= n;
         req->data = (void*)uart_id;
-        ret = uv_udp_send(req, &udps[uart_id].udp, &buf, 1, &dst_addr, on_sent_udp);
-        if (ret)
+        ret = uv_udp_send(req, &u->udp, &buf, 1, (const struct sockaddr*)&u->remote, on_sent_udp);
+        if (ret) {
             LLOGE("uv_udp_send %d", ret);
+            luat_heap_free(req);
+        }
         if (length > 0) {
             uv_sleep(1); // 减少UDP顺序错误
         }
     }
-    return length;
+    return ptr - (char*)data;
 }
 
 static int uart_read_udp(void* userdata, int uart_id, void* buffer, size_t length) {
-    if (uart_id < 0 || uart_id >= 8) {
+    uart_drv_udp_t* u = udp_get(uart_id);
+    if (u == NULL || u->state == 0) {
         return 0;
     }
-    if (udps[uart_id].state == 0) {
-        return 0;
-    }
-    if (udps[uart_id].recv_len == 0) {
-        return 0;
-    }
-    if (length > udps[uart_id].recv_len) {
-        length = udps[uart_id].recv_len;
-    }
-    memcpy(buffer, udps[uart_id].recv_buff, length);
-    if (udps[uart_id].recv_len > length) {
-        size_t newsize = udps[uart_id].recv_len - length;
-        memmove(udps[uart_id].recv_buff, udps[uart_id].recv_buff + udps[uart_id].recv_len, newsize);
-        void* ptr = luat_heap_realloc(udps[uart_id].recv_buff, newsize);
-        udps[uart_id].recv_buff = ptr;
-        udps[uart_id].recv_len = newsize;
-    }
-    else {
-        luat_heap_free(udps[uart_id].recv_buff);
-        udps[uart_id].recv_buff = NULL;
-        udps[uart_id].recv_len = 0;
-    }
-    return length;
+    return luat_uart_rx_read(uart_id, buffer, length);
 }
 
 static int uart_close_udp(void* userdata, int uart_id) {
-    if (uart_id < 0 || uart_id >= 8) {
-        return 0;
-    }
-    if (udps[uart_id].state == 0) {
+    uart_drv_udp_t* u = udp_get(uart_id);
+    if (u == NULL || u->state == 0) {
         return 0;
     }
+    uv_udp_recv_stop(&u->udp);
+    luat_uart_rx_close(uart_id);
+    u->state = 0;
     return 0;
 }
 
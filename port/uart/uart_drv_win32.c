@@ -14,7 +14,6 @@
 #include "windows.h"
 
 
-int l_uart_handler(lua_State *L, void* ptr);
 static void luat_uart_recv_cb(int id, int len);
 
 //检测串口存不存在
@@ -68,6 +67,11 @@ static int uart_setup_win32(void* userdata, luat_uart_t* uart)
     int ret = luat_uart_open_extern(uart->id,uart->baud_rate,uart->data_bits,uart->stop_bits,uart->parity);
     // LLOGD("执行uart_setup_win32 %d", ret);
     if (ret == 0) {
+        // 与其他驱动一样经过公共的接收缓冲区, 限速/合并/录制/接管都在那里处理
+        if (luat_uart_rx_open(uart->id, uart->bufsz ? uart->bufsz : 1024)) {
+            luat_uart_close_extern(uart->id);
+            return -1;
+        }
         luat_uart_recv_cb_extern(uart->id,luat_uart_recv_cb);
     }
     return ret;
@@ -80,18 +84,36 @@ static int uart_write_win32(void* userdata, int uartid, void* data, size_t lengt
 
 static int uart_read_win32(void* userdata, int uartid, void* buffer, size_t length)
 {
-    return luat_uart_read_extern(uartid,buffer,length);
+    return luat_uart_rx_read(uartid,buffer,length);
 }
 
 static int uart_close_win32(void* userdata, int uartid)
 {
+    luat_uart_rx_close(uartid);
     return luat_uart_close_extern(uartid);
 }
 
+// 在事件循环里把dll收到的数据取出来, 放进公共的接收缓冲区
+static int l_uart_win32_rx_handler(lua_State *L, void* ptr)
+{
+    (void)ptr;
+    rtos_msg_t* msg = (rtos_msg_t*)lua_topointer(L, -1);
+    int id = msg->arg1;
+    uint8_t tmp[1024];
+    while (1) {
+        int n = luat_uart_read_extern(id, tmp, sizeof(tmp));
+        if (n <= 0)
+            break;
+        luat_uart_rx_input(id, tmp, n);
+    }
+    return 0;
+}
+
+// dll的回调不在事件循环的线程里, 不能直接操作接收缓冲区
 static void luat_uart_recv_cb(int id, int len)
 {
     rtos_msg_t msg;
-    msg.handler = l_uart_handler;
+    msg.handler = l_uart_win32_rx_handler;
     msg.ptr = NULL;
     msg.arg1 = id;
     msg.arg2 = len;
@@ -58,8 +58,6 @@ static void timer_nop(uv_timer_t *handle) {
     (void)handle;
 }
 
-static void timer_lwip(uv_timer_t *handle);
-
 // boot
 int main(int argc, char** argv) {
     cmdline_argc = argc;
@@ -104,11 +102,7 @@ int main(int argc, char** argv) {
     // 加一个NOP的timer，防止uv_run 立即退出
     uv_timer_t t;
     uv_timer_init(main_loop, &t);
-    #if defined(LUAT_USE_LWIP)
-    uv_timer_start(&t, timer_lwip, 5, 5);
-    #else
     uv_timer_start(&t, timer_nop, 1000, 1000);
-    #endif
 
     uv_luat_main(NULL);
 
@@ -135,9 +129,3 @@ static void lvgl_timer_cb(uv_timer_t* lvgl_timer) {
 }
 #endif
 
-
-void sys_check_timeouts(void);
-static void timer_lwip(uv_timer_t *handle) {
-    (void)handle;
-    sys_check_timeouts();
-}
@@ -1,6 +1,10 @@
 
+-- mock脚本只编译一次, 局部变量在多次调用之间保留, 修改本文件之后会自动重新加载
+local count = 0
+
 local function mock_handle(key, data)
-    log.info("mock.key", key)
+    count = count + 1
+    log.info("mock.key", key, count)
     --print("mock", key, data or "nil")
     if key == "rtos.bsp.get" then
         return 0, "EC618"
@@ -0,0 +1,33 @@
+
+_G.sys = require("sys")
+require "sysplus"
+
+-- 并发解析同一个域名, 只应该产生1次实际解析
+sys.taskInit(function()
+    sys.waitUntil("IP_READY")
+    for i = 1, 20 do
+        sys.taskInit(function()
+            local netc = socket.create(nil, function() end)
+            socket.config(netc)
+            local ok = socket.connect(netc, "www.baidu.com", 80)
+            log.info("socket", i, ok)
+            sys.wait(500)
+            socket.close(netc)
+            socket.release(netc)
+        end)
+    end
+    sys.wait(3000)
+    log.info("dns", json.encode(pcnet.dnsStat()))
+    -- 不存在的域名, 第二次应命中负缓存
+    for i = 1, 2 do
+        local netc = socket.create(nil, function() end)
+        socket.config(netc)
+        socket.connect(netc, "not-exist.luatos.invalid", 80)
+        sys.wait(2000)
+        socket.close(netc)
+        socket.release(netc)
+    end
+    log.info("dns", json.encode(pcnet.dnsStat()))
+end)
+
+sys.run()
@@ -0,0 +1,30 @@
+
+_G.sys = require("sys")
+require "sysplus"
+
+-- 对比开启/关闭Happy Eyeballs时的连接耗时
+local function connect_once(host, port)
+    local netc = socket.create(nil, function() end)
+    socket.config(netc)
+    local ok = socket.connect(netc, host, port)
+    sys.wait(1000)
+    local info = pcnet.connectInfo(netc)
+    if info then
+        log.info("socket", host, ok, "IPv" .. info.family, "尝试", info.attempts, "耗时", info.connect_ms, "ms")
+    end
+    socket.close(netc)
+    socket.release(netc)
+end
+
+sys.taskInit(function()
+    sys.waitUntil("IP_READY")
+    for _, enable in ipairs({true, false}) do
+        pcnet.heConfig(enable, 250)
+        pcnet.dnsClear()
+        log.info("he", enable and "开启" or "关闭")
+        connect_once("www.baidu.com", 80)
+        connect_once("www.google.com", 443)
+    end
+end)
+
+sys.run()
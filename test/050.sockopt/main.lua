@@ -0,0 +1,21 @@
+
+_G.sys = require("sys")
+require "sysplus"
+
+-- 设置socket选项并读回实际生效的值
+sys.taskInit(function()
+    sys.waitUntil("IP_READY")
+    pcnet.sockoptDefault({nodelay=true})
+    local netc = socket.create(nil, function() end)
+    -- keepalive参数来自socket.config
+    socket.config(netc, nil, nil, nil, 30, 5, 3)
+    pcnet.sockopt(netc, {sndbuf=256*1024, rcvbuf=256*1024})
+    log.info("sockopt", "连接前", json.encode(pcnet.sockopt(netc)))
+    socket.connect(netc, "www.baidu.com", 80)
+    sys.wait(1000)
+    log.info("sockopt", "连接后", json.encode(pcnet.sockopt(netc)))
+    socket.close(netc)
+    socket.release(netc)
+end)
+
+sys.run()
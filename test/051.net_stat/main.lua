@@ -0,0 +1,30 @@
+
+_G.sys = require("sys")
+require "sysplus"
+
+-- socket统计信息, 每10秒打印一次
+pcnet.statDump(10000)
+
+sys.taskInit(function()
+    sys.waitUntil("IP_READY")
+    local rxbuff = zbuff.create(1024)
+    local netc = socket.create(nil, function(netc, event, param)
+        if event == socket.EVENT then
+            socket.rx(netc, rxbuff)
+            rxbuff:del()
+        end
+    end)
+    socket.config(netc)
+    socket.connect(netc, "httpbin.air32.cn", 80)
+    sys.wait(1000)
+    for i = 1, 10 do
+        socket.tx(netc, "GET /get HTTP/1.1\r\nHost: httpbin.air32.cn\r\n\r\n")
+        sys.wait(500)
+    end
+    log.info("stat", json.encode(pcnet.sockStat(netc)))
+    socket.close(netc)
+    socket.release(netc)
+    log.info("total", json.encode(pcnet.sockStat()))
+end)
+
+sys.run()
@@ -0,0 +1,70 @@
+
+_G.sys = require("sys")
+require "sysplus"
+
+-- 进程内虚拟网络, 不依赖真实网络, 用于测量socket库本身的吞吐和在给定链路条件下的表现
+pcnet.vnetListen(7, "echo", {latency=20, bandwidth=1000000, loss=1})
+pcnet.vnetListen(9, "discard")
+pcnet.vnetListen(19, "source", {size=8*1024*1024})
+pcnet.vnetListen(1883, function(conn, event, data)
+    log.info("custom", conn, event, data and #data)
+    if event == "connect" then
+        return "hello from vnet\r\n"
+    elseif event == "data" then
+        return data:upper()
+    end
+end)
+
+local function bench(port, total, txsize)
+    local rxbuff = zbuff.create(64 * 1024)
+    local topic = "vnet_" .. port
+    local rx = 0
+    local netc = socket.create(pcnet.VNET, function(netc, event, param)
+        if event == socket.ON_LINE then
+            sys.publish(topic, "online")
+        elseif event == socket.EVENT then
+            socket.rx(netc, rxbuff)
+            rx = rx + rxbuff:used()
+            rxbuff:del()
+            if rx >= total then
+                sys.publish(topic, "done")
+            end
+        elseif event == socket.TX_OK then
+            sys.publish(topic, "tx")
+        elseif event == socket.CLOSED then
+            sys.publish(topic, "closed")
+        end
+    end)
+    socket.config(netc)
+    local start = mcu.ticks()
+    socket.connect(netc, "vnet.local", port)
+    sys.waitUntil(topic, 1000)
+    local connected = mcu.ticks()
+    if txsize then
+        local data = string.rep("A", txsize)
+        local tx = 0
+        while tx < total do
+            socket.tx(netc, data)
+            tx = tx + txsize
+            sys.waitUntil(topic, 1000)
+        end
+    end
+    if port ~= 9 then
+        sys.waitUntil(topic, 30000)
+    end
+    local ms = mcu.ticks() - connected
+    log.info("bench", port, "connect", connected - start, "ms", "bytes", total, "ms", ms,
+        "KB/s", ms > 0 and (total // ms) or 0)
+    log.info("bench", port, json.encode(pcnet.vnetStat(port)))
+    socket.close(netc)
+    socket.release(netc)
+end
+
+sys.taskInit(function()
+    bench(9, 8 * 1024 * 1024, 8192)
+    bench(19, 8 * 1024 * 1024)
+    bench(7, 256 * 1024, 1460)
+    bench(1883, 17)
+end)
+
+sys.run()
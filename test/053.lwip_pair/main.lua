@@ -0,0 +1,55 @@
+
+_G.sys = require("sys")
+require "sysplus"
+
+-- 两块首尾相连的lwip虚拟网卡, socket.LWIP_AP做服务端, socket.LWIP_STA做客户端
+-- 全部流量都在进程内, 不需要真实网络
+pcnet.lwipPair(socket.LWIP_STA, socket.LWIP_AP, "192.168.77.1", "192.168.77.2")
+
+local total = 4 * 1024 * 1024
+
+sys.taskInit(function()
+    local rxbuff = zbuff.create(16 * 1024)
+    local rx = 0
+    local start = 0
+    local server = socket.create(socket.LWIP_AP, function(netc, event, param)
+        if event == socket.ON_LINE then
+            log.info("server", "客户端已连接")
+            start = mcu.ticks()
+        elseif event == socket.EVENT then
+            socket.rx(netc, rxbuff)
+            rx = rx + rxbuff:used()
+            rxbuff:del()
+            if rx >= total then
+                sys.publish("PAIR_DONE")
+            end
+        end
+    end)
+    socket.config(server, 5001)
+    socket.listen(server)
+
+    local client = socket.create(socket.LWIP_STA, function(netc, event, param)
+        if event == socket.TX_OK then
+            sys.publish("PAIR_TX")
+        end
+    end)
+    socket.config(client)
+    socket.connect(client, "192.168.77.2", 5001)
+    sys.wait(100)
+    local data = string.rep("L", 1024)
+    local tx = 0
+    while tx < total do
+        socket.tx(client, data)
+        tx = tx + #data
+        sys.waitUntil("PAIR_TX", 1000)
+    end
+    sys.waitUntil("PAIR_DONE", 10000)
+    local ms = mcu.ticks() - start
+    log.info("pair", "bytes", rx, "ms", ms, "KB/s", ms > 0 and (rx // ms) or 0)
+    log.info("pair", "STA", json.encode(pcnet.lwipLinkStat(socket.LWIP_STA)))
+    log.info("pair", "AP", json.encode(pcnet.lwipLinkStat(socket.LWIP_AP)))
+    socket.close(client)
+    socket.close(server)
+end)
+
+sys.run()
@@ -0,0 +1,15 @@
+
+_G.sys = require("sys")
+
+-- lwip校验和各实现的速度对比, 单位MB/s, sum为单独计算, copy为边复制边计算
+sys.taskInit(function()
+    log.info("chksum", "当前实现", pcnet.chksumImpl())
+    local result = pcnet.chksumBench({64, 256, 576, 1460, 4096, 9000})
+    for impl, sizes in pairs(result) do
+        for size, speed in pairs(sizes) do
+            log.info("chksum", impl, size, "sum", speed.sum, "copy", speed.copy)
+        end
+    end
+end)
+
+sys.run()
@@ -0,0 +1,41 @@
+
+_G.sys = require("sys")
+
+-- 用zbuff零拷贝地向lwip网卡注入以太网帧
+pcnet.lwipPair(socket.LWIP_STA, socket.LWIP_AP, "192.168.77.1", "192.168.77.2")
+
+sys.taskInit(function()
+    sys.wait(100)
+    -- 询问192.168.77.2的ARP请求, socket.LWIP_AP收到后会回复
+    local frame = string.fromHex("FFFFFFFFFFFF02000000000908060001080006040001020000000009C0A84D09000000000000C0A84D02")
+    local buffs = {}
+    for i = 1, 4 do
+        buffs[i] = zbuff.create(64)
+        buffs[i]:write(frame)
+    end
+    for i = 1, 1000 do
+        local buff = buffs[i % 4 + 1]
+        -- 上一次注入的帧lwip还没有释放, 就不能改写这个zbuff
+        while pcnet.lwipPinned(buff) > 0 do
+            sys.wait(1)
+        end
+        local ok, zerocopy = pcnet.lwipInput(socket.LWIP_AP, buff)
+        if not ok then
+            log.warn("zinput", "注入失败", i)
+        end
+    end
+    -- lwip引用期间zbuff被锁定, 改写会报错
+    local buff = buffs[1]
+    pcnet.lwipInput(socket.LWIP_AP, buff)
+    if pcnet.lwipPinned(buff) > 0 then
+        local ok = pcall(function() buff:write(frame) end)
+        assert(not ok, "被lwip引用的zbuff不应该能改写")
+    end
+    sys.wait(100)
+    assert(pcnet.lwipPinned(buff) == 0)
+    buff:seek(0)
+    buff:write(frame)
+    log.info("zinput", json.encode(pcnet.lwipLinkStat(socket.LWIP_AP)))
+end)
+
+sys.run()
@@ -0,0 +1,77 @@
+
+_G.sys = require("sys")
+require "sysplus"
+
+-- 启动时加 --lwip_profile=host 可以直接使用host profile, 这里演示运行时切换
+-- mcu profile与模组上的内存池一样, 只有5个TCP连接; host profile可以有上千个
+log.info("profile", json.encode(pcnet.lwipProfile()))
+pcnet.lwipProfile("host")
+-- 也可以在当前profile的基础上调整个别参数
+pcnet.lwipProfile({tcp_wnd = 128 * 1024, tcp_rcv_scale = 2})
+log.info("profile", json.encode(pcnet.lwipProfile()))
+
+pcnet.lwipPair(socket.LWIP_STA, socket.LWIP_AP, "192.168.77.1", "192.168.77.2")
+
+-- 每个服务端socket只接受一个连接, 所以每条流用一个端口
+local flows = 50
+local per_flow = 256 * 1024
+
+sys.taskInit(function()
+    local rxbuff = zbuff.create(64 * 1024)
+    local rx = 0
+    local done = 0
+    local servers = {}
+    local clients = {}
+    for i = 1, flows do
+        local got = 0
+        local finished = false
+        local server = socket.create(socket.LWIP_AP, function(netc, event, param)
+            if event == socket.EVENT then
+                socket.rx(netc, rxbuff)
+                got = got + rxbuff:used()
+                rx = rx + rxbuff:used()
+                rxbuff:del()
+                if got >= per_flow and not finished then
+                    finished = true
+                    done = done + 1
+                    if done == flows then
+                        sys.publish("PROFILE_DONE")
+                    end
+                end
+            end
+        end)
+        socket.config(server, 6000 + i)
+        socket.listen(server)
+        servers[i] = server
+    end
+    local start = mcu.ticks()
+    local data = string.rep("P", 16 * 1024)
+    for i = 1, flows do
+        local client = socket.create(socket.LWIP_STA, function(netc, event, param)
+            if event == socket.ON_LINE then
+                for _ = 1, per_flow // #data do
+                    socket.tx(netc, data)
+                end
+            end
+        end)
+        socket.config(client)
+        socket.connect(client, "192.168.77.2", 6000 + i)
+        clients[i] = client
+    end
+    sys.waitUntil("PROFILE_DONE", 30000)
+    local ms = mcu.ticks() - start
+    log.info("profile", "flows", done, "bytes", rx, "ms", ms, "KB/s", ms > 0 and (rx // ms) or 0)
+    local stat = pcnet.lwipStat()
+    for _, name in ipairs({"MEM", "TCP_PCB", "TCP_PCB_LISTEN", "TCP_SEG", "PBUF_POOL"}) do
+        local s = stat[name]
+        log.info("lwip", name, "used", s.used, "max", s.max, "cap", s.cap, "err", s.err)
+    end
+    -- 已有的连接会读取TCP参数, 有连接时不允许切换
+    assert(pcnet.lwipProfile("mcu") == nil, "有TCP连接时切换profile应该失败")
+    for i = 1, flows do
+        socket.close(clients[i])
+        socket.close(servers[i])
+    end
+end)
+
+sys.run()
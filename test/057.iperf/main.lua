@@ -0,0 +1,45 @@
+
+_G.sys = require("sys")
+require "sysplus"
+
+-- iperf2兼容的吞吐量测试, 同样的参数分别跑在进程内的lwip和系统协议栈(libuv)上
+-- 服务端也可以用PC上的 iperf -c 127.0.0.1 -p 5002 测试, 客户端可以连 iperf -s
+pcnet.lwipProfile("host")
+pcnet.lwipPair(socket.LWIP_STA, socket.LWIP_AP, "192.168.77.1", "192.168.77.2")
+
+local function run(backend, server_opts, client_opts)
+    local sid = pcnet.iperfServer(server_opts)
+    local cid = pcnet.iperfClient(client_opts)
+    local reports = {}
+    while true do
+        local result, id, report = sys.waitUntil("IPERF_REPORT", 20000)
+        if not result then
+            log.error("iperf", backend, "超时")
+            break
+        end
+        reports[report.role] = report
+        log.info("iperf", backend, report.role, report.result, report.remote,
+            report.bytes, "bytes", report.ms, "ms", report.kbps, "kbps",
+            "retrans", report.retrans, string.format("cpu %.2f ns/B", report.cpu_ns_per_byte))
+        if reports.server and reports.client then
+            break
+        end
+    end
+    pcnet.iperfStop(sid)
+    return reports
+end
+
+sys.taskInit(function()
+    sys.wait(100)
+    local lwip = run("lwip",
+        {backend = "lwip", adapter = socket.LWIP_AP},
+        {backend = "lwip", adapter = socket.LWIP_STA, host = "192.168.77.2", time = 3})
+    local uv = run("libuv",
+        {backend = "libuv", host = "127.0.0.1", port = 5002},
+        {backend = "libuv", host = "127.0.0.1", port = 5002, time = 3})
+    if lwip.server and uv.server then
+        log.info("iperf", "lwip/libuv 吞吐量", string.format("%.1f%%", lwip.server.kbps * 100 / uv.server.kbps))
+    end
+end)
+
+sys.run()
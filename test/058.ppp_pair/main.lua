@@ -0,0 +1,70 @@
+
+_G.sys = require("sys")
+require "sysplus"
+
+-- 两个PPPoS网卡首尾相连, 帧经过完整的HDLC编码/解码和LCP/IPCP协商, 用iperf测量PPP链路的吞吐量
+-- 对比pppos.c原来的逐字节处理(lwip)与批量扫描+查表FCS的实现
+-- 真实串口上的用法: uart.setup之后 pcnet.pppOpen(socket.LWIP_GP, uart_id, {user="card", passwd="card"})
+pcnet.lwipProfile("host")
+
+local function wait_running(timeout)
+    while timeout > 0 do
+        local a = pcnet.pppStat(socket.LWIP_STA)
+        local b = pcnet.pppStat(socket.LWIP_AP)
+        if a and b and a.phase == pcnet.PPP_RUNNING and b.phase == pcnet.PPP_RUNNING then
+            return true
+        end
+        sys.wait(10)
+        timeout = timeout - 10
+    end
+    return false
+end
+
+local function run(impl)
+    pcnet.hdlcImpl(impl)
+    local start = mcu.ticks()
+    pcnet.pppPair(socket.LWIP_STA, socket.LWIP_AP, "192.168.78.1", "192.168.78.2")
+    if not wait_running(5000) then
+        log.error("ppp", impl, "协商超时")
+        pcnet.pppClose(socket.LWIP_STA)
+        return
+    end
+    log.info("ppp", impl, "协商耗时", mcu.ticks() - start, "ms")
+    local sid = pcnet.iperfServer({backend = "lwip", adapter = socket.LWIP_AP})
+    pcnet.iperfClient({backend = "lwip", adapter = socket.LWIP_STA, host = "192.168.78.2", time = 3})
+    local reports = {}
+    while not (reports.server and reports.client) do
+        local result, id, report = sys.waitUntil("IPERF_REPORT", 20000)
+        if not result then
+            log.error("ppp", impl, "iperf超时")
+            break
+        end
+        reports[report.role] = report
+    end
+    pcnet.iperfStop(sid)
+    local stat = pcnet.pppStat(socket.LWIP_STA)
+    if reports.server then
+        log.info("ppp", impl, reports.server.kbps, "kbps", "线路开销", string.format("%.4f", stat.overhead),
+            "帧", stat.tx_frames, stat.rx_frames,
+            string.format("发送 %.2f ns/B", stat.tx_ns / stat.tx_payload),
+            string.format("接收 %.2f ns/B", stat.rx_ns / pcnet.pppStat(socket.LWIP_AP).rx_payload))
+    end
+    pcnet.pppClose(socket.LWIP_STA)
+    -- 两端都释放之后才能在同一个适配器上重新创建
+    while pcnet.pppStat(socket.LWIP_STA) or pcnet.pppStat(socket.LWIP_AP) do
+        sys.wait(10)
+    end
+end
+
+sys.taskInit(function()
+    sys.wait(100)
+    local default = pcnet.hdlcImpl()
+    run("lwip")
+    run(default)
+    pcnet.hdlcImpl(default)
+    -- 协商之后一般只转义0x7D/0x7E, LCP阶段的ACCM是全部控制字符
+    log.info("hdlc", json.encode(pcnet.hdlcBench()))
+    log.info("hdlc", "accm=0xFFFFFFFF", json.encode(pcnet.hdlcBench(nil, nil, 0xFFFFFFFF)))
+end)
+
+sys.run()
@@ -0,0 +1,32 @@
+
+_G.sys = require("sys")
+
+-- 模拟上千台主机的局域网, 测试ARP表与网桥转发表的查表开销
+-- mcu profile的ARP表只有10项, 轮流给1000台主机发包几乎每次都要重新解析; host profile有2048项
+local function run(profile, hosts, fdb_size)
+    pcnet.lwipProfile(profile)
+    local result = pcnet.lanBench(hosts, 10, fdb_size)
+    if not result then
+        log.error("lan", profile, "测试失败")
+        return
+    end
+    log.info("lan", profile, "hosts", result.hosts, "arp表项", result.arp_entries, "未命中", result.arp_misses,
+        string.format("学习 %.1f ns 发送 %.1f ns", result.arp_learn_ns, result.arp_output_ns))
+    log.info("lan", profile, "fdb", result.fdb_size, "广播", result.fdb_floods,
+        string.format("学习 %.1f ns 转发 %.1f ns", result.fdb_learn_ns, result.fdb_forward_ns))
+    return result
+end
+
+sys.taskInit(function()
+    sys.wait(100)
+    run("mcu", 1000)
+    local result = run("host", 1000)
+    if result and (result.arp_entries ~= 1000 or result.fdb_floods ~= 0) then
+        log.error("lan", "1000台主机没有全部学到")
+    end
+    -- 转发表比主机数少, 查不到的帧只能广播
+    run("host", 1000, 500)
+    run("host", 4000)
+end)
+
+sys.run()
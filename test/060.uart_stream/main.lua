@@ -0,0 +1,53 @@
+
+_G.sys = require("sys")
+
+-- 字节流虚拟串口, 串口1监听, 串口2连接过去, 两个串口首尾相连
+-- luatos-pc test/060.uart_stream/main.lua --uart=1,tcp-listen://127.0.0.1:7101 --uart=2,tcp://127.0.0.1:7101
+-- 也可以只配置串口1, 用 nc 127.0.0.1 7101 当作对端
+local total = 4 * 1024 * 1024
+local block = string.rep("0123456789abcdef", 4096)
+
+sys.taskInit(function()
+    uart.setup(1, 115200, 8, 1, uart.NONE, uart.LSB, 64 * 1024)
+    uart.setup(2, 115200, 8, 1, uart.NONE, uart.LSB, 64 * 1024)
+
+    local received = 0
+    local start = mcu.ticks()
+    uart.on(1, "receive", function(id, len)
+        while true do
+            local s = uart.read(id, 64 * 1024)
+            if #s == 0 then
+                break
+            end
+            received = received + #s
+        end
+        if received >= total then
+            sys.publish("UART_STREAM_DONE")
+        end
+    end)
+
+    local sent = 0
+    local function fill()
+        while sent < total do
+            local n = uart.write(2, block)
+            if n == 0 then
+                -- 发送队列满了, 等sent事件
+                return
+            end
+            sent = sent + #block
+        end
+    end
+    uart.on(2, "sent", fill)
+    fill()
+
+    if sys.waitUntil("UART_STREAM_DONE", 30000) then
+        local ms = mcu.ticks() - start
+        log.info("uart", "收到", received, "字节", ms, "ms", string.format("%.1f KB/s", received / ms))
+    else
+        log.error("uart", "超时, 只收到", received, "字节")
+    end
+    uart.close(1)
+    uart.close(2)
+end)
+
+sys.run()
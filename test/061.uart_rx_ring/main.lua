@@ -0,0 +1,56 @@
+
+_G.sys = require("sys")
+
+-- 串口接收缓冲区是固定大小的环形缓冲区, 大小就是uart.setup的bufsz, 读取时原地取走数据
+-- 串口2模拟GNSS模块持续输出NMEA语句, 串口1每次只读一小段再拼成整行, 检查内容没有错乱
+pcuart.config(1, "tcp-listen://127.0.0.1:7111")
+pcuart.config(2, "tcp://127.0.0.1:7111")
+
+local lines = 20000
+local nmea = "$GNRMC,%06d.000,A,2307.1234,N,11321.5678,E,0.00,0.00,010124,,,A*00\r\n"
+
+sys.taskInit(function()
+    uart.setup(1, 115200, 8, 1, uart.NONE, uart.LSB, 1000)
+    uart.setup(2, 115200)
+
+    local buff = ""
+    local count, bad = 0, 0
+    uart.on(1, "receive", function(id, len)
+        while true do
+            local s = uart.read(id, 37)
+            if #s == 0 then
+                break
+            end
+            buff = buff .. s
+            while true do
+                local pos = buff:find("\r\n", 1, true)
+                if not pos then
+                    break
+                end
+                local line = buff:sub(1, pos + 1)
+                buff = buff:sub(pos + 2)
+                if line ~= string.format(nmea, count) then
+                    bad = bad + 1
+                end
+                count = count + 1
+            end
+        end
+        if count >= lines then
+            sys.publish("NMEA_DONE")
+        end
+    end)
+
+    local tmp = {}
+    for i = 0, lines - 1 do
+        table.insert(tmp, string.format(nmea, i))
+    end
+    uart.write(2, table.concat(tmp))
+
+    sys.waitUntil("NMEA_DONE", 10000)
+    log.info("uart", "收到", count, "行", "错误", bad)
+    log.info("uart", "接收统计", json.encode(pcuart.stat(1)))
+    uart.close(1)
+    uart.close(2)
+end)
+
+sys.run()
@@ -0,0 +1,53 @@
+
+_G.sys = require("sys")
+
+-- 伪终端串口, 仅linux/macos
+-- 串口1创建伪终端并在/tmp/luatos_ttyV1建立符号链接, 串口2当作外部设备打开它, 模拟AT指令的一问一答
+-- 也可以只保留串口1, 用 minicom -D /tmp/luatos_ttyV1 或者 picocom 之类的工具当作对端
+pcuart.config(1, "pty:///tmp/luatos_ttyV1")
+pcuart.config(2, "tty:///tmp/luatos_ttyV1")
+
+sys.taskInit(function()
+    uart.setup(1, 115200)
+    log.info("uart", "伪终端", pcuart.ttyName(1))
+    uart.setup(2, 115200)
+
+    -- 串口2扮演模块, 收到AT指令就回OK
+    local cmd = ""
+    uart.on(2, "receive", function(id, len)
+        cmd = cmd .. uart.read(id, 1024)
+        while true do
+            local pos = cmd:find("\r", 1, true)
+            if not pos then
+                break
+            end
+            cmd = cmd:sub(pos + 1)
+            uart.write(id, "\r\nOK\r\n")
+        end
+    end)
+
+    local resp = ""
+    uart.on(1, "receive", function(id, len)
+        resp = resp .. uart.read(id, 1024)
+        if resp:find("OK\r\n", 1, true) then
+            resp = ""
+            sys.publish("AT_OK")
+        end
+    end)
+
+    local count = 1000
+    local start = mcu.ticks()
+    for i = 1, count do
+        uart.write(1, "AT\r")
+        if not sys.waitUntil("AT_OK", 1000) then
+            log.error("uart", "第", i, "条指令没有应答")
+            break
+        end
+    end
+    local ms = mcu.ticks() - start
+    log.info("uart", count, "条AT指令", ms, "ms", string.format("%.3f ms/条", ms / count))
+    uart.close(2)
+    uart.close(1)
+end)
+
+sys.run()
@@ -0,0 +1,48 @@
+
+_G.sys = require("sys")
+
+-- 接收事件合并, 串口2模拟GPS每秒发一组NMEA语句, 串口1分别在不合并和合并两种设置下接收, 比较receive回调的次数
+-- luatos-pc test/063.uart_rx_coalesce/main.lua --uart=1,tcp-listen://127.0.0.1:7103 --uart=2,tcp://127.0.0.1:7103
+local nmea = {
+    "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\r\n",
+    "$GPGSA,A,3,04,05,,09,12,,,24,,,,,2.5,1.3,2.1*39\r\n",
+    "$GPGSV,2,1,08,01,40,083,46,02,17,308,41,12,07,344,39,14,22,228,45*75\r\n",
+    "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A\r\n",
+    "$GPVTG,054.7,T,034.4,M,005.5,N,010.2,K*48\r\n",
+}
+
+local function run(name, bytes, idle_ms)
+    pcuart.rxCoalesce(1, bytes, idle_ms)
+    uart.setup(1, 9600)
+    uart.setup(2, 9600)
+    local calls, received = 0, 0
+    uart.on(1, "receive", function(id, len)
+        calls = calls + 1
+        received = received + #uart.read(id, 4096)
+    end)
+    sys.wait(500)
+    local expect = 0
+    for i = 1, 5 do
+        -- 每条语句单独写, 间隔很短, 与真实的GPS模块一样一组语句连续到达
+        for _, line in ipairs(nmea) do
+            uart.write(2, line)
+            expect = expect + #line
+            sys.wait(2)
+        end
+        sys.wait(200)
+    end
+    sys.wait(200)
+    local stat = pcuart.stat(1)
+    log.info("uart", name, "收到", received, "/", expect, "字节, 回调", calls, "次, 事件", stat and stat.events)
+    uart.close(1)
+    uart.close(2)
+    sys.wait(200)
+end
+
+sys.taskInit(function()
+    run("不合并", 0, 0)
+    -- 一组语句之间的间隔远小于20ms, 组与组之间隔200ms, 每组只回调一次
+    run("合并", 1024, 20)
+end)
+
+sys.run()
@@ -0,0 +1,51 @@
+
+_G.sys = require("sys")
+
+-- 按波特率限速, 串口2发给串口1, 分别测不限速和9600/115200限速时的实际速度
+-- luatos-pc test/064.uart_pace/main.lua --uart=1,tcp-listen://127.0.0.1:7104 --uart=2,tcp://127.0.0.1:7104
+local block = string.rep("U", 1024)
+
+local function run(baud, pace, parity, stop, seconds)
+    pcuart.pace(1, pace)
+    pcuart.pace(2, pace)
+    uart.setup(1, baud, 8, stop, parity, uart.LSB, 16 * 1024)
+    uart.setup(2, baud, 8, stop, parity, uart.LSB, 16 * 1024)
+    sys.wait(300)
+    local received = 0
+    uart.on(1, "receive", function(id, len)
+        while true do
+            local s = uart.read(id, 16 * 1024)
+            if #s == 0 then
+                break
+            end
+            received = received + #s
+        end
+    end)
+    local running = true
+    local function fill()
+        while running and uart.write(2, block) > 0 do
+        end
+    end
+    uart.on(2, "sent", fill)
+    local start = mcu.ticks()
+    fill()
+    sys.wait(seconds * 1000)
+    running = false
+    local ms = mcu.ticks() - start
+    local stat = pcuart.stat(2)
+    log.info("uart", baud, pace and "限速" or "不限速", "线路上限", stat.byte_rate, "字节/秒",
+        "实际", math.floor(received * 1000 / ms), "字节/秒", "发送", stat.tx_rate, "排队", stat.tx_queued)
+    uart.close(1)
+    uart.close(2)
+    sys.wait(300)
+end
+
+sys.taskInit(function()
+    run(115200, false, uart.NONE, 1, 2)
+    -- 8N1每个字符10位, 960字节/秒
+    run(9600, true, uart.NONE, 1, 3)
+    -- 8E2每个字符12位, 9600字节/秒
+    run(115200, true, uart.EVEN, 2, 3)
+end)
+
+sys.run()
@@ -0,0 +1,64 @@
+
+_G.sys = require("sys")
+
+-- 串口数据的录制与回放
+-- 1. 录制: 串口2模拟GNSS模块发NMEA, 串口1接收, 两个串口的数据都录进/tmp/gnss.cap
+-- 2. 回放: 串口1换成回放驱动, 分别按原来的时间和最快速度把录到的数据交给libgnss解析
+--    最快速度时回放的耗时就是解析的耗时
+-- luatos-pc test/065.uart_replay/main.lua --uart=1,tcp-listen://127.0.0.1:7105 --uart=2,tcp://127.0.0.1:7105
+-- 不改脚本也可以用--uart_capture=/tmp/gnss.cap,1录制, --uart=1,replay:///tmp/gnss.cap?speed=max回放
+local CAP = "/tmp/gnss.cap"
+local nmea = {
+    "$GNGGA,123519.000,3113.8150,N,12121.4620,E,1,08,0.9,45.4,M,9.1,M,,*4F\r\n",
+    "$GNRMC,123519.000,A,3113.8150,N,12121.4620,E,0.00,84.40,230394,,,A*72\r\n",
+    "$GPGSV,2,1,08,01,40,083,46,02,17,308,41,12,07,344,39,14,22,228,45*75\r\n",
+    "$GNVTG,84.40,T,,M,0.00,N,0.00,K,A*2C\r\n",
+}
+
+local function record()
+    uart.setup(1, 9600)
+    uart.setup(2, 9600)
+    pcuart.capture(CAP, 1, 2)
+    local received = 0
+    uart.on(1, "receive", function(id, len)
+        received = received + #uart.read(id, 4096)
+    end)
+    sys.wait(500)
+    for i = 1, 20 do
+        for _, line in ipairs(nmea) do
+            uart.write(2, line)
+            sys.wait(5)
+        end
+        sys.wait(100)
+    end
+    sys.wait(200)
+    log.info("uart", "录制完成", received, "字节, 文件", pcuart.capture(), "字节")
+    uart.close(1)
+    uart.close(2)
+end
+
+local function replay(speed)
+    pcuart.config(1, "replay://" .. CAP .. "?speed=" .. speed)
+    libgnss.clear()
+    uart.setup(1, 9600, 8, 1, uart.NONE, uart.LSB, 4096)
+    -- libgnss直接从串口读, 读得越快回放越快
+    libgnss.bind(1)
+    while true do
+        sys.wait(50)
+        local stat = pcuart.replayStat(1)
+        if stat.done and pcuart.stat(1).used == 0 then
+            log.info("uart", "回放完成 speed", speed, stat.records, "条", stat.bytes, "字节", stat.elapsed_ms, "ms",
+                "定位", libgnss.isFix())
+            break
+        end
+    end
+    uart.close(1)
+end
+
+sys.taskInit(function()
+    record()
+    replay("1")
+    replay("max")
+end)
+
+sys.run()
@@ -0,0 +1,55 @@
+
+_G.sys = require("sys")
+
+-- 声明式mock表, 常量/序列/范围/波形直接在C里应答, 不进mock脚本
+-- 通道1在3300~4200之间来回扫, 通道2按wave.csv的正弦波逐点返回, 通道3轮流返回3组值, 通道4只取wave.csv的电压列
+-- 通道5是常量, 通道6轮流返回单个数字
+-- luatos-pc test/066.mock_table/main.lua --mjson=test/066.mock_table/mock.json
+-- 表里没有的key才交给--mlua的脚本, 两者可以同时使用
+
+-- 每个通道前12次adc.read应该读到的{原始值, 电压值}, 只返回一个数时两者相同
+local wave = {{2048, 1650}, {2203, 1775}, {2355, 1898}, {2504, 2018}, {2645, 2131}, {2776, 2237},
+    {2896, 2334}, {3003, 2420}, {3095, 2494}, {3170, 2554}, {3228, 2601}, {3266, 2632}}
+local expect = {{}, wave, {}, {}, {}, {}}
+for i = 1, 12 do
+    -- 3300, 3400 ... 4200之后反射回来, 4100, 4000
+    local v = i <= 10 and 3200 + i * 100 or 4200 - (i - 10) * 100
+    expect[1][i] = {v, v}
+    expect[3][i] = {({10, 20, 30})[(i - 1) % 3 + 1], ({100, 200, 300})[(i - 1) % 3 + 1]}
+    expect[4][i] = {wave[i][2], wave[i][2]}
+    expect[5][i] = {3300, 3300}
+    local v6 = i % 2 == 1 and 1000 or 2000
+    expect[6][i] = {v6, v6}
+end
+
+sys.taskInit(function()
+    log.info("bsp", rtos.bsp())
+    for ch = 1, 6 do
+        adc.open(ch)
+        local vals = {}
+        for i = 1, 12 do
+            local raw, mv = adc.read(ch)
+            table.insert(vals, mv)
+            assert(raw == expect[ch][i][1] and mv == expect[ch][i][2],
+                string.format("adc %d 第%d次 %s,%s 应该是 %d,%d", ch, i, tostring(raw), tostring(mv), expect[ch][i][1], expect[ch][i][2]))
+        end
+        log.info("adc", ch, table.concat(vals, " "))
+    end
+
+    -- 高频采样, 全部走C的查表
+    local count = 0
+    local tnow = mcu.ticks()
+    while mcu.ticks() - tnow < 1000 do
+        for i = 1, 1000 do
+            adc.read(2)
+            wdt.feed()
+        end
+        count = count + 1000
+    end
+    log.info("adc", "1秒采样", count, "次")
+    for ch = 1, 6 do
+        adc.close(ch)
+    end
+end)
+
+sys.run()
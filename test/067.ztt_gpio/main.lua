@@ -0,0 +1,24 @@
+
+_G.sys = require("sys")
+
+-- 外设事件追踪的开销, 用GPIO模拟软件SPI的时钟线来回翻转
+-- 不开启时每次gpio操作只多一次位判断, 开启之后每次操作写一条定长记录进环形缓冲区
+-- luatos-pc test/067.ztt_gpio/main.lua
+-- luatos-pc test/067.ztt_gpio/main.lua --ztt=gpio
+
+local PIN = 10
+local COUNT = 1000000
+
+sys.taskInit(function()
+    local set = gpio.setup(PIN, 0)
+    local tnow = mcu.ticks()
+    for i = 1, COUNT do
+        set(1)
+        set(0)
+    end
+    local used = mcu.ticks() - tnow
+    log.info("gpio", "翻转", COUNT * 2, "次, 耗时", used, "ms")
+    gpio.close(PIN)
+end)
+
+sys.run()
@@ -0,0 +1,37 @@
+
+_G.sys = require("sys")
+
+-- ztt共享内存与外部模拟器的闭环测试
+-- GPIO10输出方波, 参考模拟器ztt_sim把GPIO10的电平回环注入到GPIO11, GPIO11的中断统计收到的边沿数
+-- 同时模拟器把ADC通道3注入为固定的值
+-- cc -O2 -Iinclude test/068.ztt_shm/ztt_sim.c -o ztt_sim
+-- ./ztt_sim -l 10:11 -a 3:2048:1650 /dev/shm/luatos.ztt
+-- luatos-pc test/068.ztt_shm/main.lua --ztt_shm=/dev/shm/luatos.ztt --ztt=gpio,adc
+
+local OUT, IN = 10, 11
+local COUNT = 100000
+local edges = 0
+
+sys.taskInit(function()
+    gpio.setup(IN, function()
+        edges = edges + 1
+    end, gpio.PULLDOWN, gpio.BOTH)
+    local set = gpio.setup(OUT, 0)
+
+    adc.open(3)
+    log.info("adc", "通道3", adc.read(3))
+    adc.close(3)
+
+    local tnow = mcu.ticks()
+    for i = 1, COUNT do
+        set(i % 2)
+        -- 每翻转一批让出一次, 回环注入和中断回调才有机会执行
+        if i % 1000 == 0 then
+            sys.wait(1)
+        end
+    end
+    sys.wait(500)
+    log.info("gpio", "翻转", COUNT, "次, 收到中断", edges, "次, 耗时", mcu.ticks() - tnow, "ms")
+end)
+
+sys.run()
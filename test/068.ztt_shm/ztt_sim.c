@@ -0,0 +1,193 @@
+/*
+ztt共享内存的参考读取程序, 演示外部设备模拟器怎么读设备的记录, 怎么反过来注入GPIO/ADC
+只依赖include/luat_ztt.h, linux/macos编译:
+    cc -O2 -Iinclude test/068.ztt_shm/ztt_sim.c -o ztt_sim
+
+用法:
+    ztt_sim [-v] [-t 秒] [-l 输出脚:输入脚] [-a 通道:val:val2] [-e 脚:次数] [-r 频率] 文件路径
+    -v  打印每条记录
+    -t  运行多少秒, 默认一直运行
+    -l  回环, 设备的输出脚电平变化时注入到输入脚, 可以写多个
+    -a  启动时注入一次ADC的值
+    -e  启动时在输入脚上注入多少个上升沿+下降沿
+    -r  -e的脉冲按每秒多少个注入, 默认一次全部写入. 记录带着边沿的时间, 设备据此统计中断延迟
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "luat_ztt.h"
+
+#define LOAD(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static const char* drv_names[] = {"gpio", "uart", "adc", "pwm"};
+static const char* action_names[] = {"?", "setup", "close", "set", "get"};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 与设备里的写入逻辑相同, 模拟器是rx环唯一的写入方, 这里不需要CAS
+static int push(luat_ztt_ring_t* r, uint8_t drv, uint8_t action, uint16_t id, int32_t a0, int32_t a1) {
+    luat_ztt_slot_t* slots = LUAT_ZTT_SLOTS(r);
+    uint64_t pos = r->head;
+    luat_ztt_slot_t* slot = &slots[pos & (r->capacity - 1)];
+    if (LOAD(&slot->state) != pos)
+        return -1;
+    memset(&slot->rec, 0, sizeof(luat_ztt_rec_t));
+    slot->rec.ts_ns = now_ns();
+    slot->rec.seq = (uint32_t)pos;
+    slot->rec.drv = drv;
+    slot->rec.action = action;
+    slot->rec.id = id;
+    slot->rec.args[0] = a0;
+    slot->rec.args[1] = a1;
+    STORE(&slot->state, pos + 1);
+    STORE(&r->head, pos + 1);
+    return 0;
+}
+
+// 满了就等设备读走, 注入的记录不能丢
+static void push_wait(luat_ztt_ring_t* r, uint8_t drv, uint8_t action, uint16_t id, int32_t a0, int32_t a1) {
+    while (push(r, drv, action, id, a0, a1))
+        usleep(100);
+}
+
+static const luat_ztt_rec_t* peek(luat_ztt_ring_t* r) {
+    luat_ztt_slot_t* slot = &LUAT_ZTT_SLOTS(r)[r->tail & (r->capacity - 1)];
+    if (LOAD(&slot->state) != r->tail + 1)
+        return NULL;
+    return &slot->rec;
+}
+
+static void pop(luat_ztt_ring_t* r) {
+    luat_ztt_slot_t* slot = &LUAT_ZTT_SLOTS(r)[r->tail & (r->capacity - 1)];
+    STORE(&slot->state, r->tail + r->capacity);
+    STORE(&r->tail, r->tail + 1);
+}
+
+int main(int argc, char** argv) {
+    int verbose = 0;
+    double seconds = 0;
+    int loops[16][2];
+    int nloop = 0;
+    int opt;
+    luat_ztt_rec_t adc = {0};
+    int edge_pin = -1, edge_count = 0;
+    double edge_hz = 0;
+    while ((opt = getopt(argc, argv, "vt:l:a:e:r:")) != -1) {
+        switch (opt) {
+        case 'v': verbose = 1; break;
+        case 't': seconds = atof(optarg); break;
+        case 'l':
+            if (nloop < 16 && sscanf(optarg, "%d:%d", &loops[nloop][0], &loops[nloop][1]) == 2)
+                nloop++;
+            break;
+        case 'a':
+            adc.drv = LUAT_ZTT_ADC;
+            sscanf(optarg, "%hu:%d:%d", &adc.id, &adc.args[0], &adc.args[1]);
+            break;
+        case 'e': sscanf(optarg, "%d:%d", &edge_pin, &edge_count); break;
+        case 'r': edge_hz = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-v] [-t sec] [-l out:in] [-a ch:val:val2] [-e pin:count] [-r hz] path\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "缺少共享内存文件路径\n");
+        return 1;
+    }
+
+    // 等模拟器进程创建并初始化好文件
+    luat_ztt_shm_t* shm = NULL;
+    for (;;) {
+        int fd = open(argv[optind], O_RDWR);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(luat_ztt_shm_t)) {
+            void* ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (ptr != MAP_FAILED) {
+                shm = ptr;
+                if (LOAD(&shm->magic) == LUAT_ZTT_MAGIC && shm->size <= (uint64_t)st.st_size)
+                    break;
+                munmap(ptr, st.st_size);
+            }
+        }
+        else if (fd >= 0) {
+            close(fd);
+        }
+        usleep(10000);
+    }
+    if (shm->version != LUAT_ZTT_VERSION || shm->slot_size != sizeof(luat_ztt_slot_t)) {
+        fprintf(stderr, "版本不匹配 %u %u\n", shm->version, shm->slot_size);
+        return 1;
+    }
+    luat_ztt_ring_t* tx = (luat_ztt_ring_t*)((char*)shm + shm->tx_offset);
+    luat_ztt_ring_t* rx = (luat_ztt_ring_t*)((char*)shm + shm->rx_offset);
+    // 从当前位置开始读, 之前的记录属于上一次连接
+    printf("已连接, 容量 %u条\n", tx->capacity);
+
+    if (adc.drv == LUAT_ZTT_ADC)
+        push_wait(rx, LUAT_ZTT_ADC, LUAT_ZTT_SET, adc.id, adc.args[0], adc.args[1]);
+    uint64_t edge_start = now_ns();
+    for (int i = 0; i < edge_count * 2; i++) {
+        // 按频率等到这个边沿的时间, 忙等才能做到微秒级的间隔
+        if (edge_hz > 0) {
+            uint64_t due = edge_start + (uint64_t)(i * 5e8 / edge_hz);
+            while (now_ns() < due)
+                ;
+        }
+        push_wait(rx, LUAT_ZTT_GPIO, LUAT_ZTT_SET, edge_pin, (i & 1) == 0, 0);
+    }
+
+    uint64_t start = now_ns(), report = start;
+    uint64_t total = 0, window = 0, gaps = 0;
+    uint32_t next_seq = 0;
+    int first = 1;
+    for (;;) {
+        const luat_ztt_rec_t* rec = peek(tx);
+        if (rec == NULL) {
+            uint64_t now = now_ns();
+            if (seconds > 0 && now - start >= (uint64_t)(seconds * 1e9))
+                break;
+            if (now - report >= 1000000000ull) {
+                printf("%.0f 条/秒, 共 %llu 条, 设备丢弃 %llu 条\n", window * 1e9 / (now - report),
+                       (unsigned long long)total, (unsigned long long)LOAD(&tx->dropped));
+                report = now;
+                window = 0;
+            }
+            usleep(50);
+            continue;
+        }
+        if (!first && rec->seq != next_seq)
+            gaps++;
+        first = 0;
+        next_seq = rec->seq + 1;
+        if (verbose) {
+            printf("%llu %s.%s id=%u %d %d %d %d\n", (unsigned long long)rec->ts_ns,
+                   rec->drv < 4 ? drv_names[rec->drv] : "?", rec->action < 5 ? action_names[rec->action] : "?",
+                   rec->id, rec->args[0], rec->args[1], rec->args[2], rec->args[3]);
+        }
+        if (rec->drv == LUAT_ZTT_GPIO && rec->action == LUAT_ZTT_SET) {
+            for (int i = 0; i < nloop; i++) {
+                if (loops[i][0] == rec->id)
+                    push_wait(rx, LUAT_ZTT_GPIO, LUAT_ZTT_SET, loops[i][1], rec->args[0], 0);
+            }
+        }
+        pop(tx);
+        total++;
+        window++;
+    }
+    printf("共 %llu 条, 序号不连续 %llu 次, 设备丢弃 %llu 条\n", (unsigned long long)total,
+           (unsigned long long)gaps, (unsigned long long)LOAD(&tx->dropped));
+    return 0;
+}
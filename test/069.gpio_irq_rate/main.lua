@@ -0,0 +1,52 @@
+
+_G.sys = require("sys")
+
+-- GPIO中断的延迟与能承受的最高频率, 用于估计脉冲计数之类的应用在模组上能跑多快
+-- 按不同的频率在输入脚上注入1秒的脉冲, 统计边沿到lua回调的延迟, 回调跟不上时排队的中断越来越多
+-- luatos-pc test/069.gpio_irq_rate/main.lua
+
+local PIN = 11
+-- 排队中断数的上限, 0为不限制. 设成模组消息队列的深度时, 跟不上的中断按丢失统计
+local DEPTH = 0
+local RATES = {1000, 5000, 10000, 20000, 50000, 100000, 200000, 500000}
+
+local count = 0
+
+sys.taskInit(function()
+    gpio.setup(PIN, function()
+        count = count + 1
+    end, gpio.PULLDOWN, gpio.RISING)
+    pcgpio.irqDepth(DEPTH)
+
+    local best = 0
+    for _, hz in ipairs(RATES) do
+        count = 0
+        pcgpio.irqStat(true)
+        local tnow = mcu.ticks()
+        pcgpio.pulse(PIN, hz, hz)
+        while pcgpio.pulseLeft(PIN) > 0 do
+            sys.wait(10)
+        end
+        -- 等排队的中断处理完, 最多再等5秒
+        local stat = pcgpio.irqStat()
+        while stat.pending > 0 and mcu.ticks() - tnow < 6000 do
+            sys.wait(10)
+            stat = pcgpio.irqStat()
+        end
+        local used = mcu.ticks() - tnow
+        local lat = stat.latency_ns
+        -- 所有中断都执行了回调, 并且p99延迟在一个脉冲周期的10倍以内, 算作跟得上
+        local ok = stat.lost == 0 and count == hz and lat.p99 < 10 * 1000000000 // hz
+        log.info("irq", string.format("%7d Hz 中断%d 回调%d 丢失%d 排队最多%d 耗时%dms 延迟avg/p99/max %d/%d/%dus 回调avg %dns %s",
+            hz, stat.fired, count, stat.lost, stat.pending_max, used,
+            lat.avg // 1000, lat.p99 // 1000, lat.max // 1000, stat.cb_ns.avg, ok and "OK" or "跟不上"))
+        if ok then
+            best = hz
+        end
+        sys.wait(100)
+    end
+    log.info("irq", "能持续处理的中断频率", best, "Hz")
+    gpio.close(PIN)
+end)
+
+sys.run()
@@ -0,0 +1,21 @@
+
+_G.sys = require("sys")
+
+-- lwip校验和各实现的正确性, 与lwip_standard_chksum逐项对比, 有不一致时以非0退出
+-- 需要LUAT_USE_LWIP
+-- luatos-pc test/070.chksum_verify/main.lua
+
+sys.taskInit(function()
+    local bad, result = pcnet.chksumVerify()
+    for impl, count in pairs(result) do
+        log.info("chksum", impl, count == 0 and "OK" or ("不一致 " .. count .. " 次"))
+    end
+    if bad ~= 0 then
+        log.error("chksum", "校验和实现有误, 共", bad, "次不一致")
+        os.exit(1)
+    end
+    log.info("chksum", "全部实现一致")
+    os.exit(0)
+end)
+
+sys.run()
@@ -44,6 +44,10 @@ if is_host("windows") then
     -- add_ldflags("-static")
 elseif is_host("linux") then
     add_defines("LUA_USE_LINUX")
+    -- lwip协议栈默认不编译, 需要虚拟网卡/PPP/iperf的lwip模式时打开
+    if os.getenv("LUAT_USE_LWIP") == "y" then
+        add_defines("LUAT_USE_LWIP_LINUX=1")
+    end
     add_cflags("-ffunction-sections -fdata-sections")
     add_ldflags("-Wl,--gc-sections")
 elseif is_host("macos") then
@@ -240,7 +244,7 @@ target("luatos-lua")
     add_includedirs(luatos.."components/fatfs")
     add_files(luatos.."components/fatfs/**.c")
 
-    if is_host("windows") then
+    if is_host("windows") or (is_host("linux") and os.getenv("LUAT_USE_LWIP") == "y") then
         -- lwip & zlink
         add_includedirs("lwip/include")
         add_files("lwip/api/**.c")